@@ -1,45 +1,142 @@
-#include <stdlib.h>
-
-#include "chunk.h"
-#include "memory.h"
-#include "vm.h"
-
-void initChunk(Chunk *chunk)
-{
-    chunk->count = 0;
-    chunk->capacity = 0;
-    chunk->code = NULL;
-    chunk->lines = NULL;
-    initValueArray(&chunk->constants);
-}
-
-void freeChunk(Chunk *chunk)
-{
-    FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
-    FREE_ARRAY(int, chunk->lines, chunk->capacity);
-    freeValueArray(&chunk->constants);
-    initChunk(chunk);
-}
-
-void writeChunk(Chunk *chunk, uint8_t byte, int line)
-{
-    if (chunk->capacity < chunk->count + 1)
-    {
-        int oldCapacity = chunk->capacity;
-        chunk->capacity = GROW_CAPACITY(oldCapacity);
-        chunk->code = GROW_ARRAY(uint8_t, chunk->code, oldCapacity, chunk->capacity);
-        chunk->lines = GROW_ARRAY(int, chunk->lines, oldCapacity, chunk->capacity);
-    }
-
-    chunk->code[chunk->count] = byte;
-    chunk->lines[chunk->count] = line;
-    chunk->count++;
-}
-
-int addConstant(Chunk *chunk, Value value)
-{
-    push(value);
-    writeValueArray(&chunk->constants, value);
-    pop();
-    return chunk->constants.count - 1;
-}
\ No newline at end of file
+#include <stdlib.h>
+
+#include "chunk.h"
+#include "memory.h"
+#include "vm.h"
+
+void initChunk(Chunk *chunk)
+{
+    chunk->count = 0;
+    chunk->capacity = 0;
+    chunk->code = NULL;
+    chunk->lines = NULL;
+    initValueArray(&chunk->constants);
+    chunk->cacheCount = 0;
+    chunk->cacheCapacity = 0;
+    chunk->caches = NULL;
+}
+
+void freeChunk(Chunk *chunk)
+{
+    FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+    FREE_ARRAY(int, chunk->lines, chunk->capacity);
+    freeValueArray(&chunk->constants);
+    FREE_ARRAY(InlineCache, chunk->caches, chunk->cacheCapacity);
+    initChunk(chunk);
+}
+
+void writeChunk(Chunk *chunk, uint8_t byte, int line)
+{
+    if (chunk->capacity < chunk->count + 1)
+    {
+        int oldCapacity = chunk->capacity;
+        chunk->capacity = GROW_CAPACITY(oldCapacity);
+        chunk->code = GROW_ARRAY(uint8_t, chunk->code, oldCapacity, chunk->capacity);
+        chunk->lines = GROW_ARRAY(int, chunk->lines, oldCapacity, chunk->capacity);
+    }
+
+    chunk->code[chunk->count] = byte;
+    chunk->lines[chunk->count] = line;
+    chunk->count++;
+}
+
+int addConstant(Chunk *chunk, Value value)
+{
+    push(value);
+    writeValueArray(&chunk->constants, value);
+    pop();
+    return chunk->constants.count - 1;
+}
+
+int addInlineCache(Chunk* chunk)
+{
+    if (chunk->cacheCapacity < chunk->cacheCount + 1)
+    {
+        int oldCapacity = chunk->cacheCapacity;
+        chunk->cacheCapacity = GROW_CAPACITY(oldCapacity);
+        STORE_SHARED(chunk->caches, GROW_ARRAY(InlineCache, chunk->caches, oldCapacity, chunk->cacheCapacity));
+    }
+
+    InlineCache* cache = &chunk->caches[chunk->cacheCount];
+    cache->count = 0;
+    cache->isMegamorphic = false;
+    STORE_RELEASE(chunk->cacheCount, chunk->cacheCount + 1);
+    return chunk->cacheCount - 1;
+}
+
+int instructionLength(Chunk* chunk, int offset)
+{
+    switch (baseOpcode(chunk->code[offset]))
+    {
+    case OP_CONSTANT:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+    case OP_GET_SUPER:
+    case OP_CALL:
+    case OP_TAIL_CALL:
+    case OP_CLASS:
+    case OP_METHOD:
+        return 2;
+    case OP_DEFINE_GLOBAL:
+    case OP_DEFINE_CONSTANT:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_LOOP:
+    case OP_JUMP_IF_NOT_LESS:
+    case OP_JUMP_IF_NOT_LESS_EQUAL:
+    case OP_JUMP_IF_NOT_GREATER:
+    case OP_JUMP_IF_NOT_GREATER_EQUAL:
+    case OP_INC_LOCAL:
+    case OP_SUPER_INVOKE:
+    case OP_TAIL_SUPER_INVOKE:
+    case OP_MOVE:
+        return 3;
+    case OP_GET_PROPERTY:
+    case OP_SET_PROPERTY:
+    case OP_ADD_RR:
+    case OP_SUBTRACT_RR:
+    case OP_MULTIPLY_RR:
+    case OP_DIVIDE_RR:
+    case OP_ADD_RK:
+    case OP_SUBTRACT_RK:
+    case OP_MULTIPLY_RK:
+    case OP_DIVIDE_RK:
+        return 4;
+    case OP_INVOKE:
+    case OP_TAIL_INVOKE:
+    case OP_JUMP_IF_NOT_LESS_RR:
+    case OP_JUMP_IF_NOT_LESS_EQUAL_RR:
+    case OP_JUMP_IF_NOT_GREATER_RR:
+    case OP_JUMP_IF_NOT_GREATER_EQUAL_RR:
+    case OP_JUMP_IF_NOT_LESS_RK:
+    case OP_JUMP_IF_NOT_LESS_EQUAL_RK:
+    case OP_JUMP_IF_NOT_GREATER_RK:
+    case OP_JUMP_IF_NOT_GREATER_EQUAL_RK:
+        return 5;
+    case OP_CLOSURE:
+    {
+        ObjFunction* function = AS_FUNCTION(chunk->constants.values[chunk->code[offset + 1]]);
+        return 2 + function->upvalueCount * 2;
+    }
+    default:
+        return 1;
+    }
+}
+
+//The instruction a superinstruction starts with, which has the same
+//operands, or the instruction itself.
+uint8_t baseOpcode(uint8_t instruction)
+{
+    switch (instruction)
+    {
+#define SUPERINSTRUCTION(name, first, next) case name: return first;
+#include "superinstructions.h"
+#undef SUPERINSTRUCTION
+    default:
+        return instruction;
+    }
+}
@@ -1,69 +1,152 @@
-#ifndef cspydr_chunk_h
-#define cspydr_chunk_h
-
-#include "common.h"
-#include "value.h"
-
-typedef enum
-{
-	OP_NEGATE,
-	OP_PRINT,
-	OP_JUMP_IF_FALSE,
-	OP_JUMP,
-	OP_LOOP,
-	OP_CALL,
-	OP_CLASS,
-	OP_METHOD,
-	OP_INVOKE,
-	OP_INHERIT,
-	OP_CLOSURE,
-	OP_ADD,
-	OP_SUBTRACT,
-	OP_MULTIPLY,
-	OP_DIVIDE,
-	OP_POWER,
-	OP_MODULO,
-	OP_SHIFT_LEFT,
-	OP_SHIFT_RIGHT,
-	OP_RETURN,
-	OP_NIL,
-	OP_TRUE,
-	OP_FALSE,
-	OP_POP,
-	OP_DEFINE_GLOBAL,
-	OP_DEFINE_CONSTANT,
-	OP_GET_GLOBAL,
-	OP_SET_GLOBAL,
-	OP_GET_ARRAY_INDEX,
-	OP_GET_UPVALUE,
-	OP_SET_UPVALUE,
-	OP_GET_PROPERTY,
-	OP_SET_PROPERTY,
-	OP_CLOSE_UPVALUE,
-	OP_GET_LOCAL,
-	OP_SET_LOCAL,
-	OP_GET_SUPER,
-	OP_SUPER_INVOKE,
-	OP_EQUAL,
-	OP_GREATER,
-	OP_LESS,
-	OP_NOT,
-	OP_CONSTANT,
-	OP_EXIT,
-} OpCode;
-
-typedef struct
-{
-	int count;
-	int capacity;
-	uint8_t *code;
-	int *lines;
-	ValueArray constants;
-} Chunk;
-
-void initChunk(Chunk *chunk);
-void freeChunk(Chunk *chunk);
-void writeChunk(Chunk *chunk, uint8_t byte, int line);
-int addConstant(Chunk *chunk, Value value);
-
+#ifndef cspydr_chunk_h
+#define cspydr_chunk_h
+
+#include "common.h"
+#include "value.h"
+
+typedef enum
+{
+	OP_NEGATE,
+	OP_PRINT,
+	OP_JUMP_IF_FALSE,
+	OP_JUMP,
+	OP_LOOP,
+	OP_CALL,
+	OP_TAIL_CALL,
+	OP_CLASS,
+	OP_METHOD,
+	OP_INVOKE,
+	OP_TAIL_INVOKE,
+	OP_INHERIT,
+	OP_CLOSURE,
+	OP_ADD,
+	OP_SUBTRACT,
+	OP_MULTIPLY,
+	OP_DIVIDE,
+	OP_POWER,
+	OP_MODULO,
+	OP_SHIFT_LEFT,
+	OP_SHIFT_RIGHT,
+	OP_RETURN,
+	OP_NIL,
+	OP_TRUE,
+	OP_FALSE,
+	OP_POP,
+	OP_DEFINE_GLOBAL,
+	OP_DEFINE_CONSTANT,
+	OP_GET_GLOBAL,
+	OP_SET_GLOBAL,
+	OP_GET_ARRAY_INDEX,
+	OP_GET_UPVALUE,
+	OP_SET_UPVALUE,
+	OP_GET_PROPERTY,
+	OP_SET_PROPERTY,
+	OP_CLOSE_UPVALUE,
+	OP_GET_LOCAL,
+	OP_SET_LOCAL,
+	OP_GET_SUPER,
+	OP_SUPER_INVOKE,
+	OP_TAIL_SUPER_INVOKE,
+	OP_EQUAL,
+	OP_GREATER,
+	OP_LESS,
+	OP_GREATER_EQUAL,
+	OP_LESS_EQUAL,
+	OP_NOT,
+	OP_CONSTANT,
+	OP_EXIT,
+
+	//Fused forms the optimiser writes for the idioms loops are made of. The
+	//compare and branches pop both operands and jump unless the comparison
+	//holds, OP_INC_LOCAL adds a number constant to a local in place.
+	OP_JUMP_IF_NOT_LESS,
+	OP_JUMP_IF_NOT_LESS_EQUAL,
+	OP_JUMP_IF_NOT_GREATER,
+	OP_JUMP_IF_NOT_GREATER_EQUAL,
+	OP_INC_LOCAL,
+
+	//Three-address forms the optimiser writes for locals when compiling for
+	//registers, see vm.registerCode. The _RR ones take two slots, the _RK
+	//ones a slot and a constant. The arithmetic stores into a third slot,
+	//the compare and branches work like the fused ones above.
+	OP_MOVE,
+	OP_ADD_RR,
+	OP_SUBTRACT_RR,
+	OP_MULTIPLY_RR,
+	OP_DIVIDE_RR,
+	OP_ADD_RK,
+	OP_SUBTRACT_RK,
+	OP_MULTIPLY_RK,
+	OP_DIVIDE_RK,
+	OP_JUMP_IF_NOT_LESS_RR,
+	OP_JUMP_IF_NOT_LESS_EQUAL_RR,
+	OP_JUMP_IF_NOT_GREATER_RR,
+	OP_JUMP_IF_NOT_GREATER_EQUAL_RR,
+	OP_JUMP_IF_NOT_LESS_RK,
+	OP_JUMP_IF_NOT_LESS_EQUAL_RK,
+	OP_JUMP_IF_NOT_GREATER_RK,
+	OP_JUMP_IF_NOT_GREATER_EQUAL_RK,
+
+	//Quickened forms, only ever written into a chunk by the interpreter
+	//once it has seen the operand types of the generic instruction.
+	OP_ADD_NUM,
+	OP_ADD_STR,
+	OP_SUBTRACT_NUM,
+	OP_MULTIPLY_NUM,
+	OP_DIVIDE_NUM,
+	OP_GREATER_NUM,
+	OP_LESS_NUM,
+
+	//Superinstructions the compiler writes over the first instruction of a
+	//sequence that programs run a lot, which keeps its operands. The rest of
+	//the sequence stays as it was, the interpreter just doesn't dispatch to
+	//it, except to the instructions it quickens, whose byte says which form
+	//they are in. Generated from opcode profiles, see opprofile.h.
+#define SUPERINSTRUCTION(name, first, next) name,
+#include "superinstructions.h"
+#undef SUPERINSTRUCTION
+} OpCode;
+
+#define INLINE_CACHE_ENTRIES 4
+
+//A single receiver shape seen at a property or invoke site. 'slot' is the
+//field index for that shape (or -1 for a method) and 'target' the resolved
+//method closure, or the shape a property store transitions to.
+typedef struct
+{
+	Obj* receiver;
+	int slot;
+	Obj* target;
+} CacheEntry;
+
+//Starts out empty, becomes monomorphic on the first hit, polymorphic once
+//more receivers show up and megamorphic when it runs out of entries.
+typedef struct
+{
+	int count;
+	bool isMegamorphic;
+	CacheEntry entries[INLINE_CACHE_ENTRIES];
+} InlineCache;
+
+typedef struct
+{
+	int count;
+	int capacity;
+	uint8_t *code;
+	int *lines;
+	ValueArray constants;
+
+	int cacheCount;
+	int cacheCapacity;
+	InlineCache* caches;
+} Chunk;
+
+void initChunk(Chunk *chunk);
+void freeChunk(Chunk *chunk);
+void writeChunk(Chunk *chunk, uint8_t byte, int line);
+int addConstant(Chunk *chunk, Value value);
+int addInlineCache(Chunk* chunk);
+int instructionLength(Chunk* chunk, int offset);
+uint8_t baseOpcode(uint8_t instruction);
+
 #endif
\ No newline at end of file
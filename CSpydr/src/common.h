@@ -1,46 +1,115 @@
-#ifndef cspydr_common_h
-#define cspydr_common_h
-
-#include <stdbool.h>
-#include <stddef.h>
-#include <stdint.h>
-
-#define UINT8_COUNT (UINT8_MAX + 1)
-//#define NAN_BOXING
-
-#ifdef NDEBUG
-#define CSPYDR_VERSION "v1.0 (alpha) release"
-#else
-#define DEBUG_COLOR_OUTPUT
-#define CSPYDR_VERSION "v1.0 (alpha) debug"
-#define DEBUG_TRACE_EXECUTION
-#define DEBUG_PRINT_CODE
-//#define DEBUG_STRESS_GC
-#define DEBUG_LOG_GC
-#endif
-
-#ifdef DEBUG_COLOR_OUTPUT
-#define ANSI_COLOR_RED     "\x1b[31m"
-#define ANSI_COLOR_GREEN   "\x1b[32m"
-#define ANSI_COLOR_YELLOW  "\x1b[33m"
-#define ANSI_COLOR_BLUE    "\x1b[1;34m"
-#define ANSI_COLOR_MAGENTA "\x1b[35m"
-#define ANSI_COLOR_CYAN    "\x1b[36m"
-#define ANSI_COLOR_RESET   "\x1b[0m"
-#define ANSI_COLOR_GRAY	   "\x1b[1;30m"	
-
-#define PRINT_ERROR(stream) fprintf(stream, ANSI_COLOR_RED);
-#define PRINT_INFO(stream) fprintf(stream, ANSI_COLOR_YELLOW);
-#define PRINT_RESET(stream) fprintf(stream, ANSI_COLOR_RESET);
-#define PRINT_DEBUG(stream) fprintf(stream, ANSI_COLOR_GRAY);
-#define PRINT_SPECIAL(stream) fprintf(stream, ANSI_COLOR_BLUE);
-#define PRINT_OK(stream) fprintf(stream, ANSI_COLOR_GREEN);
-#else
-#define PRINT_ERROR(stream) fprintf(stream, "");
-#define PRINT_RESET(stream) fprintf(stream, "");
-#define PRINT_OK(stream) fprintf(stream, "");
-#endif
-
-//bool scannerIsMuted;
-
+#ifndef cspydr_common_h
+#define cspydr_common_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define UINT8_COUNT (UINT8_MAX + 1)
+
+//Packs every Value into a single 8 byte double, build with -DNAN_BOXING or
+//uncomment to turn it on.
+//#define NAN_BOXING
+
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+#define COMPUTED_GOTO
+#endif
+
+//The baseline JIT emits x86-64 System V code, build with NO_JIT to leave it out.
+#if defined(__x86_64__) && defined(__unix__) && !defined(NO_JIT)
+#define JIT_ENABLED
+#endif
+
+//Marking on a background thread needs pthreads, and values that are a single
+//word so the marker never reads half of one. Build with NO_CONCURRENT_GC to
+//leave it out.
+#if defined(NAN_BOXING) && defined(__unix__) && !defined(NO_CONCURRENT_GC)
+#define CONCURRENT_GC_ENABLED
+#endif
+
+//Full collections can mark and sweep on several threads, build with
+//NO_PARALLEL_GC to leave it out.
+#if defined(__unix__) && !defined(NO_PARALLEL_GC)
+#define PARALLEL_GC_ENABLED
+#endif
+
+//Objects come from pages of same sized slots rather than one malloc each,
+//build with NO_SLAB to leave it out, for instance under a memory checker.
+#ifndef NO_SLAB
+#define SLAB_ENABLED
+#endif
+
+//For the lengths of arrays the background marker reads while the program
+//grows them: the array is published first and its new length last.
+#ifdef __GNUC__
+#define STORE_RELEASE(target, value) __atomic_store_n(&(target), (value), __ATOMIC_RELEASE)
+#define LOAD_ACQUIRE(source) __atomic_load_n(&(source), __ATOMIC_ACQUIRE)
+#else
+#define STORE_RELEASE(target, value) ((target) = (value))
+#define LOAD_ACQUIRE(source) (source)
+#endif
+
+//For the references the background marker reads while the program writes
+//them. One stored with release is loaded with acquire, so the marker finds
+//the object it points at initialised.
+#ifdef CONCURRENT_GC_ENABLED
+#define STORE_SHARED(target, value) STORE_RELEASE(target, value)
+#define LOAD_SHARED(source) LOAD_ACQUIRE(source)
+#else
+#define STORE_SHARED(target, value) ((target) = (value))
+#define LOAD_SHARED(source) (source)
+#endif
+
+//Counts which instructions the interpreter runs one after the other, for
+//--profile-ops. Build with -DPROFILE_OPCODES or uncomment, it slows down
+//every dispatch and leaves superinstructions out.
+//#define PROFILE_OPCODES
+
+//The optimiser lowers arithmetic and branches on locals to instructions that
+//address the frame's slots directly. Build with STACK_VM to only do so with
+//--register-vm.
+#ifndef STACK_VM
+#define REGISTER_CODE_DEFAULT true
+#else
+#define REGISTER_CODE_DEFAULT false
+#endif
+
+#define JIT_DEFAULT_THRESHOLD 1000
+#define TRACE_DEFAULT_THRESHOLD 50
+
+#ifdef NDEBUG
+#define CSPYDR_VERSION "v1.0 (alpha) release"
+#else
+#define DEBUG_COLOR_OUTPUT
+#define CSPYDR_VERSION "v1.0 (alpha) debug"
+#define DEBUG_TRACE_EXECUTION
+#define DEBUG_PRINT_CODE
+//#define DEBUG_STRESS_GC
+#define DEBUG_LOG_GC
+#endif
+
+#ifdef DEBUG_COLOR_OUTPUT
+#define ANSI_COLOR_RED     "\x1b[31m"
+#define ANSI_COLOR_GREEN   "\x1b[32m"
+#define ANSI_COLOR_YELLOW  "\x1b[33m"
+#define ANSI_COLOR_BLUE    "\x1b[1;34m"
+#define ANSI_COLOR_MAGENTA "\x1b[35m"
+#define ANSI_COLOR_CYAN    "\x1b[36m"
+#define ANSI_COLOR_RESET   "\x1b[0m"
+#define ANSI_COLOR_GRAY	   "\x1b[1;30m"	
+
+#define PRINT_ERROR(stream) fprintf(stream, ANSI_COLOR_RED);
+#define PRINT_INFO(stream) fprintf(stream, ANSI_COLOR_YELLOW);
+#define PRINT_RESET(stream) fprintf(stream, ANSI_COLOR_RESET);
+#define PRINT_DEBUG(stream) fprintf(stream, ANSI_COLOR_GRAY);
+#define PRINT_SPECIAL(stream) fprintf(stream, ANSI_COLOR_BLUE);
+#define PRINT_OK(stream) fprintf(stream, ANSI_COLOR_GREEN);
+#else
+#define PRINT_ERROR(stream) fprintf(stream, "");
+#define PRINT_RESET(stream) fprintf(stream, "");
+#define PRINT_OK(stream) fprintf(stream, "");
+#endif
+
+//bool scannerIsMuted;
+
 #endif
\ No newline at end of file
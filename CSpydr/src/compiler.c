@@ -1,1219 +1,1914 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-#include "common.h"
-#include "compiler.h"
-#include "scanner.h"
-#include "memory.h"
-
-#ifdef DEBUG_PRINT_CODE
-#include "debug.h"
-#endif
-
-typedef struct
-{
-	Token current;
-	Token previous;
-	bool hadError;
-	bool panicMode;
-} Parser;
-
-typedef enum
-{
-	PREC_NONE,
-	PREC_ASSIGNMENT, // =
-	PREC_OR,         // or
-	PREC_AND,        // and
-	PREC_EQUALITY,   // == !=
-	PREC_COMPARISON, // < > <= >=
-	PREC_TERM,       // + -
-	PREC_FACTOR,     // * /
-	PREC_POWER,		 // ^
-	PREC_UNARY,      // ! -
-	PREC_CALL,       // . ()
-	PREC_PRIMARY
-} Precedence;
-
-typedef void (*ParseFn)(bool canAssign);
-
-typedef struct
-{
-	ParseFn prefix;
-	ParseFn infix;
-	Precedence precedence;
-} ParseRule;
-
-typedef struct {
-	Token name;
-	int depth;
-	bool isCaptured;
-} Local;
-
-typedef struct {
-	uint8_t index;
-	bool isLocal;
-} Upvalue;
-
-typedef enum
-{
-	TYPE_FUNCTION,
-	TYPE_METHOD,
-	TYPE_INITIALIZER,
-	TYPE_SCRIPT
-} FunctionType;
-
-typedef struct Compiler {
-	struct Compiler* enclosing;
-	ObjFunction* function;
-	FunctionType type;
-
-	Local locals[UINT8_COUNT];
-	int localCount;
-	Upvalue upvalues[UINT8_COUNT];
-	int scopeDepth;
-} Compiler;
-
-typedef struct ClassCompiler
-{
-	struct ClassCompiler* enclosing;
-	bool hasSuperClass;
-	Token name;
-} ClassCompiler;
-
-Parser parser;
-Compiler* current = NULL;
-Chunk* compilingChunk;
-
-ClassCompiler* currentClass = NULL;
-
-static Chunk *currentChunk()
-{
-	return &current->function->chunk;
-}
-
-static void errorAt(Token *token, const char *message)
-{
-	if (parser.panicMode)
-		return;
-	parser.panicMode = true;
-	PRINT_ERROR(stderr);
-	fprintf(stderr, "[line %d] Error", token->line);
-
-	if (token->type == TOKEN_EOF)
-	{
-		fprintf(stderr, " at end.\n");
-		fprintf(stderr, "%s\n", message);
-	}
-	else if (token->type == TOKEN_ERROR)
-	{
-		fprintf(stderr, "%p.\n", message);
-	}
-	else
-	{
-		fprintf(stderr, " at '%.*s'.\n", token->length, token->start);
-		fprintf(stderr, "%s\n", message);
-	}
-	PRINT_RESET(stderr);
-	parser.hadError = true;
-}
-
-static void error(const char *message)
-{
-	errorAt(&parser.previous, message);
-}
-
-static void errorAtCurrent(const char *message)
-{
-	errorAt(&parser.current, message);
-}
-
-static void advance()
-{
-	parser.previous = parser.current;
-
-	for (;;)
-	{
-		parser.current = scanToken();
-		if (parser.current.type != TOKEN_ERROR)
-			break;
-
-		errorAtCurrent(parser.current.start);
-	}
-}
-
-static void consume(TokenType type, const char *message)
-{
-	if (parser.current.type == type)
-	{
-		advance();
-		return;
-	}
-
-	errorAtCurrent(message);
-}
-
-static bool check(TokenType type)
-{
-	return parser.current.type == type;
-}
-
-static bool match(TokenType type)
-{
-	if (!check(type)) return false;
-	advance();
-	return true;
-}
-
-static void emitByte(uint8_t byte)
-{
-	writeChunk(currentChunk(), byte, parser.previous.line);
-}
-
-static void emitBytes(uint8_t byte1, uint8_t byte2)
-{
-	emitByte(byte1);
-	emitByte(byte2);
-}
-
-static void emitLoop(int loopStart)
-{
-	emitByte(OP_LOOP);
-	int offset = currentChunk()->count - loopStart + 2;
-	if (offset > UINT16_MAX) {
-		error("Loop body too large.");
-	}
-
-	emitByte((offset >> 8) & 0xFF);
-	emitByte(offset & 0xFF);
-}
-
-static void emitReturn()
-{
-	if (current->type == TYPE_INITIALIZER) {
-		emitBytes(OP_GET_LOCAL, 0);
-	}
-	else {
-		emitByte(OP_NIL);
-	}
-	emitByte(OP_RETURN);
-}
-
-static void emitBreak()
-{
-
-}
-
-static int emitJump(uint8_t instruction)
-{
-	emitByte(instruction);
-	emitByte(0xFF);
-	emitByte(0xFF);
-	return currentChunk()->count - 2;
-}
-
-static uint8_t makeConstant(Value value)
-{
-	int constant = addConstant(currentChunk(), value);
-	if (constant > UINT8_MAX)
-	{
-		error("Too many constants in one chunk.");
-		return 0;
-	}
-
-	return (uint8_t)constant;
-}
-
-static void emitConstant(Value value)
-{
-	emitBytes(OP_CONSTANT, makeConstant(value));
-}
-
-static void patchJump(int offset)
-{
-	//-2 to adjust for the bytecode for the jump offset itself.
-	int jump = currentChunk()->count - offset - 2;
-
-	if (jump > UINT16_MAX) {
-		error("Too much code to jump over.");
-	}
-
-	currentChunk()->code[offset] = (jump >> 8) & 0xFF;
-	currentChunk()->code[offset + 1] = jump & 0xFF;
-}
-
-static void initCompiler(Compiler* compiler, FunctionType type)
-{
-	compiler->enclosing = current;
-	compiler->function = NULL;
-	compiler->type = type;
-	compiler->localCount = 0;
-	compiler->scopeDepth = 0;
-	compiler->function = newFunction();
-	current = compiler;
-
-	if (type != TYPE_SCRIPT) {
-		current->function->name = copyString(parser.previous.start, parser.previous.length);
-	}
-
-	Local* local = &current->locals[current->localCount++];
-	local->depth = 0;
-	local->isCaptured = false;
-	if (type != TYPE_FUNCTION) {
-		local->name.start = "this";
-		local->name.length = 4;
-	}
-	else {
-		local->name.start = "";
-		local->name.length = 0;
-	}
-}
-
-static ObjFunction* endCompiler()
-{
-	emitReturn();
-	ObjFunction* function = current->function;
-
-#ifdef DEBUG_PRINT_CODE
-	if (!parser.hadError) {
-		disassembleChunk(currentChunk(), function->name != NULL ? function->name->chars : "<script>");
-	}
-#endif
-
-	current = current->enclosing;
-	return function;
-}
-
-static void beginScope() 
-{
-	current->scopeDepth++;
-}
-
-static void endScope()
-{
-	current->scopeDepth--;
-
-	while (current->localCount > 0 && current->locals[current->localCount - 1].depth > current->scopeDepth)
-	{
-		if (current->locals[current->localCount - 1].isCaptured) {
-			emitByte(OP_CLOSE_UPVALUE);
-		}
-		else {
-			emitByte(OP_POP);
-		}
-		current->localCount--;
-	}
-}
-
-static void expression();
-static void statement();
-static void declaration();
-static uint8_t argumentList();
-static ParseRule *getRule(TokenType type);
-static void parsePrecedence(Precedence precedence);
-static uint8_t identifierConstant(Token* name);
-
-static void and_(bool canAssign);
-static void or_(bool canAssign);
-
-static void binary(bool canAssign)
-{
-	// Remember the operator.
-	TokenType operatorType = parser.previous.type;
-
-	// Compile the right operand.
-	ParseRule *rule = getRule(operatorType);
-	parsePrecedence((Precedence)(rule->precedence + 1));
-
-	// Emit the operator instruction.
-	switch (operatorType)
-	{
-	case TOKEN_BANG_EQUAL:
-		emitBytes(OP_EQUAL, OP_NOT);
-		break;
-	case TOKEN_EQUAL_EQUAL:
-		emitByte(OP_EQUAL);
-		break;
-	case TOKEN_GREATER:
-		emitByte(OP_GREATER);
-		break;
-	case TOKEN_GREATER_EQUAL:
-		emitBytes(OP_LESS, OP_NOT);
-		break;
-	case TOKEN_LESS:
-		emitByte(OP_LESS);
-		break;
-	case TOKEN_LESS_EQUAL:
-		emitBytes(OP_GREATER, OP_NOT);
-		break;
-	case TOKEN_PLUS:
-		emitByte(OP_ADD);
-		break;
-	case TOKEN_MINUS:
-		emitByte(OP_SUBTRACT);
-		break;
-	case TOKEN_STAR:
-		emitByte(OP_MULTIPLY);
-		break;
-	case TOKEN_SLASH:
-		emitByte(OP_DIVIDE);
-		break;
-	case TOKEN_PERCENT:
-		emitByte(OP_MODULO);
-		break;
-	case TOKEN_POWER:
-		emitByte(OP_POWER);
-		break;
-	case TOKEN_LESS_LESS:
-		emitByte(OP_SHIFT_LEFT);
-		break;
-	case TOKEN_GREATER_GREATER:
-		emitByte(OP_SHIFT_RIGHT);
-		break;
-	case TOKEN_PLUS_PLUS:
-		emitBytes(OP_CONSTANT, 1);
-		emitByte(OP_ADD);
-		break;
-	case TOKEN_MINUS_MINUS:
-		emitBytes(OP_CONSTANT, 1);
-		emitByte(OP_SUBTRACT);
-		break;
-	default:
-		return; // Unreachable.
-	}
-}
-
-static void literal(bool canAssign)
-{
-	switch (parser.previous.type)
-	{
-	case TOKEN_FALSE:
-		emitByte(OP_FALSE);
-		break;
-	case TOKEN_NIL:
-		emitByte(OP_NIL);
-		break;
-	case TOKEN_TRUE:
-		emitByte(OP_TRUE);
-		break;
-	default:
-		return;
-	}
-}
-
-static void call(bool canAssign)
-{
-	uint8_t argCount = argumentList();
-	emitBytes(OP_CALL, argCount);
-}
-
-static void dot(bool canAssign)
-{
-	consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
-	uint8_t name = identifierConstant(&parser.previous);
-
-	if (canAssign && match(TOKEN_EQUAL)) {
-		expression();
-		emitBytes(OP_SET_PROPERTY, name);
-	}
-	else if (match(TOKEN_LEFT_PAREN)) {
-		uint8_t argCount = argumentList();
-		emitBytes(OP_INVOKE, name);
-		emitByte(argCount);
-	}
-	else {
-		emitBytes(OP_GET_PROPERTY, name);
-	}
-}
-
-static void grouping(bool canAssign)
-{
-	expression();
-	consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
-}
-
-static void number(bool canAssign)
-{
-	double value = strtod(parser.previous.start, NULL);
-	emitConstant(NUMBER_VAL(value));
-}
-
-static void string(bool canAssign)
-{
-	emitConstant(OBJ_VAL(copyString(parser.previous.start + 1, parser.previous.length - 2)));
-}
-
-static void namedVariable(Token name, bool canAssign)
-{
-	uint8_t getOp, setOp;
-	int arg = resolveLocal(current, &name);
-	if (arg != -1) {
-		getOp = OP_GET_LOCAL;
-		setOp = OP_SET_LOCAL;
-	}
-	else if ((arg = resolveUpvalue(current, &name)) != -1) {
-		getOp = OP_GET_UPVALUE;
-		setOp = OP_SET_UPVALUE;
-	}
-	else
-	{
-		arg = identifierConstant(&name);
-		getOp = OP_GET_GLOBAL;
-		setOp = OP_SET_GLOBAL;
-	}
-	
-	if (match(TOKEN_EQUAL) && canAssign) {
-		expression();
-		emitBytes(setOp, arg);
-	}
-	else {
-		emitBytes(getOp, arg);
-	}
-}
-
-static void variable(bool canAssign)
-{
-	namedVariable(parser.previous, canAssign);
-}
-
-static Token syntheticToken(const char* text)
-{
-	Token token;
-	token.start = text;
-	token.length = (int)strlen(text);
-	return token;
-}
-
-static void this_(bool canAssign)
-{
-	if (currentClass == NULL) {
-		error("Can't use 'this' outside of a class.");
-		return;
-	}
-	variable(false);
-}
-
-static void super_(bool canAssign)
-{
-	if (currentClass == NULL) {
-		error("Can't use 'super' outside of a class.");
-	}
-	else if (!currentClass->hasSuperClass) {
-		error("Can't use 'super' in a class with no superclass.");
-	}
-
-	consume(TOKEN_DOT, "Expect '.' after 'super'.");
-	consume(TOKEN_IDENTIFIER, "Expect superclass field name.");
-	uint8_t name = identifierConstant(&parser.previous);
-
-	namedVariable(syntheticToken("this"), false);
-
-	if (match(TOKEN_LEFT_PAREN)) {
-		uint8_t argCount = argumentList();
-		namedVariable(syntheticToken("super"), false);
-		emitBytes(OP_SUPER_INVOKE, name);
-		emitByte(argCount);
-	}
-	else {
-		namedVariable(syntheticToken("super"), false);
-		emitBytes(OP_GET_SUPER, name);
-	}
-}
-
-static void unary(bool canAssign)
-{
-	TokenType operatorType = parser.previous.type;
-
-	// Compile the operand.
-	parsePrecedence(PREC_UNARY);
-
-	// Emit the operator instruction.
-	switch (operatorType)
-	{
-	case TOKEN_BANG:
-		emitByte(OP_NOT);
-		break;
-	case TOKEN_MINUS:
-		emitByte(OP_NEGATE);
-		break;
-	default:
-		return; // Unreachable.
-	}
-}
-
-static void arrayIndex(bool canAssign)
-{
-	parsePrecedence(PREC_CALL);
-
-	expression();
-	emitByte(OP_GET_ARRAY_INDEX);
-	consume(TOKEN_RIGHT_BRACKET, "Expect ']' after array index.");
-}
-
-ParseRule rules[] = {
-	[TOKEN_LEFT_PAREN] = {grouping, call, PREC_CALL},
-	[TOKEN_RIGHT_PAREN] = {NULL, NULL, PREC_NONE},
-	[TOKEN_LEFT_BRACKET] = {NULL, arrayIndex, PREC_CALL },
-	[TOKEN_RIGHT_BRACKET] = {NULL, NULL, PREC_NONE},
-	[TOKEN_LEFT_BRACE] = {NULL, NULL, PREC_NONE},
-	[TOKEN_RIGHT_BRACE] = {NULL, NULL, PREC_NONE},
-	[TOKEN_COMMA] = {NULL, NULL, PREC_NONE},
-	[TOKEN_DOT] = {NULL, dot, PREC_CALL},
-	[TOKEN_MINUS] = {unary, binary, PREC_TERM},
-	[TOKEN_MINUS_MINUS] = {NULL, binary, PREC_TERM},
-	[TOKEN_PLUS] = {NULL, binary, PREC_TERM},
-	[TOKEN_PLUS_PLUS] = {NULL, binary, PREC_TERM},
-	[TOKEN_SEMICOLON] = {NULL, NULL, PREC_NONE},
-	[TOKEN_SLASH] = {NULL, binary, PREC_FACTOR},
-	[TOKEN_STAR] = {NULL, binary, PREC_FACTOR},
-	[TOKEN_PERCENT] = {NULL, binary,  PREC_FACTOR},
-	[TOKEN_POWER] = {NULL, binary, PREC_POWER},
-	[TOKEN_BANG] = {unary, NULL, PREC_NONE},
-	[TOKEN_BANG_EQUAL] = {NULL, binary, PREC_EQUALITY},
-	[TOKEN_EQUAL] = {NULL, NULL, PREC_NONE},
-	[TOKEN_EQUAL_EQUAL] = {NULL, binary, PREC_EQUALITY},
-	[TOKEN_GREATER] = {NULL, binary, PREC_COMPARISON},
-	[TOKEN_GREATER_EQUAL] = {NULL, binary, PREC_COMPARISON},
-	[TOKEN_LESS] = {NULL, binary, PREC_COMPARISON},
-	[TOKEN_LESS_EQUAL] = {NULL, binary, PREC_COMPARISON},
-	[TOKEN_LESS_LESS] = {NULL, binary, PREC_FACTOR},
-	[TOKEN_GREATER_GREATER] = {NULL, binary, PREC_FACTOR},
-	[TOKEN_IDENTIFIER] = {variable, NULL, PREC_NONE},
-	[TOKEN_STRING] = {string, NULL, PREC_NONE},
-	[TOKEN_NUMBER] = {number, NULL, PREC_NONE},
-	[TOKEN_AND] = {NULL, and_, PREC_AND},
-	[TOKEN_CLASS] = {NULL, NULL, PREC_NONE},
-	[TOKEN_ELSE] = {NULL, NULL, PREC_NONE},
-	[TOKEN_FALSE] = {literal, NULL, PREC_NONE},
-	[TOKEN_FOR] = {NULL, NULL, PREC_NONE},
-	[TOKEN_FUN] = {NULL, NULL, PREC_NONE},
-	[TOKEN_IF] = {NULL, NULL, PREC_NONE},
-	[TOKEN_NIL] = {literal, NULL, PREC_NONE},
-	[TOKEN_OR] = {NULL, or_, PREC_OR},
-	[TOKEN_PRINT] = {NULL, NULL, PREC_NONE},
-	[TOKEN_RETURN] = {NULL, NULL, PREC_NONE},
-	[TOKEN_SUPER] = {super_, NULL, PREC_NONE},
-	[TOKEN_THIS] = {this_, NULL, PREC_NONE},
-	[TOKEN_TRUE] = {literal, NULL, PREC_NONE},
-	[TOKEN_VAR] = {NULL, NULL, PREC_NONE},
-	[TOKEN_CONST] = {NULL, NULL, PREC_NONE},
-	[TOKEN_WHILE] = {NULL, NULL, PREC_NONE},
-	[TOKEN_ERROR] = {NULL, NULL, PREC_NONE},
-	[TOKEN_EXIT] = {exit, NULL, PREC_NONE },
-	[TOKEN_EOF] = {NULL, NULL, PREC_NONE},
-};
-
-static void parsePrecedence(Precedence precedence)
-{
-	advance();
-	ParseFn prefixRule = getRule(parser.previous.type)->prefix;
-	if (prefixRule == NULL)
-	{
-		error("Expect expression.");
-		return;
-	}
-
-	bool canAssign = precedence <= PREC_ASSIGNMENT;
-	prefixRule(canAssign);
-
-	while (precedence <= getRule(parser.current.type)->precedence)
-	{
-		advance();
-		ParseFn infixRule = getRule(parser.previous.type)->infix;
-		infixRule(canAssign);
-	}
-	
-	if (canAssign && match(TOKEN_EQUAL)) {
-		error("Invalid assignment target.");
-	}
-}
-
-static uint8_t identifierConstant(Token* name) 
-{
-	return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
-}
-
-static void addLocal(Token name)
-{
-	if (current->localCount == UINT8_COUNT) {
-		error("Too many local variables in function.");
-		return;
-	}
-
-	Local* local = &current->locals[current->localCount++];
-	local->name = name; 
-	local->depth = -1;
-	local->isCaptured = false;
-}
-
-static bool identifiersEqual(Token* a, Token* b)
-{
-	if (a->length != b->length) return false;
-	return memcmp(a->start, b->start, a->length) == 0;
-}
-
-int resolveLocal(Compiler* compiler, Token* name)
-{
-	for (int i = compiler->localCount - 1; i >= 0; i--) {
-		Local* local = &compiler->locals[i];
-		if (identifiersEqual(name, &local->name)) {
-			if (local->depth == -1) {
-				error("Can't read local variable in its own initializer.");
-			}
-			return i;
-		}
-	}
-
-	return -1;
-}
-
-static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal)
-{
-	int upvalueCount = compiler->function->upvalueCount;
-
-	for (int i = 0; i < upvalueCount; i++) {
-		Upvalue* upvalue = &compiler->upvalues[i];
-		if (upvalue->index == index && upvalue->isLocal == isLocal) {
-			return i;
-		}
-	}
-
-	if (upvalueCount == UINT8_COUNT) {
-		error("Too many closure variables in function.");
-		return 0;
-	}
-
-	compiler->upvalues[upvalueCount].isLocal = isLocal;
-	compiler->upvalues[upvalueCount].index = index;
-	return compiler->function->upvalueCount++;
-}
-
-int resolveUpvalue(Compiler* compiler, Token* name)
-{
-	if (compiler->enclosing == NULL) return -1;
-
-	int local = resolveLocal(compiler->enclosing, name);
-	if (local != 1) {
-		compiler->enclosing->locals[local].isCaptured = true;
-		return addUpvalue(compiler, (uint8_t)local, true);
-	}
-
-	int upvalue = resolveUpvalue(compiler->enclosing, name);
-	if (upvalue != -1) {
-		return addUpvalue(compiler, (uint8_t)upvalue, false);
-	}
-
-	return -1;
-}
-
-static void declareVariable()
-{
-	// Global variables are implicitly declared.
-	if (current->scopeDepth == 0) return;
-
-	Token* name = &parser.previous;
-	for (int i = current->localCount - 1; i >= 0; i--) {
-		Local* local = &current->locals[i];
-		if (local->depth != -1 && local->depth < current->scopeDepth) {
-			break;
-		}
-
-		if (identifiersEqual(name, &local->name)) {
-			error("Already variable with this name in this scope.");
-		}
-	}
-
-	addLocal(*name);
-}
-
-static uint8_t parseVariable(const char* errorMessage) 
-{
-	consume(TOKEN_IDENTIFIER, errorMessage);
-
-	declareVariable();
-	if (current->scopeDepth > 0) return 0;
-
-	return identifierConstant(&parser.previous);
-}
-
-static void markInitialized()
-{
-	if (current->scopeDepth == 0) return;
-	current->locals[current->localCount - 1].depth = current->scopeDepth;
-}
-
-static void defineVariable(uint8_t global, bool isConstant) 
-{
-	if (current->scopeDepth > 0) {
-		markInitialized();
-		return;
-	}
-
-	if (isConstant) {
-		emitBytes(OP_DEFINE_CONSTANT, global);
-	}
-	else
-	{
-		emitBytes(OP_DEFINE_GLOBAL, global);
-	}
-}
-
-static void defineArray(uint8_t* globals, bool isConstant)
-{
-	if (current->scopeDepth > 0) {
-		markInitialized();
-		return;
-	}
-
-	if (isConstant) {
-		emitBytes(OP_DEFINE_CONSTANT, &globals);
-	}
-	else {
-		emitBytes(OP_DEFINE_GLOBAL, &globals);
-	}
-}
-
-static uint8_t argumentList()
-{
-	uint8_t argCount = 0;
-	if (!check(TOKEN_RIGHT_PAREN)) {
-		do {
-			expression();
-
-			if (argCount == 255) {
-				error("Can't have more than 255 arguments.");
-			}
-
-			argCount++;
-		} while (match(TOKEN_COMMA));
-	}
-
-	consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
-	return argCount;
-}
-
-static void and_(bool canAssign)
-{
-	int endJump = emitJump(OP_JUMP_IF_FALSE);
-
-	emitByte(OP_POP);
-	parsePrecedence(PREC_AND);
-
-	patchJump(endJump);
-}
-
-static void or_(bool canAssign)
-{
-	int elseJump = emitJump(OP_JUMP_IF_FALSE);
-	int endJump = emitJump(OP_JUMP);
-
-	patchJump(elseJump);
-	emitByte(OP_POP);
-
-	parsePrecedence(PREC_OR);
-	patchJump(endJump);
-}
-
-static ParseRule *getRule(TokenType type)
-{
-	return &rules[type];
-}
-
-static void synchronize()
-{
-	parser.panicMode = false;
-
-	while (parser.current.type != TOKEN_EOF){
-		if (parser.previous.type == TOKEN_SEMICOLON)
-			return;
-
-		switch (parser.current.type)
-		{
-		case TOKEN_CLASS:
-		case TOKEN_FUN:
-		case TOKEN_VAR:
-		case TOKEN_CONST:
-		case TOKEN_FOR:
-		case TOKEN_IF:
-		case TOKEN_WHILE:
-		case TOKEN_PRINT:
-		case TOKEN_RETURN:
-			return;
-
-		default:
-			//do Nothing
-			;
-		}
-
-		advance();
-	}
-}
-
-static void expression()
-{
-	parsePrecedence(PREC_ASSIGNMENT);
-}
-
-static void arrayStatement()
-{
-	do {
-		expression();
-	} while (match(TOKEN_COMMA));
-
-	consume(TOKEN_RIGHT_BRACKET, "Expect ']' after array expression.");
-}
-
-static void block()
-{
-	while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF))
-	{
-		declaration();
-	} 
-	consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
-}
-
-static void function(FunctionType type)
-{
-	Compiler compiler;
-	initCompiler(&compiler, type);
-	beginScope();
-
-	//Compile the parameter list.
-	consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
-	if (!check(TOKEN_RIGHT_PAREN)) {
-		do {
-			current->function->arity++;
-			if (current->function->arity > 255) {
-				errorAtCurrent("Can't have more than 255 parameters.");
-			}
-
-			bool isConstant = false;
-			if (match(TOKEN_CONST)) {
-				isConstant = true;
-			}
-
-			uint8_t paramConstant = parseVariable("Expect parameter name.");
-			defineVariable(paramConstant, isConstant);
-		} while (match(TOKEN_COMMA));
-	}
-	consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
-
-	//The body.
-	consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
-	block();
-
-	//Create the function object.
-	ObjFunction* function = endCompiler();
-	emitBytes(OP_CLOSURE, makeConstant(OBJ_VAL(function)));
-
-	for (int i = 0; i < function->upvalueCount; i++) {
-		emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
-		emitByte(compiler.upvalues[i].index);
-	}
-}
-
-static void method()
-{
-	consume(TOKEN_IDENTIFIER, "Expect method name.");
-	uint8_t constant = identifierConstant(&parser.previous);
-
-	FunctionType type = TYPE_METHOD;
-	if (parser.previous.length == 4 && memcmp(parser.previous.start, "init", 4) == 0) {
-		type = TYPE_INITIALIZER;
-	}
-
-	function(type);
-	emitBytes(OP_METHOD, constant);
-}
-
-static void classDeclaration()
-{
-	consume(TOKEN_IDENTIFIER, "Expect class name.");
-	Token className = parser.previous;
-	uint8_t nameConstant = identifierConstant(&parser.previous);
-	declareVariable();
-
-	emitBytes(OP_CLASS, nameConstant);
-	defineVariable(nameConstant, true);
-
-	ClassCompiler classCompiler;
-	classCompiler.name = parser.previous;
-	classCompiler.hasSuperClass = false;
-	classCompiler.enclosing = currentClass;
-	currentClass = &classCompiler;
-
-	if (match(TOKEN_LESS)) {
-		consume(TOKEN_IDENTIFIER, "Expect superclass name.");
-		variable(false);
-
-		if (identifiersEqual(&className, &parser.previous)) {
-			error("A class cannot inherit from itself.");
-		}
-
-		beginScope();
-		addLocal(syntheticToken("super"));
-		defineVariable(0, true);
-
-		namedVariable(className, false);
-		emitByte(OP_INHERIT);
-		classCompiler.hasSuperClass = true;
-	}
-
-	namedVariable(className, false);
-	consume(TOKEN_LEFT_BRACE, "Expect '{' before class body.");
-
-	while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
-		method();
-	}
-
-	consume(TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
-	emitByte(OP_POP);
-
-	if (classCompiler.hasSuperClass) {
-		endScope();
-	}
-
-	currentClass = currentClass->enclosing;
-}
-
-static void funDeclaration()
-{
-	uint8_t global = parseVariable("Expect function name.");
-	markInitialized();
-	function(TYPE_FUNCTION);
-	defineVariable(global, false);
-}
-
-static void varDeclaration(bool isConstant) 
-{
-	uint8_t global = parseVariable("Expect variable name.");
-
-	if (match(TOKEN_EQUAL)) {
-		if (match(TOKEN_LEFT_BRACKET)) {
-			arrayStatement();
-		}
-		else {
-			expression();
-		}
-	}
-	else {
-		emitByte(OP_NIL);
-	}
-	consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
-
-	defineVariable(global, isConstant);
-} 
-
-static void printStatement() 
-{
-	expression();
-	consume(TOKEN_SEMICOLON, "Expect ';' after value.");
-	emitByte(OP_PRINT);
-}
-
-static void returnStatement()
-{
-	if (current->type == TYPE_SCRIPT) {
-		error("Can't return from top-level code.");
-	}
-
-	if (match(TOKEN_SEMICOLON)) {
-		emitReturn();
-	}
-	else {
-		if (current->type == TYPE_INITIALIZER) {
-			error("Can't return a value from an initializer.");
-		}
-
-		expression();
-		consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
-		emitByte(OP_RETURN);
-	}
-}
-
-static void breakStatement()
-{
-	emitBreak();
-	consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
-}
-
-static void whileStatement()
-{
-	int loopStart = currentChunk()->count;
-
-	consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
-	expression();
-	consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
-
-	int exitJump = emitJump(OP_JUMP_IF_FALSE);
-
-	emitByte(OP_POP);
-	statement();
-	emitLoop(loopStart);
-
-	patchJump(exitJump);
-	emitByte(OP_POP);
-}
-
-static void expressionStatement() 
-{
-	expression();
-	consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
-	emitByte(OP_POP);
-}
-
-static void ifStatement()
-{
-	consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
-	expression();
-	consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
-
-	int thenJump = emitJump(OP_JUMP_IF_FALSE);
-	emitByte(OP_POP);
-	statement();
-
-	int elseJump = emitJump(OP_JUMP);
-
-	patchJump(thenJump);
-	emitByte(OP_POP);
-
-	if (match(TOKEN_ELSE)) statement();
-	patchJump(elseJump);
-}
-
-static void forStatement()
-{
-	beginScope();
-	consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
-	if (match(TOKEN_SEMICOLON)) {
-
-	}
-	else if (match(TOKEN_VAR)) {
-		varDeclaration(false);
-	}
-	else if (match(TOKEN_CONST)) {
-		varDeclaration(true);
-	}
-	else {
-		expressionStatement();
-	}
-
-	int loopStart = currentChunk()->count;
-	int exitJump = -1;
-	if (!match(TOKEN_SEMICOLON)) {
-		expression();
-		consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
-
-		//Jump out of the loop if the condition is false.
-		exitJump = emitJump(OP_JUMP_IF_FALSE);
-		emitByte(OP_POP);
-	}
-	
-	if (!match(TOKEN_RIGHT_PAREN)) {
-		int bodyJump = emitJump(OP_JUMP);
-		int incrementStart = currentChunk()->count;
-		
-		expression();
-		emitByte(OP_POP);
-		consume(TOKEN_RIGHT_PAREN, "Expect ')' after for args.");
-
-		emitLoop(loopStart);
-		loopStart = incrementStart;
-		patchJump(bodyJump);
-	}
-
-	statement();
-
-	emitLoop(loopStart);
-
-	if (exitJump != -1) {
-		patchJump(exitJump);
-		emitByte(OP_POP); // Condition.
-	}
-
-	endScope();
-}
-
-static void declaration()
-{
-	if (match(TOKEN_CLASS)) {
-		classDeclaration();
-	}
-	else if (match(TOKEN_FUN)) {
-		funDeclaration();
-	} 
-	else if (match(TOKEN_VAR)) {
-		varDeclaration(false);
-	}
-	else if (match(TOKEN_CONST)) {
-		varDeclaration(true);
-	}
-	else
-	{
-		statement();
-	}
-
-	if (parser.panicMode)
-		synchronize();
-}
-
-static void statement() 
-{
-	if (match(TOKEN_PRINT)) {
-		printStatement();
-	} 
-	else if (match(TOKEN_IF)) {
-		ifStatement();
-	} 
-	else if (match(TOKEN_RETURN)) {
-		returnStatement();
-	}
-	else if (match(TOKEN_BREAK)) {
-		breakStatement();
-	}
-	else if (match(TOKEN_WHILE)) {
-		whileStatement();
-	}
-	else if (match(TOKEN_FOR)) {
-		forStatement();
-	}
-	else if (match(TOKEN_LEFT_BRACE)) {
-		beginScope();
-		block();
-		endScope();
-	}
-	else {
-		expressionStatement();
-	}
-}
-
-ObjFunction* compile(const char *source)
-{
-	initScanner(source);
-	Compiler compiler;
-	initCompiler(&compiler, TYPE_SCRIPT);
-	//compilingChunk = chunk;
-
-	parser.hadError = false;
-	parser.panicMode = false;
-
-	advance();
-	
-	while (!match(TOKEN_EOF)) {
-		declaration();
-	}
-
-	ObjFunction* function = endCompiler();
-	return parser.hadError ? NULL : function;
-}
-
-void markCompilerRoots()
-{
-	Compiler* compiler = current;
-	while (compiler != NULL) {
-		markObject((Obj*)compiler->function);
-		compiler = compiler->enclosing;
-	}
-}
-
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "compiler.h"
+#include "scanner.h"
+#include "memory.h"
+
+#ifdef DEBUG_PRINT_CODE
+#include "debug.h"
+#endif
+
+typedef struct
+{
+	Token current;
+	Token previous;
+	bool hadError;
+	bool panicMode;
+} Parser;
+
+typedef enum
+{
+	PREC_NONE,
+	PREC_ASSIGNMENT, // =
+	PREC_OR,         // or
+	PREC_AND,        // and
+	PREC_EQUALITY,   // == !=
+	PREC_COMPARISON, // < > <= >=
+	PREC_TERM,       // + -
+	PREC_FACTOR,     // * /
+	PREC_POWER,		 // ^
+	PREC_UNARY,      // ! -
+	PREC_CALL,       // . ()
+	PREC_PRIMARY
+} Precedence;
+
+typedef void (*ParseFn)(bool canAssign);
+
+typedef struct
+{
+	ParseFn prefix;
+	ParseFn infix;
+	Precedence precedence;
+} ParseRule;
+
+typedef struct {
+	Token name;
+	int depth;
+	bool isCaptured;
+	bool isConstant;
+} Local;
+
+typedef struct {
+	uint8_t index;
+	bool isLocal;
+	bool isConstant;
+} Upvalue;
+
+typedef enum
+{
+	TYPE_FUNCTION,
+	TYPE_METHOD,
+	TYPE_INITIALIZER,
+	TYPE_SCRIPT
+} FunctionType;
+
+typedef struct Compiler {
+	struct Compiler* enclosing;
+	ObjFunction* function;
+	FunctionType type;
+
+	Local locals[UINT8_COUNT];
+	int localCount;
+	Upvalue upvalues[UINT8_COUNT];
+	int scopeDepth;
+	int lastCall;	//Offset of the last call or invoke emitted, -1 before the first.
+} Compiler;
+
+typedef struct ClassCompiler
+{
+	struct ClassCompiler* enclosing;
+	bool hasSuperClass;
+	Token name;
+} ClassCompiler;
+
+Parser parser;
+Compiler* current = NULL;
+Chunk* compilingChunk;
+
+ClassCompiler* currentClass = NULL;
+
+static Chunk *currentChunk()
+{
+	return &current->function->chunk;
+}
+
+static void errorAt(Token *token, const char *message)
+{
+	if (parser.panicMode)
+		return;
+	parser.panicMode = true;
+	PRINT_ERROR(stderr);
+	fprintf(stderr, "[line %d] Error", token->line);
+
+	if (token->type == TOKEN_EOF)
+	{
+		fprintf(stderr, " at end.\n");
+		fprintf(stderr, "%s\n", message);
+	}
+	else if (token->type == TOKEN_ERROR)
+	{
+		fprintf(stderr, "%p.\n", message);
+	}
+	else
+	{
+		fprintf(stderr, " at '%.*s'.\n", token->length, token->start);
+		fprintf(stderr, "%s\n", message);
+	}
+	PRINT_RESET(stderr);
+	parser.hadError = true;
+}
+
+static void error(const char *message)
+{
+	errorAt(&parser.previous, message);
+}
+
+static void errorAtCurrent(const char *message)
+{
+	errorAt(&parser.current, message);
+}
+
+static void advance()
+{
+	parser.previous = parser.current;
+
+	for (;;)
+	{
+		parser.current = scanToken();
+		if (parser.current.type != TOKEN_ERROR)
+			break;
+
+		errorAtCurrent(parser.current.start);
+	}
+}
+
+static void consume(TokenType type, const char *message)
+{
+	if (parser.current.type == type)
+	{
+		advance();
+		return;
+	}
+
+	errorAtCurrent(message);
+}
+
+static bool check(TokenType type)
+{
+	return parser.current.type == type;
+}
+
+static bool match(TokenType type)
+{
+	if (!check(type)) return false;
+	advance();
+	return true;
+}
+
+static void emitByte(uint8_t byte)
+{
+	writeChunk(currentChunk(), byte, parser.previous.line);
+}
+
+static void emitBytes(uint8_t byte1, uint8_t byte2)
+{
+	emitByte(byte1);
+	emitByte(byte2);
+}
+
+static void emitLoop(int loopStart)
+{
+	emitByte(OP_LOOP);
+	int offset = currentChunk()->count - loopStart + 2;
+	if (offset > UINT16_MAX) {
+		error("Loop body too large.");
+	}
+
+	emitByte((offset >> 8) & 0xFF);
+	emitByte(offset & 0xFF);
+}
+
+static void emitReturn()
+{
+	if (current->type == TYPE_INITIALIZER) {
+		emitBytes(OP_GET_LOCAL, 0);
+	}
+	else {
+		emitByte(OP_NIL);
+	}
+	emitByte(OP_RETURN);
+}
+
+static void emitBreak()
+{
+
+}
+
+static int emitJump(uint8_t instruction)
+{
+	emitByte(instruction);
+	emitByte(0xFF);
+	emitByte(0xFF);
+	return currentChunk()->count - 2;
+}
+
+static uint8_t makeConstant(Value value)
+{
+	int constant = addConstant(currentChunk(), value);
+	WRITE_BARRIER(current->function);
+	if (constant > UINT8_MAX)
+	{
+		error("Too many constants in one chunk.");
+		return 0;
+	}
+
+	return (uint8_t)constant;
+}
+
+static void emitInlineCache()
+{
+	int cache = addInlineCache(currentChunk());
+	if (cache > UINT16_MAX)
+	{
+		error("Too many property accesses in one chunk.");
+	}
+
+	emitByte((cache >> 8) & 0xFF);
+	emitByte(cache & 0xFF);
+}
+
+static void emitGlobal(uint8_t instruction, uint16_t slot)
+{
+	emitByte(instruction);
+	emitByte((slot >> 8) & 0xFF);
+	emitByte(slot & 0xFF);
+}
+
+static void emitConstant(Value value)
+{
+	emitBytes(OP_CONSTANT, makeConstant(value));
+}
+
+static void patchJump(int offset)
+{
+	//-2 to adjust for the bytecode for the jump offset itself.
+	int jump = currentChunk()->count - offset - 2;
+
+	if (jump > UINT16_MAX) {
+		error("Too much code to jump over.");
+	}
+
+	currentChunk()->code[offset] = (jump >> 8) & 0xFF;
+	currentChunk()->code[offset + 1] = jump & 0xFF;
+}
+
+static void initCompiler(Compiler* compiler, FunctionType type)
+{
+	compiler->enclosing = current;
+	compiler->function = NULL;
+	compiler->type = type;
+	compiler->localCount = 0;
+	compiler->scopeDepth = 0;
+	compiler->lastCall = -1;
+	compiler->function = newFunction();
+	current = compiler;
+
+	if (type != TYPE_SCRIPT) {
+		STORE_SHARED(current->function->name, copyString(parser.previous.start, parser.previous.length));
+		WRITE_BARRIER(current->function);
+	}
+
+	Local* local = &current->locals[current->localCount++];
+	local->depth = 0;
+	local->isCaptured = false;
+	local->isConstant = false;
+	if (type != TYPE_FUNCTION) {
+		local->name.start = "this";
+		local->name.length = 4;
+	}
+	else {
+		local->name.start = "";
+		local->name.length = 0;
+	}
+}
+
+//The optimiser's view of one instruction of the chunk it rewrites. Offsets
+//are the ones the compiler emitted, the chunk is only rewritten once all
+//the passes are done.
+typedef struct
+{
+	int offset;
+	int length;		//Folding can make an instruction shorter than it was.
+	int room;		//Bytes it had to begin with.
+	int target;		//Instruction a jump or loop goes to, -1 otherwise.
+	bool isLive;	//Reachable from the start of the chunk.
+	bool isDeleted;
+	int jumps;		//Live jumps that land here.
+} PeepholeOp;
+
+typedef struct
+{
+	//One past the last instruction is a sentinel for the end of the chunk.
+	PeepholeOp* ops;
+	int count;
+} Peephole;
+
+static uint8_t opcodeAt(Peephole* peephole, int op)
+{
+	return currentChunk()->code[peephole->ops[op].offset];
+}
+
+static bool isFalseyConstant(Value value)
+{
+	return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+//Deleted instructions are skipped over, jumps to them land on whatever
+//comes after.
+static int nextOp(Peephole* peephole, int op)
+{
+	do {
+		op++;
+	} while (op < peephole->count && peephole->ops[op].isDeleted);
+	return op;
+}
+
+static int resolveTarget(Peephole* peephole, int op)
+{
+	return peephole->ops[op].isDeleted ? nextOp(peephole, op) : op;
+}
+
+static void deleteOp(Peephole* peephole, int op)
+{
+	PeepholeOp* deleted = &peephole->ops[op];
+	deleted->isDeleted = true;
+	deleted->target = -1;
+	peephole->ops[nextOp(peephole, op)].jumps += deleted->jumps;
+}
+
+static bool endsBlock(uint8_t instruction)
+{
+	return instruction == OP_RETURN || instruction == OP_JUMP || instruction == OP_LOOP || instruction == OP_EXIT;
+}
+
+static bool isCompareJump(uint8_t instruction)
+{
+	return (instruction >= OP_JUMP_IF_NOT_LESS && instruction <= OP_JUMP_IF_NOT_GREATER_EQUAL) ||
+		(instruction >= OP_JUMP_IF_NOT_LESS_RR && instruction <= OP_JUMP_IF_NOT_GREATER_EQUAL_RK);
+}
+
+static int previousOp(Peephole* peephole, int op)
+{
+	do {
+		op--;
+	} while (op >= 0 && (peephole->ops[op].isDeleted || !peephole->ops[op].isLive));
+	return op;
+}
+
+//Flags everything reachable from the first instruction and every place a
+//reachable jump lands on.
+static void findLiveOps(Peephole* peephole)
+{
+	for (int i = 0; i <= peephole->count; i++) {
+		peephole->ops[i].isLive = false;
+		peephole->ops[i].jumps = 0;
+	}
+	peephole->ops[peephole->count].isLive = true;
+
+	int* worklist = ALLOCATE(int, peephole->count * 2 + 1);
+	int top = 0;
+	worklist[top++] = 0;
+
+	while (top > 0) {
+		int op = worklist[--top];
+		PeepholeOp* instruction = &peephole->ops[op];
+		if (instruction->isLive) continue;
+		instruction->isLive = true;
+
+		if (instruction->target >= 0) {
+			int target = resolveTarget(peephole, instruction->target);
+			peephole->ops[target].jumps++;
+			worklist[top++] = target;
+		}
+		if (instruction->isDeleted || !endsBlock(opcodeAt(peephole, op))) {
+			worklist[top++] = op + 1;
+		}
+	}
+
+	FREE_ARRAY(int, worklist, peephole->count * 2 + 1);
+}
+
+//Pushes a constant, nil or a boolean.
+static bool isConstantOp(Peephole* peephole, int op, Value* value)
+{
+	uint8_t* code = &currentChunk()->code[peephole->ops[op].offset];
+	switch (code[0])
+	{
+	case OP_CONSTANT:	*value = currentChunk()->constants.values[code[1]]; return true;
+	case OP_NIL:		*value = NIL_VAL; return true;
+	case OP_TRUE:		*value = BOOL_VAL(true); return true;
+	case OP_FALSE:		*value = BOOL_VAL(false); return true;
+	default:			return false;
+	}
+}
+
+//Turns the instruction into one that pushes 'value', if it fits.
+static bool replaceWithConstant(Peephole* peephole, int op, Value value)
+{
+	PeepholeOp* instruction = &peephole->ops[op];
+	uint8_t* code = &currentChunk()->code[instruction->offset];
+
+	if (IS_NIL(value) || IS_BOOL(value)) {
+		code[0] = IS_NIL(value) ? OP_NIL : AS_BOOL(value) ? OP_TRUE : OP_FALSE;
+		instruction->length = 1;
+		return true;
+	}
+
+	if (instruction->room < 2) return false;
+
+	//Folding leaves the operands' constants behind, reuse one of those
+	//before growing the table.
+	ValueArray* constants = &currentChunk()->constants;
+	double number = AS_NUMBER(value);
+	int constant = 0;
+	for (; constant < constants->count; constant++) {
+		if (!IS_NUMBER(constants->values[constant])) continue;
+		double existing = AS_NUMBER(constants->values[constant]);
+		if (memcmp(&number, &existing, sizeof(double)) == 0) break;
+	}
+	if (constant == constants->count) {
+		if (constant > UINT8_MAX) return false;
+		addConstant(currentChunk(), value);
+		WRITE_BARRIER(current->function);
+	}
+
+	code[0] = OP_CONSTANT;
+	code[1] = (uint8_t)constant;
+	instruction->length = 2;
+	return true;
+}
+
+//Evaluates the operator the way the interpreter would, or returns false
+//if it would raise an error or the result is not worth a constant.
+static bool foldBinary(uint8_t instruction, Value left, Value right, Value* result)
+{
+	if (instruction == OP_EQUAL) {
+		*result = BOOL_VAL(valuesEqual(left, right));
+		return true;
+	}
+
+	if (!IS_NUMBER(left) || !IS_NUMBER(right)) return false;
+	double a = AS_NUMBER(left);
+	double b = AS_NUMBER(right);
+
+	switch (instruction)
+	{
+	case OP_ADD:			*result = NUMBER_VAL(a + b); return true;
+	case OP_SUBTRACT:		*result = NUMBER_VAL(a - b); return true;
+	case OP_MULTIPLY:		*result = NUMBER_VAL(a * b); return true;
+	case OP_DIVIDE:			*result = NUMBER_VAL(a / b); return true;
+	case OP_MODULO:			*result = NUMBER_VAL(fmod(a, b)); return true;
+	case OP_POWER:			*result = NUMBER_VAL(pow(a, b)); return true;
+	case OP_GREATER:		*result = BOOL_VAL(a > b); return true;
+	case OP_LESS:			*result = BOOL_VAL(a < b); return true;
+	case OP_GREATER_EQUAL:	*result = BOOL_VAL(a >= b); return true;
+	case OP_LESS_EQUAL:		*result = BOOL_VAL(a <= b); return true;
+	case OP_SHIFT_LEFT:
+	case OP_SHIFT_RIGHT:
+		//Out of range shifts are left to the machine at runtime.
+		if (!(b >= 0 && b < 63 && a > -9.2e18 && a < 9.2e18)) return false;
+		*result = NUMBER_VAL(instruction == OP_SHIFT_LEFT ? (long)a << (long)b : (long)a >> (long)b);
+		return true;
+	default:
+		return false;
+	}
+}
+
+//Simplifies the sequence starting at 'op', only the first instruction of
+//a sequence may be jumped to.
+//With vm.registerCode, arithmetic on locals whose result is stored into a
+//local, copies between locals and compare and branches on locals read and
+//write the slots directly. 'op' is the OP_GET_LOCAL of the first operand.
+static bool lowerToRegisters(Peephole* peephole, int op)
+{
+	PeepholeOp* ops = peephole->ops;
+	uint8_t* code = currentChunk()->code;
+	int follow[4];
+	uint8_t instructions[4];
+	int at = op;
+	for (int i = 0; i < 4; i++) {
+		at = at < peephole->count ? nextOp(peephole, at) : at;
+		follow[i] = at;
+		instructions[i] = at < peephole->count && ops[at].jumps == 0 ? opcodeAt(peephole, at) : OP_EXIT;
+	}
+
+	uint8_t a = code[ops[op].offset + 1];
+	uint8_t lowered[3];
+	int length;
+	int last;
+	if (instructions[0] == OP_SET_LOCAL && instructions[1] == OP_POP) {
+		lowered[0] = code[ops[follow[0]].offset + 1];
+		lowered[1] = a;
+		code[ops[op].offset] = OP_MOVE;
+		length = 3;
+		last = 1;
+	}
+	else if (instructions[0] == OP_GET_LOCAL || instructions[0] == OP_CONSTANT) {
+		bool isConstant = instructions[0] == OP_CONSTANT;
+		uint8_t b = code[ops[follow[0]].offset + 1];
+		int arithmetic = instructions[1] == OP_ADD ? 0 : instructions[1] == OP_SUBTRACT ? 1 :
+			instructions[1] == OP_MULTIPLY ? 2 : instructions[1] == OP_DIVIDE ? 3 : -1;
+		if (arithmetic >= 0 && instructions[2] == OP_SET_LOCAL && instructions[3] == OP_POP) {
+			lowered[0] = code[ops[follow[2]].offset + 1];
+			lowered[1] = a;
+			lowered[2] = b;
+			code[ops[op].offset] = (isConstant ? OP_ADD_RK : OP_ADD_RR) + arithmetic;
+			length = 4;
+			last = 3;
+		}
+		else if (instructions[1] >= OP_JUMP_IF_NOT_LESS && instructions[1] <= OP_JUMP_IF_NOT_GREATER_EQUAL) {
+			//The distance is written once the chunk is laid out.
+			lowered[0] = a;
+			lowered[1] = b;
+			code[ops[op].offset] = (isConstant ? OP_JUMP_IF_NOT_LESS_RK : OP_JUMP_IF_NOT_LESS_RR) + (instructions[1] - OP_JUMP_IF_NOT_LESS);
+			ops[op].target = ops[follow[1]].target;
+			length = 5;
+			last = 1;
+		}
+		else return false;
+	}
+	else return false;
+
+	for (int i = 0; i <= last; i++) deleteOp(peephole, follow[i]);
+	memcpy(&code[ops[op].offset + 1], lowered, length == 5 ? 2 : length - 1);
+	ops[op].length = length;
+	ops[op].room = ops[follow[last]].offset + ops[follow[last]].room - ops[op].offset;
+	return true;
+}
+
+static bool simplifyOp(Peephole* peephole, int op)
+{
+	PeepholeOp* ops = peephole->ops;
+	uint8_t* code = currentChunk()->code;
+	uint8_t instruction = opcodeAt(peephole, op);
+	int next = nextOp(peephole, op);
+	int after = next < peephole->count ? nextOp(peephole, next) : next;
+	//OP_EXIT stands in for the end of the chunk and for instructions that
+	//are jumped to, neither can be part of a sequence.
+	uint8_t nextInstruction = next < peephole->count && ops[next].jumps == 0 ? opcodeAt(peephole, next) : OP_EXIT;
+	uint8_t afterInstruction = after < peephole->count && ops[after].jumps == 0 ? opcodeAt(peephole, after) : OP_EXIT;
+
+	Value value;
+	if (isConstantOp(peephole, op, &value)) {
+		Value right;
+		Value result;
+		if (nextInstruction == OP_POP) {
+			deleteOp(peephole, op);
+			deleteOp(peephole, next);
+			return true;
+		}
+		if (nextInstruction == OP_NOT) {
+			replaceWithConstant(peephole, op, BOOL_VAL(isFalseyConstant(value)));
+			deleteOp(peephole, next);
+			return true;
+		}
+		if (nextInstruction == OP_NEGATE && IS_NUMBER(value) && replaceWithConstant(peephole, op, NUMBER_VAL(-AS_NUMBER(value)))) {
+			deleteOp(peephole, next);
+			return true;
+		}
+		if (nextInstruction == OP_JUMP_IF_FALSE) {
+			//The branch always goes the same way. When it is never taken
+			//the value is popped right after.
+			if (isFalseyConstant(value)) {
+				code[ops[next].offset] = OP_JUMP;
+				return true;
+			}
+			if (afterInstruction == OP_POP) {
+				deleteOp(peephole, op);
+				deleteOp(peephole, next);
+				deleteOp(peephole, after);
+				return true;
+			}
+		}
+		if (nextInstruction != OP_EXIT && afterInstruction != OP_EXIT && isConstantOp(peephole, next, &right) &&
+			foldBinary(afterInstruction, value, right, &result) && replaceWithConstant(peephole, op, result)) {
+			deleteOp(peephole, next);
+			deleteOp(peephole, after);
+			return true;
+		}
+		return false;
+	}
+
+	switch (instruction)
+	{
+	case OP_GET_LOCAL:
+	{
+		//'x = x + k' as a statement, where k is a number, adds to the slot
+		//in place. It is written over the OP_CONSTANT too.
+		int set = after < peephole->count ? nextOp(peephole, after) : after;
+		int pop = set < peephole->count ? nextOp(peephole, set) : set;
+		if (nextInstruction == OP_CONSTANT && afterInstruction == OP_ADD && pop < peephole->count &&
+			ops[set].jumps == 0 && ops[pop].jumps == 0 && opcodeAt(peephole, set) == OP_SET_LOCAL && opcodeAt(peephole, pop) == OP_POP &&
+			code[ops[set].offset + 1] == code[ops[op].offset + 1] && IS_NUMBER(currentChunk()->constants.values[code[ops[next].offset + 1]])) {
+			uint8_t constant = code[ops[next].offset + 1];
+			deleteOp(peephole, next);
+			deleteOp(peephole, after);
+			deleteOp(peephole, set);
+			deleteOp(peephole, pop);
+			code[ops[op].offset] = OP_INC_LOCAL;
+			code[ops[op].offset + 2] = constant;
+			ops[op].room = ops[next].offset + ops[next].room - ops[op].offset;
+			ops[op].length = 3;
+			return true;
+		}
+		if (vm.registerCode && lowerToRegisters(peephole, op)) return true;
+	}
+	//Fall through.
+	case OP_GET_UPVALUE:
+		if (nextInstruction != OP_POP) return false;
+		deleteOp(peephole, op);
+		deleteOp(peephole, next);
+		return true;
+
+	case OP_LESS:
+	case OP_LESS_EQUAL:
+	case OP_GREATER:
+	case OP_GREATER_EQUAL:
+	{
+		//A comparison only branched on, with the condition popped on both
+		//paths, becomes a single compare and branch. The pop the jump lands
+		//on must not be reachable any other way.
+		if (nextInstruction != OP_JUMP_IF_FALSE || afterInstruction != OP_POP) return false;
+		int target = resolveTarget(peephole, ops[next].target);
+		if (target == peephole->count || opcodeAt(peephole, target) != OP_POP || ops[target].jumps != 1) return false;
+		int before = previousOp(peephole, target);
+		if (before < 0 || !endsBlock(opcodeAt(peephole, before))) return false;
+
+		static const uint8_t fused[] = { OP_JUMP_IF_NOT_LESS, OP_JUMP_IF_NOT_LESS_EQUAL, OP_JUMP_IF_NOT_GREATER, OP_JUMP_IF_NOT_GREATER_EQUAL };
+		int index = instruction == OP_LESS ? 0 : instruction == OP_LESS_EQUAL ? 1 : instruction == OP_GREATER ? 2 : 3;
+		code[ops[next].offset] = fused[index];
+		deleteOp(peephole, op);
+		deleteOp(peephole, after);
+		deleteOp(peephole, target);
+		return true;
+	}
+
+	case OP_SET_LOCAL:
+	case OP_SET_UPVALUE:
+	case OP_SET_GLOBAL:
+	{
+		//The value stored is still on the stack, there is no need to pop it
+		//and read it back.
+		uint8_t getOp = instruction == OP_SET_LOCAL ? OP_GET_LOCAL : instruction == OP_SET_UPVALUE ? OP_GET_UPVALUE : OP_GET_GLOBAL;
+		if (nextInstruction != OP_POP || afterInstruction != getOp) return false;
+		if (memcmp(&code[ops[op].offset + 1], &code[ops[after].offset + 1], ops[op].length - 1) != 0) return false;
+		deleteOp(peephole, next);
+		deleteOp(peephole, after);
+		return true;
+	}
+
+	case OP_JUMP:
+	case OP_JUMP_IF_FALSE:
+	case OP_JUMP_IF_NOT_LESS:
+	case OP_JUMP_IF_NOT_LESS_EQUAL:
+	case OP_JUMP_IF_NOT_GREATER:
+	case OP_JUMP_IF_NOT_GREATER_EQUAL:
+	case OP_JUMP_IF_NOT_LESS_RR:
+	case OP_JUMP_IF_NOT_LESS_EQUAL_RR:
+	case OP_JUMP_IF_NOT_GREATER_RR:
+	case OP_JUMP_IF_NOT_GREATER_EQUAL_RR:
+	case OP_JUMP_IF_NOT_LESS_RK:
+	case OP_JUMP_IF_NOT_LESS_EQUAL_RK:
+	case OP_JUMP_IF_NOT_GREATER_RK:
+	case OP_JUMP_IF_NOT_GREATER_EQUAL_RK:
+	{
+		int target = resolveTarget(peephole, ops[op].target);
+		int skipped = next;
+		while (skipped < target && !ops[skipped].isLive) skipped = nextOp(peephole, skipped);
+		//Compare and branches pop their operands, they can't just go.
+		if (skipped == target && !isCompareJump(instruction)) {
+			//Conditional jumps leave the condition alone, so either kind
+			//can go when all they skip is dead code. That has to go with
+			//it, or it would be reached by falling through.
+			for (int dead = next; dead < target; dead = nextOp(peephole, dead)) deleteOp(peephole, dead);
+			deleteOp(peephole, op);
+			return true;
+		}
+		if (target == peephole->count) return false;
+
+		uint8_t targetInstruction = opcodeAt(peephole, target);
+		if (instruction == OP_JUMP && targetInstruction == OP_RETURN) {
+			code[ops[op].offset] = OP_RETURN;
+			ops[op].length = 1;
+			ops[op].target = -1;
+			return true;
+		}
+
+		//A jump to a jump can go straight to where that one goes, as can a
+		//conditional jump to one testing the same value. Distances are
+		//checked against the unoptimised chunk, which is only ever longer.
+		if (targetInstruction != OP_JUMP && !(instruction == OP_JUMP_IF_FALSE && targetInstruction == OP_JUMP_IF_FALSE)) return false;
+		int threaded = resolveTarget(peephole, ops[target].target);
+		if (ops[threaded].offset - ops[op].offset - ops[op].length > UINT16_MAX) return false;
+		ops[op].target = threaded;
+		ops[threaded].jumps++;
+		return true;
+	}
+
+	default:
+		return false;
+	}
+}
+
+//Folds constant expressions, threads jumps, drops unreachable code and
+//pushes that are popped straight away. Runs once the whole function has
+//been compiled, before anything could have quickened or cached it.
+static void optimizeChunk()
+{
+	Chunk* chunk = currentChunk();
+	Peephole peephole;
+	peephole.count = 0;
+	for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) {
+		peephole.count++;
+	}
+
+	peephole.ops = ALLOCATE(PeepholeOp, peephole.count + 1);
+	int* opAt = ALLOCATE(int, chunk->count + 1);
+	int op = 0;
+	for (int offset = 0; offset < chunk->count; op++) {
+		PeepholeOp* instruction = &peephole.ops[op];
+		instruction->offset = offset;
+		instruction->length = instructionLength(chunk, offset);
+		instruction->room = instruction->length;
+		instruction->isDeleted = false;
+		opAt[offset] = op;
+		offset += instruction->length;
+	}
+	PeepholeOp* end = &peephole.ops[peephole.count];
+	end->offset = chunk->count;
+	end->length = 0;
+	end->target = -1;
+	end->isDeleted = false;
+	opAt[chunk->count] = peephole.count;
+
+	for (op = 0; op < peephole.count; op++) {
+		PeepholeOp* instruction = &peephole.ops[op];
+		uint8_t* code = &chunk->code[instruction->offset];
+		switch (code[0])
+		{
+		case OP_JUMP:
+		case OP_JUMP_IF_FALSE:
+		case OP_JUMP_IF_NOT_LESS:
+		case OP_JUMP_IF_NOT_LESS_EQUAL:
+		case OP_JUMP_IF_NOT_GREATER:
+		case OP_JUMP_IF_NOT_GREATER_EQUAL:	instruction->target = opAt[instruction->offset + 3 + ((code[1] << 8) | code[2])]; break;
+		case OP_LOOP:			instruction->target = opAt[instruction->offset + 3 - ((code[1] << 8) | code[2])]; break;
+		default:				instruction->target = -1; break;
+		}
+	}
+	FREE_ARRAY(int, opAt, chunk->count + 1);
+
+	bool changed;
+	do {
+		findLiveOps(&peephole);
+		changed = false;
+		for (op = 0; op < peephole.count; op++) {
+			if (peephole.ops[op].isLive && !peephole.ops[op].isDeleted && simplifyOp(&peephole, op)) changed = true;
+		}
+	} while (changed);
+
+	//Lay out what is left and rewrite the chunk in place, it only shrinks.
+	int* newOffset = ALLOCATE(int, peephole.count + 1);
+	int newCount = 0;
+	for (op = 0; op <= peephole.count; op++) {
+		newOffset[op] = newCount;
+		if (peephole.ops[op].isLive && !peephole.ops[op].isDeleted) newCount += peephole.ops[op].length;
+	}
+
+	uint8_t* code = ALLOCATE(uint8_t, newCount);
+	int* lines = ALLOCATE(int, newCount);
+	for (op = 0; op < peephole.count; op++) {
+		PeepholeOp* instruction = &peephole.ops[op];
+		if (!instruction->isLive || instruction->isDeleted) continue;
+
+		int offset = newOffset[op];
+		memcpy(&code[offset], &chunk->code[instruction->offset], instruction->length);
+		memcpy(&lines[offset], &chunk->lines[instruction->offset], instruction->length * sizeof(int));
+		if (instruction->target >= 0) {
+			//The distance is always the last operand.
+			int target = newOffset[resolveTarget(&peephole, instruction->target)];
+			int end = offset + instruction->length;
+			int distance = code[offset] == OP_LOOP ? end - target : target - end;
+			code[end - 2] = (distance >> 8) & 0xFF;
+			code[end - 1] = distance & 0xFF;
+		}
+	}
+
+	memcpy(chunk->code, code, newCount);
+	memcpy(chunk->lines, lines, newCount * sizeof(int));
+	chunk->count = newCount;
+
+	FREE_ARRAY(uint8_t, code, newCount);
+	FREE_ARRAY(int, lines, newCount);
+	FREE_ARRAY(int, newOffset, peephole.count + 1);
+	FREE_ARRAY(PeepholeOp, peephole.ops, peephole.count + 1);
+}
+
+//Profiles count the instructions superinstructions are made of, so a
+//profiling build leaves them out.
+#ifndef PROFILE_OPCODES
+//Superinstructions in the order superinstructions.h lists them, the ones
+//that save the most first. OP_EXIT ends the list.
+static const uint8_t superinstructions[][3] = {
+#define SUPERINSTRUCTION(name, first, next) { name, first, next },
+#include "superinstructions.h"
+#undef SUPERINSTRUCTION
+	{ OP_EXIT, OP_EXIT, OP_EXIT }
+};
+
+//The instruction the interpreter quickens into 'instruction' and back.
+static uint8_t unquickened(uint8_t instruction)
+{
+	switch (instruction)
+	{
+	case OP_ADD_NUM:
+	case OP_ADD_STR:		return OP_ADD;
+	case OP_SUBTRACT_NUM:	return OP_SUBTRACT;
+	case OP_MULTIPLY_NUM:	return OP_MULTIPLY;
+	case OP_DIVIDE_NUM:		return OP_DIVIDE;
+	case OP_GREATER_NUM:	return OP_GREATER;
+	case OP_LESS_NUM:		return OP_LESS;
+	default:				return instruction;
+	}
+}
+
+//The superinstruction for 'first' followed by 'next', or 'first' if there
+//is none. One that continues into another superinstruction needs exactly
+//that one next. One that continues into a plain instruction takes it in
+//any form: the quickened handlers fall back to the generic ones, and a
+//superinstruction there only adds the knowledge of what comes after it.
+static uint8_t findSuperinstruction(uint8_t first, uint8_t next)
+{
+	for (int i = 0; superinstructions[i][0] != OP_EXIT; i++) {
+		if (superinstructions[i][1] == first && superinstructions[i][2] == next) return superinstructions[i][0];
+	}
+	for (int i = 0; superinstructions[i][0] != OP_EXIT; i++) {
+		uint8_t continuation = superinstructions[i][2];
+		if (superinstructions[i][1] == first && baseOpcode(continuation) == continuation &&
+			unquickened(continuation) == unquickened(baseOpcode(next))) {
+			return superinstructions[i][0];
+		}
+	}
+	return first;
+}
+
+//Relabels instructions with superinstructions. Walking backwards lets the
+//one for a triple build on the pair after it. Every instruction keeps its
+//offset and operands, so jumps into the middle of a sequence still work.
+static void writeSuperinstructions()
+{
+	Chunk* chunk = currentChunk();
+	int count = 0;
+	for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) count++;
+
+	int* offsets = ALLOCATE(int, count + 1);
+	int op = 0;
+	for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) offsets[op++] = offset;
+	offsets[count] = chunk->count;
+
+	for (op = count - 2; op >= 0; op--) {
+		uint8_t* code = &chunk->code[offsets[op]];
+		*code = findSuperinstruction(*code, chunk->code[offsets[op + 1]]);
+	}
+
+	FREE_ARRAY(int, offsets, count + 1);
+}
+#endif
+
+static ObjFunction* endCompiler()
+{
+	emitReturn();
+	ObjFunction* function = current->function;
+	if (!parser.hadError && vm.optimizeBytecode) {
+		optimizeChunk();
+#ifndef PROFILE_OPCODES
+		writeSuperinstructions();
+#endif
+	}
+
+#ifdef DEBUG_PRINT_CODE
+	if (!parser.hadError) {
+		disassembleChunk(currentChunk(), function->name != NULL ? function->name->chars : "<script>");
+	}
+#endif
+
+	current = current->enclosing;
+	return function;
+}
+
+static void beginScope() 
+{
+	current->scopeDepth++;
+}
+
+static void endScope()
+{
+	current->scopeDepth--;
+
+	while (current->localCount > 0 && current->locals[current->localCount - 1].depth > current->scopeDepth)
+	{
+		if (current->locals[current->localCount - 1].isCaptured) {
+			emitByte(OP_CLOSE_UPVALUE);
+		}
+		else {
+			emitByte(OP_POP);
+		}
+		current->localCount--;
+	}
+}
+
+static void expression();
+static void statement();
+static void declaration();
+static uint8_t argumentList();
+static ParseRule *getRule(TokenType type);
+static void parsePrecedence(Precedence precedence);
+static uint8_t identifierConstant(Token* name);
+static uint16_t globalVariable(Token* name);
+
+static void and_(bool canAssign);
+static void or_(bool canAssign);
+
+static void binary(bool canAssign)
+{
+	// Remember the operator.
+	TokenType operatorType = parser.previous.type;
+
+	// Compile the right operand.
+	ParseRule *rule = getRule(operatorType);
+	parsePrecedence((Precedence)(rule->precedence + 1));
+
+	// Emit the operator instruction.
+	switch (operatorType)
+	{
+	case TOKEN_BANG_EQUAL:
+		emitBytes(OP_EQUAL, OP_NOT);
+		break;
+	case TOKEN_EQUAL_EQUAL:
+		emitByte(OP_EQUAL);
+		break;
+	case TOKEN_GREATER:
+		emitByte(OP_GREATER);
+		break;
+	case TOKEN_GREATER_EQUAL:
+		emitByte(OP_GREATER_EQUAL);
+		break;
+	case TOKEN_LESS:
+		emitByte(OP_LESS);
+		break;
+	case TOKEN_LESS_EQUAL:
+		emitByte(OP_LESS_EQUAL);
+		break;
+	case TOKEN_PLUS:
+		emitByte(OP_ADD);
+		break;
+	case TOKEN_MINUS:
+		emitByte(OP_SUBTRACT);
+		break;
+	case TOKEN_STAR:
+		emitByte(OP_MULTIPLY);
+		break;
+	case TOKEN_SLASH:
+		emitByte(OP_DIVIDE);
+		break;
+	case TOKEN_PERCENT:
+		emitByte(OP_MODULO);
+		break;
+	case TOKEN_POWER:
+		emitByte(OP_POWER);
+		break;
+	case TOKEN_LESS_LESS:
+		emitByte(OP_SHIFT_LEFT);
+		break;
+	case TOKEN_GREATER_GREATER:
+		emitByte(OP_SHIFT_RIGHT);
+		break;
+	default:
+		return; // Unreachable.
+	}
+}
+
+static void literal(bool canAssign)
+{
+	switch (parser.previous.type)
+	{
+	case TOKEN_FALSE:
+		emitByte(OP_FALSE);
+		break;
+	case TOKEN_NIL:
+		emitByte(OP_NIL);
+		break;
+	case TOKEN_TRUE:
+		emitByte(OP_TRUE);
+		break;
+	default:
+		return;
+	}
+}
+
+static void call(bool canAssign)
+{
+	uint8_t argCount = argumentList();
+	current->lastCall = currentChunk()->count;
+	emitBytes(OP_CALL, argCount);
+}
+
+static void dot(bool canAssign)
+{
+	consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
+	uint8_t name = identifierConstant(&parser.previous);
+
+	if (canAssign && match(TOKEN_EQUAL)) {
+		expression();
+		emitBytes(OP_SET_PROPERTY, name);
+		emitInlineCache();
+	}
+	else if (match(TOKEN_LEFT_PAREN)) {
+		uint8_t argCount = argumentList();
+		current->lastCall = currentChunk()->count;
+		emitBytes(OP_INVOKE, name);
+		emitByte(argCount);
+		emitInlineCache();
+	}
+	else {
+		emitBytes(OP_GET_PROPERTY, name);
+		emitInlineCache();
+	}
+}
+
+static void grouping(bool canAssign)
+{
+	expression();
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+}
+
+static void number(bool canAssign)
+{
+	double value = strtod(parser.previous.start, NULL);
+	emitConstant(NUMBER_VAL(value));
+}
+
+static void string(bool canAssign)
+{
+	emitConstant(OBJ_VAL(copyString(parser.previous.start + 1, parser.previous.length - 2)));
+}
+
+static void namedVariable(Token name, bool canAssign)
+{
+	uint8_t getOp, setOp;
+	bool isConstant = false;
+	int arg = resolveLocal(current, &name);
+	if (arg != -1) {
+		getOp = OP_GET_LOCAL;
+		setOp = OP_SET_LOCAL;
+		isConstant = current->locals[arg].isConstant;
+	}
+	else if ((arg = resolveUpvalue(current, &name)) != -1) {
+		getOp = OP_GET_UPVALUE;
+		setOp = OP_SET_UPVALUE;
+		isConstant = current->upvalues[arg].isConstant;
+	}
+	else
+	{
+		arg = globalVariable(&name);
+		getOp = OP_GET_GLOBAL;
+		setOp = OP_SET_GLOBAL;
+	}
+	
+	if (match(TOKEN_EQUAL) && canAssign) {
+		// Global constness lives in the slot and is checked at runtime.
+		if (isConstant) error("Can't change the value of a constant.");
+		expression();
+		if (setOp == OP_SET_GLOBAL) emitGlobal(setOp, arg);
+		else emitBytes(setOp, arg);
+	}
+	else if (match(TOKEN_PLUS_PLUS) || match(TOKEN_MINUS_MINUS)) {
+		//Compiled like 'x = x + 1', so it evaluates to the new value. The
+		//optimiser turns the local form into OP_INC_LOCAL.
+		if (isConstant) error("Can't change the value of a constant.");
+		double step = parser.previous.type == TOKEN_PLUS_PLUS ? 1 : -1;
+		if (getOp == OP_GET_GLOBAL) emitGlobal(getOp, arg);
+		else emitBytes(getOp, arg);
+		emitConstant(NUMBER_VAL(step));
+		emitByte(OP_ADD);
+		if (setOp == OP_SET_GLOBAL) emitGlobal(setOp, arg);
+		else emitBytes(setOp, arg);
+	}
+	else {
+		if (getOp == OP_GET_GLOBAL) emitGlobal(getOp, arg);
+		else emitBytes(getOp, arg);
+	}
+}
+
+static void variable(bool canAssign)
+{
+	namedVariable(parser.previous, canAssign);
+}
+
+static Token syntheticToken(const char* text)
+{
+	Token token;
+	token.start = text;
+	token.length = (int)strlen(text);
+	return token;
+}
+
+static void this_(bool canAssign)
+{
+	if (currentClass == NULL) {
+		error("Can't use 'this' outside of a class.");
+		return;
+	}
+	variable(false);
+}
+
+static void super_(bool canAssign)
+{
+	if (currentClass == NULL) {
+		error("Can't use 'super' outside of a class.");
+	}
+	else if (!currentClass->hasSuperClass) {
+		error("Can't use 'super' in a class with no superclass.");
+	}
+
+	consume(TOKEN_DOT, "Expect '.' after 'super'.");
+	consume(TOKEN_IDENTIFIER, "Expect superclass field name.");
+	uint8_t name = identifierConstant(&parser.previous);
+
+	namedVariable(syntheticToken("this"), false);
+
+	if (match(TOKEN_LEFT_PAREN)) {
+		uint8_t argCount = argumentList();
+		namedVariable(syntheticToken("super"), false);
+		current->lastCall = currentChunk()->count;
+		emitBytes(OP_SUPER_INVOKE, name);
+		emitByte(argCount);
+	}
+	else {
+		namedVariable(syntheticToken("super"), false);
+		emitBytes(OP_GET_SUPER, name);
+	}
+}
+
+static void unary(bool canAssign)
+{
+	TokenType operatorType = parser.previous.type;
+
+	// Compile the operand.
+	parsePrecedence(PREC_UNARY);
+
+	// Emit the operator instruction.
+	switch (operatorType)
+	{
+	case TOKEN_BANG:
+		emitByte(OP_NOT);
+		break;
+	case TOKEN_MINUS:
+		emitByte(OP_NEGATE);
+		break;
+	default:
+		return; // Unreachable.
+	}
+}
+
+static void arrayIndex(bool canAssign)
+{
+	parsePrecedence(PREC_CALL);
+
+	expression();
+	emitByte(OP_GET_ARRAY_INDEX);
+	consume(TOKEN_RIGHT_BRACKET, "Expect ']' after array index.");
+}
+
+ParseRule rules[] = {
+	[TOKEN_LEFT_PAREN] = {grouping, call, PREC_CALL},
+	[TOKEN_RIGHT_PAREN] = {NULL, NULL, PREC_NONE},
+	[TOKEN_LEFT_BRACKET] = {NULL, arrayIndex, PREC_CALL },
+	[TOKEN_RIGHT_BRACKET] = {NULL, NULL, PREC_NONE},
+	[TOKEN_LEFT_BRACE] = {NULL, NULL, PREC_NONE},
+	[TOKEN_RIGHT_BRACE] = {NULL, NULL, PREC_NONE},
+	[TOKEN_COMMA] = {NULL, NULL, PREC_NONE},
+	[TOKEN_DOT] = {NULL, dot, PREC_CALL},
+	[TOKEN_MINUS] = {unary, binary, PREC_TERM},
+	[TOKEN_MINUS_MINUS] = {NULL, NULL, PREC_NONE},
+	[TOKEN_PLUS] = {NULL, binary, PREC_TERM},
+	[TOKEN_PLUS_PLUS] = {NULL, NULL, PREC_NONE},
+	[TOKEN_SEMICOLON] = {NULL, NULL, PREC_NONE},
+	[TOKEN_SLASH] = {NULL, binary, PREC_FACTOR},
+	[TOKEN_STAR] = {NULL, binary, PREC_FACTOR},
+	[TOKEN_PERCENT] = {NULL, binary,  PREC_FACTOR},
+	[TOKEN_POWER] = {NULL, binary, PREC_POWER},
+	[TOKEN_BANG] = {unary, NULL, PREC_NONE},
+	[TOKEN_BANG_EQUAL] = {NULL, binary, PREC_EQUALITY},
+	[TOKEN_EQUAL] = {NULL, NULL, PREC_NONE},
+	[TOKEN_EQUAL_EQUAL] = {NULL, binary, PREC_EQUALITY},
+	[TOKEN_GREATER] = {NULL, binary, PREC_COMPARISON},
+	[TOKEN_GREATER_EQUAL] = {NULL, binary, PREC_COMPARISON},
+	[TOKEN_LESS] = {NULL, binary, PREC_COMPARISON},
+	[TOKEN_LESS_EQUAL] = {NULL, binary, PREC_COMPARISON},
+	[TOKEN_LESS_LESS] = {NULL, binary, PREC_FACTOR},
+	[TOKEN_GREATER_GREATER] = {NULL, binary, PREC_FACTOR},
+	[TOKEN_IDENTIFIER] = {variable, NULL, PREC_NONE},
+	[TOKEN_STRING] = {string, NULL, PREC_NONE},
+	[TOKEN_NUMBER] = {number, NULL, PREC_NONE},
+	[TOKEN_AND] = {NULL, and_, PREC_AND},
+	[TOKEN_CLASS] = {NULL, NULL, PREC_NONE},
+	[TOKEN_ELSE] = {NULL, NULL, PREC_NONE},
+	[TOKEN_FALSE] = {literal, NULL, PREC_NONE},
+	[TOKEN_FOR] = {NULL, NULL, PREC_NONE},
+	[TOKEN_FUN] = {NULL, NULL, PREC_NONE},
+	[TOKEN_IF] = {NULL, NULL, PREC_NONE},
+	[TOKEN_NIL] = {literal, NULL, PREC_NONE},
+	[TOKEN_OR] = {NULL, or_, PREC_OR},
+	[TOKEN_PRINT] = {NULL, NULL, PREC_NONE},
+	[TOKEN_RETURN] = {NULL, NULL, PREC_NONE},
+	[TOKEN_SUPER] = {super_, NULL, PREC_NONE},
+	[TOKEN_THIS] = {this_, NULL, PREC_NONE},
+	[TOKEN_TRUE] = {literal, NULL, PREC_NONE},
+	[TOKEN_VAR] = {NULL, NULL, PREC_NONE},
+	[TOKEN_CONST] = {NULL, NULL, PREC_NONE},
+	[TOKEN_WHILE] = {NULL, NULL, PREC_NONE},
+	[TOKEN_ERROR] = {NULL, NULL, PREC_NONE},
+	[TOKEN_EXIT] = {exit, NULL, PREC_NONE },
+	[TOKEN_EOF] = {NULL, NULL, PREC_NONE},
+};
+
+static void parsePrecedence(Precedence precedence)
+{
+	advance();
+	ParseFn prefixRule = getRule(parser.previous.type)->prefix;
+	if (prefixRule == NULL)
+	{
+		error("Expect expression.");
+		return;
+	}
+
+	bool canAssign = precedence <= PREC_ASSIGNMENT;
+	prefixRule(canAssign);
+
+	while (precedence <= getRule(parser.current.type)->precedence)
+	{
+		advance();
+		ParseFn infixRule = getRule(parser.previous.type)->infix;
+		infixRule(canAssign);
+	}
+	
+	if (canAssign && match(TOKEN_EQUAL)) {
+		error("Invalid assignment target.");
+	}
+}
+
+static uint8_t identifierConstant(Token* name) 
+{
+	return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
+}
+
+static uint16_t globalVariable(Token* name)
+{
+	int slot = globalSlot(copyString(name->start, name->length));
+	if (slot > UINT16_MAX)
+	{
+		error("Too many global variables.");
+		return 0;
+	}
+
+	return (uint16_t)slot;
+}
+
+static void addLocal(Token name)
+{
+	if (current->localCount == UINT8_COUNT) {
+		error("Too many local variables in function.");
+		return;
+	}
+
+	Local* local = &current->locals[current->localCount++];
+	local->name = name; 
+	local->depth = -1;
+	local->isCaptured = false;
+	local->isConstant = false;
+}
+
+static bool identifiersEqual(Token* a, Token* b)
+{
+	if (a->length != b->length) return false;
+	return memcmp(a->start, b->start, a->length) == 0;
+}
+
+int resolveLocal(Compiler* compiler, Token* name)
+{
+	for (int i = compiler->localCount - 1; i >= 0; i--) {
+		Local* local = &compiler->locals[i];
+		if (identifiersEqual(name, &local->name)) {
+			if (local->depth == -1) {
+				error("Can't read local variable in its own initializer.");
+			}
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal, bool isConstant)
+{
+	int upvalueCount = compiler->function->upvalueCount;
+
+	for (int i = 0; i < upvalueCount; i++) {
+		Upvalue* upvalue = &compiler->upvalues[i];
+		if (upvalue->index == index && upvalue->isLocal == isLocal) {
+			return i;
+		}
+	}
+
+	if (upvalueCount == UINT8_COUNT) {
+		error("Too many closure variables in function.");
+		return 0;
+	}
+
+	compiler->upvalues[upvalueCount].isLocal = isLocal;
+	compiler->upvalues[upvalueCount].index = index;
+	compiler->upvalues[upvalueCount].isConstant = isConstant;
+	return compiler->function->upvalueCount++;
+}
+
+int resolveUpvalue(Compiler* compiler, Token* name)
+{
+	if (compiler->enclosing == NULL) return -1;
+
+	int local = resolveLocal(compiler->enclosing, name);
+	if (local != -1) {
+		Local* captured = &compiler->enclosing->locals[local];
+		captured->isCaptured = true;
+		return addUpvalue(compiler, (uint8_t)local, true, captured->isConstant);
+	}
+
+	int upvalue = resolveUpvalue(compiler->enclosing, name);
+	if (upvalue != -1) {
+		return addUpvalue(compiler, (uint8_t)upvalue, false, compiler->enclosing->upvalues[upvalue].isConstant);
+	}
+
+	return -1;
+}
+
+static void declareVariable()
+{
+	// Global variables are implicitly declared.
+	if (current->scopeDepth == 0) return;
+
+	Token* name = &parser.previous;
+	for (int i = current->localCount - 1; i >= 0; i--) {
+		Local* local = &current->locals[i];
+		if (local->depth != -1 && local->depth < current->scopeDepth) {
+			break;
+		}
+
+		if (identifiersEqual(name, &local->name)) {
+			error("Already variable with this name in this scope.");
+		}
+	}
+
+	addLocal(*name);
+}
+
+static uint16_t parseVariable(const char* errorMessage) 
+{
+	consume(TOKEN_IDENTIFIER, errorMessage);
+
+	declareVariable();
+	if (current->scopeDepth > 0) return 0;
+
+	return globalVariable(&parser.previous);
+}
+
+static void markInitialized(bool isConstant)
+{
+	if (current->scopeDepth == 0) return;
+	Local* local = &current->locals[current->localCount - 1];
+	local->depth = current->scopeDepth;
+	local->isConstant = isConstant;
+}
+
+static void defineVariable(uint16_t global, bool isConstant) 
+{
+	if (current->scopeDepth > 0) {
+		markInitialized(isConstant);
+		return;
+	}
+
+	if (isConstant) {
+		emitGlobal(OP_DEFINE_CONSTANT, global);
+	}
+	else
+	{
+		emitGlobal(OP_DEFINE_GLOBAL, global);
+	}
+}
+
+static void defineArray(uint16_t* globals, bool isConstant)
+{
+	if (current->scopeDepth > 0) {
+		markInitialized(isConstant);
+		return;
+	}
+
+	if (isConstant) {
+		emitGlobal(OP_DEFINE_CONSTANT, *globals);
+	}
+	else {
+		emitGlobal(OP_DEFINE_GLOBAL, *globals);
+	}
+}
+
+static uint8_t argumentList()
+{
+	uint8_t argCount = 0;
+	if (!check(TOKEN_RIGHT_PAREN)) {
+		do {
+			expression();
+
+			if (argCount == 255) {
+				error("Can't have more than 255 arguments.");
+			}
+
+			argCount++;
+		} while (match(TOKEN_COMMA));
+	}
+
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+	return argCount;
+}
+
+static void and_(bool canAssign)
+{
+	int endJump = emitJump(OP_JUMP_IF_FALSE);
+
+	emitByte(OP_POP);
+	parsePrecedence(PREC_AND);
+
+	patchJump(endJump);
+}
+
+static void or_(bool canAssign)
+{
+	int elseJump = emitJump(OP_JUMP_IF_FALSE);
+	int endJump = emitJump(OP_JUMP);
+
+	patchJump(elseJump);
+	emitByte(OP_POP);
+
+	parsePrecedence(PREC_OR);
+	patchJump(endJump);
+}
+
+static ParseRule *getRule(TokenType type)
+{
+	return &rules[type];
+}
+
+static void synchronize()
+{
+	parser.panicMode = false;
+
+	while (parser.current.type != TOKEN_EOF){
+		if (parser.previous.type == TOKEN_SEMICOLON)
+			return;
+
+		switch (parser.current.type)
+		{
+		case TOKEN_CLASS:
+		case TOKEN_FUN:
+		case TOKEN_VAR:
+		case TOKEN_CONST:
+		case TOKEN_FOR:
+		case TOKEN_IF:
+		case TOKEN_WHILE:
+		case TOKEN_PRINT:
+		case TOKEN_RETURN:
+			return;
+
+		default:
+			//do Nothing
+			;
+		}
+
+		advance();
+	}
+}
+
+static void expression()
+{
+	parsePrecedence(PREC_ASSIGNMENT);
+}
+
+static void arrayStatement()
+{
+	do {
+		expression();
+	} while (match(TOKEN_COMMA));
+
+	consume(TOKEN_RIGHT_BRACKET, "Expect ']' after array expression.");
+}
+
+static void block()
+{
+	while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF))
+	{
+		declaration();
+	} 
+	consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+}
+
+static void function(FunctionType type)
+{
+	Compiler compiler;
+	initCompiler(&compiler, type);
+	beginScope();
+
+	//Compile the parameter list.
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+	if (!check(TOKEN_RIGHT_PAREN)) {
+		do {
+			current->function->arity++;
+			if (current->function->arity > 255) {
+				errorAtCurrent("Can't have more than 255 parameters.");
+			}
+
+			bool isConstant = false;
+			if (match(TOKEN_CONST)) {
+				isConstant = true;
+			}
+
+			uint16_t paramConstant = parseVariable("Expect parameter name.");
+			defineVariable(paramConstant, isConstant);
+		} while (match(TOKEN_COMMA));
+	}
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+
+	//The body.
+	consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+	block();
+
+	//Create the function object.
+	ObjFunction* function = endCompiler();
+	emitBytes(OP_CLOSURE, makeConstant(OBJ_VAL(function)));
+
+	for (int i = 0; i < function->upvalueCount; i++) {
+		emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
+		emitByte(compiler.upvalues[i].index);
+	}
+}
+
+static void method()
+{
+	consume(TOKEN_IDENTIFIER, "Expect method name.");
+	uint8_t constant = identifierConstant(&parser.previous);
+
+	FunctionType type = TYPE_METHOD;
+	if (parser.previous.length == 4 && memcmp(parser.previous.start, "init", 4) == 0) {
+		type = TYPE_INITIALIZER;
+	}
+
+	function(type);
+	emitBytes(OP_METHOD, constant);
+}
+
+static void classDeclaration()
+{
+	consume(TOKEN_IDENTIFIER, "Expect class name.");
+	Token className = parser.previous;
+	uint8_t nameConstant = identifierConstant(&parser.previous);
+	declareVariable();
+
+	emitBytes(OP_CLASS, nameConstant);
+	defineVariable(current->scopeDepth > 0 ? 0 : globalVariable(&className), true);
+
+	ClassCompiler classCompiler;
+	classCompiler.name = parser.previous;
+	classCompiler.hasSuperClass = false;
+	classCompiler.enclosing = currentClass;
+	currentClass = &classCompiler;
+
+	if (match(TOKEN_LESS)) {
+		consume(TOKEN_IDENTIFIER, "Expect superclass name.");
+		variable(false);
+
+		if (identifiersEqual(&className, &parser.previous)) {
+			error("A class cannot inherit from itself.");
+		}
+
+		beginScope();
+		addLocal(syntheticToken("super"));
+		defineVariable(0, true);
+
+		namedVariable(className, false);
+		emitByte(OP_INHERIT);
+		classCompiler.hasSuperClass = true;
+	}
+
+	namedVariable(className, false);
+	consume(TOKEN_LEFT_BRACE, "Expect '{' before class body.");
+
+	while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
+		method();
+	}
+
+	consume(TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
+	emitByte(OP_POP);
+
+	if (classCompiler.hasSuperClass) {
+		endScope();
+	}
+
+	currentClass = currentClass->enclosing;
+}
+
+static void funDeclaration()
+{
+	uint16_t global = parseVariable("Expect function name.");
+	markInitialized(false);
+	function(TYPE_FUNCTION);
+	defineVariable(global, false);
+}
+
+static void varDeclaration(bool isConstant) 
+{
+	uint16_t global = parseVariable("Expect variable name.");
+
+	if (match(TOKEN_EQUAL)) {
+		if (match(TOKEN_LEFT_BRACKET)) {
+			arrayStatement();
+		}
+		else {
+			expression();
+		}
+	}
+	else {
+		emitByte(OP_NIL);
+	}
+	consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
+
+	defineVariable(global, isConstant);
+} 
+
+static void printStatement() 
+{
+	expression();
+	consume(TOKEN_SEMICOLON, "Expect ';' after value.");
+	emitByte(OP_PRINT);
+}
+
+static void returnStatement()
+{
+	if (current->type == TYPE_SCRIPT) {
+		error("Can't return from top-level code.");
+	}
+
+	if (match(TOKEN_SEMICOLON)) {
+		emitReturn();
+	}
+	else {
+		if (current->type == TYPE_INITIALIZER) {
+			error("Can't return a value from an initializer.");
+		}
+
+		Chunk* chunk = currentChunk();
+		int start = chunk->count;
+		expression();
+		consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
+
+		//A call that is the last thing the value needs is in tail position.
+		//The return stays behind it for callees that don't reuse the frame,
+		//and for 'and'/'or' jumping past the call. Calls from before the
+		//value can only line up with its end by accident.
+		int lastCall = current->lastCall;
+		if (lastCall >= start && lastCall < chunk->count && lastCall + instructionLength(chunk, lastCall) == chunk->count) {
+			switch (chunk->code[lastCall])
+			{
+			case OP_CALL: chunk->code[lastCall] = OP_TAIL_CALL; break;
+			case OP_INVOKE: chunk->code[lastCall] = OP_TAIL_INVOKE; break;
+			case OP_SUPER_INVOKE: chunk->code[lastCall] = OP_TAIL_SUPER_INVOKE; break;
+			}
+		}
+		emitByte(OP_RETURN);
+	}
+}
+
+static void breakStatement()
+{
+	emitBreak();
+	consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
+}
+
+static void whileStatement()
+{
+	int loopStart = currentChunk()->count;
+
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
+	expression();
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+	int exitJump = emitJump(OP_JUMP_IF_FALSE);
+
+	emitByte(OP_POP);
+	statement();
+	emitLoop(loopStart);
+
+	patchJump(exitJump);
+	emitByte(OP_POP);
+}
+
+static void expressionStatement() 
+{
+	expression();
+	consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
+	emitByte(OP_POP);
+}
+
+static void ifStatement()
+{
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
+	expression();
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+	int thenJump = emitJump(OP_JUMP_IF_FALSE);
+	emitByte(OP_POP);
+	statement();
+
+	int elseJump = emitJump(OP_JUMP);
+
+	patchJump(thenJump);
+	emitByte(OP_POP);
+
+	if (match(TOKEN_ELSE)) statement();
+	patchJump(elseJump);
+}
+
+static void forStatement()
+{
+	beginScope();
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
+	if (match(TOKEN_SEMICOLON)) {
+
+	}
+	else if (match(TOKEN_VAR)) {
+		varDeclaration(false);
+	}
+	else if (match(TOKEN_CONST)) {
+		varDeclaration(true);
+	}
+	else {
+		expressionStatement();
+	}
+
+	int loopStart = currentChunk()->count;
+	int exitJump = -1;
+	if (!match(TOKEN_SEMICOLON)) {
+		expression();
+		consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
+
+		//Jump out of the loop if the condition is false.
+		exitJump = emitJump(OP_JUMP_IF_FALSE);
+		emitByte(OP_POP);
+	}
+	
+	//The increment is compiled here but moved after the body, so each
+	//iteration runs straight through instead of jumping over it and back.
+	uint8_t* increment = NULL;
+	int* incrementLines = NULL;
+	int incrementLength = 0;
+	if (!match(TOKEN_RIGHT_PAREN)) {
+		Chunk* chunk = currentChunk();
+		int incrementStart = chunk->count;
+		
+		expression();
+		emitByte(OP_POP);
+		consume(TOKEN_RIGHT_PAREN, "Expect ')' after for args.");
+
+		incrementLength = chunk->count - incrementStart;
+		increment = ALLOCATE(uint8_t, incrementLength);
+		incrementLines = ALLOCATE(int, incrementLength);
+		memcpy(increment, chunk->code + incrementStart, incrementLength);
+		memcpy(incrementLines, chunk->lines + incrementStart, incrementLength * sizeof(int));
+		chunk->count = incrementStart;
+		//A call in the increment is no longer where it was compiled.
+		current->lastCall = -1;
+	}
+
+	statement();
+
+	if (increment != NULL) {
+		for (int i = 0; i < incrementLength; i++) {
+			writeChunk(currentChunk(), increment[i], incrementLines[i]);
+		}
+		FREE_ARRAY(uint8_t, increment, incrementLength);
+		FREE_ARRAY(int, incrementLines, incrementLength);
+	}
+
+	emitLoop(loopStart);
+
+	if (exitJump != -1) {
+		patchJump(exitJump);
+		emitByte(OP_POP); // Condition.
+	}
+
+	endScope();
+}
+
+static void declaration()
+{
+	if (match(TOKEN_CLASS)) {
+		classDeclaration();
+	}
+	else if (match(TOKEN_FUN)) {
+		funDeclaration();
+	} 
+	else if (match(TOKEN_VAR)) {
+		varDeclaration(false);
+	}
+	else if (match(TOKEN_CONST)) {
+		varDeclaration(true);
+	}
+	else
+	{
+		statement();
+	}
+
+	if (parser.panicMode)
+		synchronize();
+}
+
+static void statement() 
+{
+	if (match(TOKEN_PRINT)) {
+		printStatement();
+	} 
+	else if (match(TOKEN_IF)) {
+		ifStatement();
+	} 
+	else if (match(TOKEN_RETURN)) {
+		returnStatement();
+	}
+	else if (match(TOKEN_BREAK)) {
+		breakStatement();
+	}
+	else if (match(TOKEN_WHILE)) {
+		whileStatement();
+	}
+	else if (match(TOKEN_FOR)) {
+		forStatement();
+	}
+	else if (match(TOKEN_LEFT_BRACE)) {
+		beginScope();
+		block();
+		endScope();
+	}
+	else {
+		expressionStatement();
+	}
+}
+
+ObjFunction* compile(const char *source)
+{
+	initScanner(source);
+	Compiler compiler;
+	initCompiler(&compiler, TYPE_SCRIPT);
+	//compilingChunk = chunk;
+
+	parser.hadError = false;
+	parser.panicMode = false;
+
+	advance();
+	
+	while (!match(TOKEN_EOF)) {
+		declaration();
+	}
+
+	ObjFunction* function = endCompiler();
+	return parser.hadError ? NULL : function;
+}
+
+void markCompilerRoots()
+{
+	Compiler* compiler = current;
+	while (compiler != NULL) {
+		markObject((Obj*)compiler->function);
+		compiler = compiler->enclosing;
+	}
+}
+
 //class A {out() {print "works!";}} class B < A {init() {super.out();}} let b = B();
\ No newline at end of file
@@ -1,10 +1,10 @@
-#ifndef cspydr_compiler_h
-#define cspydr_compiler_h
-
-#include "object.h"
-#include "vm.h"
-
-ObjFunction* compile(const char* source);
-void markCompilerRoots();
-
+#ifndef cspydr_compiler_h
+#define cspydr_compiler_h
+
+#include "object.h"
+#include "vm.h"
+
+ObjFunction* compile(const char* source);
+void markCompilerRoots();
+
 #endif
\ No newline at end of file
@@ -1,194 +1,379 @@
-#include <stdio.h>
-
-#include "debug.h"
-#include "value.h"
-#include "object.h"
-#include "memory.h"
-
-static int simpleInstruction(const char *name, int offset);
-static int constantInstruction(const char *name, Chunk *chunk, int offset);
-static int byteInstruction(const char* name, Chunk* chunk, int offset);
-
-void disassembleChunk(Chunk *chunk, const char *name)
-{
-	if (name == "<script>") {
-		printf("== %s ==\n", name);
-	}
-	else {
-		printf("== <fn %s> ==\n", name);
-	}
-
-	for (int offset = 0; offset < chunk->count;)
-	{
-		offset = disassembleInstruction(chunk, offset);
-	}
-}
-
-int disassembleInstruction(Chunk *chunk, int offset)
-{
-	//"%04d " for dec; "%04hhX " for hex.
-	printf("0x%04hhX ", offset);
-	if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1])
-	{
-		printf("   | ");
-	}
-	else
-	{
-		printf("%4d ", chunk->lines[offset]);
-	}
-
-	uint8_t instruction = chunk->code[offset];
-	switch (instruction)
-	{
-	case OP_RETURN:
-		return simpleInstruction("OP_RETURN", offset);
-	case OP_EXIT:
-		return simpleInstruction("OP_EXIT", offset);
-
-	case OP_CONSTANT:
-		return constantInstruction("OP_CONSTANT", chunk, offset);
-	case OP_NIL:
-		return simpleInstruction("OP_NIL", offset);
-	case OP_TRUE:
-		return simpleInstruction("OP_TRUE", offset);
-	case OP_FALSE:
-		return simpleInstruction("OP_FALSE", offset);
-	case OP_POP:
-		return simpleInstruction("OP_POP", offset);
-	case OP_EQUAL:
-		return simpleInstruction("OP_EQUAL", offset);
-	case OP_GREATER:
-		return simpleInstruction("OP_GREATER", offset);
-	case OP_LESS:
-		return simpleInstruction("OP_LESS", offset);
-	case OP_ADD:
-		return simpleInstruction("OP_ADD", offset);
-	case OP_SUBTRACT:
-		return simpleInstruction("OP_SUBTRACT", offset);
-	case OP_MULTIPLY:
-		return simpleInstruction("OP_MULTIPLY", offset);
-	case OP_DIVIDE:
-		return simpleInstruction("OP_DIVIDE", offset);
-	case OP_MODULO:
-		return simpleInstruction("OP_MODULO", offset);
-	case OP_POWER:
-		return simpleInstruction("OP_POWER", offset);
-	case OP_NOT:
-		return simpleInstruction("OP_NOT", offset);
-	case OP_NEGATE:
-		return simpleInstruction("OP_NEGATE", offset);
-	case OP_PRINT:
-		return simpleInstruction("OP_PRINT", offset);
-	case OP_DEFINE_CONSTANT:
-		return constantInstruction("OP_DEFINE_CONST", chunk, offset);
-	case OP_DEFINE_GLOBAL:
-		return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
-	case OP_GET_GLOBAL:
-		return constantInstruction("OP_GET_GLOBAL", chunk, offset);
-	case OP_SET_GLOBAL:
-		return constantInstruction("OP_SET_GLOBAL", chunk, offset);
-	case OP_GET_UPVALUE:
-		return byteInstruction("OP_GET_UPVALUE", chunk, offset);
-	case OP_SET_UPVALUE:
-		return byteInstruction("OP_SET_UPVALUE", chunk, offset);
-	case OP_GET_PROPERTY:
-		return constantInstruction("OP_GET_PROPERTY", chunk, offset);
-	case OP_SET_PROPERTY:
-		return constantInstruction("OP_SET_PROPERTY", chunk, offset);
-	case OP_CLOSE_UPVALUE:
-		return simpleInstruction("OP_CLOSE_UPVALUE", offset);
-	case OP_GET_LOCAL:
-		return byteInstruction("OP_GET_LOCAL", chunk, offset);
-	case OP_SET_LOCAL:
-		return byteInstruction("OP_SET_LOCAL", chunk, offset);
-	case OP_GET_SUPER:
-		return constantInstruction("OP_GET_SUPER", chunk, offset);
-	case OP_SUPER_INVOKE:
-		return invokeInstruction("OP_SUPER_INVOKE", chunk, offset);
-	case OP_SHIFT_LEFT:
-		return simpleInstruction("OP_BINARY_SHIFT", offset);
-	case OP_SHIFT_RIGHT:
-		return simpleInstruction("OP_BINARY_SHIFT", offset);
-	case OP_JUMP:
-		return jumpInstruction("OP_JUMP", 1, chunk, offset);
-	case OP_JUMP_IF_FALSE:
-		return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
-	case OP_LOOP:
-		return jumpInstruction("OP_LOOP", -1, chunk, offset);
-	case OP_CALL:
-		return byteInstruction("OP_CALL", chunk, offset);
-	case OP_INVOKE:
-		return invokeInstruction("OP_INVOKE", chunk, offset);
-	case OP_INHERIT:
-		return simpleInstruction("OP_INHERIT", offset);
-	case OP_METHOD:
-		return constantInstruction("OP_METHOD", chunk, offset);
-	case OP_CLOSURE:
-	{
-		offset++;
-		uint8_t constant = chunk->code[offset++];
-		printf("%-16s %4d ", "OP_CLOSURE", constant);
-		printValue(chunk->constants.values[constant]);
-		printf("\n");
-
-		ObjFunction* function = AS_FUNCTION(
-			chunk->constants.values[constant]);
-		for (int j = 0; j < function->upvalueCount; j++) {
-			int isLocal = chunk->code[offset++];
-			int index = chunk->code[offset++];
-			printf("%04d      |                     %s %d\n",
-				offset - 2, isLocal ? "local" : "upvalue", index);
-		}
-
-		return offset;
-	}
-	case OP_CLASS:
-		return constantInstruction("OP_CLASS", chunk, offset);
-
-	default:
-		printf("Unknown opcode %d\n", instruction);
-		return offset + 1;
-	}
-}
-
-static int simpleInstruction(const char *name, int offset)
-{
-	printf("%s\n", name);
-	return offset + 1;
-}
-
-static int constantInstruction(const char *name, Chunk *chunk, int offset)
-{
-	uint8_t constant = chunk->code[offset + 1];
-	printf("%-16s %4d '", name, constant);
-	printValue(chunk->constants.values[constant]);
-	printf("'\n");
-	return offset + 2;
-}
-
-static int byteInstruction(const char* name, Chunk* chunk, int offset)
-{
-	uint8_t slot = chunk->code[offset + 1];
-	printf("%-16s %4d\n", name, slot);
-	return offset + 2;
-}
-
-int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset)
-{
-	uint16_t jump = (uint16_t)(chunk->code[offset + 1] << 8);
-	jump |= chunk->code[offset + 2];
-	printf("%-16s 0x%04hhX -> 0x%04hhX\n", name, offset, offset + 3 + sign * jump);
-	return offset + 3;
-}
-
-int invokeInstruction(const char* name, Chunk* chunk, int offset)
-{
-	uint8_t constant = chunk->code[offset + 1];
-	uint8_t argCount = chunk->code[offset + 2];
-	
-	printf("%-16s (%d args) %4d '", name, argCount, constant);
-	printValue(chunk->constants.values[constant]);
-	printf("'\n");
-
-	return offset + 3;
+#include <stdio.h>
+
+#include "debug.h"
+#include "value.h"
+#include "object.h"
+#include "memory.h"
+#include "vm.h"
+
+static int simpleInstruction(const char *name, int offset);
+static int constantInstruction(const char *name, Chunk *chunk, int offset);
+static int globalInstruction(const char* name, Chunk* chunk, int offset);
+static int byteInstruction(const char* name, Chunk* chunk, int offset);
+static int propertyInstruction(const char* name, Chunk* chunk, int offset);
+static int cachedInvokeInstruction(const char* name, Chunk* chunk, int offset);
+static int incrementInstruction(const char* name, Chunk* chunk, int offset);
+static int superinstruction(uint8_t instruction, Chunk* chunk, int offset);
+static int registerInstruction(const char* name, bool isConstant, Chunk* chunk, int offset);
+static int registerJumpInstruction(const char* name, bool isConstant, Chunk* chunk, int offset);
+
+void disassembleChunk(Chunk *chunk, const char *name)
+{
+	if (name == "<script>") {
+		printf("== %s ==\n", name);
+	}
+	else {
+		printf("== <fn %s> ==\n", name);
+	}
+
+	for (int offset = 0; offset < chunk->count;)
+	{
+		offset = disassembleInstruction(chunk, offset);
+	}
+}
+
+int disassembleInstruction(Chunk *chunk, int offset)
+{
+	//"%04d " for dec; "%04hhX " for hex.
+	printf("0x%04hhX ", offset);
+	if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1])
+	{
+		printf("   | ");
+	}
+	else
+	{
+		printf("%4d ", chunk->lines[offset]);
+	}
+
+	uint8_t instruction = chunk->code[offset];
+	if (baseOpcode(instruction) != instruction) return superinstruction(instruction, chunk, offset);
+
+	switch (instruction)
+	{
+	case OP_RETURN:
+		return simpleInstruction("OP_RETURN", offset);
+	case OP_EXIT:
+		return simpleInstruction("OP_EXIT", offset);
+
+	case OP_CONSTANT:
+		return constantInstruction("OP_CONSTANT", chunk, offset);
+	case OP_NIL:
+		return simpleInstruction("OP_NIL", offset);
+	case OP_TRUE:
+		return simpleInstruction("OP_TRUE", offset);
+	case OP_FALSE:
+		return simpleInstruction("OP_FALSE", offset);
+	case OP_POP:
+		return simpleInstruction("OP_POP", offset);
+	case OP_EQUAL:
+		return simpleInstruction("OP_EQUAL", offset);
+	case OP_GREATER:
+		return simpleInstruction("OP_GREATER", offset);
+	case OP_LESS:
+		return simpleInstruction("OP_LESS", offset);
+	case OP_GREATER_EQUAL:
+		return simpleInstruction("OP_GREATER_EQUAL", offset);
+	case OP_LESS_EQUAL:
+		return simpleInstruction("OP_LESS_EQUAL", offset);
+	case OP_ADD:
+		return simpleInstruction("OP_ADD", offset);
+	case OP_SUBTRACT:
+		return simpleInstruction("OP_SUBTRACT", offset);
+	case OP_ADD_NUM:
+		return simpleInstruction("OP_ADD_NUM", offset);
+	case OP_ADD_STR:
+		return simpleInstruction("OP_ADD_STR", offset);
+	case OP_SUBTRACT_NUM:
+		return simpleInstruction("OP_SUBTRACT_NUM", offset);
+	case OP_MULTIPLY_NUM:
+		return simpleInstruction("OP_MULTIPLY_NUM", offset);
+	case OP_DIVIDE_NUM:
+		return simpleInstruction("OP_DIVIDE_NUM", offset);
+	case OP_GREATER_NUM:
+		return simpleInstruction("OP_GREATER_NUM", offset);
+	case OP_LESS_NUM:
+		return simpleInstruction("OP_LESS_NUM", offset);
+	case OP_MULTIPLY:
+		return simpleInstruction("OP_MULTIPLY", offset);
+	case OP_DIVIDE:
+		return simpleInstruction("OP_DIVIDE", offset);
+	case OP_MODULO:
+		return simpleInstruction("OP_MODULO", offset);
+	case OP_POWER:
+		return simpleInstruction("OP_POWER", offset);
+	case OP_NOT:
+		return simpleInstruction("OP_NOT", offset);
+	case OP_NEGATE:
+		return simpleInstruction("OP_NEGATE", offset);
+	case OP_PRINT:
+		return simpleInstruction("OP_PRINT", offset);
+	case OP_DEFINE_CONSTANT:
+		return globalInstruction("OP_DEFINE_CONST", chunk, offset);
+	case OP_DEFINE_GLOBAL:
+		return globalInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+	case OP_GET_GLOBAL:
+		return globalInstruction("OP_GET_GLOBAL", chunk, offset);
+	case OP_SET_GLOBAL:
+		return globalInstruction("OP_SET_GLOBAL", chunk, offset);
+	case OP_GET_UPVALUE:
+		return byteInstruction("OP_GET_UPVALUE", chunk, offset);
+	case OP_SET_UPVALUE:
+		return byteInstruction("OP_SET_UPVALUE", chunk, offset);
+	case OP_GET_PROPERTY:
+		return propertyInstruction("OP_GET_PROPERTY", chunk, offset);
+	case OP_SET_PROPERTY:
+		return propertyInstruction("OP_SET_PROPERTY", chunk, offset);
+	case OP_CLOSE_UPVALUE:
+		return simpleInstruction("OP_CLOSE_UPVALUE", offset);
+	case OP_GET_LOCAL:
+		return byteInstruction("OP_GET_LOCAL", chunk, offset);
+	case OP_SET_LOCAL:
+		return byteInstruction("OP_SET_LOCAL", chunk, offset);
+	case OP_GET_SUPER:
+		return constantInstruction("OP_GET_SUPER", chunk, offset);
+	case OP_SUPER_INVOKE:
+		return invokeInstruction("OP_SUPER_INVOKE", chunk, offset);
+	case OP_TAIL_SUPER_INVOKE:
+		return invokeInstruction("OP_TAIL_SUPER_INVOKE", chunk, offset);
+	case OP_SHIFT_LEFT:
+		return simpleInstruction("OP_BINARY_SHIFT", offset);
+	case OP_SHIFT_RIGHT:
+		return simpleInstruction("OP_BINARY_SHIFT", offset);
+	case OP_JUMP:
+		return jumpInstruction("OP_JUMP", 1, chunk, offset);
+	case OP_JUMP_IF_FALSE:
+		return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+	case OP_LOOP:
+		return jumpInstruction("OP_LOOP", -1, chunk, offset);
+	case OP_JUMP_IF_NOT_LESS:
+		return jumpInstruction("OP_JUMP_IF_NOT_LESS", 1, chunk, offset);
+	case OP_JUMP_IF_NOT_LESS_EQUAL:
+		return jumpInstruction("OP_JUMP_IF_NOT_LESS_EQUAL", 1, chunk, offset);
+	case OP_JUMP_IF_NOT_GREATER:
+		return jumpInstruction("OP_JUMP_IF_NOT_GREATER", 1, chunk, offset);
+	case OP_JUMP_IF_NOT_GREATER_EQUAL:
+		return jumpInstruction("OP_JUMP_IF_NOT_GREATER_EQUAL", 1, chunk, offset);
+	case OP_INC_LOCAL:
+		return incrementInstruction("OP_INC_LOCAL", chunk, offset);
+	case OP_MOVE:
+	{
+		printf("%-16s %4d = %d\n", "OP_MOVE", chunk->code[offset + 1], chunk->code[offset + 2]);
+		return offset + 3;
+	}
+	case OP_ADD_RR:
+		return registerInstruction("OP_ADD_RR", false, chunk, offset);
+	case OP_SUBTRACT_RR:
+		return registerInstruction("OP_SUBTRACT_RR", false, chunk, offset);
+	case OP_MULTIPLY_RR:
+		return registerInstruction("OP_MULTIPLY_RR", false, chunk, offset);
+	case OP_DIVIDE_RR:
+		return registerInstruction("OP_DIVIDE_RR", false, chunk, offset);
+	case OP_ADD_RK:
+		return registerInstruction("OP_ADD_RK", true, chunk, offset);
+	case OP_SUBTRACT_RK:
+		return registerInstruction("OP_SUBTRACT_RK", true, chunk, offset);
+	case OP_MULTIPLY_RK:
+		return registerInstruction("OP_MULTIPLY_RK", true, chunk, offset);
+	case OP_DIVIDE_RK:
+		return registerInstruction("OP_DIVIDE_RK", true, chunk, offset);
+	case OP_JUMP_IF_NOT_LESS_RR:
+		return registerJumpInstruction("OP_JUMP_IF_NOT_LESS_RR", false, chunk, offset);
+	case OP_JUMP_IF_NOT_LESS_EQUAL_RR:
+		return registerJumpInstruction("OP_JUMP_IF_NOT_LESS_EQUAL_RR", false, chunk, offset);
+	case OP_JUMP_IF_NOT_GREATER_RR:
+		return registerJumpInstruction("OP_JUMP_IF_NOT_GREATER_RR", false, chunk, offset);
+	case OP_JUMP_IF_NOT_GREATER_EQUAL_RR:
+		return registerJumpInstruction("OP_JUMP_IF_NOT_GREATER_EQUAL_RR", false, chunk, offset);
+	case OP_JUMP_IF_NOT_LESS_RK:
+		return registerJumpInstruction("OP_JUMP_IF_NOT_LESS_RK", true, chunk, offset);
+	case OP_JUMP_IF_NOT_LESS_EQUAL_RK:
+		return registerJumpInstruction("OP_JUMP_IF_NOT_LESS_EQUAL_RK", true, chunk, offset);
+	case OP_JUMP_IF_NOT_GREATER_RK:
+		return registerJumpInstruction("OP_JUMP_IF_NOT_GREATER_RK", true, chunk, offset);
+	case OP_JUMP_IF_NOT_GREATER_EQUAL_RK:
+		return registerJumpInstruction("OP_JUMP_IF_NOT_GREATER_EQUAL_RK", true, chunk, offset);
+	case OP_CALL:
+		return byteInstruction("OP_CALL", chunk, offset);
+	case OP_TAIL_CALL:
+		return byteInstruction("OP_TAIL_CALL", chunk, offset);
+	case OP_INVOKE:
+		return cachedInvokeInstruction("OP_INVOKE", chunk, offset);
+	case OP_TAIL_INVOKE:
+		return cachedInvokeInstruction("OP_TAIL_INVOKE", chunk, offset);
+	case OP_INHERIT:
+		return simpleInstruction("OP_INHERIT", offset);
+	case OP_METHOD:
+		return constantInstruction("OP_METHOD", chunk, offset);
+	case OP_CLOSURE:
+	{
+		offset++;
+		uint8_t constant = chunk->code[offset++];
+		printf("%-16s %4d ", "OP_CLOSURE", constant);
+		printValue(chunk->constants.values[constant]);
+		printf("\n");
+
+		ObjFunction* function = AS_FUNCTION(
+			chunk->constants.values[constant]);
+		for (int j = 0; j < function->upvalueCount; j++) {
+			int isLocal = chunk->code[offset++];
+			int index = chunk->code[offset++];
+			printf("%04d      |                     %s %d\n",
+				offset - 2, isLocal ? "local" : "upvalue", index);
+		}
+
+		return offset;
+	}
+	case OP_CLASS:
+		return constantInstruction("OP_CLASS", chunk, offset);
+
+	default:
+		printf("Unknown opcode %d\n", instruction);
+		return offset + 1;
+	}
+}
+
+//Shown under its own name with the operands of the instruction it starts
+//with.
+static int superinstruction(uint8_t instruction, Chunk* chunk, int offset)
+{
+	const char* name = "";
+	switch (instruction)
+	{
+#define SUPERINSTRUCTION(super, first, next) case super: name = #super; break;
+#include "superinstructions.h"
+#undef SUPERINSTRUCTION
+	}
+
+	switch (baseOpcode(instruction))
+	{
+	case OP_CONSTANT:
+		return constantInstruction(name, chunk, offset);
+	case OP_GET_LOCAL:
+	case OP_SET_LOCAL:
+	case OP_GET_UPVALUE:
+		return byteInstruction(name, chunk, offset);
+	case OP_GET_GLOBAL:
+	case OP_SET_GLOBAL:
+		return globalInstruction(name, chunk, offset);
+	case OP_INC_LOCAL:
+		return incrementInstruction(name, chunk, offset);
+	default:
+		return simpleInstruction(name, offset);
+	}
+}
+
+static int simpleInstruction(const char *name, int offset)
+{
+	printf("%s\n", name);
+	return offset + 1;
+}
+
+static int constantInstruction(const char *name, Chunk *chunk, int offset)
+{
+	uint8_t constant = chunk->code[offset + 1];
+	printf("%-16s %4d '", name, constant);
+	printValue(chunk->constants.values[constant]);
+	printf("'\n");
+	return offset + 2;
+}
+
+static int globalInstruction(const char* name, Chunk* chunk, int offset)
+{
+	uint16_t slot = (uint16_t)(chunk->code[offset + 1] << 8);
+	slot |= chunk->code[offset + 2];
+	printf("%-16s %4d '%s'\n", name, slot, vm.globalSlots[slot].name->chars);
+	return offset + 3;
+}
+
+static int byteInstruction(const char* name, Chunk* chunk, int offset)
+{
+	uint8_t slot = chunk->code[offset + 1];
+	printf("%-16s %4d\n", name, slot);
+	return offset + 2;
+}
+
+static int propertyInstruction(const char* name, Chunk* chunk, int offset)
+{
+	uint8_t constant = chunk->code[offset + 1];
+	uint16_t cache = (uint16_t)(chunk->code[offset + 2] << 8);
+	cache |= chunk->code[offset + 3];
+	printf("%-16s %4d '", name, constant);
+	printValue(chunk->constants.values[constant]);
+	printf("' (cache %d)\n", cache);
+	return offset + 4;
+}
+
+static int incrementInstruction(const char* name, Chunk* chunk, int offset)
+{
+	uint8_t slot = chunk->code[offset + 1];
+	uint8_t constant = chunk->code[offset + 2];
+	printf("%-16s %4d += '", name, slot);
+	printValue(chunk->constants.values[constant]);
+	printf("'\n");
+	return offset + 3;
+}
+
+//The second operand of the register forms is a slot, or a constant for the
+//_RK ones.
+static void registerOperand(bool isConstant, Chunk* chunk, uint8_t operand)
+{
+	if (!isConstant) {
+		printf("%d", operand);
+		return;
+	}
+	printf("'");
+	printValue(chunk->constants.values[operand]);
+	printf("'");
+}
+
+static int registerInstruction(const char* name, bool isConstant, Chunk* chunk, int offset)
+{
+	printf("%-16s %4d = %d, ", name, chunk->code[offset + 1], chunk->code[offset + 2]);
+	registerOperand(isConstant, chunk, chunk->code[offset + 3]);
+	printf("\n");
+	return offset + 4;
+}
+
+static int registerJumpInstruction(const char* name, bool isConstant, Chunk* chunk, int offset)
+{
+	uint16_t jump = (uint16_t)(chunk->code[offset + 3] << 8);
+	jump |= chunk->code[offset + 4];
+	printf("%-16s %4d, ", name, chunk->code[offset + 1]);
+	registerOperand(isConstant, chunk, chunk->code[offset + 2]);
+	printf(" 0x%04hhX -> 0x%04hhX\n", offset, offset + 5 + jump);
+	return offset + 5;
+}
+
+int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset)
+{
+	uint16_t jump = (uint16_t)(chunk->code[offset + 1] << 8);
+	jump |= chunk->code[offset + 2];
+	printf("%-16s 0x%04hhX -> 0x%04hhX\n", name, offset, offset + 3 + sign * jump);
+	return offset + 3;
+}
+
+int invokeInstruction(const char* name, Chunk* chunk, int offset)
+{
+	uint8_t constant = chunk->code[offset + 1];
+	uint8_t argCount = chunk->code[offset + 2];
+	
+	printf("%-16s (%d args) %4d '", name, argCount, constant);
+	printValue(chunk->constants.values[constant]);
+	printf("'\n");
+
+	return offset + 3;
+}
+
+static int cachedInvokeInstruction(const char* name, Chunk* chunk, int offset)
+{
+	uint8_t constant = chunk->code[offset + 1];
+	uint8_t argCount = chunk->code[offset + 2];
+	uint16_t cache = (uint16_t)(chunk->code[offset + 3] << 8);
+	cache |= chunk->code[offset + 4];
+
+	printf("%-16s (%d args) %4d '", name, argCount, constant);
+	printValue(chunk->constants.values[constant]);
+	printf("' (cache %d)\n", cache);
+
+	return offset + 5;
 }
\ No newline at end of file
@@ -1,9 +1,9 @@
-#ifndef cspydr_debug_h
-#define cspydr_debug_h
-
-#include "chunk.h"
-
-void disassembleChunk(Chunk *chunk, const char *name);
-int disassembleInstruction(Chunk *chunk, int offset);
-
+#ifndef cspydr_debug_h
+#define cspydr_debug_h
+
+#include "chunk.h"
+
+void disassembleChunk(Chunk *chunk, const char *name);
+int disassembleInstruction(Chunk *chunk, int offset);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include <string.h>
+#include <time.h>
+
+#include "gcstats.h"
+#include "memory.h"
+#include "vm.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static const char* typeNames[OBJ_TYPE_COUNT] = {
+	"bound_method",
+	"class",
+	"instance",
+	"function",
+	"string",
+	"native",
+	"closure",
+	"upvalue",
+	"shape"
+};
+
+//Collections called from inside a collection, like the minor one that
+//starts a full cycle, are part of the outer pause.
+static int pauseDepth = 0;
+static double pauseStart = 0;
+
+//Wall clock seconds, which unlike clock() keep counting while the program
+//waits and do not count the time of the collector's other threads.
+double gcClock()
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double)counter.QuadPart / frequency.QuadPart;
+#elif defined(__unix__)
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+void initGcStats(GcStats* stats)
+{
+	memset(stats, 0, sizeof(GcStats));
+	stats->cycleStartTime = gcClock();
+	pauseDepth = 0;
+}
+
+void gcPauseBegin()
+{
+	if (pauseDepth++ == 0) pauseStart = gcClock();
+}
+
+void gcPauseEnd()
+{
+	if (--pauseDepth > 0) return;
+
+	GcStats* stats = &vm.gcStats;
+	double pause = gcClock() - pauseStart;
+	stats->pauseCount++;
+	stats->pauseTime += pause;
+	if (pause > stats->pauseMax) stats->pauseMax = pause;
+
+	int bucket = 0;
+	for (double bound = 1e-6; pause >= bound && bucket < GC_PAUSE_BUCKETS - 1; bound *= 2) {
+		bucket++;
+	}
+	stats->pauseHistogram[bucket]++;
+}
+
+//Called by the collector when a full cycle has swept its last object. The
+//collector fills in the record's nextGC once it has decided on it.
+GcCycleStats* gcCycleEnd()
+{
+	GcStats* stats = &vm.gcStats;
+	size_t allocated = vm.bytesAllocated + stats->bytesFreed;
+	double now = gcClock();
+	//The pause this is called from is not over yet.
+	double pauseTime = stats->pauseTime;
+	if (pauseDepth > 0) pauseTime += now - pauseStart;
+
+	GcCycleStats* cycle = &stats->cycles[stats->fullCollections % GC_CYCLE_HISTORY];
+	cycle->allocated = allocated - stats->cycleStartAllocated;
+	cycle->freed = stats->bytesFreed - stats->cycleStartFreed;
+	cycle->live = vm.bytesAllocated;
+	cycle->duration = now - stats->cycleStartTime;
+	cycle->pauseTime = pauseTime - stats->cycleStartPause;
+	stats->fullCollections++;
+
+	stats->cycleStartAllocated = allocated;
+	stats->cycleStartFreed = stats->bytesFreed;
+	stats->cycleStartPause = pauseTime;
+	stats->cycleStartTime = now;
+	return cycle;
+}
+
+//Upper bound of the histogram bucket the pause at 'share' of the way
+//through the sorted pauses falls in.
+static double pausePercentile(double share)
+{
+	GcStats* stats = &vm.gcStats;
+	int rank = (int)(stats->pauseCount * share);
+	if (rank >= stats->pauseCount) rank = stats->pauseCount - 1;
+
+	int seen = 0;
+	double bound = 1e-6;
+	for (int i = 0; i < GC_PAUSE_BUCKETS - 1; i++, bound *= 2) {
+		seen += stats->pauseHistogram[i];
+		if (seen > rank) return bound < stats->pauseMax ? bound : stats->pauseMax;
+	}
+	return stats->pauseMax;
+}
+
+static int typeIndex(const char* name)
+{
+	for (int i = 0; i < OBJ_TYPE_COUNT; i++) {
+		if (strcmp(name, typeNames[i]) == 0) return i;
+	}
+	return -1;
+}
+
+//Looks up a statistic by the name gc_stat() was given. Times are in
+//seconds, like clock(). The live_ ones walk the heap, and take an object
+//type after a dot to count only that type.
+bool gcStat(const char* name, double* value)
+{
+	GcStats* stats = &vm.gcStats;
+
+	if (strcmp(name, "minor_collections") == 0) *value = stats->minorCollections;
+	else if (strcmp(name, "full_collections") == 0) *value = stats->fullCollections;
+	else if (strcmp(name, "compactions") == 0) *value = stats->compactions;
+	else if (strcmp(name, "pause_count") == 0) *value = stats->pauseCount;
+	else if (strcmp(name, "pause_time") == 0) *value = stats->pauseTime;
+	else if (strcmp(name, "pause_max") == 0) *value = stats->pauseMax;
+	else if (strcmp(name, "pause_p50") == 0) *value = stats->pauseCount > 0 ? pausePercentile(0.5) : 0;
+	else if (strcmp(name, "pause_p99") == 0) *value = stats->pauseCount > 0 ? pausePercentile(0.99) : 0;
+	else if (strcmp(name, "bytes_allocated") == 0) *value = (double)(vm.bytesAllocated + stats->bytesFreed);
+	else if (strcmp(name, "bytes_freed") == 0) *value = (double)stats->bytesFreed;
+	else if (strcmp(name, "heap_bytes") == 0) *value = (double)vm.bytesAllocated;
+	else if (strcmp(name, "next_gc") == 0) *value = (double)vm.nextGC;
+	else if (strcmp(name, "next_minor_gc") == 0) *value = (double)vm.nextMinorGC;
+	else if (strcmp(name, "heap_growth") == 0) *value = vm.heapGrowth;
+	else if (strcmp(name, "nursery_size") == 0) *value = (double)vm.nurserySize;
+	else if (strcmp(name, "step_work") == 0) *value = vm.gcStepWork;
+	else if (strncmp(name, "live_objects", 12) == 0 || strncmp(name, "live_bytes", 10) == 0) {
+		bool isBytes = name[5] == 'b';
+		const char* type = name + (isBytes ? 10 : 12);
+		int only = -1;
+		if (*type == '.') {
+			only = typeIndex(type + 1);
+			if (only < 0) return false;
+		}
+		else if (*type != '\0') {
+			return false;
+		}
+
+		GcCensus census;
+		heapCensus(&census);
+		size_t total = 0;
+		for (int i = 0; i < OBJ_TYPE_COUNT; i++) {
+			if (only < 0 || only == i) total += isBytes ? census.bytes[i] : census.objects[i];
+		}
+		*value = (double)total;
+	}
+	else return false;
+
+	return true;
+}
+
+void printGcStats(FILE* stream)
+{
+	GcStats* stats = &vm.gcStats;
+
+	fprintf(stream, "-- gc stats\n");
+	fprintf(stream, "   %d minor collections, %d full, %d compactions\n", stats->minorCollections, stats->fullCollections, stats->compactions);
+	fprintf(stream, "   %d pauses, %.3f ms in total", stats->pauseCount, stats->pauseTime * 1e3);
+	if (stats->pauseCount > 0) {
+		fprintf(stream, ", p50 %.3f ms, p99 %.3f ms, max %.3f ms", pausePercentile(0.5) * 1e3, pausePercentile(0.99) * 1e3, stats->pauseMax * 1e3);
+	}
+	fprintf(stream, "\n");
+
+	double bound = 1e-6;
+	for (int i = 0; i < GC_PAUSE_BUCKETS; i++, bound *= 2) {
+		if (stats->pauseHistogram[i] == 0) continue;
+
+		if (i == GC_PAUSE_BUCKETS - 1) fprintf(stream, "      >= %10.0f us: %d\n", bound / 2 * 1e6, stats->pauseHistogram[i]);
+		else fprintf(stream, "      <  %10.0f us: %d\n", bound * 1e6, stats->pauseHistogram[i]);
+	}
+
+	fprintf(stream, "   %zu bytes allocated, %zu freed, %zu in use, next gc at %zu\n", vm.bytesAllocated + stats->bytesFreed, stats->bytesFreed, vm.bytesAllocated, vm.nextGC);
+	fprintf(stream, "   heap growth %.2f, nursery %zu bytes, %d objects per slice\n", vm.heapGrowth, vm.nurserySize, vm.gcStepWork);
+
+	if (stats->fullCollections > 0) {
+		fprintf(stream, "   cycle %12s %12s %12s %12s %10s %10s\n", "allocated", "freed", "live", "next gc", "time ms", "pause ms");
+		int first = stats->fullCollections > GC_CYCLE_HISTORY ? stats->fullCollections - GC_CYCLE_HISTORY : 0;
+		for (int i = first; i < stats->fullCollections; i++) {
+			GcCycleStats* cycle = &stats->cycles[i % GC_CYCLE_HISTORY];
+			fprintf(stream, "   %5d %12zu %12zu %12zu %12zu %10.3f %10.3f\n", i + 1, cycle->allocated, cycle->freed, cycle->live, cycle->nextGC, cycle->duration * 1e3, cycle->pauseTime * 1e3);
+		}
+	}
+
+	GcCensus census;
+	heapCensus(&census);
+	fprintf(stream, "   live objects:\n");
+	for (int i = 0; i < OBJ_TYPE_COUNT; i++) {
+		if (census.objects[i] == 0) continue;
+		fprintf(stream, "      %-12s %10zu objects %12zu bytes\n", typeNames[i], census.objects[i], census.bytes[i]);
+	}
+}
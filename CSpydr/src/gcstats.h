@@ -0,0 +1,66 @@
+#ifndef cspydr_gcstats_h
+#define cspydr_gcstats_h
+
+#include <stdio.h>
+
+#include "common.h"
+#include "object.h"
+
+//Pause i took under 2^i microseconds, the last bucket holds everything
+//longer.
+#define GC_PAUSE_BUCKETS 24
+//Full cycles remembered for the report, the oldest is dropped first.
+#define GC_CYCLE_HISTORY 16
+
+#define OBJ_TYPE_COUNT (OBJ_SHAPE + 1)
+
+typedef struct
+{
+	size_t allocated;	//Bytes allocated since the previous cycle ended.
+	size_t freed;
+	size_t live;		//Heap size once the cycle was over.
+	size_t nextGC;
+	double duration;	//Seconds since the previous cycle ended.
+	double pauseTime;	//Seconds the program stood still for it, slices included.
+} GcCycleStats;
+
+//Kept up to date by the collector in every build, read with gc_stat() or
+//printed at exit with --gc-stats.
+typedef struct
+{
+	int minorCollections;
+	int fullCollections;
+	int compactions;
+
+	int pauseCount;
+	double pauseTime;
+	double pauseMax;
+	int pauseHistogram[GC_PAUSE_BUCKETS];
+
+	//Everything ever allocated is bytesAllocated plus this.
+	size_t bytesFreed;
+
+	size_t cycleStartAllocated;
+	size_t cycleStartFreed;
+	double cycleStartPause;
+	double cycleStartTime;
+	GcCycleStats cycles[GC_CYCLE_HISTORY];
+} GcStats;
+
+//Objects not known to be garbage, by type. Bytes include the arrays an
+//object owns, like a string's characters or a function's bytecode.
+typedef struct
+{
+	size_t objects[OBJ_TYPE_COUNT];
+	size_t bytes[OBJ_TYPE_COUNT];
+} GcCensus;
+
+double gcClock();
+void initGcStats(GcStats* stats);
+void gcPauseBegin();
+void gcPauseEnd();
+GcCycleStats* gcCycleEnd();
+bool gcStat(const char* name, double* value);
+void printGcStats(FILE* stream);
+
+#endif
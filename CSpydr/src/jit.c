@@ -0,0 +1,1824 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "jit.h"
+
+#ifdef JIT_ENABLED
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "memory.h"
+
+//A baseline template JIT. Every instruction of a hot function is turned into
+//a fixed piece of x86-64 code: stack, local, global and number operations are
+//emitted inline on the interpreter's own Value stack, everything else calls
+//the matching slow path in vm.c. Branches become native jumps, while calls
+//and returns leave native code so the interpreter can switch frames. Every
+//instruction gets an entry point, so a frame can be resumed anywhere.
+//
+//On top of that hot loops are traced: one iteration is recorded into a typed
+//IR, optimised and compiled into a native loop that leaves through side
+//exits when a guard fails. See the tracing section further down.
+//
+//Register use inside compiled code:
+//  rbx  address of vm.stackTop
+//  r12  slots of the current frame
+//  rax, rcx, rdx, xmm0, xmm1  scratch
+
+typedef enum
+{
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15
+} Register;
+
+typedef enum
+{
+	CC_ALWAYS = -1,
+	CC_BELOW = 0x2,
+	CC_ABOVE_EQUAL = 0x3,
+	CC_EQUAL = 0x4,
+	CC_NOT_EQUAL = 0x5,
+	CC_BELOW_EQUAL = 0x6,
+	CC_ABOVE = 0x7,
+	CC_GREATER = 0xF
+} Condition;
+
+typedef struct
+{
+	int patch;		//Where the rel32 lives.
+	int target;		//Bytecode offset it jumps to.
+} JumpFixup;
+
+typedef struct
+{
+	uint8_t* code;
+	int count;
+	int capacity;
+
+	JumpFixup* fixups;
+	int fixupCount;
+	int fixupCapacity;
+
+	uint32_t* entries;
+	int exitOffset;
+} Assembler;
+
+#define NO_ENTRY UINT32_MAX
+#define VALUE_SIZE ((int)sizeof(Value))
+
+#ifdef NAN_BOXING
+#define NUMBER_OFFSET 0
+#else
+#define NUMBER_OFFSET ((int)offsetof(Value, as.number))
+#endif
+
+static void emitByte(Assembler* as, uint8_t byte)
+{
+	if (as->capacity < as->count + 1) {
+		int oldCapacity = as->capacity;
+		as->capacity = GROW_CAPACITY(oldCapacity);
+		as->code = GROW_ARRAY(uint8_t, as->code, oldCapacity, as->capacity);
+	}
+
+	as->code[as->count++] = byte;
+}
+
+static void emitBytes(Assembler* as, int count, const uint8_t* bytes)
+{
+	for (int i = 0; i < count; i++) emitByte(as, bytes[i]);
+}
+
+static void emitInt(Assembler* as, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) emitByte(as, (uint8_t)(value >> (i * 8)));
+}
+
+static void emitLong(Assembler* as, uint64_t value)
+{
+	for (int i = 0; i < 8; i++) emitByte(as, (uint8_t)(value >> (i * 8)));
+}
+
+static void patchInt(Assembler* as, int offset, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) as->code[offset + i] = (uint8_t)(value >> (i * 8));
+}
+
+static void emitRex(Assembler* as, bool wide, int reg, int base)
+{
+	uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((base & 8) ? 0x01 : 0);
+	if (rex != 0x40) emitByte(as, rex);
+}
+
+//ModRM for [base + disp32], rsp and r12 can only be a base through a SIB byte.
+static void emitMemory(Assembler* as, int reg, int base, int32_t disp)
+{
+	emitByte(as, 0x80 | ((reg & 7) << 3) | (base & 7));
+	if ((base & 7) == RSP) emitByte(as, 0x24);
+	emitInt(as, (uint32_t)disp);
+}
+
+static void movImmediate(Assembler* as, Register reg, uint64_t value)
+{
+	emitRex(as, true, 0, reg);
+	emitByte(as, 0xB8 + (reg & 7));
+	emitLong(as, value);
+}
+
+static void load(Assembler* as, Register reg, Register base, int32_t disp)
+{
+	emitRex(as, true, reg, base);
+	emitByte(as, 0x8B);
+	emitMemory(as, reg, base, disp);
+}
+
+static void store(Assembler* as, Register base, int32_t disp, Register reg)
+{
+	emitRex(as, true, reg, base);
+	emitByte(as, 0x89);
+	emitMemory(as, reg, base, disp);
+}
+
+//add qword [base + disp], imm32
+static void addMemory(Assembler* as, Register base, int32_t disp, int32_t value)
+{
+	emitRex(as, true, 0, base);
+	emitByte(as, 0x81);
+	emitMemory(as, 0, base, disp);
+	emitInt(as, (uint32_t)value);
+}
+
+//cmp dword [base + disp], imm32
+static void compareInt(Assembler* as, Register base, int32_t disp, int32_t value)
+{
+	emitRex(as, false, 0, base);
+	emitByte(as, 0x81);
+	emitMemory(as, 7, base, disp);
+	emitInt(as, (uint32_t)value);
+}
+
+//cmp byte [base + disp], imm8
+static void compareByte(Assembler* as, Register base, int32_t disp, uint8_t value)
+{
+	emitRex(as, false, 0, base);
+	emitByte(as, 0x80);
+	emitMemory(as, 7, base, disp);
+	emitByte(as, value);
+}
+
+//cmp qword [base + disp], imm8
+static void compareLong(Assembler* as, Register base, int32_t disp, int8_t value)
+{
+	emitRex(as, true, 0, base);
+	emitByte(as, 0x83);
+	emitMemory(as, 7, base, disp);
+	emitByte(as, (uint8_t)value);
+}
+
+//sub dword [base + disp], imm32
+static void subtractInt(Assembler* as, Register base, int32_t disp, int32_t value)
+{
+	emitRex(as, false, 0, base);
+	emitByte(as, 0x81);
+	emitMemory(as, 5, base, disp);
+	emitInt(as, (uint32_t)value);
+}
+
+//cmp a, b on full registers.
+static void compareRegisters(Assembler* as, Register a, Register b)
+{
+	emitRex(as, true, b, a);
+	emitByte(as, 0x39);
+	emitByte(as, 0xC0 | ((b & 7) << 3) | (a & 7));
+}
+
+static void loadDouble(Assembler* as, int xmm, Register base, int32_t disp)
+{
+	emitByte(as, 0xF2);
+	emitRex(as, false, xmm, base);
+	emitBytes(as, 2, (uint8_t[]){ 0x0F, 0x10 });
+	emitMemory(as, xmm, base, disp);
+}
+
+static void storeDouble(Assembler* as, Register base, int32_t disp, int xmm)
+{
+	emitByte(as, 0xF2);
+	emitRex(as, false, xmm, base);
+	emitBytes(as, 2, (uint8_t[]){ 0x0F, 0x11 });
+	emitMemory(as, xmm, base, disp);
+}
+
+//addsd/subsd/mulsd/divsd xmm0, xmm1
+static void doubleArithmetic(Assembler* as, uint8_t opcode)
+{
+	emitBytes(as, 4, (uint8_t[]){ 0xF2, 0x0F, opcode, 0xC1 });
+}
+
+//ucomisd xmmA, xmmB
+static void compareDoubles(Assembler* as, int a, int b)
+{
+	emitBytes(as, 4, (uint8_t[]){ 0x66, 0x0F, 0x2E, (uint8_t)(0xC0 | (a << 3) | b) });
+}
+
+//Emits a jump with an empty rel32 and returns where to patch it.
+static int emitJump(Assembler* as, Condition condition)
+{
+	if (condition == CC_ALWAYS) {
+		emitByte(as, 0xE9);
+	}
+	else {
+		emitByte(as, 0x0F);
+		emitByte(as, 0x80 | condition);
+	}
+
+	emitInt(as, 0);
+	return as->count - 4;
+}
+
+static void patchJump(Assembler* as, int patch, int target)
+{
+	patchInt(as, patch, (uint32_t)(target - (patch + 4)));
+}
+
+static void patchJumpHere(Assembler* as, int patch)
+{
+	patchJump(as, patch, as->count);
+}
+
+static void jumpToBytecode(Assembler* as, Condition condition, int target)
+{
+	if (as->fixupCapacity < as->fixupCount + 1) {
+		int oldCapacity = as->fixupCapacity;
+		as->fixupCapacity = GROW_CAPACITY(oldCapacity);
+		as->fixups = GROW_ARRAY(JumpFixup, as->fixups, oldCapacity, as->fixupCapacity);
+	}
+
+	JumpFixup* fixup = &as->fixups[as->fixupCount++];
+	fixup->patch = emitJump(as, condition);
+	fixup->target = target;
+}
+
+static void callHelper(Assembler* as, JitHelper helper, uint8_t* ip)
+{
+	movImmediate(as, RDI, (uint64_t)(uintptr_t)ip);
+	movImmediate(as, RAX, (uint64_t)(uintptr_t)helper);
+	emitBytes(as, 2, (uint8_t[]){ 0xFF, 0xD0 });	//call rax
+	emitBytes(as, 2, (uint8_t[]){ 0x85, 0xC0 });	//test eax, eax
+	patchJump(as, emitJump(as, CC_NOT_EQUAL), as->exitOffset);
+}
+
+static void loadStackTop(Assembler* as)
+{
+	load(as, RAX, RBX, 0);
+}
+
+static void adjustStackTop(Assembler* as, int values)
+{
+	addMemory(as, RBX, 0, values * VALUE_SIZE);
+}
+
+static void copyValue(Assembler* as, Register dst, int32_t dstDisp, Register src, int32_t srcDisp)
+{
+	for (int i = 0; i < VALUE_SIZE; i += 8) {
+		load(as, RCX, src, srcDisp + i);
+		store(as, dst, dstDisp + i, RCX);
+	}
+}
+
+static void storeValue(Assembler* as, Register base, int32_t disp, Value value)
+{
+	uint64_t words[sizeof(Value) / 8];
+	memcpy(words, &value, sizeof(Value));
+
+	for (int i = 0; i < VALUE_SIZE / 8; i++) {
+		movImmediate(as, RCX, words[i]);
+		store(as, base, disp + i * 8, RCX);
+	}
+}
+
+//Stores xmm0 as a number Value.
+static void storeNumber(Assembler* as, Register base, int32_t disp)
+{
+	Value number = NUMBER_VAL(0);
+	uint64_t words[sizeof(Value) / 8];
+	memcpy(words, &number, sizeof(Value));
+
+	for (int i = 0; i < VALUE_SIZE / 8; i++) {
+		if (i * 8 == NUMBER_OFFSET) {
+			storeDouble(as, base, disp + i * 8, 0);
+		}
+		else {
+			movImmediate(as, RCX, words[i]);
+			store(as, base, disp + i * 8, RCX);
+		}
+	}
+}
+
+//Returns the patch site of a jump taken when the Value isn't a number.
+static int guardNumber(Assembler* as, Register base, int32_t disp)
+{
+#ifdef NAN_BOXING
+	load(as, RCX, base, disp);
+	movImmediate(as, RDX, QNAN);
+	emitRex(as, true, RDX, RCX);
+	emitBytes(as, 2, (uint8_t[]){ 0x21, 0xD1 });	//and rcx, rdx
+	compareRegisters(as, RCX, RDX);
+	return emitJump(as, CC_EQUAL);
+#else
+	compareInt(as, base, disp + (int32_t)offsetof(Value, type), VAL_NUMBER);
+	return emitJump(as, CC_NOT_EQUAL);
+#endif
+}
+
+//Number fast path for a binary instruction, falling back to jitBinary for
+//anything else.
+static void binaryNumber(Assembler* as, uint8_t* ip)
+{
+	loadStackTop(as);
+	int notNumberA = guardNumber(as, RAX, -2 * VALUE_SIZE);
+	int notNumberB = guardNumber(as, RAX, -VALUE_SIZE);
+	loadDouble(as, 0, RAX, -2 * VALUE_SIZE + NUMBER_OFFSET);
+	loadDouble(as, 1, RAX, -VALUE_SIZE + NUMBER_OFFSET);
+
+	switch (*ip) {
+	case OP_ADD:
+	case OP_ADD_NUM:		doubleArithmetic(as, 0x58); break;
+	case OP_SUBTRACT:
+	case OP_SUBTRACT_NUM:	doubleArithmetic(as, 0x5C); break;
+	case OP_MULTIPLY:
+	case OP_MULTIPLY_NUM:	doubleArithmetic(as, 0x59); break;
+	case OP_DIVIDE:
+	case OP_DIVIDE_NUM:		doubleArithmetic(as, 0x5E); break;
+	}
+
+	switch (*ip) {
+	case OP_GREATER:
+	case OP_GREATER_NUM:
+	case OP_LESS:
+	case OP_LESS_NUM:
+	case OP_GREATER_EQUAL:
+	case OP_LESS_EQUAL:
+	{
+		//'above' is false for unordered operands, matching C's NaN rules.
+		bool isGreater = *ip == OP_GREATER || *ip == OP_GREATER_NUM || *ip == OP_GREATER_EQUAL;
+		bool orEqual = *ip == OP_GREATER_EQUAL || *ip == OP_LESS_EQUAL;
+		compareDoubles(as, isGreater ? 0 : 1, isGreater ? 1 : 0);
+		int isTrue = emitJump(as, orEqual ? CC_ABOVE_EQUAL : CC_ABOVE);
+		storeValue(as, RAX, -2 * VALUE_SIZE, BOOL_VAL(false));
+		int done = emitJump(as, CC_ALWAYS);
+		patchJumpHere(as, isTrue);
+		storeValue(as, RAX, -2 * VALUE_SIZE, BOOL_VAL(true));
+		patchJumpHere(as, done);
+		break;
+	}
+	default:
+		storeNumber(as, RAX, -2 * VALUE_SIZE);
+		break;
+	}
+
+	adjustStackTop(as, -1);
+	int done = emitJump(as, CC_ALWAYS);
+
+	patchJumpHere(as, notNumberA);
+	patchJumpHere(as, notNumberB);
+	callHelper(as, jitBinary, ip);
+	patchJumpHere(as, done);
+}
+
+//Number fast path for the compare and branches. Jumping on 'below' and
+//'below or equal' also takes the branch for unordered operands.
+static void compareJump(Assembler* as, uint8_t* ip, int target)
+{
+	loadStackTop(as);
+	int notNumberA = guardNumber(as, RAX, -2 * VALUE_SIZE);
+	int notNumberB = guardNumber(as, RAX, -VALUE_SIZE);
+	loadDouble(as, 0, RAX, -2 * VALUE_SIZE + NUMBER_OFFSET);
+	loadDouble(as, 1, RAX, -VALUE_SIZE + NUMBER_OFFSET);
+	adjustStackTop(as, -2);
+
+	bool isGreater = *ip == OP_JUMP_IF_NOT_GREATER || *ip == OP_JUMP_IF_NOT_GREATER_EQUAL;
+	bool orEqual = *ip == OP_JUMP_IF_NOT_LESS_EQUAL || *ip == OP_JUMP_IF_NOT_GREATER_EQUAL;
+	compareDoubles(as, isGreater ? 0 : 1, isGreater ? 1 : 0);
+	jumpToBytecode(as, orEqual ? CC_BELOW : CC_BELOW_EQUAL, target);
+	int done = emitJump(as, CC_ALWAYS);
+
+	patchJumpHere(as, notNumberA);
+	patchJumpHere(as, notNumberB);
+	callHelper(as, jitBinary, ip);
+	patchJumpHere(as, done);
+}
+
+//Number fast path for OP_INC_LOCAL, whose constant is always a number.
+static void incrementLocal(Assembler* as, Chunk* chunk, uint8_t* ip)
+{
+	int32_t slot = ip[1] * VALUE_SIZE;
+	int notNumber = guardNumber(as, R12, slot);
+	loadDouble(as, 0, R12, slot + NUMBER_OFFSET);
+	movImmediate(as, RDX, (uint64_t)(uintptr_t)&chunk->constants.values[ip[2]]);
+	loadDouble(as, 1, RDX, NUMBER_OFFSET);
+	doubleArithmetic(as, 0x58);
+	storeNumber(as, R12, slot);
+	int done = emitJump(as, CC_ALWAYS);
+
+	patchJumpHere(as, notNumber);
+	callHelper(as, jitIncLocal, ip);
+	patchJumpHere(as, done);
+}
+
+//Loads the first operand of a register instruction from its slot into xmm0
+//and the second from its slot or the constants into xmm1. Writes where to
+//patch the guards to, -1 for a constant.
+static void loadRegisterOperands(Assembler* as, Chunk* chunk, uint8_t* operands, bool isConstant, int notNumber[2])
+{
+	int32_t a = operands[0] * VALUE_SIZE;
+	notNumber[0] = guardNumber(as, R12, a);
+	if (isConstant) {
+		notNumber[1] = -1;
+		movImmediate(as, RDX, (uint64_t)(uintptr_t)&chunk->constants.values[operands[1]]);
+		loadDouble(as, 1, RDX, NUMBER_OFFSET);
+	}
+	else {
+		int32_t b = operands[1] * VALUE_SIZE;
+		notNumber[1] = guardNumber(as, R12, b);
+		loadDouble(as, 1, R12, b + NUMBER_OFFSET);
+	}
+	loadDouble(as, 0, R12, a + NUMBER_OFFSET);
+}
+
+static void patchNotNumber(Assembler* as, int notNumber[2])
+{
+	for (int i = 0; i < 2; i++) {
+		if (notNumber[i] >= 0) patchJumpHere(as, notNumber[i]);
+	}
+}
+
+//Number fast path for the three-address arithmetic. A constant that isn't
+//a number always takes the slow path.
+static void registerBinary(Assembler* as, Chunk* chunk, uint8_t* ip)
+{
+	bool isConstant = *ip >= OP_ADD_RK;
+	if (isConstant && !IS_NUMBER(chunk->constants.values[ip[3]])) {
+		callHelper(as, jitRegisterBinary, ip);
+		return;
+	}
+
+	static const uint8_t arithmetic[] = { 0x58, 0x5C, 0x59, 0x5E };
+	int notNumber[2];
+	loadRegisterOperands(as, chunk, ip + 2, isConstant, notNumber);
+	doubleArithmetic(as, arithmetic[*ip - (isConstant ? OP_ADD_RK : OP_ADD_RR)]);
+	storeNumber(as, R12, ip[1] * VALUE_SIZE);
+	int done = emitJump(as, CC_ALWAYS);
+
+	patchNotNumber(as, notNumber);
+	callHelper(as, jitRegisterBinary, ip);
+	patchJumpHere(as, done);
+}
+
+//Like compareJump, on slots and constants instead of the stack.
+static void registerCompareJump(Assembler* as, Chunk* chunk, uint8_t* ip, int target)
+{
+	bool isConstant = *ip >= OP_JUMP_IF_NOT_LESS_RK;
+	if (isConstant && !IS_NUMBER(chunk->constants.values[ip[2]])) {
+		callHelper(as, jitRegisterBinary, ip);
+		return;
+	}
+
+	int index = *ip - (isConstant ? OP_JUMP_IF_NOT_LESS_RK : OP_JUMP_IF_NOT_LESS_RR);
+	bool isGreater = index >= 2;
+	bool orEqual = index % 2 == 1;
+	int notNumber[2];
+	loadRegisterOperands(as, chunk, ip + 1, isConstant, notNumber);
+	compareDoubles(as, isGreater ? 0 : 1, isGreater ? 1 : 0);
+	jumpToBytecode(as, orEqual ? CC_BELOW : CC_BELOW_EQUAL, target);
+	int done = emitJump(as, CC_ALWAYS);
+
+	patchNotNumber(as, notNumber);
+	callHelper(as, jitRegisterBinary, ip);
+	patchJumpHere(as, done);
+}
+
+static void jumpIfFalse(Assembler* as, int target)
+{
+	loadStackTop(as);
+#ifdef NAN_BOXING
+	load(as, RCX, RAX, -VALUE_SIZE);
+	movImmediate(as, RDX, NIL_VAL);
+	compareRegisters(as, RCX, RDX);
+	jumpToBytecode(as, CC_EQUAL, target);
+	movImmediate(as, RDX, FALSE_VAL);
+	compareRegisters(as, RCX, RDX);
+	jumpToBytecode(as, CC_EQUAL, target);
+#else
+	int32_t type = -VALUE_SIZE + (int32_t)offsetof(Value, type);
+	compareInt(as, RAX, type, VAL_NIL);
+	jumpToBytecode(as, CC_EQUAL, target);
+	compareInt(as, RAX, type, VAL_BOOL);
+	int notBool = emitJump(as, CC_NOT_EQUAL);
+	compareByte(as, RAX, -VALUE_SIZE + (int32_t)offsetof(Value, as.boolean), 0);
+	jumpToBytecode(as, CC_EQUAL, target);
+	patchJumpHere(as, notBool);
+#endif
+}
+
+static void getGlobal(Assembler* as, uint8_t* ip)
+{
+	int slot = (ip[1] << 8) | ip[2];
+
+	//The global arrays can grow while the code lives, so go through vm.
+	movImmediate(as, RDX, (uint64_t)(uintptr_t)&vm.globalSlots);
+	load(as, RDX, RDX, 0);
+	compareByte(as, RDX, slot * (int32_t)sizeof(GlobalSlot) + (int32_t)offsetof(GlobalSlot, isDefined), 0);
+	int undefined = emitJump(as, CC_EQUAL);
+
+	movImmediate(as, RDX, (uint64_t)(uintptr_t)&vm.globalValues);
+	load(as, RDX, RDX, 0);
+	loadStackTop(as);
+	copyValue(as, RAX, 0, RDX, slot * VALUE_SIZE);
+	adjustStackTop(as, 1);
+	int done = emitJump(as, CC_ALWAYS);
+
+	patchJumpHere(as, undefined);
+	callHelper(as, jitGetGlobal, ip);
+	patchJumpHere(as, done);
+}
+
+static void setGlobal(Assembler* as, uint8_t* ip)
+{
+	int slot = (ip[1] << 8) | ip[2];
+	int32_t flags = slot * (int32_t)sizeof(GlobalSlot);
+
+	movImmediate(as, RDX, (uint64_t)(uintptr_t)&vm.globalSlots);
+	load(as, RDX, RDX, 0);
+	compareByte(as, RDX, flags + (int32_t)offsetof(GlobalSlot, isDefined), 0);
+	int undefined = emitJump(as, CC_EQUAL);
+	compareByte(as, RDX, flags + (int32_t)offsetof(GlobalSlot, isConstant), 0);
+	int constant = emitJump(as, CC_NOT_EQUAL);
+
+	movImmediate(as, RDX, (uint64_t)(uintptr_t)&vm.globalValues);
+	load(as, RDX, RDX, 0);
+	loadStackTop(as);
+	copyValue(as, RDX, slot * VALUE_SIZE, RAX, -VALUE_SIZE);
+	int done = emitJump(as, CC_ALWAYS);
+
+	patchJumpHere(as, undefined);
+	patchJumpHere(as, constant);
+	callHelper(as, jitSetGlobal, ip);
+	patchJumpHere(as, done);
+}
+
+//Shared entry and exit stubs. The entry is called as
+//  int enter(void* target, Value* slots)
+//and the exit returns whatever status is in eax.
+static void emitStubs(Assembler* as)
+{
+	emitByte(as, 0x53);								//push rbx
+	emitBytes(as, 2, (uint8_t[]){ 0x41, 0x54 });	//push r12
+	emitBytes(as, 4, (uint8_t[]){ 0x48, 0x83, 0xEC, 0x08 });	//sub rsp, 8 (keeps calls aligned)
+	movImmediate(as, RBX, (uint64_t)(uintptr_t)&vm.stackTop);
+	emitBytes(as, 3, (uint8_t[]){ 0x49, 0x89, 0xF4 });	//mov r12, rsi
+	emitBytes(as, 2, (uint8_t[]){ 0xFF, 0xE7 });	//jmp rdi
+
+	as->exitOffset = as->count;
+	emitBytes(as, 4, (uint8_t[]){ 0x48, 0x83, 0xC4, 0x08 });	//add rsp, 8
+	emitBytes(as, 2, (uint8_t[]){ 0x41, 0x5C });	//pop r12
+	emitByte(as, 0x5B);								//pop rbx
+	emitByte(as, 0xC3);								//ret
+}
+
+static Trace* traceAnchor(ObjFunction* function, int header);
+
+//Back edges count the loop's trace anchor down inline and only call out once
+//the loop is due for recording or already has a trace to run.
+static void loopBackEdge(Assembler* as, ObjFunction* function, uint8_t* ip, int header)
+{
+	Trace* trace = traceAnchor(function, header);
+	movImmediate(as, RDX, (uint64_t)(uintptr_t)trace);
+	compareLong(as, RDX, (int32_t)offsetof(Trace, code), 0);
+	int traced = emitJump(as, CC_NOT_EQUAL);
+	subtractInt(as, RDX, (int32_t)offsetof(Trace, countdown), 1);
+	jumpToBytecode(as, CC_GREATER, header);
+
+	patchJumpHere(as, traced);
+	callHelper(as, jitLoop, ip);
+	jumpToBytecode(as, CC_ALWAYS, header);
+}
+
+static bool emitInstruction(Assembler* as, ObjFunction* function, int offset)
+{
+	Chunk* chunk = &function->chunk;
+	uint8_t* ip = &chunk->code[offset];
+
+	//Superinstructions only matter to the interpreter.
+	switch (baseOpcode(*ip)) {
+	case OP_CONSTANT:
+		loadStackTop(as);
+		movImmediate(as, RDX, (uint64_t)(uintptr_t)&chunk->constants.values[ip[1]]);
+		copyValue(as, RAX, 0, RDX, 0);
+		adjustStackTop(as, 1);
+		return true;
+	case OP_NIL:
+	case OP_TRUE:
+	case OP_FALSE:
+		loadStackTop(as);
+		storeValue(as, RAX, 0, baseOpcode(*ip) == OP_NIL ? NIL_VAL : BOOL_VAL(baseOpcode(*ip) == OP_TRUE));
+		adjustStackTop(as, 1);
+		return true;
+	case OP_POP:
+		adjustStackTop(as, -1);
+		return true;
+	case OP_GET_LOCAL:
+		loadStackTop(as);
+		copyValue(as, RAX, 0, R12, ip[1] * VALUE_SIZE);
+		adjustStackTop(as, 1);
+		return true;
+	case OP_SET_LOCAL:
+		loadStackTop(as);
+		copyValue(as, R12, ip[1] * VALUE_SIZE, RAX, -VALUE_SIZE);
+		return true;
+	case OP_INC_LOCAL:
+		incrementLocal(as, chunk, ip);
+		return true;
+	case OP_MOVE:
+		copyValue(as, R12, ip[1] * VALUE_SIZE, R12, ip[2] * VALUE_SIZE);
+		return true;
+	case OP_ADD_RR:
+	case OP_SUBTRACT_RR:
+	case OP_MULTIPLY_RR:
+	case OP_DIVIDE_RR:
+	case OP_ADD_RK:
+	case OP_SUBTRACT_RK:
+	case OP_MULTIPLY_RK:
+	case OP_DIVIDE_RK:
+		registerBinary(as, chunk, ip);
+		return true;
+	case OP_GET_GLOBAL:
+		getGlobal(as, ip);
+		return true;
+	case OP_SET_GLOBAL:
+		setGlobal(as, ip);
+		return true;
+
+	case OP_ADD:
+	case OP_ADD_NUM:
+	case OP_SUBTRACT:
+	case OP_SUBTRACT_NUM:
+	case OP_MULTIPLY:
+	case OP_MULTIPLY_NUM:
+	case OP_DIVIDE:
+	case OP_DIVIDE_NUM:
+	case OP_GREATER:
+	case OP_GREATER_NUM:
+	case OP_LESS:
+	case OP_LESS_NUM:
+	case OP_GREATER_EQUAL:
+	case OP_LESS_EQUAL:
+		binaryNumber(as, ip);
+		return true;
+	case OP_ADD_STR:
+	case OP_POWER:
+	case OP_MODULO:
+	case OP_SHIFT_LEFT:
+	case OP_SHIFT_RIGHT:
+		callHelper(as, jitBinary, ip);
+		return true;
+
+	case OP_JUMP:
+		jumpToBytecode(as, CC_ALWAYS, offset + 3 + ((ip[1] << 8) | ip[2]));
+		return true;
+	case OP_LOOP:
+		loopBackEdge(as, function, ip, offset + 3 - ((ip[1] << 8) | ip[2]));
+		return true;
+	case OP_JUMP_IF_FALSE:
+		jumpIfFalse(as, offset + 3 + ((ip[1] << 8) | ip[2]));
+		return true;
+	case OP_JUMP_IF_NOT_LESS:
+	case OP_JUMP_IF_NOT_LESS_EQUAL:
+	case OP_JUMP_IF_NOT_GREATER:
+	case OP_JUMP_IF_NOT_GREATER_EQUAL:
+		compareJump(as, ip, offset + 3 + ((ip[1] << 8) | ip[2]));
+		return true;
+	case OP_JUMP_IF_NOT_LESS_RR:
+	case OP_JUMP_IF_NOT_LESS_EQUAL_RR:
+	case OP_JUMP_IF_NOT_GREATER_RR:
+	case OP_JUMP_IF_NOT_GREATER_EQUAL_RR:
+	case OP_JUMP_IF_NOT_LESS_RK:
+	case OP_JUMP_IF_NOT_LESS_EQUAL_RK:
+	case OP_JUMP_IF_NOT_GREATER_RK:
+	case OP_JUMP_IF_NOT_GREATER_EQUAL_RK:
+		registerCompareJump(as, chunk, ip, offset + 5 + ((ip[3] << 8) | ip[4]));
+		return true;
+
+	case OP_EXIT:
+		movImmediate(as, RAX, JIT_EXIT_DONE);
+		patchJump(as, emitJump(as, CC_ALWAYS), as->exitOffset);
+		return true;
+	case OP_GET_ARRAY_INDEX:
+		//The interpreter skips it as well.
+		return true;
+
+	case OP_NEGATE:			callHelper(as, jitNegate, ip); return true;
+	case OP_NOT:			callHelper(as, jitNot, ip); return true;
+	case OP_EQUAL:			callHelper(as, jitEqual, ip); return true;
+	case OP_PRINT:			callHelper(as, jitPrint, ip); return true;
+	case OP_DEFINE_GLOBAL:	callHelper(as, jitDefineGlobal, ip); return true;
+	case OP_DEFINE_CONSTANT:callHelper(as, jitDefineConstant, ip); return true;
+	case OP_GET_UPVALUE:	callHelper(as, jitGetUpvalue, ip); return true;
+	case OP_SET_UPVALUE:	callHelper(as, jitSetUpvalue, ip); return true;
+	case OP_CLOSE_UPVALUE:	callHelper(as, jitCloseUpvalue, ip); return true;
+	case OP_GET_PROPERTY:	callHelper(as, jitGetProperty, ip); return true;
+	case OP_SET_PROPERTY:	callHelper(as, jitSetProperty, ip); return true;
+	case OP_GET_SUPER:		callHelper(as, jitGetSuper, ip); return true;
+	case OP_CALL:			callHelper(as, jitCall, ip); return true;
+	case OP_TAIL_CALL:		callHelper(as, jitTailCall, ip); return true;
+	case OP_INVOKE:			callHelper(as, jitInvoke, ip); return true;
+	case OP_TAIL_INVOKE:	callHelper(as, jitTailInvoke, ip); return true;
+	case OP_SUPER_INVOKE:	callHelper(as, jitSuperInvoke, ip); return true;
+	case OP_TAIL_SUPER_INVOKE:	callHelper(as, jitTailSuperInvoke, ip); return true;
+	case OP_CLOSURE:		callHelper(as, jitClosure, ip); return true;
+	case OP_CLASS:			callHelper(as, jitClass, ip); return true;
+	case OP_METHOD:			callHelper(as, jitMethod, ip); return true;
+	case OP_INHERIT:		callHelper(as, jitInherit, ip); return true;
+	case OP_RETURN:			callHelper(as, jitReturn, ip); return true;
+
+	default:
+		//Unknown to the JIT, leave the function to the interpreter.
+		return false;
+	}
+}
+
+static void freeAssembler(Assembler* as, int entryCount)
+{
+	FREE_ARRAY(uint8_t, as->code, as->capacity);
+	FREE_ARRAY(JumpFixup, as->fixups, as->fixupCapacity);
+	FREE_ARRAY(uint32_t, as->entries, entryCount);
+}
+
+//Copies the assembled code into fresh pages and only then makes them
+//executable. Returns NULL if the memory can't be had.
+static uint8_t* makeExecutable(Assembler* as, size_t* size)
+{
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	*size = ((size_t)as->count + pageSize - 1) / pageSize * pageSize;
+	uint8_t* code = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED) return NULL;
+
+	memcpy(code, as->code, as->count);
+	if (mprotect(code, *size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(code, *size);
+		return NULL;
+	}
+
+	return code;
+}
+
+bool jitCompile(ObjFunction* function)
+{
+	Chunk* chunk = &function->chunk;
+	Assembler as;
+	as.code = NULL;
+	as.count = 0;
+	as.capacity = 0;
+	as.fixups = NULL;
+	as.fixupCount = 0;
+	as.fixupCapacity = 0;
+	as.entries = ALLOCATE(uint32_t, chunk->count);
+	for (int i = 0; i < chunk->count; i++) as.entries[i] = NO_ENTRY;
+
+	emitStubs(&as);
+
+	for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) {
+		as.entries[offset] = (uint32_t)as.count;
+		if (!emitInstruction(&as, function, offset)) {
+			freeAssembler(&as, chunk->count);
+			return false;
+		}
+	}
+
+	for (int i = 0; i < as.fixupCount; i++) {
+		JumpFixup* fixup = &as.fixups[i];
+		if (fixup->target < 0 || fixup->target >= chunk->count ||
+			as.entries[fixup->target] == NO_ENTRY) {
+			freeAssembler(&as, chunk->count);
+			return false;
+		}
+		patchJump(&as, fixup->patch, (int)as.entries[fixup->target]);
+	}
+
+	size_t size;
+	uint8_t* code = makeExecutable(&as, &size);
+	if (code == NULL) {
+		freeAssembler(&as, chunk->count);
+		return false;
+	}
+
+	JitCode* jit = ALLOCATE(JitCode, 1);
+	jit->code = code;
+	jit->size = size;
+	jit->entries = as.entries;
+	jit->entryCount = chunk->count;
+
+	as.entries = NULL;
+	freeAssembler(&as, 0);
+
+	function->jit = jit;
+	return true;
+}
+
+JitStatus jitRun(CallFrame* frame)
+{
+	ObjFunction* function = frame->closure->function;
+	JitCode* jit = function->jit;
+	uint32_t entry = jit->entries[frame->ip - function->chunk.code];
+
+	int (*enter)(uint8_t*, Value*) = (int (*)(uint8_t*, Value*))(void*)jit->code;
+	return (JitStatus)enter(jit->code + entry, frame->slots);
+}
+
+//Tracing.
+//
+//When a loop header gets hot the recorder walks one iteration of the loop
+//body, starting at the header, against the live values in the frame. It
+//doesn't execute anything: the values only tell it which way branches go and
+//what types slots hold. The result is a linear, typed IR in which
+//  - every slot or global read once becomes a load with a type guard,
+//  - later reads and writes of it only touch the recorder's slot map, so
+//    repeated loads disappear and stores are sunk to the exits,
+//  - operations on constants are folded away, and
+//  - every branch becomes a guard on the direction seen while recording.
+//Each guard carries a snapshot of the slots it has to write back and the
+//bytecode offset the interpreter resumes at. Only numbers and bools are
+//handled, anything else (calls, objects, printing...) aborts the recording
+//and the loop is left to the interpreter and the baseline JIT.
+
+#define TRACE_MAX_IR 512
+#define TRACE_MAX_SLOTS (2 * UINT8_COUNT)
+#define TRACE_MAX_GLOBALS 64
+#define NO_REF -1
+
+typedef enum
+{
+	IR_CONSTANT,
+	IR_LOAD_SLOT,
+	IR_LOAD_GLOBAL,
+	IR_ADD,
+	IR_SUBTRACT,
+	IR_MULTIPLY,
+	IR_DIVIDE,
+	IR_NEGATE,
+	IR_LESS,
+	IR_GREATER,
+	IR_LESS_EQUAL,
+	IR_GREATER_EQUAL,
+	IR_EQUAL,
+	IR_NOT,
+	IR_GUARD_TRUE,
+	IR_GUARD_FALSE
+} IrOp;
+
+typedef enum
+{
+	IR_NUMBER,
+	IR_BOOL
+} IrType;
+
+typedef struct
+{
+	IrOp op;
+	IrType type;
+	int a;				//Operand refs, or the slot a load reads.
+	int b;
+	double value;		//Seen while recording, bools as 0 or 1.
+	int snapshot;		//Where loads and guards exit to.
+	bool isUsed;
+	int patch;			//Guard jump waiting for its exit stub.
+} IrIns;
+
+//A slot (position >= 0) or global (position -1 - index) to write back.
+typedef struct
+{
+	int position;
+	int ref;
+} SnapshotEntry;
+
+typedef struct
+{
+	int offset;			//Bytecode offset to resume at.
+	int depth;			//Stack height above frame->slots.
+	int first;
+	int count;
+} Snapshot;
+
+typedef struct
+{
+	CallFrame* frame;
+	Chunk* chunk;
+	int header;
+	bool isAborted;
+
+	IrIns ir[TRACE_MAX_IR];
+	int irCount;
+
+	//Current ref of every stack position, and whether the trace wrote it.
+	int slots[TRACE_MAX_SLOTS];
+	bool dirty[TRACE_MAX_SLOTS];
+	int depth;
+	int entryDepth;
+
+	int globals[TRACE_MAX_GLOBALS];
+	int globalRefs[TRACE_MAX_GLOBALS];
+	bool globalDirty[TRACE_MAX_GLOBALS];
+	int globalCount;
+
+	Snapshot snapshots[TRACE_MAX_IR];
+	int snapshotCount;
+	SnapshotEntry* entries;
+	int entryCount;
+	int entryCapacity;
+	bool* visited;
+} Recorder;
+
+static Recorder recorder;
+
+static Trace* traceAnchor(ObjFunction* function, int header)
+{
+	for (Trace* trace = function->traces; trace != NULL; trace = trace->next) {
+		if (trace->header == header) return trace;
+	}
+
+	Trace* trace = ALLOCATE(Trace, 1);
+	trace->header = header;
+	trace->countdown = vm.traceThreshold;
+	trace->code = NULL;
+	trace->size = 0;
+	trace->exits = NULL;
+	trace->exitCount = 0;
+	trace->next = function->traces;
+	function->traces = trace;
+	return trace;
+}
+
+static int abortRecording()
+{
+	recorder.isAborted = true;
+	return 0;
+}
+
+static int emitIr(IrOp op, IrType type, int a, int b, double value)
+{
+	if (recorder.irCount == TRACE_MAX_IR) return abortRecording();
+
+	IrIns* ins = &recorder.ir[recorder.irCount];
+	ins->op = op;
+	ins->type = type;
+	ins->a = a;
+	ins->b = b;
+	ins->value = value;
+	ins->snapshot = -1;
+	ins->isUsed = false;
+	ins->patch = -1;
+	return recorder.irCount++;
+}
+
+static int constantRef(IrType type, double value)
+{
+	return emitIr(IR_CONSTANT, type, NO_REF, NO_REF, value);
+}
+
+static bool isConstantRef(int ref)
+{
+	return recorder.ir[ref].op == IR_CONSTANT;
+}
+
+static void addSnapshotEntry(int position, int ref)
+{
+	if (recorder.entryCapacity < recorder.entryCount + 1) {
+		int oldCapacity = recorder.entryCapacity;
+		recorder.entryCapacity = GROW_CAPACITY(oldCapacity);
+		recorder.entries = GROW_ARRAY(SnapshotEntry, recorder.entries, oldCapacity, recorder.entryCapacity);
+	}
+
+	SnapshotEntry* entry = &recorder.entries[recorder.entryCount++];
+	entry->position = position;
+	entry->ref = ref;
+}
+
+//Captures what has to be written back to resume the interpreter at 'offset'.
+static int takeSnapshot(int offset)
+{
+	if (recorder.snapshotCount == TRACE_MAX_IR) return abortRecording();
+
+	Snapshot* snapshot = &recorder.snapshots[recorder.snapshotCount];
+	snapshot->offset = offset;
+	snapshot->depth = recorder.depth;
+	snapshot->first = recorder.entryCount;
+
+	for (int i = 0; i < recorder.depth; i++) {
+		if (recorder.dirty[i]) addSnapshotEntry(i, recorder.slots[i]);
+	}
+	for (int i = 0; i < recorder.globalCount; i++) {
+		if (recorder.globalDirty[i]) addSnapshotEntry(-1 - recorder.globals[i], recorder.globalRefs[i]);
+	}
+
+	snapshot->count = recorder.entryCount - snapshot->first;
+	return recorder.snapshotCount++;
+}
+
+//Turns a value seen while recording into a guarded load.
+static int loadRef(IrOp op, int index, Value value, int offset)
+{
+	IrType type;
+	double seen;
+	if (IS_NUMBER(value)) {
+		type = IR_NUMBER;
+		seen = AS_NUMBER(value);
+	}
+	else if (IS_BOOL(value)) {
+		type = IR_BOOL;
+		seen = AS_BOOL(value) ? 1 : 0;
+	}
+	else {
+		return abortRecording();
+	}
+
+	int snapshot = takeSnapshot(offset);
+	int ref = emitIr(op, type, index, NO_REF, seen);
+	if (!recorder.isAborted) recorder.ir[ref].snapshot = snapshot;
+	return ref;
+}
+
+static int slotRef(int slot, int offset)
+{
+	if (slot >= recorder.depth) return abortRecording();
+
+	if (recorder.slots[slot] == NO_REF) {
+		int ref = loadRef(IR_LOAD_SLOT, slot, recorder.frame->slots[slot], offset);
+		if (recorder.isAborted) return 0;
+		recorder.slots[slot] = ref;
+	}
+
+	return recorder.slots[slot];
+}
+
+static int findGlobal(int slot)
+{
+	for (int i = 0; i < recorder.globalCount; i++) {
+		if (recorder.globals[i] == slot) return i;
+	}
+
+	if (recorder.globalCount == TRACE_MAX_GLOBALS || !vm.globalSlots[slot].isDefined) return abortRecording();
+
+	int index = recorder.globalCount++;
+	recorder.globals[index] = slot;
+	recorder.globalRefs[index] = NO_REF;
+	recorder.globalDirty[index] = false;
+	return index;
+}
+
+static int globalRef(int slot, int offset)
+{
+	int index = findGlobal(slot);
+	if (recorder.isAborted) return 0;
+
+	if (recorder.globalRefs[index] == NO_REF) {
+		int ref = loadRef(IR_LOAD_GLOBAL, slot, vm.globalValues[slot], offset);
+		if (recorder.isAborted) return 0;
+		recorder.globalRefs[index] = ref;
+	}
+
+	return recorder.globalRefs[index];
+}
+
+static void pushRef(int ref)
+{
+	if (recorder.depth == TRACE_MAX_SLOTS) {
+		abortRecording();
+		return;
+	}
+
+	recorder.slots[recorder.depth] = ref;
+	recorder.dirty[recorder.depth] = true;
+	recorder.depth++;
+}
+
+static int popRef(int offset)
+{
+	if (recorder.depth == 0) return abortRecording();
+
+	int ref = slotRef(recorder.depth - 1, offset);
+	recorder.depth--;
+	return ref;
+}
+
+static int binaryRef(IrOp op, int a, int b)
+{
+	IrIns* left = &recorder.ir[a];
+	IrIns* right = &recorder.ir[b];
+	if (left->type != IR_NUMBER || right->type != IR_NUMBER) return abortRecording();
+
+	double x = left->value;
+	double y = right->value;
+	double result;
+	IrType type = IR_NUMBER;
+	switch (op) {
+	case IR_ADD:		result = x + y; break;
+	case IR_SUBTRACT:	result = x - y; break;
+	case IR_MULTIPLY:	result = x * y; break;
+	case IR_DIVIDE:		result = x / y; break;
+	case IR_LESS:		result = x < y; type = IR_BOOL; break;
+	case IR_GREATER:	result = x > y; type = IR_BOOL; break;
+	case IR_LESS_EQUAL:	result = x <= y; type = IR_BOOL; break;
+	case IR_GREATER_EQUAL:	result = x >= y; type = IR_BOOL; break;
+	default:			return abortRecording();
+	}
+
+	if (isConstantRef(a) && isConstantRef(b)) return constantRef(type, result);
+	return emitIr(op, type, a, b, result);
+}
+
+static int equalRef(int a, int b)
+{
+	IrIns* left = &recorder.ir[a];
+	IrIns* right = &recorder.ir[b];
+
+	//Types are guarded, so values of different types are never equal here.
+	if (left->type != right->type) return constantRef(IR_BOOL, 0);
+
+	double result = left->value == right->value;
+	if (isConstantRef(a) && isConstantRef(b)) return constantRef(IR_BOOL, result);
+	return emitIr(IR_EQUAL, IR_BOOL, a, b, result);
+}
+
+static int notRef(int a)
+{
+	IrIns* operand = &recorder.ir[a];
+
+	//Numbers are always truthy.
+	if (operand->type == IR_NUMBER) return constantRef(IR_BOOL, 0);
+	if (isConstantRef(a)) return constantRef(IR_BOOL, operand->value == 0);
+	return emitIr(IR_NOT, IR_BOOL, a, NO_REF, operand->value == 0);
+}
+
+static int negateRef(int a)
+{
+	IrIns* operand = &recorder.ir[a];
+	if (operand->type != IR_NUMBER) return abortRecording();
+	if (isConstantRef(a)) return constantRef(IR_NUMBER, -operand->value);
+	return emitIr(IR_NEGATE, IR_NUMBER, a, NO_REF, -operand->value);
+}
+
+//Records 'condition' going the way it went this time. Numbers are always
+//truthy and constants need no guard at all.
+static bool guardBranch(int condition, int next, int jumpTarget)
+{
+	IrIns* ins = &recorder.ir[condition];
+	bool isFalse = ins->type == IR_BOOL && ins->value == 0;
+	if (ins->type == IR_BOOL && !isConstantRef(condition)) {
+		int snapshot = takeSnapshot(isFalse ? next : jumpTarget);
+		int guard = emitIr(isFalse ? IR_GUARD_FALSE : IR_GUARD_TRUE, IR_BOOL, condition, NO_REF, 0);
+		if (!recorder.isAborted) recorder.ir[guard].snapshot = snapshot;
+	}
+
+	return isFalse;
+}
+
+//A jump if false on the top of the stack.
+static bool recordBranch(int offset, int jumpTarget)
+{
+	int condition = slotRef(recorder.depth - 1, offset);
+	if (recorder.isAborted) return false;
+	return guardBranch(condition, offset + 3, jumpTarget);
+}
+
+//A compare and branch. Like the binary operators it reads both operands
+//before the stack shrinks, and a failing guard resumes past the compare.
+static bool recordCompareBranch(IrOp op, int offset, int jumpTarget)
+{
+	int b = slotRef(recorder.depth - 1, offset);
+	int a = recorder.isAborted ? 0 : slotRef(recorder.depth - 2, offset);
+	if (recorder.isAborted) return false;
+	recorder.depth -= 2;
+
+	int condition = binaryRef(op, a, b);
+	if (recorder.isAborted) return false;
+	return guardBranch(condition, offset + 3, jumpTarget);
+}
+
+//The second operand of a register instruction, a slot or a constant.
+static int registerOperandRef(uint8_t operand, bool isConstant, int offset)
+{
+	if (!isConstant) return slotRef(operand, offset);
+
+	Value constant = recorder.chunk->constants.values[operand];
+	if (!IS_NUMBER(constant)) return abortRecording();
+	return constantRef(IR_NUMBER, AS_NUMBER(constant));
+}
+
+static bool recordTrace(CallFrame* frame, int header)
+{
+	Chunk* chunk = &frame->closure->function->chunk;
+
+	recorder.frame = frame;
+	recorder.chunk = chunk;
+	recorder.header = header;
+	recorder.isAborted = false;
+	recorder.irCount = 0;
+	recorder.globalCount = 0;
+	recorder.snapshotCount = 0;
+	recorder.entryCount = 0;
+	recorder.depth = (int)(vm.stackTop - frame->slots);
+	recorder.entryDepth = recorder.depth;
+	if (recorder.depth > TRACE_MAX_SLOTS) return false;
+
+	for (int i = 0; i < recorder.depth; i++) {
+		recorder.slots[i] = NO_REF;
+		recorder.dirty[i] = false;
+	}
+
+	recorder.visited = ALLOCATE(bool, chunk->count);
+	memset(recorder.visited, 0, chunk->count);
+
+	int offset = header;
+	while (!recorder.isAborted) {
+		if (recorder.visited[offset]) {
+			//An inner loop, it gets a trace of its own.
+			abortRecording();
+			break;
+		}
+		recorder.visited[offset] = true;
+
+		uint8_t* ip = &chunk->code[offset];
+		int next = offset + instructionLength(chunk, offset);
+		switch (baseOpcode(*ip)) {
+		case OP_CONSTANT:
+		{
+			Value constant = chunk->constants.values[ip[1]];
+			if (IS_NUMBER(constant)) pushRef(constantRef(IR_NUMBER, AS_NUMBER(constant)));
+			else if (IS_BOOL(constant)) pushRef(constantRef(IR_BOOL, AS_BOOL(constant)));
+			else abortRecording();
+			break;
+		}
+		case OP_TRUE:
+		case OP_FALSE:
+			pushRef(constantRef(IR_BOOL, baseOpcode(*ip) == OP_TRUE));
+			break;
+		case OP_POP:
+			if (recorder.depth == 0) abortRecording();
+			else recorder.depth--;
+			break;
+		case OP_GET_LOCAL:
+		{
+			int ref = slotRef(ip[1], offset);
+			if (!recorder.isAborted) pushRef(ref);
+			break;
+		}
+		case OP_SET_LOCAL:
+		{
+			int ref = slotRef(recorder.depth - 1, offset);
+			if (recorder.isAborted || ip[1] >= recorder.depth) {
+				abortRecording();
+				break;
+			}
+			recorder.slots[ip[1]] = ref;
+			recorder.dirty[ip[1]] = true;
+			break;
+		}
+		case OP_GET_GLOBAL:
+		{
+			int ref = globalRef((ip[1] << 8) | ip[2], offset);
+			if (!recorder.isAborted) pushRef(ref);
+			break;
+		}
+		case OP_SET_GLOBAL:
+		{
+			int slot = (ip[1] << 8) | ip[2];
+			int ref = slotRef(recorder.depth - 1, offset);
+			int index = findGlobal(slot);
+			if (recorder.isAborted || vm.globalSlots[slot].isConstant) {
+				abortRecording();
+				break;
+			}
+			recorder.globalRefs[index] = ref;
+			recorder.globalDirty[index] = true;
+			break;
+		}
+
+		case OP_ADD:
+		case OP_ADD_NUM:
+		case OP_SUBTRACT:
+		case OP_SUBTRACT_NUM:
+		case OP_MULTIPLY:
+		case OP_MULTIPLY_NUM:
+		case OP_DIVIDE:
+		case OP_DIVIDE_NUM:
+		case OP_LESS:
+		case OP_LESS_NUM:
+		case OP_GREATER:
+		case OP_GREATER_NUM:
+		case OP_LESS_EQUAL:
+		case OP_GREATER_EQUAL:
+		{
+			IrOp op;
+			switch (*ip) {
+			case OP_ADD: case OP_ADD_NUM:				op = IR_ADD; break;
+			case OP_SUBTRACT: case OP_SUBTRACT_NUM:		op = IR_SUBTRACT; break;
+			case OP_MULTIPLY: case OP_MULTIPLY_NUM:		op = IR_MULTIPLY; break;
+			case OP_DIVIDE: case OP_DIVIDE_NUM:			op = IR_DIVIDE; break;
+			case OP_LESS: case OP_LESS_NUM:				op = IR_LESS; break;
+			case OP_LESS_EQUAL:							op = IR_LESS_EQUAL; break;
+			case OP_GREATER_EQUAL:						op = IR_GREATER_EQUAL; break;
+			default:									op = IR_GREATER; break;
+			}
+
+			//Both operands are read before the stack shrinks, so a failing
+			//load guard exits with the instruction still to run.
+			int b = slotRef(recorder.depth - 1, offset);
+			int a = recorder.isAborted ? 0 : slotRef(recorder.depth - 2, offset);
+			if (recorder.isAborted) break;
+			recorder.depth -= 2;
+			int ref = binaryRef(op, a, b);
+			if (!recorder.isAborted) pushRef(ref);
+			break;
+		}
+		case OP_EQUAL:
+		{
+			int b = slotRef(recorder.depth - 1, offset);
+			int a = recorder.isAborted ? 0 : slotRef(recorder.depth - 2, offset);
+			if (recorder.isAborted) break;
+			recorder.depth -= 2;
+			pushRef(equalRef(a, b));
+			break;
+		}
+		case OP_NOT:
+		case OP_NEGATE:
+		{
+			int a = popRef(offset);
+			if (recorder.isAborted) break;
+			pushRef(*ip == OP_NOT ? notRef(a) : negateRef(a));
+			break;
+		}
+
+		case OP_JUMP:
+			next = offset + 3 + ((ip[1] << 8) | ip[2]);
+			break;
+		case OP_JUMP_IF_FALSE:
+		{
+			int target = offset + 3 + ((ip[1] << 8) | ip[2]);
+			if (recordBranch(offset, target)) next = target;
+			break;
+		}
+		case OP_JUMP_IF_NOT_LESS:
+		case OP_JUMP_IF_NOT_LESS_EQUAL:
+		case OP_JUMP_IF_NOT_GREATER:
+		case OP_JUMP_IF_NOT_GREATER_EQUAL:
+		{
+			static const IrOp ops[] = { IR_LESS, IR_LESS_EQUAL, IR_GREATER, IR_GREATER_EQUAL };
+			int target = offset + 3 + ((ip[1] << 8) | ip[2]);
+			if (recordCompareBranch(ops[*ip - OP_JUMP_IF_NOT_LESS], offset, target)) next = target;
+			break;
+		}
+		case OP_LOOP:
+			next = offset + 3 - ((ip[1] << 8) | ip[2]);
+			break;
+		case OP_INC_LOCAL:
+		{
+			Value constant = chunk->constants.values[ip[2]];
+			int ref = slotRef(ip[1], offset);
+			if (recorder.isAborted) break;
+			ref = binaryRef(IR_ADD, ref, constantRef(IR_NUMBER, AS_NUMBER(constant)));
+			if (recorder.isAborted) break;
+			recorder.slots[ip[1]] = ref;
+			recorder.dirty[ip[1]] = true;
+			break;
+		}
+		case OP_MOVE:
+		{
+			int ref = slotRef(ip[2], offset);
+			if (recorder.isAborted || ip[1] >= recorder.depth) {
+				abortRecording();
+				break;
+			}
+			recorder.slots[ip[1]] = ref;
+			recorder.dirty[ip[1]] = true;
+			break;
+		}
+		case OP_ADD_RR:
+		case OP_SUBTRACT_RR:
+		case OP_MULTIPLY_RR:
+		case OP_DIVIDE_RR:
+		case OP_ADD_RK:
+		case OP_SUBTRACT_RK:
+		case OP_MULTIPLY_RK:
+		case OP_DIVIDE_RK:
+		{
+			static const IrOp ops[] = { IR_ADD, IR_SUBTRACT, IR_MULTIPLY, IR_DIVIDE };
+			bool isConstant = *ip >= OP_ADD_RK;
+			int a = slotRef(ip[2], offset);
+			int b = recorder.isAborted ? 0 : registerOperandRef(ip[3], isConstant, offset);
+			if (recorder.isAborted) break;
+			int ref = binaryRef(ops[*ip - (isConstant ? OP_ADD_RK : OP_ADD_RR)], a, b);
+			if (recorder.isAborted || ip[1] >= recorder.depth) {
+				abortRecording();
+				break;
+			}
+			recorder.slots[ip[1]] = ref;
+			recorder.dirty[ip[1]] = true;
+			break;
+		}
+		case OP_JUMP_IF_NOT_LESS_RR:
+		case OP_JUMP_IF_NOT_LESS_EQUAL_RR:
+		case OP_JUMP_IF_NOT_GREATER_RR:
+		case OP_JUMP_IF_NOT_GREATER_EQUAL_RR:
+		case OP_JUMP_IF_NOT_LESS_RK:
+		case OP_JUMP_IF_NOT_LESS_EQUAL_RK:
+		case OP_JUMP_IF_NOT_GREATER_RK:
+		case OP_JUMP_IF_NOT_GREATER_EQUAL_RK:
+		{
+			static const IrOp ops[] = { IR_LESS, IR_LESS_EQUAL, IR_GREATER, IR_GREATER_EQUAL };
+			bool isConstant = *ip >= OP_JUMP_IF_NOT_LESS_RK;
+			int a = slotRef(ip[1], offset);
+			int b = recorder.isAborted ? 0 : registerOperandRef(ip[2], isConstant, offset);
+			if (recorder.isAborted) break;
+			int condition = binaryRef(ops[*ip - (isConstant ? OP_JUMP_IF_NOT_LESS_RK : OP_JUMP_IF_NOT_LESS_RR)], a, b);
+			if (recorder.isAborted) break;
+			int target = next + ((ip[3] << 8) | ip[4]);
+			if (guardBranch(condition, next, target)) next = target;
+			break;
+		}
+		case OP_GET_ARRAY_INDEX:
+			break;
+
+		default:
+			abortRecording();
+			break;
+		}
+
+		if (next == header) break;
+		offset = next;
+	}
+
+	FREE_ARRAY(bool, recorder.visited, chunk->count);
+
+	//The loop has to come back around with the stack as it found it.
+	return !recorder.isAborted && recorder.depth == recorder.entryDepth;
+}
+
+//Drops everything that neither a guard nor a write back depends on, which
+//includes loads nobody reads.
+static void markUsed()
+{
+	for (int i = 0; i < recorder.snapshotCount; i++) {
+		Snapshot* snapshot = &recorder.snapshots[i];
+		for (int j = 0; j < snapshot->count; j++) {
+			recorder.ir[recorder.entries[snapshot->first + j].ref].isUsed = true;
+		}
+	}
+
+	for (int i = recorder.irCount - 1; i >= 0; i--) {
+		IrIns* ins = &recorder.ir[i];
+		if (ins->op == IR_GUARD_TRUE || ins->op == IR_GUARD_FALSE) ins->isUsed = true;
+		if (!ins->isUsed || ins->op == IR_LOAD_SLOT || ins->op == IR_LOAD_GLOBAL) continue;
+
+		if (ins->a != NO_REF) recorder.ir[ins->a].isUsed = true;
+		if (ins->b != NO_REF) recorder.ir[ins->b].isUsed = true;
+	}
+}
+
+//Every IR value lives in its own 8 byte spill slot, numbers as doubles and
+//bools as 0 or 1.
+static int32_t spill(int ref)
+{
+	return ref * 8;
+}
+
+static void loadNumberRef(Assembler* as, int xmm, int ref)
+{
+	IrIns* ins = &recorder.ir[ref];
+	if (ins->op == IR_CONSTANT) {
+		uint64_t bits;
+		memcpy(&bits, &ins->value, sizeof(double));
+		movImmediate(as, RAX, bits);
+		emitBytes(as, 5, (uint8_t[]){ 0x66, 0x48, 0x0F, 0x6E, (uint8_t)(0xC0 | (xmm << 3)) });	//movq xmm, rax
+	}
+	else {
+		loadDouble(as, xmm, RSP, spill(ref));
+	}
+}
+
+static void loadBoolRef(Assembler* as, Register reg, int ref)
+{
+	IrIns* ins = &recorder.ir[ref];
+	if (ins->op == IR_CONSTANT) {
+		movImmediate(as, reg, ins->value != 0);
+	}
+	else {
+		load(as, reg, RSP, spill(ref));
+	}
+}
+
+//setcc al, then zero extends it into the spill slot of 'ref'.
+static void storeFlag(Assembler* as, uint8_t condition, int ref)
+{
+	emitBytes(as, 3, (uint8_t[]){ 0x0F, (uint8_t)(0x90 | condition), 0xC0 });
+	emitBytes(as, 3, (uint8_t[]){ 0x0F, 0xB6, 0xC0 });		//movzx eax, al
+	store(as, RSP, spill(ref), RAX);
+}
+
+static void materialize(Assembler* as, Register base, int32_t disp, int ref)
+{
+	IrIns* ins = &recorder.ir[ref];
+	if (ins->type == IR_NUMBER) {
+		loadNumberRef(as, 0, ref);
+		storeNumber(as, base, disp);
+		return;
+	}
+
+	if (ins->op == IR_CONSTANT) {
+		storeValue(as, base, disp, BOOL_VAL(ins->value != 0));
+		return;
+	}
+
+	load(as, RAX, RSP, spill(ref));
+#ifdef NAN_BOXING
+	movImmediate(as, RCX, FALSE_VAL);
+	emitBytes(as, 3, (uint8_t[]){ 0x48, 0x09, 0xC8 });		//or rax, rcx
+	store(as, base, disp, RAX);
+#else
+	storeValue(as, base, disp, BOOL_VAL(false));
+	emitRex(as, false, RAX, base);
+	emitByte(as, 0x88);										//mov byte [base + disp], al
+	emitMemory(as, RAX, base, disp + (int32_t)offsetof(Value, as.boolean));
+#endif
+}
+
+static void writeBack(Assembler* as, Snapshot* snapshot)
+{
+	for (int i = 0; i < snapshot->count; i++) {
+		SnapshotEntry* entry = &recorder.entries[snapshot->first + i];
+		if (entry->position >= 0) {
+			materialize(as, R12, entry->position * VALUE_SIZE, entry->ref);
+		}
+		else {
+			materialize(as, R13, (-1 - entry->position) * VALUE_SIZE, entry->ref);
+		}
+	}
+}
+
+//Type guard for a load from [base + disp], returns the jump to patch.
+static int guardType(Assembler* as, Register base, int32_t disp, IrType type)
+{
+	if (type == IR_NUMBER) return guardNumber(as, base, disp);
+
+#ifdef NAN_BOXING
+	load(as, RCX, base, disp);
+	emitBytes(as, 4, (uint8_t[]){ 0x48, 0x83, 0xC9, 0x01 });	//or rcx, 1
+	movImmediate(as, RDX, TRUE_VAL);
+	compareRegisters(as, RCX, RDX);
+#else
+	compareInt(as, base, disp + (int32_t)offsetof(Value, type), VAL_BOOL);
+#endif
+	return emitJump(as, CC_NOT_EQUAL);
+}
+
+static void emitLoad(Assembler* as, int ref, Register base, int32_t disp)
+{
+	IrIns* ins = &recorder.ir[ref];
+	ins->patch = guardType(as, base, disp, ins->type);
+
+	if (ins->type == IR_NUMBER) {
+		loadDouble(as, 0, base, disp + NUMBER_OFFSET);
+		storeDouble(as, RSP, spill(ref), 0);
+		return;
+	}
+
+#ifdef NAN_BOXING
+	load(as, RAX, base, disp);
+	emitBytes(as, 3, (uint8_t[]){ 0x83, 0xE0, 0x01 });		//and eax, 1
+#else
+	emitRex(as, false, RAX, base);
+	emitBytes(as, 2, (uint8_t[]){ 0x0F, 0xB6 });			//movzx eax, byte [base + disp]
+	emitMemory(as, RAX, base, disp + (int32_t)offsetof(Value, as.boolean));
+#endif
+	store(as, RSP, spill(ref), RAX);
+}
+
+static void emitIrIns(Assembler* as, int ref)
+{
+	IrIns* ins = &recorder.ir[ref];
+
+	switch (ins->op) {
+	case IR_CONSTANT:
+		//Materialized wherever it is used.
+		break;
+	case IR_LOAD_SLOT:
+		emitLoad(as, ref, R12, ins->a * VALUE_SIZE);
+		break;
+	case IR_LOAD_GLOBAL:
+		emitLoad(as, ref, R13, ins->a * VALUE_SIZE);
+		break;
+
+	case IR_ADD:
+	case IR_SUBTRACT:
+	case IR_MULTIPLY:
+	case IR_DIVIDE:
+	{
+		static const uint8_t opcodes[] = { 0x58, 0x5C, 0x59, 0x5E };
+		loadNumberRef(as, 0, ins->a);
+		loadNumberRef(as, 1, ins->b);
+		doubleArithmetic(as, opcodes[ins->op - IR_ADD]);
+		storeDouble(as, RSP, spill(ref), 0);
+		break;
+	}
+	case IR_NEGATE:
+		loadNumberRef(as, 0, ins->a);
+		movImmediate(as, RAX, (uint64_t)1 << 63);
+		emitBytes(as, 5, (uint8_t[]){ 0x66, 0x48, 0x0F, 0x6E, 0xC8 });	//movq xmm1, rax
+		emitBytes(as, 4, (uint8_t[]){ 0x66, 0x0F, 0x57, 0xC1 });		//xorpd xmm0, xmm1
+		storeDouble(as, RSP, spill(ref), 0);
+		break;
+	case IR_LESS:
+	case IR_GREATER:
+	case IR_LESS_EQUAL:
+	case IR_GREATER_EQUAL:
+		//'above' is false for unordered operands, matching C's NaN rules.
+		loadNumberRef(as, 0, ins->a);
+		loadNumberRef(as, 1, ins->b);
+		if (ins->op == IR_GREATER || ins->op == IR_GREATER_EQUAL) compareDoubles(as, 0, 1);
+		else compareDoubles(as, 1, 0);
+		storeFlag(as, ins->op == IR_LESS || ins->op == IR_GREATER ? CC_ABOVE : CC_ABOVE_EQUAL, ref);
+		break;
+	case IR_EQUAL:
+		if (recorder.ir[ins->a].type == IR_NUMBER) {
+			loadNumberRef(as, 0, ins->a);
+			loadNumberRef(as, 1, ins->b);
+			compareDoubles(as, 0, 1);
+			emitBytes(as, 3, (uint8_t[]){ 0x0F, 0x94, 0xC0 });	//sete al
+			emitBytes(as, 3, (uint8_t[]){ 0x0F, 0x9B, 0xC1 });	//setnp cl
+			emitBytes(as, 2, (uint8_t[]){ 0x20, 0xC8 });		//and al, cl
+			emitBytes(as, 3, (uint8_t[]){ 0x0F, 0xB6, 0xC0 });	//movzx eax, al
+			store(as, RSP, spill(ref), RAX);
+		}
+		else {
+			loadBoolRef(as, RAX, ins->a);
+			loadBoolRef(as, RCX, ins->b);
+			compareRegisters(as, RAX, RCX);
+			storeFlag(as, CC_EQUAL, ref);
+		}
+		break;
+	case IR_NOT:
+		loadBoolRef(as, RAX, ins->a);
+		emitBytes(as, 3, (uint8_t[]){ 0x83, 0xF0, 0x01 });		//xor eax, 1
+		store(as, RSP, spill(ref), RAX);
+		break;
+
+	case IR_GUARD_TRUE:
+	case IR_GUARD_FALSE:
+		compareLong(as, RSP, spill(ins->a), 0);
+		ins->patch = emitJump(as, ins->op == IR_GUARD_TRUE ? CC_EQUAL : CC_NOT_EQUAL);
+		break;
+	}
+}
+
+//Native layout of a trace, called as int trace(Value* slots, Value* globals):
+//
+//  prologue
+//  loop:   the IR, then the loop's own write back, jmp loop
+//  exits:  one stub per snapshot: write back, set vm.stackTop, eax = exit
+//  epilogue
+static bool compileTrace(Trace* trace)
+{
+	//The state at the loop back edge is written back every iteration so the
+	//next one can reload it.
+	int loopSnapshot = takeSnapshot(recorder.header);
+	if (recorder.isAborted) return false;
+
+	markUsed();
+
+	int32_t frameSize = (recorder.irCount * 8 + 15) & ~15;
+
+	Assembler as;
+	as.code = NULL;
+	as.count = 0;
+	as.capacity = 0;
+	as.fixups = NULL;
+	as.fixupCount = 0;
+	as.fixupCapacity = 0;
+	as.entries = NULL;
+
+	emitByte(&as, 0x53);								//push rbx
+	emitBytes(&as, 2, (uint8_t[]){ 0x41, 0x54 });		//push r12
+	emitBytes(&as, 2, (uint8_t[]){ 0x41, 0x55 });		//push r13
+	emitBytes(&as, 3, (uint8_t[]){ 0x48, 0x81, 0xEC });	//sub rsp, frameSize
+	emitInt(&as, (uint32_t)frameSize);
+	emitBytes(&as, 3, (uint8_t[]){ 0x49, 0x89, 0xFC });	//mov r12, rdi
+	emitBytes(&as, 3, (uint8_t[]){ 0x49, 0x89, 0xF5 });	//mov r13, rsi
+
+	int loop = as.count;
+	for (int i = 0; i < recorder.irCount; i++) {
+		if (recorder.ir[i].isUsed) emitIrIns(&as, i);
+	}
+	writeBack(&as, &recorder.snapshots[loopSnapshot]);
+	patchJump(&as, emitJump(&as, CC_ALWAYS), loop);
+
+	int* stubs = ALLOCATE(int, recorder.snapshotCount);
+	int epilogueJumps[TRACE_MAX_IR];
+	for (int i = 0; i < recorder.snapshotCount; i++) {
+		Snapshot* snapshot = &recorder.snapshots[i];
+		stubs[i] = as.count;
+		if (i == loopSnapshot) {
+			epilogueJumps[i] = -1;
+			continue;
+		}
+
+		writeBack(&as, snapshot);
+		emitRex(&as, true, RAX, R12);
+		emitByte(&as, 0x8D);							//lea rax, [r12 + depth]
+		emitMemory(&as, RAX, R12, snapshot->depth * VALUE_SIZE);
+		movImmediate(&as, RCX, (uint64_t)(uintptr_t)&vm.stackTop);
+		store(&as, RCX, 0, RAX);
+		movImmediate(&as, RAX, (uint64_t)i);
+		epilogueJumps[i] = emitJump(&as, CC_ALWAYS);
+	}
+
+	for (int i = 0; i < recorder.snapshotCount; i++) {
+		if (epilogueJumps[i] >= 0) patchJumpHere(&as, epilogueJumps[i]);
+	}
+	emitBytes(&as, 3, (uint8_t[]){ 0x48, 0x81, 0xC4 });	//add rsp, frameSize
+	emitInt(&as, (uint32_t)frameSize);
+	emitBytes(&as, 2, (uint8_t[]){ 0x41, 0x5D });		//pop r13
+	emitBytes(&as, 2, (uint8_t[]){ 0x41, 0x5C });		//pop r12
+	emitByte(&as, 0x5B);								//pop rbx
+	emitByte(&as, 0xC3);								//ret
+
+	for (int i = 0; i < recorder.irCount; i++) {
+		IrIns* ins = &recorder.ir[i];
+		if (ins->isUsed && ins->patch >= 0) patchJump(&as, ins->patch, stubs[ins->snapshot]);
+	}
+	FREE_ARRAY(int, stubs, recorder.snapshotCount);
+
+	size_t size;
+	uint8_t* code = makeExecutable(&as, &size);
+	freeAssembler(&as, 0);
+	if (code == NULL) return false;
+
+	trace->exits = ALLOCATE(int, recorder.snapshotCount);
+	trace->exitCount = recorder.snapshotCount;
+	for (int i = 0; i < recorder.snapshotCount; i++) {
+		trace->exits[i] = recorder.snapshots[i].offset;
+	}
+
+	trace->code = code;
+	trace->size = size;
+	return true;
+}
+
+bool traceLoop(CallFrame* frame)
+{
+	ObjFunction* function = frame->closure->function;
+	Trace* trace = traceAnchor(function, (int)(frame->ip - function->chunk.code));
+
+	if (trace->code == NULL) {
+		if (--trace->countdown > 0) return false;
+
+		if (!recordTrace(frame, trace->header) || !compileTrace(trace)) {
+			//Not worth another try.
+			trace->countdown = INT32_MAX;
+			return false;
+		}
+	}
+
+	int (*enter)(Value*, Value*) = (int (*)(Value*, Value*))(void*)trace->code;
+	int exit = enter(frame->slots, vm.globalValues);
+	frame->ip = function->chunk.code + trace->exits[exit];
+	return true;
+}
+
+//Back edge slow path for baseline compiled code, 'ip' is the OP_LOOP.
+int jitLoop(uint8_t* ip)
+{
+	CallFrame* frame = &vm.frames[vm.frameCount - 1];
+	frame->ip = ip + 3 - ((ip[1] << 8) | ip[2]);
+	return traceLoop(frame) ? JIT_EXIT_FRAME : JIT_CONTINUE;
+}
+
+void jitFree(ObjFunction* function)
+{
+	Trace* trace = function->traces;
+	while (trace != NULL) {
+		Trace* next = trace->next;
+		if (trace->code != NULL) munmap(trace->code, trace->size);
+		FREE_ARRAY(int, trace->exits, trace->exitCount);
+		FREE(Trace, trace);
+		trace = next;
+	}
+	function->traces = NULL;
+
+	JitCode* jit = function->jit;
+	if (jit == NULL) return;
+
+	munmap(jit->code, jit->size);
+	FREE_ARRAY(uint32_t, jit->entries, jit->entryCount);
+	FREE(JitCode, jit);
+	function->jit = NULL;
+}
+
+#endif
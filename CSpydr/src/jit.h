@@ -0,0 +1,81 @@
+#ifndef cspydr_jit_h
+#define cspydr_jit_h
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+//What compiled code hands back to the interpreter when it leaves a frame.
+typedef enum
+{
+	JIT_CONTINUE,		//Only passed between the slow paths and native code.
+	JIT_EXIT_FRAME,		//A call or return switched frames.
+	JIT_EXIT_ERROR,
+	JIT_EXIT_DONE
+} JitStatus;
+
+#ifdef JIT_ENABLED
+
+typedef struct sJitCode
+{
+	uint8_t* code;
+	size_t size;
+	uint32_t* entries;	//Native offset of every instruction, by bytecode offset.
+	int entryCount;
+} JitCode;
+
+//A hot loop header. Starts out as a back edge counter and holds the native
+//code of the recorded loop body once it has been traced.
+typedef struct sTrace
+{
+	struct sTrace* next;
+	int header;			//Bytecode offset of the loop header.
+	int countdown;		//Back edges left before recording.
+	uint8_t* code;
+	size_t size;
+	int* exits;			//Bytecode offset to resume at, per side exit.
+	int exitCount;
+} Trace;
+
+typedef int (*JitHelper)(uint8_t* ip);
+
+bool jitCompile(ObjFunction* function);
+JitStatus jitRun(CallFrame* frame);
+void jitFree(ObjFunction* function);
+
+bool traceLoop(CallFrame* frame);
+int jitLoop(uint8_t* ip);
+
+//Slow paths, implemented in vm.c.
+int jitNegate(uint8_t* ip);
+int jitNot(uint8_t* ip);
+int jitEqual(uint8_t* ip);
+int jitBinary(uint8_t* ip);
+int jitIncLocal(uint8_t* ip);
+int jitRegisterBinary(uint8_t* ip);
+int jitPrint(uint8_t* ip);
+int jitDefineGlobal(uint8_t* ip);
+int jitDefineConstant(uint8_t* ip);
+int jitGetGlobal(uint8_t* ip);
+int jitSetGlobal(uint8_t* ip);
+int jitGetUpvalue(uint8_t* ip);
+int jitSetUpvalue(uint8_t* ip);
+int jitCloseUpvalue(uint8_t* ip);
+int jitGetProperty(uint8_t* ip);
+int jitSetProperty(uint8_t* ip);
+int jitGetSuper(uint8_t* ip);
+int jitCall(uint8_t* ip);
+int jitTailCall(uint8_t* ip);
+int jitInvoke(uint8_t* ip);
+int jitTailInvoke(uint8_t* ip);
+int jitSuperInvoke(uint8_t* ip);
+int jitTailSuperInvoke(uint8_t* ip);
+int jitClosure(uint8_t* ip);
+int jitClass(uint8_t* ip);
+int jitMethod(uint8_t* ip);
+int jitInherit(uint8_t* ip);
+int jitReturn(uint8_t* ip);
+
+#endif
+
+#endif
@@ -1,101 +1,242 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-
-#include "common.h"
-#include "chunk.h"
-#include "debug.h"
-#include "vm.h"
-
-bool scannerIsMuted;
-
-static void repl()
-{
-	printf("Starting in repl compile mode.\n");
-	char line[1024];
-	for (;;)
-	{
-		if (!scannerIsMuted) {
-			printf("[Spydr] >> ");
-
-			if (!fgets(line, sizeof(line), stdin)) {
-				printf("\n");
-				break;
-			}
-		}
-		interpret(line);
-	}
-}
-
-static char* readFile(const char *path)
-{
-	FILE* file = fopen(path, "rb");
-	if (file == NULL)
-	{
-		fprintf(stderr, "Could not open file \"%s\".\n", path);
-		exit(74);
-	}
-
-	fseek(file, 0L, SEEK_END);
-	size_t fileSize = ftell(file);
-	rewind(file);
-
-	char* buffer = (char *)malloc(fileSize + 1);
-	if (buffer == NULL)
-	{
-		fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
-		exit(74);
-	}
-
-	size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
-	if (bytesRead < fileSize)
-	{
-		fprintf(stderr, "Could not read file\"%s\".\n", path);
-	}
-	buffer[bytesRead] = '\0';
-
-	fclose(file);
-	return buffer;
-}
-
-static void runFile(const char *path)
-{
-	char* source = readFile(path);
-	InterpretResult result = interpret(source);
-	free(source);
-
-	if (result == INTERPRET_COMPILE_ERROR)
-		exit(65);
-	if (result == INTERPRET_RUNTIME_ERROR)
-		exit(70);
-}
-
-int main(int argc, const char *argv[])
-{
-	printf("The CSpydr Programming Language Compiler\n");
-	PRINT_OK(stdout);
-	printf("Build Version: %s\n", CSPYDR_VERSION);
-	PRINT_RESET(stdout);
-
-	initVM();
-	scannerIsMuted = false;
-	if (argc == 1)
-	{
-		repl();
-	}
-	else if (argc == 2)
-	{
-		printf("Compiling %s ...\n", argv[1]);
-		runFile(argv[1]);
-		system("pause");
-	}
-	else
-	{
-		fprintf(stderr, "Usage: cspydr [path]\n");
-		exit(64);
-	}
-
-	freeVM();
-	return 0;
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "chunk.h"
+#include "debug.h"
+#include "memory.h"
+#include "opprofile.h"
+#include "vm.h"
+
+bool scannerIsMuted;
+static bool gcStatsOnExit = false;
+static const char* opcodeProfile = NULL;
+
+static void repl()
+{
+	printf("Starting in repl compile mode.\n");
+	char line[1024];
+	for (;;)
+	{
+		if (!scannerIsMuted) {
+			printf("[Spydr] >> ");
+
+			if (!fgets(line, sizeof(line), stdin)) {
+				printf("\n");
+				break;
+			}
+		}
+		interpret(line);
+	}
+}
+
+static char* readFile(const char *path)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Could not open file \"%s\".\n", path);
+		exit(74);
+	}
+
+	fseek(file, 0L, SEEK_END);
+	size_t fileSize = ftell(file);
+	rewind(file);
+
+	char* buffer = (char *)malloc(fileSize + 1);
+	if (buffer == NULL)
+	{
+		fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
+		exit(74);
+	}
+
+	size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
+	if (bytesRead < fileSize)
+	{
+		fprintf(stderr, "Could not read file\"%s\".\n", path);
+	}
+	buffer[bytesRead] = '\0';
+
+	fclose(file);
+	return buffer;
+}
+
+//A byte count with an optional k, m or g suffix, or 0 when it is not one.
+static size_t parseSize(const char* text)
+{
+	char* end;
+	double size = strtod(text, &end);
+	switch (*end)
+	{
+	case 'k': case 'K': size *= 1024; end++; break;
+	case 'm': case 'M': size *= 1024 * 1024; end++; break;
+	case 'g': case 'G': size *= 1024.0 * 1024 * 1024; end++; break;
+	}
+	return *end == '\0' && size > 0 ? (size_t)size : 0;
+}
+
+static void runFile(const char *path)
+{
+	char* source = readFile(path);
+	InterpretResult result = interpret(source);
+	free(source);
+
+	if (gcStatsOnExit) printGcStats(stderr);
+	if (opcodeProfile != NULL) writeOpcodeProfile(opcodeProfile);
+
+	if (result == INTERPRET_COMPILE_ERROR)
+		exit(65);
+	if (result == INTERPRET_RUNTIME_ERROR)
+		exit(70);
+}
+
+int main(int argc, const char *argv[])
+{
+	printf("The CSpydr Programming Language Compiler\n");
+	PRINT_OK(stdout);
+	printf("Build Version: %s\n", CSPYDR_VERSION);
+	PRINT_RESET(stdout);
+
+	initVM();
+	scannerIsMuted = false;
+	GcPacing pacing = vm.gcPacing;
+	const char* superinstructionProfile = NULL;
+
+	int arg = 1;
+	for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++)
+	{
+		if (strcmp(argv[arg], "--no-jit") == 0)
+		{
+			vm.jitEnabled = false;
+		}
+		else if (strcmp(argv[arg], "--no-optimize") == 0)
+		{
+			vm.optimizeBytecode = false;
+		}
+		else if (strcmp(argv[arg], "--register-vm") == 0)
+		{
+			vm.registerCode = true;
+		}
+		else if (strcmp(argv[arg], "--stack-vm") == 0)
+		{
+			vm.registerCode = false;
+		}
+		else if (strcmp(argv[arg], "--gc-incremental") == 0)
+		{
+			vm.gcIncremental = true;
+		}
+		else if (strcmp(argv[arg], "--gc-concurrent") == 0)
+		{
+			//Builds without a background marker fall back to incremental marking.
+			vm.gcIncremental = true;
+			vm.gcConcurrent = true;
+#ifndef CONCURRENT_GC_ENABLED
+			fprintf(stderr, "Concurrent marking needs a build with NAN_BOXING defined, marking incrementally instead.\n");
+#endif
+		}
+		else if (strcmp(argv[arg], "--gc-compact") == 0)
+		{
+			vm.gcCompact = true;
+		}
+		else if (strcmp(argv[arg], "--gc-stats") == 0)
+		{
+			gcStatsOnExit = true;
+		}
+		else if (strncmp(argv[arg], "--gc-target-heap=", 17) == 0 && parseSize(argv[arg] + 17) > 0)
+		{
+			pacing.targetHeap = parseSize(argv[arg] + 17);
+		}
+		else if (strncmp(argv[arg], "--gc-max-heap=", 14) == 0 && parseSize(argv[arg] + 14) > 0)
+		{
+			pacing.maxHeap = parseSize(argv[arg] + 14);
+		}
+		else if (strncmp(argv[arg], "--gc-grow=", 10) == 0 && atof(argv[arg] + 10) > 1)
+		{
+			pacing.growFactor = atof(argv[arg] + 10);
+		}
+		else if (strncmp(argv[arg], "--gc-time-ratio=", 16) == 0 && atof(argv[arg] + 16) > 0 && atof(argv[arg] + 16) < 100)
+		{
+			//A percentage on the command line.
+			pacing.gcTimeRatio = atof(argv[arg] + 16) / 100;
+		}
+		else if (strncmp(argv[arg], "--gc-pause=", 11) == 0 && atof(argv[arg] + 11) > 0)
+		{
+			//In milliseconds on the command line.
+			pacing.pauseTarget = atof(argv[arg] + 11) / 1000;
+		}
+		else if (strncmp(argv[arg], "--gc-threads=", 13) == 0 && atoi(argv[arg] + 13) > 0)
+		{
+			int threads = atoi(argv[arg] + 13);
+			vm.gcThreads = threads < GC_MAX_THREADS ? threads : GC_MAX_THREADS;
+		}
+		else if (strncmp(argv[arg], "--gc-step=", 10) == 0 && atoi(argv[arg] + 10) > 0)
+		{
+			//Slices smaller than the pacing would ever pick never catch up.
+			int work = atoi(argv[arg] + 10);
+			vm.gcStepWork = work > GC_MIN_STEP_WORK ? work : GC_MIN_STEP_WORK;
+		}
+		else if (strcmp(argv[arg], "--jit-all") == 0)
+		{
+			//Compile every function on its first call and trace every loop
+			//on its first back edge.
+			vm.jitThreshold = 0;
+			vm.traceThreshold = 1;
+		}
+		else if (strncmp(argv[arg], "--profile-ops=", 14) == 0 && argv[arg][14] != '\0')
+		{
+#ifdef PROFILE_OPCODES
+			opcodeProfile = argv[arg] + 14;
+#else
+			fprintf(stderr, "Opcode profiles need a build with PROFILE_OPCODES defined.\n");
+			exit(64);
+#endif
+		}
+		else if (strncmp(argv[arg], "--gen-superinstructions=", 24) == 0 && argv[arg][24] != '\0')
+		{
+			superinstructionProfile = argv[arg] + 24;
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option \"%s\".\n", argv[arg]);
+			exit(64);
+		}
+	}
+	setGcPacing(pacing);
+
+	//Takes the header to write instead of a script.
+	if (superinstructionProfile != NULL)
+	{
+		if (arg != argc - 1)
+		{
+			fprintf(stderr, "Usage: cspydr --gen-superinstructions=<profile> <header>\n");
+			exit(64);
+		}
+		bool isGenerated = generateSuperinstructions(superinstructionProfile, argv[arg]);
+		freeVM();
+		return isGenerated ? 0 : 74;
+	}
+
+	if (arg == argc)
+	{
+		repl();
+		if (gcStatsOnExit) printGcStats(stderr);
+		if (opcodeProfile != NULL) writeOpcodeProfile(opcodeProfile);
+	}
+	else if (arg == argc - 1)
+	{
+		printf("Compiling %s ...\n", argv[arg]);
+		runFile(argv[arg]);
+		system("pause");
+	}
+	else
+	{
+		fprintf(stderr, "Usage: cspydr [--no-optimize] [--register-vm] [--stack-vm] [--no-jit] [--jit-all] [--gc-incremental] [--gc-concurrent (NAN_BOXING builds)] [--gc-compact] [--gc-stats] [--gc-threads=<n>] [--gc-step=<objects>] [--gc-target-heap=<size>] [--gc-max-heap=<size>] [--gc-grow=<factor>] [--gc-time-ratio=<percent>] [--gc-pause=<ms>] [--profile-ops=<profile>] [path]\n"
+			"       cspydr --gen-superinstructions=<profile> <header>\n");
+		exit(64);
+	}
+
+	freeVM();
+	return 0;
 }
\ No newline at end of file
@@ -1,289 +1,1498 @@
-#include <stdlib.h>
-
-#include "memory.h"
-#include "vm.h"
-#include "compiler.h"
-
-#ifdef DEBUG_LOG_GC
-#include <stdio.h>
-#include "debug.h"
-#endif
-
-#define GC_HEAP_GROW_FACTOR 2
-
-void *reallocate(void *pointer, size_t oldSize, size_t newSize)
-{
-	vm.bytesAllocated += newSize - oldSize;
-
-	if (newSize > oldSize) {
-#ifdef DEBUG_STRESS_GC
-		collectGarbage();
-#endif
-
-		if (vm.bytesAllocated > vm.nextGC) {
-			collectGarbage();
-		}
-	}
-
-	if (newSize == 0)
-	{
-		free(pointer);
-		return NULL;
-	}
-
-	void *result = realloc(pointer, newSize);
-	if (result == NULL)
-		exit(1);
-	return result;
-}
-
-static void freeObject(Obj *object)
-{
-#ifdef DEBUG_LOG_GC
-	PRINT_DEBUG(stdout);
-	printf("%p free type %d\n", (void*)object->type);
-	PRINT_RESET(stdout);
-#endif
-
-	switch (object->type)
-	{
-	case OBJ_BOUND_METHOD:
-		FREE(ObjBoundMethod, object);
-		break;
-
-	case OBJ_CLASS:
-	{
-		ObjClass* _class = (ObjClass*)object;
-		freeTable(&_class->methods);
-		FREE(ObjClass, object);
-		break;
-	}
-	case OBJ_INSTANCE:
-	{
-		ObjInstance* instance = (ObjInstance*)object;
-		freeTable(&instance->fields);
-		FREE(ObjInstance, object);
-		break;
-	}
-	case OBJ_FUNCTION:
-	{
-		ObjFunction* function = (ObjFunction*)object;
-		freeChunk(&function->chunk);
-		FREE(ObjFunction, object);
-		break;
-	}
-	case OBJ_CLOSURE:
-	{
-		ObjClosure* closure = (ObjClosure*)object;
-		FREE_ARRAY(ObjUpvalue*, closure->upvalues,closure->upvalueCount);
-		FREE(ObjClosure, object);
-		break;
-	}
-	case OBJ_NATIVE:
-	{
-		FREE(ObjNative, object);
-		break;
-	}
-	case OBJ_UPVALUE:
-		FREE(ObjUpvalue, object);
-		break;
-	case OBJ_STRING:
-	{
-		ObjString *string = (ObjString *)object;
-		FREE_ARRAY(char, string->chars, string->length + 1);
-		FREE(ObjString, object);
-		break;
-	}
-	}
-}
-
-void freeObjects()
-{
-	Obj *object = vm.objects;
-	while (object != NULL)
-	{
-		Obj *next = object->next;
-		freeObject(object);
-		object = next;
-	}
-
-	free(vm.grayStack);
-}
-
-void markObject(Obj* object)
-{
-	if (object == NULL) return;
-	if (object->isMarked) return;
-
-#ifdef DEBUG_LOG_GC
-	PRINT_DEBUG(stdout);
-	printf("%p mark ", (void*)object);
-	printValue(OBJ_VAL(object));
-	printf("\n");
-	PRINT_RESET(stdout);
-#endif
-
-	object->isMarked = true;
-
-	if (vm.grayCapacity < vm.grayCount + 1) {
-		vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);
-		vm.grayStack = realloc(vm.grayStack, sizeof(Obj*) * vm.grayCapacity);
-
-		if (vm.grayStack == NULL) exit(1);
-	}
-
-	vm.grayStack[vm.grayCount++] = object;
-}
-
-void markValue(Value value)
-{
-	if (!IS_OBJ(value)) return;
-	markObject(AS_OBJ(value));
-}
-
-void markArray(ValueArray* array) 
-{
-	for (int i = 0; i < array->count; i++) {
-		markValue(array->values[i]);
-	}
-}
-
-static void markRoots()
-{
-	for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
-		markValue(*slot);
-	}
-
-	for (int i = 0; i < vm.frameCount; i++) {
-		markObject((Obj*)vm.frames[i].closure);
-	}
-
-	for (ObjUpvalue* upvalue = vm.openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
-		markObject((Obj*)upvalue);
-	}
-
-	markTable(&vm.globals);
-	markCompilerRoots();
-	markObject((Obj*)vm.initString);
-}
-
-static void blackenObject(Obj* object)
-{
-#ifdef DEBUG_LOG_GC
-	PRINT_DEBUG(stdout);
-	printf("%p blacken ", (void*)object);
-	printValue(OBJ_VAL(object));
-	printf("\n");
-	PRINT_RESET(stdout);
-#endif
-
-	switch (object->type) {
-	case OBJ_BOUND_METHOD:
-	{
-		ObjBoundMethod* bound = (ObjBoundMethod*)object;
-		markValue(bound->reciever);
-		markObject((Obj*)bound->method);
-		break;
-	}
-
-	case OBJ_CLASS:
-	{
-		ObjClass* _class = (ObjClass*)object;
-		markObject((Obj*)_class->name);
-		markTable(&_class->methods);
-		break;
-	}
-
-	case OBJ_CLOSURE:
-	{
-		ObjClosure* closure = (ObjClosure*)object;
-		markObject((Obj*)closure->function);
-		for (int i = 0; i < closure->upvalueCount; i++) {
-			markObject((Obj*)closure->upvalues[i]);
-		}
-		break;
-	}
-
-	case OBJ_FUNCTION:
-	{
-		ObjFunction* function = (ObjFunction*)object;
-		markObject((Obj*)function->name);
-		markArray(&function->chunk.constants);
-		break;
-	}
-
-	case OBJ_INSTANCE:
-	{
-		ObjInstance* instance = (ObjInstance*)object;
-		markObject((Obj*)instance->_class);
-		markTable(&instance->fields);
-		break;
-	}
-
-	case OBJ_UPVALUE:
-		markValue(((ObjUpvalue*)object)->closed);
-		break;
-
-	case OBJ_NATIVE:
-	case OBJ_STRING:
-		break;
-	}
-}
-
-static void traceReferences()
-{
-	while (vm.grayCount > 0) {
-		Obj* object = vm.grayStack[--vm.grayCount];
-		blackenObject(object);
-	}
-}
-
-static void sweep()
-{
-	Obj* previous = NULL;
-	Obj* object = vm.objects;
-
-	while (object != NULL) {
-		if (object->isMarked) {
-			object->isMarked = false;
-			previous = object;
-			object = object->next;
-		}
-		else {
-			Obj* unreached = object;
-
-			object = object->next;
-			if (previous != NULL) {
-				previous->next = object;
-			}
-			else {
-				vm.objects = object;
-			}
-
-			freeObject(unreached);
-		}
-	}
-}
-
-void collectGarbage()
-{
-#ifdef DEBUG_LOG_GC
-	PRINT_INFO(stdout);
-	printf("-- gc begin\n");
-	size_t before = vm.bytesAllocated;
-	PRINT_RESET(stdout);
-#endif
-	markRoots();
-	traceReferences();
-	tableRemoveWhite(&vm.strings);
-	sweep();
-
-	vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
-
-#ifdef DEBUG_LOG_GC
-	PRINT_INFO(stdout);
-	printf("-- gc end\n");
-	printf("   collected %ld bytes (from %ld to %ld) next at %ld\n", before - vm.bytesAllocated, before, vm.bytesAllocated, vm.nextGC);
-	PRINT_RESET(stdout);
-#endif
-}
\ No newline at end of file
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+#include "vm.h"
+#include "compiler.h"
+#include "jit.h"
+#include "slab.h"
+
+#ifdef DEBUG_LOG_GC
+#include <stdio.h>
+#include "debug.h"
+#endif
+
+#if defined(CONCURRENT_GC_ENABLED) || defined(PARALLEL_GC_ENABLED)
+#include <pthread.h>
+#endif
+
+#ifdef PARALLEL_GC_ENABLED
+#include <sched.h>
+
+//Gray objects a marker offers to the others at a time.
+#define GC_SHARE_SIZE 64
+
+typedef struct
+{
+	pthread_t thread;
+	Obj** stack;
+	int count;
+	int capacity;
+
+	//Gray objects other markers may steal.
+	pthread_mutex_t lock;
+	Obj** shared;
+	int sharedCount;
+
+	size_t bytesFreed;
+	SlabFreeList freeSlots;
+} GcWorker;
+
+static GcWorker workers[GC_MAX_THREADS];
+static __thread GcWorker* currentWorker = NULL;
+static int workerCount;
+static int idleWorkers;
+static int sharedTotal;
+static int nextRegion;
+#endif
+
+//Bytes allocated between two slices of an incremental collection.
+#define GC_STEP_SIZE (32 * 1024)
+//Share of nextGC the heap may grow past it while an incremental cycle runs,
+//after which the cycle is finished in one go.
+#define GC_OVERDUE_MARGIN 0.5
+//With DEBUG_STRESS_GC, allocations per full collection.
+#define GC_STRESS_FULL_INTERVAL 4
+//Shares of the nursery surviving a minor collection above which it grows,
+//and below which it shrinks again.
+#define GC_NURSERY_GROW_SURVIVAL 0.25
+#define GC_NURSERY_SHRINK_SURVIVAL 0.05
+
+static void startCycle(bool isConcurrent);
+static void gcStep(int work);
+
+#ifdef CONCURRENT_GC_ENABLED
+static pthread_t marker;
+static void** deferredFrees = NULL;
+static int deferredCount = 0;
+static int deferredCapacity = 0;
+
+static void joinMarker();
+
+//While the background marker runs, no block it may be reading is given
+//back: a reallocation copies instead, and the old block is freed once
+//marking is over.
+static void* reallocateDeferred(void* pointer, size_t oldSize, size_t newSize)
+{
+	void* result = NULL;
+	if (newSize > 0) {
+		result = malloc(newSize);
+		if (result == NULL) exit(1);
+		if (pointer != NULL) memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+	}
+
+	if (pointer != NULL) {
+		if (deferredCapacity < deferredCount + 1) {
+			deferredCapacity = GROW_CAPACITY(deferredCapacity);
+			deferredFrees = realloc(deferredFrees, sizeof(void*) * deferredCapacity);
+
+			if (deferredFrees == NULL) exit(1);
+		}
+		deferredFrees[deferredCount++] = pointer;
+	}
+	return result;
+}
+#endif
+
+//True once the program allocates faster than the slices keep up with, or
+//the heap is past its limit.
+static bool isCycleOverdue()
+{
+	if (vm.gcPacing.maxHeap > 0 && vm.bytesAllocated > vm.gcPacing.maxHeap) return true;
+	return vm.bytesAllocated > vm.nextGC + (size_t)(vm.nextGC * GC_OVERDUE_MARGIN);
+}
+
+//The work of a slice is gcStepWork for every GC_STEP_SIZE bytes allocated
+//since the last one, so allocating in large blocks does not skip slices.
+static int sliceWork()
+{
+	size_t last = vm.nextGCStep - GC_STEP_SIZE;
+	size_t steps = vm.bytesAllocated > last ? (vm.bytesAllocated - last) / GC_STEP_SIZE : 1;
+	if (steps < 1) steps = 1;
+
+	double work = (double)vm.gcStepWork * steps;
+	return work > INT_MAX / 2 ? INT_MAX / 2 : (int)work;
+}
+
+//Runs whatever collection work the bytes just allocated made due.
+static void collectIfDue()
+{
+#ifdef DEBUG_STRESS_GC
+	//Every allocation collects the nursery, or does a slice of the cycle in
+	//progress, and every few start a full collection, so the old generation
+	//and the write barrier get stressed as well.
+	static int stressCount = 0;
+	if (vm.gcPhase != GC_IDLE) gcStep(vm.gcStepWork);
+	else if (++stressCount % GC_STRESS_FULL_INTERVAL != 0) collectYoung();
+	else if (vm.gcIncremental) startCycle(vm.gcConcurrent);
+	else collectGarbage();
+#endif
+
+	if (vm.gcPhase != GC_IDLE) {
+		if (isCycleOverdue()) {
+			//Waits for the background marker, if it is still going.
+			while (vm.gcPhase != GC_IDLE) gcStep(INT_MAX);
+		}
+		else if (vm.bytesAllocated > vm.nextGCStep) {
+			gcStep(sliceWork());
+		}
+	}
+	else if (vm.bytesAllocated > vm.nextGC) {
+		if (vm.gcIncremental) startCycle(vm.gcConcurrent);
+		else collectGarbage();
+	}
+	else if (vm.bytesAllocated > vm.nextMinorGC) {
+		collectYoung();
+	}
+}
+
+void *reallocate(void *pointer, size_t oldSize, size_t newSize)
+{
+#ifdef PARALLEL_GC_ENABLED
+	//Sweeper threads only free, and count it on the side.
+	if (currentWorker != NULL) {
+		currentWorker->bytesFreed += oldSize;
+		free(pointer);
+		return NULL;
+	}
+#endif
+
+	vm.bytesAllocated += newSize - oldSize;
+	if (newSize > oldSize) collectIfDue();
+	else vm.gcStats.bytesFreed += oldSize - newSize;
+
+#ifdef CONCURRENT_GC_ENABLED
+	if (vm.isMarkerRunning) return reallocateDeferred(pointer, oldSize, newSize);
+#endif
+
+	if (newSize == 0)
+	{
+		free(pointer);
+		return NULL;
+	}
+
+	void *result = realloc(pointer, newSize);
+	if (result == NULL)
+		exit(1);
+	return result;
+}
+
+#ifdef SLAB_ENABLED
+static int sweepPage(SlabPage* page, bool freeAll);
+#endif
+
+//Memory for an object header and its fixed fields. Every object type fits
+//in a slab slot.
+void* allocateSlot(size_t size)
+{
+#ifdef SLAB_ENABLED
+	vm.bytesAllocated += size;
+	collectIfDue();
+
+	//Pages the last collection has not swept yet are swept here, as the size
+	//class runs out of free slots, rather than all at once after marking.
+	int sizeClass = SLAB_CLASS(size);
+	if (vm.gcPhase == GC_SWEEP && !slabHasFreeSlot(sizeClass)) {
+		gcPauseBegin();
+		while (!slabHasFreeSlot(sizeClass)) {
+			SlabPage* page = slabNextUnswept(sizeClass);
+			if (page == NULL) break;
+			sweepPage(page, false);
+		}
+		gcPauseEnd();
+	}
+	return slabAllocate(size);
+#else
+	return reallocate(NULL, 0, size);
+#endif
+}
+
+void freeSlot(void* pointer, size_t size)
+{
+#ifdef SLAB_ENABLED
+#ifdef PARALLEL_GC_ENABLED
+	if (currentWorker != NULL) {
+		currentWorker->bytesFreed += size;
+		slabFreeTo(&currentWorker->freeSlots, pointer, size);
+		return;
+	}
+#endif
+	vm.bytesAllocated -= size;
+	vm.gcStats.bytesFreed += size;
+	slabFree(pointer, size);
+#else
+	reallocate(pointer, size, 0);
+#endif
+}
+
+static void freeObject(Obj *object)
+{
+#ifdef DEBUG_LOG_GC
+	PRINT_DEBUG(stdout);
+	printf("%p free type %d\n", (void*)object->type);
+	PRINT_RESET(stdout);
+#endif
+
+	switch (object->type)
+	{
+	case OBJ_BOUND_METHOD:
+		FREE_OBJ(ObjBoundMethod, object);
+		break;
+
+	case OBJ_CLASS:
+	{
+		ObjClass* _class = (ObjClass*)object;
+		freeTable(&_class->methods);
+		FREE_OBJ(ObjClass, object);
+		break;
+	}
+	case OBJ_INSTANCE:
+	{
+		ObjInstance* instance = (ObjInstance*)object;
+		FREE_ARRAY(Value, instance->fields, instance->fieldCapacity);
+		FREE_OBJ(ObjInstance, object);
+		break;
+	}
+	case OBJ_SHAPE:
+	{
+		ObjShape* shape = (ObjShape*)object;
+		freeTable(&shape->slots);
+		freeTable(&shape->transitions);
+		FREE_OBJ(ObjShape, object);
+		break;
+	}
+	case OBJ_FUNCTION:
+	{
+		ObjFunction* function = (ObjFunction*)object;
+#ifdef JIT_ENABLED
+		jitFree(function);
+#endif
+		freeChunk(&function->chunk);
+		FREE_OBJ(ObjFunction, object);
+		break;
+	}
+	case OBJ_CLOSURE:
+	{
+		ObjClosure* closure = (ObjClosure*)object;
+		FREE_ARRAY(ObjUpvalue*, closure->upvalues,closure->upvalueCount);
+		FREE_OBJ(ObjClosure, object);
+		break;
+	}
+	case OBJ_NATIVE:
+	{
+		FREE_OBJ(ObjNative, object);
+		break;
+	}
+	case OBJ_UPVALUE:
+		FREE_OBJ(ObjUpvalue, object);
+		break;
+	case OBJ_STRING:
+	{
+		ObjString *string = (ObjString *)object;
+		FREE_ARRAY(char, string->chars, string->length + 1);
+		FREE_OBJ(ObjString, object);
+		break;
+	}
+	}
+}
+
+#ifdef SLAB_ENABLED
+//Frees the old objects of a page that were left unmarked, or every object
+//with 'freeAll', a bitmap word at a time. Returns how many it freed.
+static int sweepPage(SlabPage* page, bool freeAll)
+{
+	int freed = 0;
+	for (int i = 0; i < SLAB_BITMAP_WORDS; i++) {
+		uint64_t dead = page->oldBits[i];
+		if (freeAll) dead |= page->youngBits[i];
+		else dead &= ~page->markBits[i];
+
+		while (dead != 0) {
+			int bit = slabLowestBit(dead);
+			dead &= dead - 1;
+			freeObject((Obj*)SLAB_BIT_ADDRESS(page, i * 64 + bit));
+			freed++;
+		}
+	}
+	return freed;
+}
+#else
+static void freeList(Obj* object)
+{
+	while (object != NULL)
+	{
+		Obj *next = object->next;
+		freeObject(object);
+		object = next;
+	}
+}
+#endif
+
+void freeObjects()
+{
+#ifdef CONCURRENT_GC_ENABLED
+	if (vm.isMarkerRunning) joinMarker();
+#endif
+#ifdef SLAB_ENABLED
+	for (int i = 0; i < slabPageCount(); i++) {
+		sweepPage(slabPageAt(i), true);
+	}
+#else
+	for (int i = 0; i < GC_REGION_COUNT; i++) {
+		freeList(vm.objects[i]);
+	}
+	freeList(vm.youngObjects);
+	freeList(vm.sweepYoung);
+#endif
+
+	free(vm.grayStack);
+	free(vm.rememberedSet);
+#ifdef SLAB_ENABLED
+	freeSlabs();
+#endif
+
+#ifdef PARALLEL_GC_ENABLED
+	for (int i = 0; i < GC_MAX_THREADS; i++) {
+		free(workers[i].stack);
+		free(workers[i].shared);
+	}
+#endif
+}
+
+//What freeObject() would give back for it.
+static size_t objectSize(Obj* object)
+{
+	switch (object->type)
+	{
+	case OBJ_BOUND_METHOD: return sizeof(ObjBoundMethod);
+	case OBJ_CLASS:
+		return sizeof(ObjClass) + sizeof(Entry) * ((ObjClass*)object)->methods.capacity;
+	case OBJ_INSTANCE:
+		return sizeof(ObjInstance) + sizeof(Value) * ((ObjInstance*)object)->fieldCapacity;
+	case OBJ_SHAPE:
+	{
+		ObjShape* shape = (ObjShape*)object;
+		return sizeof(ObjShape) + sizeof(Entry) * (shape->slots.capacity + shape->transitions.capacity);
+	}
+	case OBJ_FUNCTION:
+	{
+		Chunk* chunk = &((ObjFunction*)object)->chunk;
+		return sizeof(ObjFunction) + (sizeof(uint8_t) + sizeof(int)) * chunk->capacity
+			+ sizeof(Value) * chunk->constants.capacity + sizeof(InlineCache) * chunk->cacheCapacity;
+	}
+	case OBJ_CLOSURE:
+		return sizeof(ObjClosure) + sizeof(ObjUpvalue*) * ((ObjClosure*)object)->upvalueCount;
+	case OBJ_NATIVE: return sizeof(ObjNative);
+	case OBJ_UPVALUE: return sizeof(ObjUpvalue);
+	case OBJ_STRING: return sizeof(ObjString) + ((ObjString*)object)->length + 1;
+	}
+	return 0;
+}
+
+static void countObject(GcCensus* census, Obj* object)
+{
+	census->objects[object->type]++;
+	census->bytes[object->type] += objectSize(object);
+}
+
+//Counts every object that is not known to be garbage: the old ones the last
+//full collection marked, or all of them while it is still marking, and the
+//young ones, which no collection has looked at yet.
+void heapCensus(GcCensus* census)
+{
+	memset(census, 0, sizeof(GcCensus));
+	bool isMarking = vm.gcPhase == GC_MARK;
+
+#ifdef SLAB_ENABLED
+	for (int i = 0; i < slabPageCount(); i++) {
+		SlabPage* page = slabPageAt(i);
+		for (int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+			uint64_t counted = page->oldBits[word];
+			if (!isMarking) counted &= page->markBits[word];
+			counted |= page->youngBits[word];
+
+			while (counted != 0) {
+				int bit = slabLowestBit(counted);
+				counted &= counted - 1;
+				countObject(census, (Obj*)SLAB_BIT_ADDRESS(page, word * 64 + bit));
+			}
+		}
+	}
+#else
+	for (int i = 0; i < GC_REGION_COUNT; i++) {
+		for (Obj* object = vm.objects[i]; object != NULL; object = object->next) {
+			if (isMarking || IS_MARKED(object)) countObject(census, object);
+		}
+	}
+	for (Obj* object = vm.sweepYoung; object != NULL; object = object->next) {
+		if (IS_MARKED(object)) countObject(census, object);
+	}
+	for (Obj* object = vm.youngObjects; object != NULL; object = object->next) {
+		countObject(census, object);
+	}
+#endif
+}
+
+void rememberObject(Obj* object)
+{
+	if (vm.rememberedCapacity < vm.rememberedCount + 1) {
+		vm.rememberedCapacity = GROW_CAPACITY(vm.rememberedCapacity);
+		vm.rememberedSet = realloc(vm.rememberedSet, sizeof(Obj*) * vm.rememberedCapacity);
+
+		if (vm.rememberedSet == NULL) exit(1);
+	}
+
+	object->isRemembered = true;
+	vm.rememberedSet[vm.rememberedCount++] = object;
+}
+
+#ifdef PARALLEL_GC_ENABLED
+static void pushWorker(GcWorker* worker, Obj* object)
+{
+	if (worker->capacity < worker->count + 1) {
+		worker->capacity = GROW_CAPACITY(worker->capacity);
+		worker->stack = realloc(worker->stack, sizeof(Obj*) * worker->capacity);
+
+		if (worker->stack == NULL) exit(1);
+	}
+
+	worker->stack[worker->count++] = object;
+}
+#endif
+
+void markObject(Obj* object)
+{
+	if (object == NULL) return;
+
+#ifdef PARALLEL_GC_ENABLED
+	if (currentWorker != NULL) {
+		//Markers race for the same object; the one that sets the mark grays it.
+#ifdef SLAB_ENABLED
+		if (!slabClaimMark(object)) return;
+#else
+		if (__atomic_load_n(&object->mark, __ATOMIC_RELAXED) == vm.markValue) return;
+		if (__atomic_exchange_n(&object->mark, vm.markValue, __ATOMIC_RELAXED) == vm.markValue) return;
+#endif
+		pushWorker(currentWorker, object);
+		return;
+	}
+#endif
+
+	if (IS_MARKED(object)) return;
+
+#ifdef DEBUG_LOG_GC
+	PRINT_DEBUG(stdout);
+	printf("%p mark ", (void*)object);
+	printValue(OBJ_VAL(object));
+	printf("\n");
+	PRINT_RESET(stdout);
+#endif
+
+#ifdef SLAB_ENABLED
+	slabMark(object);
+#else
+	object->mark = vm.markValue;
+#endif
+
+	if (vm.grayCapacity < vm.grayCount + 1) {
+		vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);
+		vm.grayStack = realloc(vm.grayStack, sizeof(Obj*) * vm.grayCapacity);
+
+		if (vm.grayStack == NULL) exit(1);
+	}
+
+	vm.grayStack[vm.grayCount++] = object;
+}
+
+void markValue(Value value)
+{
+	if (!IS_OBJ(value)) return;
+	markObject(AS_OBJ(value));
+}
+
+void markArray(ValueArray* array) 
+{
+	int count = LOAD_ACQUIRE(array->count);
+	Value* values = LOAD_SHARED(array->values);
+	for (int i = 0; i < count; i++) {
+		markValue(LOAD_SHARED(values[i]));
+	}
+}
+
+static void markRoots()
+{
+	for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
+		markValue(*slot);
+	}
+
+	for (int i = 0; i < vm.frameCount; i++) {
+		markObject((Obj*)vm.frames[i].closure);
+	}
+
+	for (ObjUpvalue* upvalue = vm.openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
+		markObject((Obj*)upvalue);
+	}
+
+	markTable(&vm.globalNames);
+	for (int i = 0; i < vm.globalCount; i++) {
+		markValue(vm.globalValues[i]);
+	}
+	markCompilerRoots();
+	markObject((Obj*)vm.initString);
+}
+
+static void blackenObject(Obj* object)
+{
+#ifdef DEBUG_LOG_GC
+	PRINT_DEBUG(stdout);
+	printf("%p blacken ", (void*)object);
+	printValue(OBJ_VAL(object));
+	printf("\n");
+	PRINT_RESET(stdout);
+#endif
+
+	switch (object->type) {
+	case OBJ_BOUND_METHOD:
+	{
+		ObjBoundMethod* bound = (ObjBoundMethod*)object;
+		markValue(bound->reciever);
+		markObject((Obj*)bound->method);
+		break;
+	}
+
+	case OBJ_CLASS:
+	{
+		ObjClass* _class = (ObjClass*)object;
+		markObject((Obj*)_class->name);
+		markTable(&_class->methods);
+		markObject((Obj*)_class->rootShape);
+		break;
+	}
+
+	case OBJ_CLOSURE:
+	{
+		ObjClosure* closure = (ObjClosure*)object;
+		markObject((Obj*)closure->function);
+		for (int i = 0; i < closure->upvalueCount; i++) {
+			markObject((Obj*)LOAD_SHARED(closure->upvalues[i]));
+		}
+		break;
+	}
+
+	case OBJ_FUNCTION:
+	{
+		ObjFunction* function = (ObjFunction*)object;
+		markObject((Obj*)LOAD_SHARED(function->name));
+		markArray(&function->chunk.constants);
+		int cacheCount = LOAD_ACQUIRE(function->chunk.cacheCount);
+		InlineCache* caches = LOAD_SHARED(function->chunk.caches);
+		for (int i = 0; i < cacheCount; i++) {
+			InlineCache* cache = &caches[i];
+			int count = LOAD_ACQUIRE(cache->count);
+			for (int j = 0; j < count; j++) {
+				markObject(cache->entries[j].receiver);
+				markObject(cache->entries[j].target);
+			}
+		}
+		break;
+	}
+
+	case OBJ_INSTANCE:
+	{
+		ObjInstance* instance = (ObjInstance*)object;
+		markObject((Obj*)instance->_class);
+		markObject((Obj*)LOAD_SHARED(instance->shape));
+		//Spare capacity is always nil, so this does not depend on the shape,
+		//which the background marker may see before the array that fits it.
+		int capacity = LOAD_ACQUIRE(instance->fieldCapacity);
+		Value* fields = LOAD_SHARED(instance->fields);
+		for (int i = 0; i < capacity; i++) {
+			markValue(LOAD_SHARED(fields[i]));
+		}
+		break;
+	}
+
+	case OBJ_SHAPE:
+	{
+		ObjShape* shape = (ObjShape*)object;
+		markObject((Obj*)LOAD_SHARED(shape->parent));
+		markObject((Obj*)shape->key);
+		markTable(&shape->slots);
+		markTable(&shape->transitions);
+		break;
+	}
+
+	case OBJ_UPVALUE:
+		markValue(LOAD_SHARED(((ObjUpvalue*)object)->closed));
+		break;
+
+	case OBJ_NATIVE:
+	case OBJ_STRING:
+		break;
+	}
+}
+
+//Blackens gray objects until the stack is empty or 'work' runs out, and
+//returns the work left over.
+static int traceReferences(int work)
+{
+	while (vm.grayCount > 0 && work > 0) {
+		Obj* object = vm.grayStack[--vm.grayCount];
+		blackenObject(object);
+		work--;
+	}
+	return work;
+}
+
+#ifdef CONCURRENT_GC_ENABLED
+static void* markInBackground(void* unused)
+{
+	(void)unused;
+	traceReferences(INT_MAX);
+	STORE_RELEASE(vm.isMarkerDone, true);
+	return NULL;
+}
+
+//Hands the gray stack to a background thread. If one cannot be started,
+//the cycle just goes on in slices on this thread.
+static void startMarker()
+{
+	vm.isMarkerDone = false;
+	vm.isMarkerRunning = true;
+	if (pthread_create(&marker, NULL, markInBackground, NULL) != 0) {
+		vm.isMarkerRunning = false;
+	}
+}
+
+static void joinMarker()
+{
+	pthread_join(marker, NULL);
+	vm.isMarkerRunning = false;
+
+	for (int i = 0; i < deferredCount; i++) {
+		free(deferredFrees[i]);
+	}
+	deferredCount = 0;
+}
+#endif
+
+#ifdef PARALLEL_GC_ENABLED
+//Moves part of a long gray stack to where idle markers can steal it.
+static void shareWork(GcWorker* worker)
+{
+	if (worker->count < 2 * GC_SHARE_SIZE || LOAD_ACQUIRE(worker->sharedCount) > 0) return;
+
+	pthread_mutex_lock(&worker->lock);
+	worker->count -= GC_SHARE_SIZE;
+	memcpy(worker->shared, worker->stack + worker->count, sizeof(Obj*) * GC_SHARE_SIZE);
+	STORE_RELEASE(worker->sharedCount, GC_SHARE_SIZE);
+	pthread_mutex_unlock(&worker->lock);
+
+	__atomic_add_fetch(&sharedTotal, GC_SHARE_SIZE, __ATOMIC_SEQ_CST);
+}
+
+//Takes the shared gray objects of the first marker that has any, this
+//one's own included.
+static bool stealWork(GcWorker* worker)
+{
+	int self = (int)(worker - workers);
+	int count = __atomic_load_n(&workerCount, __ATOMIC_ACQUIRE);
+	for (int i = 0; i < count; i++) {
+		GcWorker* victim = &workers[(self + i) % count];
+		if (LOAD_ACQUIRE(victim->sharedCount) == 0) continue;
+
+		pthread_mutex_lock(&victim->lock);
+		int stolen = victim->sharedCount;
+		for (int j = 0; j < stolen; j++) {
+			pushWorker(worker, victim->shared[j]);
+		}
+		STORE_RELEASE(victim->sharedCount, 0);
+		pthread_mutex_unlock(&victim->lock);
+
+		if (stolen > 0) {
+			__atomic_sub_fetch(&sharedTotal, stolen, __ATOMIC_SEQ_CST);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void* markInParallel(void* argument)
+{
+	GcWorker* worker = (GcWorker*)argument;
+	currentWorker = worker;
+
+	for (;;) {
+		while (worker->count > 0) {
+			blackenObject(worker->stack[--worker->count]);
+			shareWork(worker);
+		}
+		if (stealWork(worker)) continue;
+
+		//A marker only goes idle with nothing left in its own queue, so once
+		//all of them are idle there is no gray object anywhere.
+		__atomic_add_fetch(&idleWorkers, 1, __ATOMIC_SEQ_CST);
+		for (;;) {
+			if (__atomic_load_n(&idleWorkers, __ATOMIC_SEQ_CST) == __atomic_load_n(&workerCount, __ATOMIC_ACQUIRE)) {
+				currentWorker = NULL;
+				return NULL;
+			}
+			if (__atomic_load_n(&sharedTotal, __ATOMIC_SEQ_CST) > 0) break;
+			sched_yield();
+		}
+		__atomic_sub_fetch(&idleWorkers, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+static void* sweepInParallel(void* argument)
+{
+	GcWorker* worker = (GcWorker*)argument;
+	currentWorker = worker;
+
+	for (;;) {
+		int region = __atomic_fetch_add(&nextRegion, 1, __ATOMIC_RELAXED);
+#ifdef SLAB_ENABLED
+		//Pages are the regions here.
+		if (region >= slabPageCount()) break;
+		sweepPage(slabPageAt(region), false);
+#else
+		if (region >= GC_REGION_COUNT) break;
+
+		Obj* previous = NULL;
+		Obj* object = vm.objects[region];
+		while (object != NULL) {
+			Obj* next = object->next;
+			if (IS_MARKED(object)) {
+				previous = object;
+			}
+			else {
+				if (previous != NULL) {
+					previous->next = next;
+				}
+				else {
+					vm.objects[region] = next;
+				}
+				freeObject(object);
+			}
+			object = next;
+		}
+#endif
+	}
+
+	currentWorker = NULL;
+	return NULL;
+}
+
+//Runs 'task' on vm.gcThreads threads, this one being the first of them.
+static void runWorkers(void* (*task)(void*))
+{
+	workerCount = vm.gcThreads;
+
+	int started = 1;
+	for (; started < vm.gcThreads; started++) {
+		if (pthread_create(&workers[started].thread, NULL, task, &workers[started]) != 0) break;
+	}
+
+	//Markers wait for each other, so the ones that never started hand
+	//their gray objects to this thread and drop out of the count.
+	for (int i = started; i < vm.gcThreads; i++) {
+		while (workers[i].count > 0) {
+			pushWorker(&workers[0], workers[i].stack[--workers[i].count]);
+		}
+	}
+	__atomic_store_n(&workerCount, started, __ATOMIC_RELEASE);
+
+	task(&workers[0]);
+	for (int i = 1; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+}
+
+static void parallelMark()
+{
+	for (int i = 0; i < vm.gcThreads; i++) {
+		GcWorker* worker = &workers[i];
+		pthread_mutex_init(&worker->lock, NULL);
+		if (worker->shared == NULL) {
+			worker->shared = malloc(sizeof(Obj*) * GC_SHARE_SIZE);
+			if (worker->shared == NULL) exit(1);
+		}
+		worker->sharedCount = 0;
+	}
+
+	//Deal the roots out to the markers.
+	for (int i = 0; i < vm.grayCount; i++) {
+		pushWorker(&workers[i % vm.gcThreads], vm.grayStack[i]);
+	}
+	vm.grayCount = 0;
+	idleWorkers = 0;
+	sharedTotal = 0;
+	runWorkers(markInParallel);
+
+	for (int i = 0; i < vm.gcThreads; i++) {
+		pthread_mutex_destroy(&workers[i].lock);
+	}
+}
+
+static void parallelSweep()
+{
+	nextRegion = 0;
+	runWorkers(sweepInParallel);
+
+	for (int i = 0; i < vm.gcThreads; i++) {
+		vm.bytesAllocated -= workers[i].bytesFreed;
+		vm.gcStats.bytesFreed += workers[i].bytesFreed;
+		workers[i].bytesFreed = 0;
+#ifdef SLAB_ENABLED
+		slabMergeFreeList(&workers[i].freeSlots);
+#endif
+	}
+#ifdef SLAB_ENABLED
+	slabEndSweep();
+#else
+	vm.sweepRegion = GC_REGION_COUNT;
+	vm.sweepCursor = NULL;
+#endif
+}
+#endif
+
+static void traceRemembered()
+{
+	for (int i = 0; i < vm.rememberedCount; i++) {
+		vm.rememberedSet[i]->isRemembered = false;
+		blackenObject(vm.rememberedSet[i]);
+	}
+	vm.rememberedCount = 0;
+}
+
+//Frees an unmarked nursery object, or promotes a marked one into the old
+//generation: its page's old bitmap, or one of the region lists. Returns the
+//bytes it kept.
+static size_t sweepYoungObject(Obj* object, bool isMinor)
+{
+	if (IS_MARKED(object)) {
+#ifdef SLAB_ENABLED
+		slabSetOld(object);
+#else
+		//Dealt out round robin, so the regions stay about the same size.
+		object->next = vm.objects[vm.promoteRegion];
+		vm.objects[vm.promoteRegion] = object;
+		vm.promoteRegion = (vm.promoteRegion + 1) % GC_REGION_COUNT;
+#endif
+		return objectSize(object);
+	}
+
+	//A minor collection skips the full intern table scan, so dead young
+	//strings are dropped from it one by one instead.
+	if (isMinor && object->type == OBJ_STRING) {
+		tableDelete(&vm.strings, (ObjString*)object);
+	}
+	freeObject(object);
+	return 0;
+}
+
+//Whether the cycle in progress is done sweeping, which without slab pages
+//includes the nursery that was detached when marking finished.
+static bool isSwept()
+{
+#ifdef SLAB_ENABLED
+	return slabIsSwept();
+#else
+	return vm.sweepRegion == GC_REGION_COUNT && vm.sweepYoung == NULL;
+#endif
+}
+
+//Sweeps the old generation page by page, or region by region from the
+//cursor and then the detached nursery, until done or 'work' runs out.
+//Survivors keep their mark, which is what makes them old for the next
+//minor collection.
+static int sweep(int work)
+{
+#ifdef SLAB_ENABLED
+	while (!slabIsSwept() && work > 0) {
+		work -= 1 + sweepPage(slabNextUnswept(-1), false);
+	}
+#else
+	while (vm.sweepRegion < GC_REGION_COUNT && work > 0) {
+		if (vm.sweepCursor == NULL) {
+			if (++vm.sweepRegion < GC_REGION_COUNT) {
+				vm.sweepPrevious = NULL;
+				vm.sweepCursor = vm.objects[vm.sweepRegion];
+			}
+			continue;
+		}
+
+		Obj* object = vm.sweepCursor;
+		vm.sweepCursor = object->next;
+
+		if (IS_MARKED(object)) {
+			vm.sweepPrevious = object;
+		}
+		else {
+			if (vm.sweepPrevious != NULL) {
+				vm.sweepPrevious->next = vm.sweepCursor;
+			}
+			else {
+				vm.objects[vm.sweepRegion] = vm.sweepCursor;
+			}
+
+			freeObject(object);
+		}
+		work--;
+	}
+
+	while (vm.sweepRegion == GC_REGION_COUNT && vm.sweepYoung != NULL && work > 0) {
+		Obj* object = vm.sweepYoung;
+		vm.sweepYoung = object->next;
+		sweepYoungObject(object, false);
+		work--;
+	}
+#endif
+	return work;
+}
+
+//A nursery that mostly survives promotes objects before they had the time
+//to die, so it grows until they do, and shrinks back once they die young.
+static void sizeNursery(size_t survived, size_t freed)
+{
+	//A collection that came early, to start a full one, says little.
+	if (survived + freed < vm.nurserySize / 2) return;
+
+	size_t limit = GC_MAX_NURSERY_SIZE;
+	if (vm.gcPacing.maxHeap > 0 && limit > vm.gcPacing.maxHeap / 4) limit = vm.gcPacing.maxHeap / 4;
+
+	double survival = (double)survived / (survived + freed);
+	if (survival > GC_NURSERY_GROW_SURVIVAL && vm.nurserySize * 2 <= limit) {
+		vm.nurserySize *= 2;
+	}
+	else if (survival < GC_NURSERY_SHRINK_SURVIVAL && vm.nurserySize / 2 >= GC_NURSERY_SIZE) {
+		vm.nurserySize /= 2;
+	}
+}
+
+void collectYoung()
+{
+	gcPauseBegin();
+	size_t freedBefore = vm.gcStats.bytesFreed;
+#ifdef DEBUG_LOG_GC
+	PRINT_INFO(stdout);
+	printf("-- minor gc begin\n");
+	size_t before = vm.bytesAllocated;
+	PRINT_RESET(stdout);
+#endif
+	//Old objects are still marked, so marking stops at them. The ones that
+	//were written to since the last collection are traced explicitly.
+	markRoots();
+	traceRemembered();
+	traceReferences(INT_MAX);
+
+	size_t survived = 0;
+#ifdef SLAB_ENABLED
+	for (int i = 0; i < slabYoungPageCount(); i++) {
+		SlabPage* page = slabYoungPageAt(i);
+		for (int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+			uint64_t young = page->youngBits[word];
+			while (young != 0) {
+				int bit = slabLowestBit(young);
+				young &= young - 1;
+				survived += sweepYoungObject((Obj*)SLAB_BIT_ADDRESS(page, word * 64 + bit), true);
+			}
+		}
+	}
+	slabClearYoung();
+#else
+	Obj* object = vm.youngObjects;
+	vm.youngObjects = NULL;
+	while (object != NULL) {
+		Obj* next = object->next;
+		survived += sweepYoungObject(object, true);
+		object = next;
+	}
+#endif
+
+	sizeNursery(survived, vm.gcStats.bytesFreed - freedBefore);
+	vm.nextMinorGC = vm.bytesAllocated + vm.nurserySize;
+	vm.gcStats.minorCollections++;
+
+#ifdef DEBUG_LOG_GC
+	PRINT_INFO(stdout);
+	printf("-- minor gc end\n");
+	printf("   collected %ld bytes (from %ld to %ld) next at %ld\n", before - vm.bytesAllocated, before, vm.bytesAllocated, vm.nextMinorGC);
+	PRINT_RESET(stdout);
+#endif
+	gcPauseEnd();
+}
+
+//Begins a full collection. Marking and sweeping then advance in slices from
+//gcStep() while the program keeps running, and with 'isConcurrent' the
+//marking is done by a background thread instead.
+static void startCycle(bool isConcurrent)
+{
+	gcPauseBegin();
+#ifdef DEBUG_LOG_GC
+	PRINT_INFO(stdout);
+	printf("-- gc begin\n");
+	PRINT_RESET(stdout);
+#endif
+	//With the nursery empty, clearing the mark bitmaps, or flipping the
+	//mark value, turns every object white at once.
+	collectYoung();
+#ifdef SLAB_ENABLED
+	slabClearMarks();
+#else
+	vm.markValue = !vm.markValue;
+#endif
+
+	for (int i = 0; i < vm.rememberedCount; i++) {
+		vm.rememberedSet[i]->isRemembered = false;
+	}
+	vm.rememberedCount = 0;
+
+	markRoots();
+	vm.gcPhase = GC_MARK;
+	vm.cycleStartAllocated = vm.bytesAllocated + vm.gcStats.bytesFreed;
+	vm.nextGCStep = vm.bytesAllocated + GC_STEP_SIZE;
+
+#ifdef CONCURRENT_GC_ENABLED
+	if (isConcurrent) startMarker();
+#else
+	(void)isConcurrent;
+#endif
+	gcPauseEnd();
+}
+
+static void finishMark()
+{
+	//The roots are not behind the write barrier, so they are scanned again
+	//together with every marked object that was written to since.
+	markRoots();
+	traceRemembered();
+	traceReferences(INT_MAX);
+	tableRemoveWhite(&vm.strings);
+
+	//Objects allocated from here on are not part of this cycle's sweep. The
+	//nursery is, and with slab pages it simply joins the old generation,
+	//whose sweep frees its unmarked objects.
+#ifdef SLAB_ENABLED
+	slabPromoteYoung();
+	slabBeginSweep();
+#else
+	vm.sweepRegion = 0;
+	vm.sweepPrevious = NULL;
+	vm.sweepCursor = vm.objects[0];
+	vm.sweepYoung = vm.youngObjects;
+	vm.youngObjects = NULL;
+#endif
+	vm.gcPhase = GC_SWEEP;
+}
+
+//Where the next full collection should start, given what survived the
+//last one.
+static size_t heapGoal(size_t live)
+{
+	GcPacing* pacing = &vm.gcPacing;
+	size_t goal = (size_t)(live * vm.heapGrowth);
+	if (goal < pacing->targetHeap) goal = pacing->targetHeap;
+	if (pacing->maxHeap > 0 && goal > pacing->maxHeap) goal = pacing->maxHeap;
+
+	//Once the survivors alone outgrow the limit, collections are still kept
+	//a nursery apart rather than back to back.
+	if (goal < live + vm.nurserySize) goal = live + vm.nurserySize;
+	return goal;
+}
+
+//Decides when the next full collection starts from how the one that just
+//ended went.
+static void paceNextCycle(GcCycleStats* cycle)
+{
+	GcPacing* pacing = &vm.gcPacing;
+	size_t live = vm.bytesAllocated;
+
+	//The next collection will take about as long as this one did, so the
+	//time ratio is met by letting the program run long enough in between,
+	//which at the rate it allocates takes this much room on top of what
+	//survived.
+	double runTime = cycle->duration - cycle->pauseTime;
+	if (pacing->gcTimeRatio > 0 && live > 0 && runTime > 0 && cycle->pauseTime > 0) {
+		double rate = cycle->allocated / runTime;
+		double room = rate * cycle->pauseTime * (1 - pacing->gcTimeRatio) / pacing->gcTimeRatio;
+
+		//Only halfway there each cycle, so one odd cycle does not throw it.
+		vm.heapGrowth = (vm.heapGrowth + 1 + room / live) / 2;
+		if (vm.heapGrowth < GC_MIN_GROW_FACTOR) vm.heapGrowth = GC_MIN_GROW_FACTOR;
+		if (vm.heapGrowth > GC_MAX_GROW_FACTOR) vm.heapGrowth = GC_MAX_GROW_FACTOR;
+	}
+
+	size_t goal = heapGoal(live);
+	vm.nextGC = goal;
+
+	//The program keeps allocating while an incremental cycle runs, so it
+	//starts as early as the last one allocated, to be done by the goal, but
+	//not before half of the room is used up.
+	if (vm.gcIncremental) {
+		size_t room = (goal - live) / 2;
+		vm.nextGC = goal - (vm.cycleAllocated < room ? vm.cycleAllocated : room);
+	}
+}
+
+static void finishCycle()
+{
+	vm.gcPhase = GC_IDLE;
+	vm.cycleAllocated = vm.bytesAllocated + vm.gcStats.bytesFreed - vm.cycleStartAllocated;
+	GcCycleStats* cycle = gcCycleEnd();
+	paceNextCycle(cycle);
+	cycle->nextGC = vm.nextGC;
+	vm.nextMinorGC = vm.bytesAllocated + vm.nurserySize;
+
+#ifdef SLAB_ENABLED
+	//Objects never move on their own, so a heap that shrank leaves its
+	//survivors scattered over mostly empty pages.
+	if (vm.gcCompact) {
+		size_t slots = 0;
+		size_t live = 0;
+		for (int i = 0; i < slabPageCount(); i++) {
+			slots += slabPageAt(i)->slotCount;
+			live += slabPageAt(i)->liveCount;
+		}
+		if (slabPageCount() >= GC_COMPACT_MIN_PAGES && live < slots * GC_COMPACT_LIVE_RATIO) {
+			vm.compactPending = true;
+		}
+	}
+#endif
+
+#ifdef DEBUG_LOG_GC
+	PRINT_INFO(stdout);
+	printf("-- gc end\n");
+	printf("   %ld bytes live, next at %ld\n", vm.bytesAllocated, vm.nextGC);
+#ifdef SLAB_ENABLED
+	for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+		SlabClassStats stats;
+		slabStats(i, &stats);
+		if (stats.pageCount == 0) continue;
+		printf("   %ld byte slots: %d pages (%d empty), %ld of %ld slots live\n", stats.slotSize, stats.pageCount, stats.emptyPages, stats.liveCount, stats.slotCount);
+	}
+#endif
+	PRINT_RESET(stdout);
+#endif
+}
+
+//Sizes the slices of an incremental collection to the pause target, from
+//how long the last one took for the work it did.
+static void paceSlices(int done, double elapsed)
+{
+	if (done <= 0 || elapsed <= 0) return;
+
+	double work = (vm.gcStepWork + vm.gcPacing.pauseTarget * done / elapsed) / 2;
+	if (work < GC_MIN_STEP_WORK) work = GC_MIN_STEP_WORK;
+	if (work > INT_MAX / 2) work = INT_MAX / 2;
+	vm.gcStepWork = (int)work;
+}
+
+//Does up to 'work' units of marking or sweeping for the cycle in progress.
+static void gcStep(int work)
+{
+#ifdef CONCURRENT_GC_ENABLED
+	if (vm.isMarkerRunning && !LOAD_ACQUIRE(vm.isMarkerDone) && work != INT_MAX) {
+		vm.nextGCStep = vm.bytesAllocated + GC_STEP_SIZE;
+		return;
+	}
+#endif
+
+	gcPauseBegin();
+	int budget = work;
+	double start = vm.gcPacing.pauseTarget > 0 ? gcClock() : 0;
+
+	if (vm.gcPhase == GC_MARK) {
+#ifdef CONCURRENT_GC_ENABLED
+		if (vm.isMarkerRunning) joinMarker();
+#endif
+		work = traceReferences(work);
+		if (vm.grayCount == 0) finishMark();
+	}
+
+	if (vm.gcPhase == GC_SWEEP && work > 0) {
+		work = sweep(work);
+		if (isSwept()) finishCycle();
+	}
+
+	if (start > 0 && budget != INT_MAX) paceSlices(budget - work, gcClock() - start);
+	vm.nextGCStep = vm.bytesAllocated + GC_STEP_SIZE;
+	gcPauseEnd();
+}
+
+#ifdef SLAB_ENABLED
+//What is left of an object a compaction moved: its header, then where it
+//went, over the first field. Every object type is at least this big.
+typedef struct
+{
+	Obj obj;
+	Obj* forward;
+} ObjForward;
+
+//Where an object moved to, for any pointer that may still have the old
+//address.
+Obj* forwardObject(Obj* object)
+{
+	if (object == NULL || !SLAB_PAGE(object)->isEvacuating) return object;
+	return ((ObjForward*)object)->forward;
+}
+
+void forwardValue(Value* value)
+{
+	if (IS_OBJ(*value)) *value = OBJ_VAL(forwardObject(AS_OBJ(*value)));
+}
+
+#define FORWARD(type, pointer) ((pointer) = (type)forwardObject((Obj*)(pointer)))
+
+static void forwardArray(ValueArray* array)
+{
+	for (int i = 0; i < array->count; i++) {
+		forwardValue(&array->values[i]);
+	}
+}
+
+//Updates the references an object holds, the same ones blackenObject()
+//traces.
+static void forwardFields(Obj* object)
+{
+	switch (object->type) {
+	case OBJ_BOUND_METHOD:
+	{
+		ObjBoundMethod* bound = (ObjBoundMethod*)object;
+		forwardValue(&bound->reciever);
+		FORWARD(ObjClosure*, bound->method);
+		break;
+	}
+
+	case OBJ_CLASS:
+	{
+		ObjClass* _class = (ObjClass*)object;
+		FORWARD(ObjString*, _class->name);
+		forwardTable(&_class->methods);
+		FORWARD(ObjShape*, _class->rootShape);
+		break;
+	}
+
+	case OBJ_CLOSURE:
+	{
+		ObjClosure* closure = (ObjClosure*)object;
+		FORWARD(ObjFunction*, closure->function);
+		for (int i = 0; i < closure->upvalueCount; i++) {
+			FORWARD(ObjUpvalue*, closure->upvalues[i]);
+		}
+		break;
+	}
+
+	case OBJ_FUNCTION:
+	{
+		//Compiled code reads constants and caches from the chunk, it never
+		//holds an object's address itself.
+		ObjFunction* function = (ObjFunction*)object;
+		FORWARD(ObjString*, function->name);
+		forwardArray(&function->chunk.constants);
+		for (int i = 0; i < function->chunk.cacheCount; i++) {
+			InlineCache* cache = &function->chunk.caches[i];
+			for (int j = 0; j < cache->count; j++) {
+				FORWARD(Obj*, cache->entries[j].receiver);
+				FORWARD(Obj*, cache->entries[j].target);
+			}
+		}
+		break;
+	}
+
+	case OBJ_INSTANCE:
+	{
+		ObjInstance* instance = (ObjInstance*)object;
+		FORWARD(ObjClass*, instance->_class);
+		FORWARD(ObjShape*, instance->shape);
+		for (int i = 0; i < instance->fieldCapacity; i++) {
+			forwardValue(&instance->fields[i]);
+		}
+		break;
+	}
+
+	case OBJ_SHAPE:
+	{
+		ObjShape* shape = (ObjShape*)object;
+		FORWARD(ObjShape*, shape->parent);
+		FORWARD(ObjString*, shape->key);
+		forwardTable(&shape->slots);
+		forwardTable(&shape->transitions);
+		break;
+	}
+
+	case OBJ_UPVALUE:
+	{
+		//A closed upvalue points at its own 'closed' field, which moved with
+		//it. The open list is fixed from the roots.
+		ObjUpvalue* upvalue = (ObjUpvalue*)object;
+		forwardValue(&upvalue->closed);
+		if (upvalue->location < vm.stack || upvalue->location >= vm.stack + STACK_MAX) {
+			upvalue->location = &upvalue->closed;
+		}
+		break;
+	}
+
+	case OBJ_NATIVE:
+	case OBJ_STRING:
+		break;
+	}
+}
+
+static void forwardRoots()
+{
+	for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
+		forwardValue(slot);
+	}
+
+	for (int i = 0; i < vm.frameCount; i++) {
+		FORWARD(ObjClosure*, vm.frames[i].closure);
+	}
+
+	ObjUpvalue** upvalue = &vm.openUpvalues;
+	while (*upvalue != NULL) {
+		FORWARD(ObjUpvalue*, *upvalue);
+		upvalue = &(*upvalue)->next;
+	}
+
+	forwardTable(&vm.globalNames);
+	for (int i = 0; i < vm.globalCount; i++) {
+		forwardValue(&vm.globalValues[i]);
+		FORWARD(ObjString*, vm.globalSlots[i].name);
+	}
+	forwardTable(&vm.strings);
+	FORWARD(ObjString*, vm.initString);
+}
+
+//Moves the old objects out of the emptiest slab pages into the free slots
+//of the others, updates every reference to them and gives the emptied pages
+//back to the OS. Objects are only ever addressed through the VM's own
+//structures when the interpreter is between instructions, so this is only
+//called from there, never from inside an allocation.
+void compactHeap()
+{
+	vm.compactPending = false;
+	gcPauseBegin();
+
+	//Finish whatever cycle is running and empty the nursery, which leaves
+	//every live object old and marked.
+#ifdef CONCURRENT_GC_ENABLED
+	if (vm.isMarkerRunning) joinMarker();
+#endif
+	while (vm.gcPhase != GC_IDLE) {
+		gcStep(INT_MAX);
+	}
+	collectYoung();
+
+#ifdef DEBUG_LOG_GC
+	PRINT_INFO(stdout);
+	printf("-- compact begin\n");
+	PRINT_RESET(stdout);
+	int moved = 0;
+#endif
+
+	int picked = slabPlanEvacuation();
+	if (picked == 0) {
+		gcPauseEnd();
+		return;
+	}
+	vm.gcStats.compactions++;
+
+	for (int i = 0; i < slabPageCount(); i++) {
+		SlabPage* page = slabPageAt(i);
+		if (!page->isEvacuating) continue;
+
+		size_t slotSize = ((size_t)page->sizeClass + 1) * SLAB_GRANULE;
+		for (int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+			uint64_t old = page->oldBits[word];
+			while (old != 0) {
+				int bit = slabLowestBit(old);
+				old &= old - 1;
+
+				Obj* object = (Obj*)SLAB_BIT_ADDRESS(page, word * 64 + bit);
+				Obj* copy = (Obj*)slabAllocate(slotSize);
+				memcpy(copy, object, slotSize);
+				slabSetOld(copy);
+				slabMark(copy);
+				((ObjForward*)object)->forward = copy;
+#ifdef DEBUG_LOG_GC
+				moved++;
+#endif
+			}
+		}
+	}
+
+	forwardRoots();
+	for (int i = 0; i < slabPageCount(); i++) {
+		SlabPage* page = slabPageAt(i);
+		if (page->isEvacuating) continue;
+
+		for (int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+			uint64_t old = page->oldBits[word];
+			while (old != 0) {
+				int bit = slabLowestBit(old);
+				old &= old - 1;
+				forwardFields((Obj*)SLAB_BIT_ADDRESS(page, word * 64 + bit));
+			}
+		}
+	}
+
+	slabReleaseEvacuated();
+
+#ifdef DEBUG_LOG_GC
+	PRINT_INFO(stdout);
+	printf("-- compact end\n");
+	printf("   moved %d objects out of %d pages\n", moved, picked);
+	PRINT_RESET(stdout);
+#endif
+	gcPauseEnd();
+}
+#endif
+
+void collectGarbage()
+{
+	gcPauseBegin();
+	if (vm.gcPhase == GC_IDLE) startCycle(false);
+#ifdef CONCURRENT_GC_ENABLED
+	if (vm.isMarkerRunning) joinMarker();
+#endif
+#ifdef PARALLEL_GC_ENABLED
+	if (vm.gcThreads > 1 && vm.gcPhase == GC_MARK) {
+		parallelMark();
+		finishMark();
+		parallelSweep();
+	}
+#endif
+	if (vm.gcPhase == GC_MARK) {
+		traceReferences(INT_MAX);
+		finishMark();
+	}
+
+	//The old generation is left to be swept lazily, by the allocator and by
+	//the slices that follow.
+#ifndef SLAB_ENABLED
+	while (vm.gcPhase != GC_IDLE) {
+		gcStep(INT_MAX);
+	}
+#endif
+	gcPauseEnd();
+}
+
+//Lets an embedder, or the command line, trade memory for time spent
+//collecting. Takes effect from the next full collection on, or right away
+//while none has run yet.
+void setGcPacing(GcPacing pacing)
+{
+	if (pacing.growFactor < GC_MIN_GROW_FACTOR) pacing.growFactor = GC_MIN_GROW_FACTOR;
+	if (pacing.gcTimeRatio >= 1) pacing.gcTimeRatio = 0;
+
+	vm.gcPacing = pacing;
+	vm.heapGrowth = pacing.growFactor;
+	if (pacing.pauseTarget > 0) vm.gcIncremental = true;
+
+	if (vm.gcPhase == GC_IDLE) {
+		int last = vm.gcStats.fullCollections - 1;
+		vm.nextGC = heapGoal(last < 0 ? 0 : vm.gcStats.cycles[last % GC_CYCLE_HISTORY].live);
+	}
+}
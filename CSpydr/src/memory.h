@@ -1,22 +1,75 @@
-#ifndef cspydr_memory_h
-#define cspydr_memory_h
-
-#include "common.h"
-#include "object.h"
-
-#define FREE(type, pointer) reallocate(pointer, sizeof(type), 0);
-
-#define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity)*2)
-
-#define GROW_ARRAY(type, pointer, oldCount, newCount) (type *)reallocate(pointer, sizeof(type) * (oldCount), sizeof(type) * (newCount))
-
-#define FREE_ARRAY(type, pointer, oldCount) reallocate(pointer, sizeof(type) * (oldCount), 0)
-#define ALLOCATE(type, count) (type *)reallocate(NULL, 0, sizeof(type) * (count))
-
-void *reallocate(void *pointer, size_t oldSize, size_t newSize);
-void freeObjects();
-void collectGarbage();
-void markValue(Value value);
-void markObject(Obj* object);
-
+#ifndef cspydr_memory_h
+#define cspydr_memory_h
+
+#include "common.h"
+#include "object.h"
+#include "slab.h"
+#include "vm.h"
+
+#define FREE(type, pointer) reallocate(pointer, sizeof(type), 0);
+#define FREE_OBJ(type, pointer) freeSlot(pointer, sizeof(type));
+
+//Bytes allocated between two minor collections, the nursery grows up to
+//the maximum while much of it survives.
+#define GC_NURSERY_SIZE (256 * 1024)
+#define GC_MAX_NURSERY_SIZE (8 * 1024 * 1024)
+//Defaults for GcPacing, and the range an adapted growth stays in.
+#define GC_DEFAULT_TARGET_HEAP (1024 * 1024)
+#define GC_HEAP_GROW_FACTOR 2
+#define GC_MIN_GROW_FACTOR 1.1
+#define GC_MAX_GROW_FACTOR 16
+//Most threads a parallel collection will use.
+#define GC_MAX_THREADS 64
+//Objects traced or swept per slice of an incremental collection.
+#define GC_DEFAULT_STEP_WORK 4096
+#define GC_MIN_STEP_WORK 64
+//With --gc-compact, a full collection that leaves at least this many pages
+//with less than this share of their slots live asks for a compaction.
+#define GC_COMPACT_MIN_PAGES 16
+#define GC_COMPACT_LIVE_RATIO 0.5
+
+//A mark also makes an object old, marks stay set until the next full
+//collection starts.
+#ifdef SLAB_ENABLED
+#define IS_MARKED(object) slabIsMarked(object)
+#else
+#define IS_MARKED(object) ((object)->mark == vm.markValue)
+#endif
+
+#define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity)*2)
+
+#define GROW_ARRAY(type, pointer, oldCount, newCount) (type *)reallocate(pointer, sizeof(type) * (oldCount), sizeof(type) * (newCount))
+
+#define FREE_ARRAY(type, pointer, oldCount) reallocate(pointer, sizeof(type) * (oldCount), 0)
+#define ALLOCATE(type, count) (type *)reallocate(NULL, 0, sizeof(type) * (count))
+
+//Call after storing a reference into 'object'. A marked object that may now
+//point at unmarked ones is remembered, so the next minor collection, or the
+//end of the marking in progress, traces it again. While the background
+//marker runs, marks are its business, so every written object is remembered.
+#define WRITE_BARRIER(object) \
+	do { \
+		Obj* barrierObject = (Obj*)(object); \
+		if ((vm.isMarkerRunning || IS_MARKED(barrierObject)) && !barrierObject->isRemembered) { \
+			rememberObject(barrierObject); \
+		} \
+	} while (false)
+
+void *reallocate(void *pointer, size_t oldSize, size_t newSize);
+void* allocateSlot(size_t size);
+void freeSlot(void* pointer, size_t size);
+void freeObjects();
+void rememberObject(Obj* object);
+void collectYoung();
+void collectGarbage();
+void setGcPacing(GcPacing pacing);
+#ifdef SLAB_ENABLED
+void compactHeap();
+Obj* forwardObject(Obj* object);
+void forwardValue(Value* value);
+#endif
+void heapCensus(GcCensus* census);
+void markValue(Value value);
+void markObject(Obj* object);
+
 #endif
\ No newline at end of file
@@ -1,186 +1,310 @@
-#include <stdio.h>
-#include <string.h>
-
-#include "memory.h"
-#include "object.h"
-#include "table.h"
-#include "value.h"
-#include "vm.h"
-
-#define ALLOCATE_OBJ(type, objectType) (type *)allocateObject(sizeof(type), objectType)
-
-static Obj *allocateObject(size_t size, ObjType type)
-{
-	Obj *object = (Obj *)reallocate(NULL, 0, size);
-	object->type = type;
-	object->isMarked = false;
-	object->next = vm.objects;
-	vm.objects = object;
-
-#ifdef DEBUG_LOG_GC
-	PRINT_SPECIAL(stdout)
-	printf("%p allocate %ld for %d\n", (void*)object, size, type);
-	PRINT_RESET(stdout)
-#endif
-
-	return object;
-}
-
-ObjBoundMethod* newBoundMethod(Value reciever, ObjClosure* method)
-{
-	ObjBoundMethod* bound = ALLOCATE_OBJ(ObjBoundMethod, OBJ_BOUND_METHOD);
-
-	bound->reciever = reciever;
-	bound->method = method;
-	return bound;
-}
-
-ObjClass* newClass(ObjString* name)
-{
-	ObjClass* _class = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
-	_class->name = name;
-	initTable(&_class->methods);
-	return _class;
-}
-
-ObjInstance* newInstance(ObjClass* _class)
-{
-	ObjInstance* instance = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
-	instance->_class = _class;
-	initTable(&instance->fields);
-	return instance;
-}
-
-ObjFunction* newFunction()
-{
-	ObjFunction* function = ALLOCATE_OBJ(ObjFunction, OBJ_FUNCTION);
-
-	function->arity = 0;
-	function->upvalueCount = 0;
-	function->name = NULL;
-	initChunk(&function->chunk);
-	return function;
-}
-
-ObjNative* newNative(NativeFn function)
-{
-	ObjNative* native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
-	native->function = function;
-	return native;
-}
-
-ObjUpvalue* newUpvalue(Value* slot)
-{
-	ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
-	upvalue->location = slot;
-	upvalue->next = NULL;
-	upvalue->closed = NIL_VAL;
-	return upvalue;
-}
-
-ObjClosure* newClosure(ObjFunction* function)
-{
-	ObjUpvalue** upvalues = ALLOCATE(ObjUpvalue*,function->upvalueCount);
-	for (int i = 0; i < function->upvalueCount; i++) {
-		upvalues[i] = NULL;
-	}
-
-	ObjClosure* closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
-	closure->function = function;
-	closure->upvalues = upvalues;
-	closure->upvalueCount = function->upvalueCount;
-	return closure;
-}
-
-static ObjString *allocateString(char *chars, int length, uint32_t hash)
-{
-	ObjString *string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
-	string->length = length;
-	string->chars = chars;
-	string->hash = hash;
-
-	push(OBJ_VAL(string));
-	tableSet(&vm.strings, string, NIL_VAL);
-	pop();
-
-	return string;
-}
-
-static uint32_t hashString(const char* key, int length)
-{
-	uint32_t hash = 2166136261u;
-
-	for (int i = 0; i < length; i++) {
-		hash ^= key[i];
-		hash *= 16777619;
-	}
-
-	return hash;
-}
-
-ObjString *copyString(const char *chars, int length)
-{
-	uint32_t hash = hashString(chars, length);
-	ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
-	if (interned != NULL)
-		return interned;
-
-	char *heapChars = ALLOCATE(char, length + 1);
-	memcpy(heapChars, chars, length);
-	heapChars[length] = '\0';
-
-	return allocateString(heapChars, length, hash);
-}
-
-static void printFunction(ObjFunction* function)
-{
-	if (function->name == NULL) {
-		printf("<script>");
-		return;
-	}
-
-	printf("<fn %s>", function->name->chars);
-}
-
-void printObject(Value value)
-{
-	switch (OBJ_TYPE(value))
-	{
-	case OBJ_BOUND_METHOD:
-		printFunction(AS_BOUND_METHOD(value)->method->function);
-		break;
-	case OBJ_CLASS:
-		printf("%s", AS_CLASS(value)->name->chars);
-		break;
-	case OBJ_CLOSURE:
-		printFunction(AS_CLOSURE(value)->function);
-		break;
-	case OBJ_FUNCTION:
-		printFunction(AS_FUNCTION(value));
-		break;
-	case OBJ_INSTANCE:
-		printf("%s instance",
-			AS_INSTANCE(value)->_class->name->chars);
-		break;
-	case OBJ_NATIVE:
-		printf("<native fn>");
-		break;
-	case OBJ_UPVALUE:
-		printf("upvalue");
-		break;
-	case OBJ_STRING:
-		printf("%s", AS_CSTRING(value));
-		break;
-	}
-}
-
-ObjString *takeString(char *chars, int length)
-{
-	uint32_t hash = hashString(chars, length);
-	ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
-	if (interned != NULL) {
-		FREE_ARRAY(char, chars, length + 1);
-		return interned;
-	}
-	return allocateString(chars, length, hash);
+#include <stdio.h>
+#include <string.h>
+
+#include "memory.h"
+#include "object.h"
+#include "table.h"
+#include "value.h"
+#include "vm.h"
+
+#define ALLOCATE_OBJ(type, objectType) (type *)allocateObject(sizeof(type), objectType)
+
+static Obj *allocateObject(size_t size, ObjType type)
+{
+	Obj *object = (Obj *)allocateSlot(size);
+	object->type = (uint8_t)type;
+	object->isRemembered = false;
+#ifdef SLAB_ENABLED
+	slabSetYoung(object);
+#else
+	object->mark = !vm.markValue;
+	object->next = vm.youngObjects;
+	vm.youngObjects = object;
+#endif
+
+#ifdef DEBUG_LOG_GC
+	PRINT_SPECIAL(stdout)
+	printf("%p allocate %ld for %d\n", (void*)object, size, type);
+	PRINT_RESET(stdout)
+#endif
+
+	return object;
+}
+
+ObjBoundMethod* newBoundMethod(Value reciever, ObjClosure* method)
+{
+	ObjBoundMethod* bound = ALLOCATE_OBJ(ObjBoundMethod, OBJ_BOUND_METHOD);
+
+	bound->reciever = reciever;
+	bound->method = method;
+	return bound;
+}
+
+ObjClass* newClass(ObjString* name)
+{
+	ObjShape* rootShape = newShape(NULL, NULL);
+	push(OBJ_VAL(rootShape));
+
+	ObjClass* _class = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
+	_class->name = name;
+	_class->rootShape = rootShape;
+	_class->fieldHint = 0;
+	initTable(&_class->methods);
+
+	pop();
+	return _class;
+}
+
+ObjInstance* newInstance(ObjClass* _class)
+{
+	//Size the field array from what earlier instances of the class ended up
+	//needing, so most instances never have to grow it.
+	Value* fields = NULL;
+	if (_class->fieldHint > 0) {
+		fields = ALLOCATE(Value, _class->fieldHint);
+		for (int i = 0; i < _class->fieldHint; i++) {
+			fields[i] = NIL_VAL;
+		}
+	}
+
+	ObjInstance* instance = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
+	instance->_class = _class;
+	instance->shape = _class->rootShape;
+	instance->fieldCapacity = _class->fieldHint;
+	instance->fields = fields;
+	return instance;
+}
+
+ObjShape* newShape(ObjShape* parent, ObjString* key)
+{
+	ObjShape* shape = ALLOCATE_OBJ(ObjShape, OBJ_SHAPE);
+	shape->parent = parent;
+	shape->key = key;
+	shape->slotCount = 0;
+	shape->isDictionary = false;
+	initTable(&shape->slots);
+	initTable(&shape->transitions);
+
+	if (parent == NULL) return shape;
+
+	push(OBJ_VAL(shape));
+	tableAddAll(&parent->slots, &shape->slots);
+	shape->slotCount = parent->slotCount;
+	if (key != NULL) {
+		tableSet(&shape->slots, key, NUMBER_VAL(shape->slotCount++));
+		tableSet(&parent->transitions, key, OBJ_VAL(shape));
+		WRITE_BARRIER(parent);
+	}
+	WRITE_BARRIER(shape);
+	pop();
+
+	return shape;
+}
+
+int shapeFindSlot(ObjShape* shape, ObjString* key)
+{
+	Value slot;
+	if (!tableGet(&shape->slots, key, &slot)) return -1;
+	return (int)AS_NUMBER(slot);
+}
+
+static ObjShape* shapeAddField(ObjShape* shape, ObjString* key)
+{
+	if (shape->isDictionary) {
+		tableSet(&shape->slots, key, NUMBER_VAL(shape->slotCount++));
+		WRITE_BARRIER(shape);
+		return shape;
+	}
+
+	Value next;
+	if (tableGet(&shape->transitions, key, &next)) {
+		return AS_SHAPE(next);
+	}
+
+	if (shape->slotCount < SHAPE_MAX_SLOTS) {
+		return newShape(shape, key);
+	}
+
+	//Too many fields for a shared shape; give the instance its own mutable
+	//dictionary shape so the transition tree stays small.
+	ObjShape* dictionary = newShape(shape, NULL);
+	STORE_SHARED(dictionary->parent, NULL);
+	dictionary->isDictionary = true;
+	push(OBJ_VAL(dictionary));
+	tableSet(&dictionary->slots, key, NUMBER_VAL(dictionary->slotCount++));
+	WRITE_BARRIER(dictionary);
+	pop();
+	return dictionary;
+}
+
+void instanceSetField(ObjInstance* instance, ObjString* name, Value value)
+{
+	int slot = shapeFindSlot(instance->shape, name);
+	if (slot >= 0) {
+		STORE_SHARED(instance->fields[slot], value);
+		WRITE_BARRIER(instance);
+		return;
+	}
+
+	//Grow first, so the field array always covers the shape it is traced with.
+	slot = instance->shape->slotCount;
+	if (instance->fieldCapacity < slot + 1) {
+		int oldCapacity = instance->fieldCapacity;
+		int capacity = oldCapacity < 4 ? 4 : oldCapacity * 2;
+		Value* fields = GROW_ARRAY(Value, instance->fields, oldCapacity, capacity);
+		for (int i = oldCapacity; i < capacity; i++) {
+			fields[i] = NIL_VAL;
+		}
+		STORE_SHARED(instance->fields, fields);
+		STORE_RELEASE(instance->fieldCapacity, capacity);
+	}
+
+	ObjShape* shape = shapeAddField(instance->shape, name);
+	STORE_SHARED(instance->shape, shape);
+	STORE_SHARED(instance->fields[slot], value);
+	WRITE_BARRIER(instance);
+
+	if (!shape->isDictionary && instance->_class->fieldHint < shape->slotCount) {
+		instance->_class->fieldHint = shape->slotCount;
+	}
+}
+
+ObjFunction* newFunction()
+{
+	ObjFunction* function = ALLOCATE_OBJ(ObjFunction, OBJ_FUNCTION);
+
+	function->arity = 0;
+	function->upvalueCount = 0;
+	function->name = NULL;
+	function->hotness = 0;
+	function->jit = NULL;
+	function->traces = NULL;
+	initChunk(&function->chunk);
+	return function;
+}
+
+ObjNative* newNative(NativeFn function)
+{
+	ObjNative* native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
+	native->function = function;
+	return native;
+}
+
+ObjUpvalue* newUpvalue(Value* slot)
+{
+	ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
+	upvalue->location = slot;
+	upvalue->next = NULL;
+	upvalue->closed = NIL_VAL;
+	return upvalue;
+}
+
+ObjClosure* newClosure(ObjFunction* function)
+{
+	ObjUpvalue** upvalues = ALLOCATE(ObjUpvalue*,function->upvalueCount);
+	for (int i = 0; i < function->upvalueCount; i++) {
+		upvalues[i] = NULL;
+	}
+
+	ObjClosure* closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
+	closure->function = function;
+	closure->upvalues = upvalues;
+	closure->upvalueCount = function->upvalueCount;
+	return closure;
+}
+
+static ObjString *allocateString(char *chars, int length, uint32_t hash)
+{
+	ObjString *string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+	string->length = length;
+	string->chars = chars;
+	string->hash = hash;
+
+	push(OBJ_VAL(string));
+	tableSet(&vm.strings, string, NIL_VAL);
+	pop();
+
+	return string;
+}
+
+static uint32_t hashString(const char* key, int length)
+{
+	uint32_t hash = 2166136261u;
+
+	for (int i = 0; i < length; i++) {
+		hash ^= key[i];
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+ObjString *copyString(const char *chars, int length)
+{
+	uint32_t hash = hashString(chars, length);
+	ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+	if (interned != NULL)
+		return interned;
+
+	char *heapChars = ALLOCATE(char, length + 1);
+	memcpy(heapChars, chars, length);
+	heapChars[length] = '\0';
+
+	return allocateString(heapChars, length, hash);
+}
+
+static void printFunction(ObjFunction* function)
+{
+	if (function->name == NULL) {
+		printf("<script>");
+		return;
+	}
+
+	printf("<fn %s>", function->name->chars);
+}
+
+void printObject(Value value)
+{
+	switch (OBJ_TYPE(value))
+	{
+	case OBJ_BOUND_METHOD:
+		printFunction(AS_BOUND_METHOD(value)->method->function);
+		break;
+	case OBJ_CLASS:
+		printf("%s", AS_CLASS(value)->name->chars);
+		break;
+	case OBJ_CLOSURE:
+		printFunction(AS_CLOSURE(value)->function);
+		break;
+	case OBJ_FUNCTION:
+		printFunction(AS_FUNCTION(value));
+		break;
+	case OBJ_INSTANCE:
+		printf("%s instance",
+			AS_INSTANCE(value)->_class->name->chars);
+		break;
+	case OBJ_NATIVE:
+		printf("<native fn>");
+		break;
+	case OBJ_UPVALUE:
+		printf("upvalue");
+		break;
+	case OBJ_SHAPE:
+		printf("shape");
+		break;
+	case OBJ_STRING:
+		printf("%s", AS_CSTRING(value));
+		break;
+	}
+}
+
+ObjString *takeString(char *chars, int length)
+{
+	uint32_t hash = hashString(chars, length);
+	ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+	if (interned != NULL) {
+		FREE_ARRAY(char, chars, length + 1);
+		return interned;
+	}
+	return allocateString(chars, length, hash);
 }
\ No newline at end of file
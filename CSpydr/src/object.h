@@ -1,125 +1,163 @@
-#ifndef cspydr_object_h
-#define cspydr_object_h
-
-#include "value.h"
-#include "common.h"
-#include "table.h"
-#include "chunk.h"
-
-#define OBJ_TYPE(value) (AS_OBJ(value)->type)
-
-#define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
-#define IS_CLASS(value) isObjType(value, OBJ_CLASS)
-#define IS_INSTANCE(value)     isObjType(value, OBJ_INSTANCE)
-#define IS_CLOSURE(value) isObjType(value, OBJ_CLOSURE)
-#define IS_STRING(value) isObjType(value, OBJ_STRING)
-#define IS_FUNCTION(value) isObjType(value, OBJ_FUNCTION)
-#define IS_NATIVE(value)       isObjType(value, OBJ_NATIVE)
-
-#define AS_BOUND_METHOD(value) ((ObjBoundMethod*)AS_OBJ(value))
-#define AS_CLASS(value) ((ObjClass*)AS_OBJ(value))
-#define AS_INSTANCE(value) ((ObjInstance*)AS_OBJ(value))
-#define AS_CLOSURE(value) ((ObjClosure*)AS_OBJ(value))
-#define AS_FUNCTION(value) ((ObjFunction*)AS_OBJ(value))
-#define AS_STRING(value) ((ObjString*)AS_OBJ(value))
-#define AS_CSTRING(value) (((ObjString*)AS_OBJ(value))->chars)
-#define AS_NATIVE(value) (((ObjNative*)AS_OBJ(value))->function)
-
-typedef enum
-{
-	OBJ_BOUND_METHOD,
-	OBJ_CLASS,
-	OBJ_INSTANCE,
-	OBJ_FUNCTION,
-	OBJ_STRING,
-	OBJ_NATIVE,
-	OBJ_CLOSURE,
-	OBJ_UPVALUE
-} ObjType;
-
-struct sObj
-{
-	ObjType type;
-	bool isMarked;
-	struct sObj *next;
-};
-
-typedef struct
-{
-	Obj obj;
-	int arity;
-	int upvalueCount;
-	Chunk chunk;
-	ObjString* name;
-} ObjFunction;
-
-typedef struct ObjUpvalue
-{
-	Obj obj;
-	Value* location;
-	Value closed;
-	struct ObjUpvalue* next;
-} ObjUpvalue;
-
-typedef struct
-{
-	Obj obj;
-	ObjFunction* function;
-	ObjUpvalue** upvalues;
-	int upvalueCount;
-} ObjClosure;
-
-typedef struct
-{
-	Obj obj;
-	ObjString* name;
-	Table methods;
-} ObjClass;
-
-typedef struct
-{
-	Obj obj;
-	ObjClass* _class;
-	Table fields;
-} ObjInstance;
-
-typedef struct
-{
-	Obj obj;
-	Value reciever;
-	ObjClosure* method;
-} ObjBoundMethod;
-
-typedef Value(*NativeFn) (int argCount, Value* args);
-
-typedef struct
-{
-	Obj obj;
-	NativeFn function;
-} ObjNative;
-
-struct sObjString
-{
-	Obj obj;
-	int length;
-	char *chars;
-	uint32_t hash;
-};
-
-ObjBoundMethod* newBoundMethod(Value reciever, ObjClosure* method);
-ObjClass* newClass(ObjString* name);
-ObjInstance* newInstance(ObjClass* _class);
-ObjNative* newNative(NativeFn function);
-ObjFunction* newFunction();
-ObjUpvalue* newUpvalue(Value* slot);
-ObjClosure* newClosure();
-ObjString *takeString(char *chars, int length);
-ObjString *copyString(const char *chars, int length);
-void printObject(Value value);
-
-static inline bool isObjType(Value value, ObjType type)
-{
-	return IS_OBJ(value) && AS_OBJ(value)->type == type;
-}
-
+#ifndef cspydr_object_h
+#define cspydr_object_h
+
+#include "value.h"
+#include "common.h"
+#include "table.h"
+#include "chunk.h"
+
+#define OBJ_TYPE(value) (AS_OBJ(value)->type)
+
+#define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
+#define IS_CLASS(value) isObjType(value, OBJ_CLASS)
+#define IS_INSTANCE(value)     isObjType(value, OBJ_INSTANCE)
+#define IS_CLOSURE(value) isObjType(value, OBJ_CLOSURE)
+#define IS_STRING(value) isObjType(value, OBJ_STRING)
+#define IS_FUNCTION(value) isObjType(value, OBJ_FUNCTION)
+#define IS_NATIVE(value)       isObjType(value, OBJ_NATIVE)
+#define IS_SHAPE(value) isObjType(value, OBJ_SHAPE)
+
+#define AS_BOUND_METHOD(value) ((ObjBoundMethod*)AS_OBJ(value))
+#define AS_CLASS(value) ((ObjClass*)AS_OBJ(value))
+#define AS_INSTANCE(value) ((ObjInstance*)AS_OBJ(value))
+#define AS_CLOSURE(value) ((ObjClosure*)AS_OBJ(value))
+#define AS_FUNCTION(value) ((ObjFunction*)AS_OBJ(value))
+#define AS_STRING(value) ((ObjString*)AS_OBJ(value))
+#define AS_CSTRING(value) (((ObjString*)AS_OBJ(value))->chars)
+#define AS_NATIVE(value) (((ObjNative*)AS_OBJ(value))->function)
+#define AS_SHAPE(value) ((ObjShape*)AS_OBJ(value))
+
+//Instances whose shape would grow past this many fields are switched to a
+//private dictionary shape instead of extending the transition tree.
+#define SHAPE_MAX_SLOTS 32
+
+typedef enum
+{
+	OBJ_BOUND_METHOD,
+	OBJ_CLASS,
+	OBJ_INSTANCE,
+	OBJ_FUNCTION,
+	OBJ_STRING,
+	OBJ_NATIVE,
+	OBJ_CLOSURE,
+	OBJ_UPVALUE,
+	OBJ_SHAPE
+} ObjType;
+
+//With slab pages, the collector keeps everything else it knows about an
+//object in the page's bitmaps, so the header is two bytes and the fields
+//that follow share its word. Without them, objects are found through the
+//'next' lists.
+struct sObj
+{
+	uint8_t type;		//An ObjType.
+	bool isRemembered;	//Old and queued in vm.rememberedSet.
+#ifndef SLAB_ENABLED
+	bool mark;			//Marked when equal to vm.markValue, which also makes it old.
+	struct sObj *next;
+#endif
+};
+
+typedef struct
+{
+	Obj obj;
+	int arity;
+	int upvalueCount;
+	int hotness;		//Calls plus loop back edges, -1 once the JIT gave up.
+	Chunk chunk;
+	ObjString* name;
+	struct sJitCode* jit;
+	struct sTrace* traces;
+} ObjFunction;
+
+typedef struct ObjUpvalue
+{
+	Obj obj;
+	Value* location;
+	Value closed;
+	struct ObjUpvalue* next;
+} ObjUpvalue;
+
+typedef struct
+{
+	Obj obj;
+	int upvalueCount;
+	ObjFunction* function;
+	ObjUpvalue** upvalues;
+} ObjClosure;
+
+//Hidden class shared by all instances that added the same fields in the
+//same order. Adding a field moves an instance along 'transitions' to the
+//child shape for that name.
+typedef struct ObjShape
+{
+	Obj obj;
+	bool isDictionary;
+	int slotCount;
+	struct ObjShape* parent;
+	ObjString* key;
+	Table slots;
+	Table transitions;
+} ObjShape;
+
+typedef struct
+{
+	Obj obj;
+	int fieldHint;
+	ObjString* name;
+	Table methods;
+	ObjShape* rootShape;
+} ObjClass;
+
+typedef struct
+{
+	Obj obj;
+	int fieldCapacity;
+	ObjClass* _class;
+	ObjShape* shape;
+	Value* fields;
+} ObjInstance;
+
+typedef struct
+{
+	Obj obj;
+	Value reciever;
+	ObjClosure* method;
+} ObjBoundMethod;
+
+typedef Value(*NativeFn) (int argCount, Value* args);
+
+typedef struct
+{
+	Obj obj;
+	NativeFn function;
+} ObjNative;
+
+struct sObjString
+{
+	Obj obj;
+	int length;
+	uint32_t hash;
+	char *chars;
+};
+
+ObjBoundMethod* newBoundMethod(Value reciever, ObjClosure* method);
+ObjClass* newClass(ObjString* name);
+ObjInstance* newInstance(ObjClass* _class);
+ObjShape* newShape(ObjShape* parent, ObjString* key);
+int shapeFindSlot(ObjShape* shape, ObjString* key);
+void instanceSetField(ObjInstance* instance, ObjString* name, Value value);
+ObjNative* newNative(NativeFn function);
+ObjFunction* newFunction();
+ObjUpvalue* newUpvalue(Value* slot);
+ObjClosure* newClosure();
+ObjString *takeString(char *chars, int length);
+ObjString *copyString(const char *chars, int length);
+void printObject(Value value);
+
+static inline bool isObjType(Value value, ObjType type)
+{
+	return IS_OBJ(value) && AS_OBJ(value)->type == type;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,346 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "opprofile.h"
+
+//Instructions that can start a superinstruction, in the order their counts
+//are kept in.
+static const uint8_t starts[] = {
+	OP_CONSTANT,
+	OP_NIL,
+	OP_TRUE,
+	OP_FALSE,
+	OP_POP,
+	OP_GET_LOCAL,
+	OP_SET_LOCAL,
+	OP_INC_LOCAL,
+	OP_GET_UPVALUE,
+	OP_GET_GLOBAL,
+	OP_SET_GLOBAL,
+};
+
+#define START_COUNT ((int)(sizeof(starts) / sizeof(starts[0])))
+
+//Profiles name the instructions rather than number them, so they stay
+//valid when the opcodes are renumbered.
+static const char* names[UINT8_COUNT] = {
+	[OP_NEGATE] = "OP_NEGATE",
+	[OP_PRINT] = "OP_PRINT",
+	[OP_JUMP_IF_FALSE] = "OP_JUMP_IF_FALSE",
+	[OP_JUMP] = "OP_JUMP",
+	[OP_LOOP] = "OP_LOOP",
+	[OP_CALL] = "OP_CALL",
+	[OP_TAIL_CALL] = "OP_TAIL_CALL",
+	[OP_CLASS] = "OP_CLASS",
+	[OP_METHOD] = "OP_METHOD",
+	[OP_INVOKE] = "OP_INVOKE",
+	[OP_TAIL_INVOKE] = "OP_TAIL_INVOKE",
+	[OP_INHERIT] = "OP_INHERIT",
+	[OP_CLOSURE] = "OP_CLOSURE",
+	[OP_ADD] = "OP_ADD",
+	[OP_SUBTRACT] = "OP_SUBTRACT",
+	[OP_MULTIPLY] = "OP_MULTIPLY",
+	[OP_DIVIDE] = "OP_DIVIDE",
+	[OP_POWER] = "OP_POWER",
+	[OP_MODULO] = "OP_MODULO",
+	[OP_SHIFT_LEFT] = "OP_SHIFT_LEFT",
+	[OP_SHIFT_RIGHT] = "OP_SHIFT_RIGHT",
+	[OP_RETURN] = "OP_RETURN",
+	[OP_NIL] = "OP_NIL",
+	[OP_TRUE] = "OP_TRUE",
+	[OP_FALSE] = "OP_FALSE",
+	[OP_POP] = "OP_POP",
+	[OP_DEFINE_GLOBAL] = "OP_DEFINE_GLOBAL",
+	[OP_DEFINE_CONSTANT] = "OP_DEFINE_CONSTANT",
+	[OP_GET_GLOBAL] = "OP_GET_GLOBAL",
+	[OP_SET_GLOBAL] = "OP_SET_GLOBAL",
+	[OP_GET_ARRAY_INDEX] = "OP_GET_ARRAY_INDEX",
+	[OP_GET_UPVALUE] = "OP_GET_UPVALUE",
+	[OP_SET_UPVALUE] = "OP_SET_UPVALUE",
+	[OP_GET_PROPERTY] = "OP_GET_PROPERTY",
+	[OP_SET_PROPERTY] = "OP_SET_PROPERTY",
+	[OP_CLOSE_UPVALUE] = "OP_CLOSE_UPVALUE",
+	[OP_GET_LOCAL] = "OP_GET_LOCAL",
+	[OP_SET_LOCAL] = "OP_SET_LOCAL",
+	[OP_GET_SUPER] = "OP_GET_SUPER",
+	[OP_SUPER_INVOKE] = "OP_SUPER_INVOKE",
+	[OP_TAIL_SUPER_INVOKE] = "OP_TAIL_SUPER_INVOKE",
+	[OP_EQUAL] = "OP_EQUAL",
+	[OP_GREATER] = "OP_GREATER",
+	[OP_LESS] = "OP_LESS",
+	[OP_GREATER_EQUAL] = "OP_GREATER_EQUAL",
+	[OP_LESS_EQUAL] = "OP_LESS_EQUAL",
+	[OP_NOT] = "OP_NOT",
+	[OP_CONSTANT] = "OP_CONSTANT",
+	[OP_EXIT] = "OP_EXIT",
+	[OP_JUMP_IF_NOT_LESS] = "OP_JUMP_IF_NOT_LESS",
+	[OP_JUMP_IF_NOT_LESS_EQUAL] = "OP_JUMP_IF_NOT_LESS_EQUAL",
+	[OP_JUMP_IF_NOT_GREATER] = "OP_JUMP_IF_NOT_GREATER",
+	[OP_JUMP_IF_NOT_GREATER_EQUAL] = "OP_JUMP_IF_NOT_GREATER_EQUAL",
+	[OP_INC_LOCAL] = "OP_INC_LOCAL",
+	[OP_MOVE] = "OP_MOVE",
+	[OP_ADD_RR] = "OP_ADD_RR",
+	[OP_SUBTRACT_RR] = "OP_SUBTRACT_RR",
+	[OP_MULTIPLY_RR] = "OP_MULTIPLY_RR",
+	[OP_DIVIDE_RR] = "OP_DIVIDE_RR",
+	[OP_ADD_RK] = "OP_ADD_RK",
+	[OP_SUBTRACT_RK] = "OP_SUBTRACT_RK",
+	[OP_MULTIPLY_RK] = "OP_MULTIPLY_RK",
+	[OP_DIVIDE_RK] = "OP_DIVIDE_RK",
+	[OP_JUMP_IF_NOT_LESS_RR] = "OP_JUMP_IF_NOT_LESS_RR",
+	[OP_JUMP_IF_NOT_LESS_EQUAL_RR] = "OP_JUMP_IF_NOT_LESS_EQUAL_RR",
+	[OP_JUMP_IF_NOT_GREATER_RR] = "OP_JUMP_IF_NOT_GREATER_RR",
+	[OP_JUMP_IF_NOT_GREATER_EQUAL_RR] = "OP_JUMP_IF_NOT_GREATER_EQUAL_RR",
+	[OP_JUMP_IF_NOT_LESS_RK] = "OP_JUMP_IF_NOT_LESS_RK",
+	[OP_JUMP_IF_NOT_LESS_EQUAL_RK] = "OP_JUMP_IF_NOT_LESS_EQUAL_RK",
+	[OP_JUMP_IF_NOT_GREATER_RK] = "OP_JUMP_IF_NOT_GREATER_RK",
+	[OP_JUMP_IF_NOT_GREATER_EQUAL_RK] = "OP_JUMP_IF_NOT_GREATER_EQUAL_RK",
+	[OP_ADD_NUM] = "OP_ADD_NUM",
+	[OP_ADD_STR] = "OP_ADD_STR",
+	[OP_SUBTRACT_NUM] = "OP_SUBTRACT_NUM",
+	[OP_MULTIPLY_NUM] = "OP_MULTIPLY_NUM",
+	[OP_DIVIDE_NUM] = "OP_DIVIDE_NUM",
+	[OP_GREATER_NUM] = "OP_GREATER_NUM",
+	[OP_LESS_NUM] = "OP_LESS_NUM",
+};
+
+//Counts for sequences that start with one of 'starts', by its index. The
+//quickened forms the interpreter rewrote instructions into are counted as
+//such, a superinstruction can go straight to those.
+typedef struct
+{
+	uint64_t instructions;
+	uint64_t pairs[START_COUNT][UINT8_COUNT];
+	uint64_t triples[START_COUNT][START_COUNT][UINT8_COUNT];
+	int previous;
+	int beforePrevious;
+} OpcodeProfile;
+
+static OpcodeProfile profile = { 0, { { 0 } }, { { { 0 } } }, -1, -1 };
+
+static int startIndex(uint8_t instruction)
+{
+	for (int i = 0; i < START_COUNT; i++) {
+		if (starts[i] == instruction) return i;
+	}
+	return -1;
+}
+
+static int opcodeNamed(const char* name)
+{
+	for (int i = 0; i < UINT8_COUNT; i++) {
+		if (names[i] != NULL && strcmp(names[i], name) == 0) return i;
+	}
+	return -1;
+}
+
+static int startNamed(const char* name)
+{
+	int instruction = opcodeNamed(name);
+	return instruction >= 0 ? startIndex((uint8_t)instruction) : -1;
+}
+
+bool canStartSuperinstruction(uint8_t instruction)
+{
+	return startIndex(instruction) >= 0;
+}
+
+//Called by the profiling build's dispatch for every instruction it runs.
+void profileInstruction(uint8_t instruction)
+{
+	profile.instructions++;
+	if (profile.previous >= 0) {
+		profile.pairs[profile.previous][instruction]++;
+		if (profile.beforePrevious >= 0) profile.triples[profile.beforePrevious][profile.previous][instruction]++;
+	}
+	profile.beforePrevious = profile.previous;
+	profile.previous = startIndex(instruction);
+}
+
+//The next instruction does not follow the last one, like when the
+//interpreter is entered again after an error.
+void profileBreak()
+{
+	profile.previous = -1;
+	profile.beforePrevious = -1;
+}
+
+//Adds the counts in a profile file to the ones in memory. A missing file
+//is an empty profile, sequences of instructions this build doesn't have
+//are skipped.
+static bool readOpcodeProfile(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL) return true;
+
+	char kind[16];
+	char first[32], second[32], third[32];
+	unsigned long long count;
+	bool isValid = true;
+	while (isValid && fscanf(file, "%15s", kind) == 1) {
+		if (strcmp(kind, "instructions") == 0) {
+			isValid = fscanf(file, "%llu", &count) == 1;
+			if (isValid) profile.instructions += count;
+		}
+		else if (strcmp(kind, "pair") == 0) {
+			isValid = fscanf(file, "%31s %31s %llu", first, second, &count) == 3;
+			int a = startNamed(first);
+			int b = opcodeNamed(second);
+			if (isValid && a >= 0 && b >= 0) profile.pairs[a][b] += count;
+		}
+		else if (strcmp(kind, "triple") == 0) {
+			isValid = fscanf(file, "%31s %31s %31s %llu", first, second, third, &count) == 4;
+			int a = startNamed(first);
+			int b = startNamed(second);
+			int c = opcodeNamed(third);
+			if (isValid && a >= 0 && b >= 0 && c >= 0) profile.triples[a][b][c] += count;
+		}
+		else {
+			isValid = false;
+		}
+	}
+
+	fclose(file);
+	if (!isValid) fprintf(stderr, "\"%s\" is not an opcode profile.\n", path);
+	return isValid;
+}
+
+//Adds this run's counts to the profile at 'path', creating it if needed.
+bool writeOpcodeProfile(const char* path)
+{
+	if (!readOpcodeProfile(path)) return false;
+
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not write \"%s\".\n", path);
+		return false;
+	}
+
+	fprintf(file, "instructions %llu\n", (unsigned long long)profile.instructions);
+	for (int a = 0; a < START_COUNT; a++) {
+		for (int b = 0; b < UINT8_COUNT; b++) {
+			if (profile.pairs[a][b] == 0 || names[b] == NULL) continue;
+			fprintf(file, "pair %s %s %llu\n", names[starts[a]], names[b], (unsigned long long)profile.pairs[a][b]);
+		}
+	}
+	for (int a = 0; a < START_COUNT; a++) {
+		for (int b = 0; b < START_COUNT; b++) {
+			for (int c = 0; c < UINT8_COUNT; c++) {
+				if (profile.triples[a][b][c] == 0 || names[c] == NULL) continue;
+				fprintf(file, "triple %s %s %s %llu\n", names[starts[a]], names[starts[b]], names[c], (unsigned long long)profile.triples[a][b][c]);
+			}
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+typedef struct
+{
+	uint8_t ops[3];
+	int length;
+	uint64_t count;
+} Sequence;
+
+static int compareSequences(const void* a, const void* b)
+{
+	uint64_t x = ((const Sequence*)a)->count;
+	uint64_t y = ((const Sequence*)b)->count;
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static bool sameSequence(Sequence* sequence, const uint8_t* ops, int length)
+{
+	return sequence->length == length && memcmp(sequence->ops, ops, length) == 0;
+}
+
+static void writeSequenceName(FILE* file, const uint8_t* ops, int length)
+{
+	fprintf(file, "%s", names[ops[0]]);
+	for (int i = 1; i < length; i++) fprintf(file, "__%s", names[ops[i]] + 3);
+}
+
+//Picks the sequences that would save the most dispatches and writes them
+//out as the SUPERINSTRUCTION() list the interpreter is built with. Each
+//execution of a pair saves one dispatch. A triple is a pair whose second
+//instruction is the superinstruction for the last two, so it needs that
+//one too and saves one more.
+bool generateSuperinstructions(const char* profilePath, const char* headerPath)
+{
+	memset(&profile, 0, sizeof(profile));
+	profileBreak();
+	FILE* check = fopen(profilePath, "r");
+	if (check == NULL) {
+		fprintf(stderr, "Could not open file \"%s\".\n", profilePath);
+		return false;
+	}
+	fclose(check);
+	if (!readOpcodeProfile(profilePath)) return false;
+
+	uint64_t minCount = (uint64_t)(profile.instructions * SUPERINSTRUCTION_MIN_SHARE) + 1;
+	int capacity = START_COUNT * UINT8_COUNT * (START_COUNT + 1);
+	Sequence* candidates = malloc(sizeof(Sequence) * capacity);
+	int count = 0;
+	for (int a = 0; a < START_COUNT; a++) {
+		for (int c = 0; c < UINT8_COUNT; c++) {
+			if (profile.pairs[a][c] >= minCount) {
+				candidates[count++] = (Sequence){ { starts[a], (uint8_t)c, 0 }, 2, profile.pairs[a][c] };
+			}
+			for (int b = 0; b < START_COUNT; b++) {
+				if (profile.triples[a][b][c] < minCount) continue;
+				candidates[count++] = (Sequence){ { starts[a], starts[b], (uint8_t)c }, 3, profile.triples[a][b][c] };
+			}
+		}
+	}
+	qsort(candidates, count, sizeof(Sequence), compareSequences);
+
+	//Opcodes left over after the ones the interpreter already has.
+	int limit = UINT8_COUNT - (OP_LESS_NUM + 1);
+	if (limit > MAX_SUPERINSTRUCTIONS) limit = MAX_SUPERINSTRUCTIONS;
+	Sequence chosen[MAX_SUPERINSTRUCTIONS];
+	int chosenCount = 0;
+	for (int i = 0; i < count; i++) {
+		Sequence* candidate = &candidates[i];
+		bool hasSuffix = candidate->length == 2;
+		bool isChosen = false;
+		for (int j = 0; j < chosenCount; j++) {
+			if (sameSequence(&chosen[j], candidate->ops, candidate->length)) isChosen = true;
+			if (sameSequence(&chosen[j], candidate->ops + 1, 2)) hasSuffix = true;
+		}
+		if (isChosen || chosenCount + (hasSuffix ? 1 : 2) > limit) continue;
+
+		if (!hasSuffix) {
+			Sequence* suffix = &chosen[chosenCount++];
+			suffix->ops[0] = candidate->ops[1];
+			suffix->ops[1] = candidate->ops[2];
+			suffix->length = 2;
+			suffix->count = profile.pairs[startIndex(suffix->ops[0])][suffix->ops[1]];
+		}
+		chosen[chosenCount++] = *candidate;
+	}
+	free(candidates);
+
+	FILE* file = fopen(headerPath, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not write \"%s\".\n", headerPath);
+		return false;
+	}
+
+	fprintf(file, "//Generated by --gen-superinstructions from a profile of %llu instructions,\n", (unsigned long long)profile.instructions);
+	fprintf(file, "//see opprofile.h. Regenerate this file rather than editing it.\n");
+	fprintf(file, "//\n");
+	fprintf(file, "//SUPERINSTRUCTION(name, first, next) runs 'first' and goes straight on to\n");
+	fprintf(file, "//'next', which may be a superinstruction itself.\n");
+	for (int i = 0; i < chosenCount; i++) {
+		Sequence* sequence = &chosen[i];
+		fprintf(file, "SUPERINSTRUCTION(");
+		writeSequenceName(file, sequence->ops, sequence->length);
+		fprintf(file, ", %s, ", names[sequence->ops[0]]);
+		writeSequenceName(file, sequence->ops + 1, sequence->length - 1);
+		fprintf(file, ")\t//%.2f%%\n", 100.0 * sequence->count / profile.instructions);
+	}
+
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,31 @@
+#ifndef cspydr_opprofile_h
+#define cspydr_opprofile_h
+
+#include <stdio.h>
+
+#include "common.h"
+#include "chunk.h"
+
+//Superinstructions the generator picks at most, out of the opcodes left.
+#define MAX_SUPERINSTRUCTIONS 32
+//Sequences that run less often than this share of all instructions are
+//not worth an opcode.
+#define SUPERINSTRUCTION_MIN_SHARE 0.001
+
+//Superinstructions are generated from what real programs run:
+//
+//  1. Build with -DPROFILE_OPCODES and run the workloads with
+//     --profile-ops=<profile>. Each run adds its counts to the file.
+//  2. Run --gen-superinstructions=<profile> src/superinstructions.h.
+//  3. Rebuild without PROFILE_OPCODES.
+//
+//Only instructions that never jump, call or rewrite themselves can start
+//a superinstruction, so the one after them is always the next in the chunk.
+bool canStartSuperinstruction(uint8_t instruction);
+
+void profileInstruction(uint8_t instruction);
+void profileBreak();
+bool writeOpcodeProfile(const char* path);
+bool generateSuperinstructions(const char* profilePath, const char* headerPath);
+
+#endif
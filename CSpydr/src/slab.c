@@ -0,0 +1,427 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#ifdef __unix__
+#include <sys/mman.h>
+#endif
+
+#define SLOT_SIZE(sizeClass) (((size_t)(sizeClass) + 1) * SLAB_GRANULE)
+#define FIRST_SLOT ((sizeof(SlabPage) + SLAB_GRANULE - 1) & ~(size_t)(SLAB_GRANULE - 1))
+
+typedef struct
+{
+	SlabPage* pages;
+	//Pages the collection that just marked has not swept yet. New pages go
+	//in front of it, since they hold nothing old.
+	SlabPage* sweepCursor;
+	SlabSlot* freeSlots;
+	//Never used part of the newest page, handed out in address order so
+	//objects allocated together end up next to each other.
+	char* bump;
+	char* bumpEnd;
+} SlabClass;
+
+static SlabClass classes[SLAB_CLASS_COUNT];
+
+//Every page of every size class, in the order they were made.
+static SlabPage** pages = NULL;
+static int pageCount = 0;
+static int pageCapacity = 0;
+static int unsweptPages = 0;
+
+//Pages with a young bit set.
+static SlabPage** youngPages = NULL;
+static int youngPageCount = 0;
+static int youngPageCapacity = 0;
+
+//Pages a compaction emptied. Their memory has been handed back to the OS,
+//but the address range is kept for the next page that is needed.
+static SlabPage** released = NULL;
+static int releasedCount = 0;
+static int releasedCapacity = 0;
+
+static SlabPage* newPage(int sizeClass)
+{
+	void* memory = NULL;
+	if (releasedCount > 0) {
+		memory = released[--releasedCount];
+	}
+	else {
+#ifdef _WIN32
+		memory = _aligned_malloc(SLAB_PAGE_SIZE, SLAB_PAGE_SIZE);
+#else
+		if (posix_memalign(&memory, SLAB_PAGE_SIZE, SLAB_PAGE_SIZE) != 0) memory = NULL;
+#endif
+		if (memory == NULL) exit(1);
+	}
+
+	if (pageCapacity < pageCount + 1) {
+		pageCapacity = pageCapacity < 8 ? 8 : pageCapacity * 2;
+		pages = realloc(pages, sizeof(SlabPage*) * pageCapacity);
+
+		if (pages == NULL) exit(1);
+	}
+
+	SlabClass* slabClass = &classes[sizeClass];
+	SlabPage* page = (SlabPage*)memory;
+	page->sizeClass = sizeClass;
+	page->slotCount = (int)((SLAB_PAGE_SIZE - FIRST_SLOT) / SLOT_SIZE(sizeClass));
+	page->liveCount = 0;
+	page->isEvacuating = false;
+	page->hasYoung = false;
+	memset(page->markBits, 0, sizeof(page->markBits));
+	memset(page->oldBits, 0, sizeof(page->oldBits));
+	memset(page->youngBits, 0, sizeof(page->youngBits));
+	page->next = slabClass->pages;
+	slabClass->pages = page;
+	pages[pageCount++] = page;
+
+	slabClass->bump = (char*)page + FIRST_SLOT;
+	slabClass->bumpEnd = slabClass->bump + page->slotCount * SLOT_SIZE(sizeClass);
+	return page;
+}
+
+void* slabAllocate(size_t size)
+{
+	int sizeClass = SLAB_CLASS(size);
+	SlabClass* slabClass = &classes[sizeClass];
+
+	void* slot;
+	if (slabClass->freeSlots != NULL) {
+		slot = slabClass->freeSlots;
+		slabClass->freeSlots = slabClass->freeSlots->next;
+	}
+	else {
+		if (slabClass->bump == slabClass->bumpEnd) newPage(sizeClass);
+		slot = slabClass->bump;
+		slabClass->bump += SLOT_SIZE(sizeClass);
+	}
+
+	SLAB_PAGE(slot)->liveCount++;
+	return slot;
+}
+
+void slabFree(void* pointer, size_t size)
+{
+	SlabClass* slabClass = &classes[SLAB_CLASS(size)];
+	SlabSlot* slot = (SlabSlot*)pointer;
+	slot->next = slabClass->freeSlots;
+	slabClass->freeSlots = slot;
+
+	size_t bit = SLAB_BIT(slot);
+	SlabPage* page = SLAB_PAGE(slot);
+	page->oldBits[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+	page->liveCount--;
+}
+
+void slabFreeTo(SlabFreeList* list, void* pointer, size_t size)
+{
+	int sizeClass = SLAB_CLASS(size);
+	SlabSlot* slot = (SlabSlot*)pointer;
+	slot->next = list->heads[sizeClass];
+	if (list->heads[sizeClass] == NULL) list->tails[sizeClass] = slot;
+	list->heads[sizeClass] = slot;
+
+	//The page itself belongs to the thread sweeping it.
+	size_t bit = SLAB_BIT(slot);
+	SlabPage* page = SLAB_PAGE(slot);
+	page->oldBits[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+	page->liveCount--;
+}
+
+void slabMergeFreeList(SlabFreeList* list)
+{
+	for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+		if (list->heads[i] == NULL) continue;
+
+		list->tails[i]->next = classes[i].freeSlots;
+		classes[i].freeSlots = list->heads[i];
+		list->heads[i] = NULL;
+		list->tails[i] = NULL;
+	}
+}
+
+bool slabHasFreeSlot(int sizeClass)
+{
+	return classes[sizeClass].freeSlots != NULL || classes[sizeClass].bump != classes[sizeClass].bumpEnd;
+}
+
+//Turns every object white for a new full collection.
+void slabClearMarks()
+{
+	for (int i = 0; i < pageCount; i++) {
+		memset(pages[i]->markBits, 0, sizeof(pages[i]->markBits));
+	}
+}
+
+//Queues every page for sweeping, which then happens a page at a time as the
+//allocator runs out of slots in a size class, or as the collector's slices
+//come along.
+void slabBeginSweep()
+{
+	for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+		classes[i].sweepCursor = classes[i].pages;
+	}
+	unsweptPages = pageCount;
+}
+
+//Takes the next unswept page of 'sizeClass', or of any class when it is -1.
+SlabPage* slabNextUnswept(int sizeClass)
+{
+	if (unsweptPages == 0) return NULL;
+
+	if (sizeClass < 0) {
+		for (sizeClass = 0; classes[sizeClass].sweepCursor == NULL; sizeClass++);
+	}
+
+	SlabPage* page = classes[sizeClass].sweepCursor;
+	if (page == NULL) return NULL;
+
+	classes[sizeClass].sweepCursor = page->next;
+	unsweptPages--;
+	return page;
+}
+
+//For when every page has been swept by other means.
+void slabEndSweep()
+{
+	for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+		classes[i].sweepCursor = NULL;
+	}
+	unsweptPages = 0;
+}
+
+bool slabIsSwept()
+{
+	return unsweptPages == 0;
+}
+
+int slabPageCount()
+{
+	return pageCount;
+}
+
+SlabPage* slabPageAt(int index)
+{
+	return pages[index];
+}
+
+void slabStats(int sizeClass, SlabClassStats* stats)
+{
+	stats->slotSize = SLOT_SIZE(sizeClass);
+	stats->pageCount = 0;
+	stats->emptyPages = 0;
+	stats->slotCount = 0;
+	stats->liveCount = 0;
+
+	for (int i = 0; i < pageCount; i++) {
+		SlabPage* page = pages[i];
+		if (page->sizeClass != sizeClass) continue;
+
+		stats->pageCount++;
+		if (page->liveCount == 0) stats->emptyPages++;
+		stats->slotCount += page->slotCount;
+		stats->liveCount += page->liveCount;
+	}
+}
+
+int slabReleasedPages()
+{
+	return releasedCount;
+}
+
+void slabAddYoungPage(SlabPage* page)
+{
+	if (youngPageCapacity < youngPageCount + 1) {
+		youngPageCapacity = youngPageCapacity < 8 ? 8 : youngPageCapacity * 2;
+		youngPages = realloc(youngPages, sizeof(SlabPage*) * youngPageCapacity);
+
+		if (youngPages == NULL) exit(1);
+	}
+	page->hasYoung = true;
+	youngPages[youngPageCount++] = page;
+}
+
+int slabYoungPageCount()
+{
+	return youngPageCount;
+}
+
+SlabPage* slabYoungPageAt(int index)
+{
+	return youngPages[index];
+}
+
+//Empties the nursery, once a minor collection has freed or promoted every
+//object in it.
+void slabClearYoung()
+{
+	for (int i = 0; i < youngPageCount; i++) {
+		memset(youngPages[i]->youngBits, 0, sizeof(youngPages[i]->youngBits));
+		youngPages[i]->hasYoung = false;
+	}
+	youngPageCount = 0;
+}
+
+//Turns every young object old, so that the sweep of a full collection frees
+//the unmarked ones along with the old garbage and keeps the rest.
+void slabPromoteYoung()
+{
+	for (int i = 0; i < youngPageCount; i++) {
+		SlabPage* page = youngPages[i];
+		for (int word = 0; word < SLAB_BITMAP_WORDS; word++) {
+			page->oldBits[word] |= page->youngBits[word];
+		}
+	}
+	slabClearYoung();
+}
+
+static int compareLiveCount(const void* a, const void* b)
+{
+	return (*(SlabPage**)a)->liveCount - (*(SlabPage**)b)->liveCount;
+}
+
+//Picks, in every size class, the emptiest pages whose objects fit in the
+//free slots of the others, and leaves only those free slots to allocate
+//from, so that allocating moves an object out of a picked page. Must be
+//called with the nursery empty, when every slot in use holds an old object.
+//Returns how many pages were picked.
+int slabPlanEvacuation()
+{
+	if (pageCount == 0) return 0;
+
+	SlabPage** sorted = malloc(sizeof(SlabPage*) * pageCount);
+	if (sorted == NULL) exit(1);
+
+	int picked = 0;
+	for (int sizeClass = 0; sizeClass < SLAB_CLASS_COUNT; sizeClass++) {
+		SlabClass* slabClass = &classes[sizeClass];
+		if (slabClass->pages == NULL) continue;
+
+		int count = 0;
+		size_t freeSlots = 0;
+		for (SlabPage* page = slabClass->pages; page != NULL; page = page->next) {
+			sorted[count++] = page;
+			freeSlots += page->slotCount - page->liveCount;
+		}
+		qsort(sorted, count, sizeof(SlabPage*), compareLiveCount);
+
+		//Each page taken moves its objects out, and takes its own free slots
+		//away from where they could go.
+		size_t moving = 0;
+		for (int i = 0; i < count; i++) {
+			SlabPage* page = sorted[i];
+			size_t pageFree = page->slotCount - page->liveCount;
+			if (moving + page->liveCount > freeSlots - pageFree) break;
+
+			moving += page->liveCount;
+			freeSlots -= pageFree;
+			page->isEvacuating = true;
+			picked++;
+		}
+
+		slabClass->freeSlots = NULL;
+		slabClass->bump = NULL;
+		slabClass->bumpEnd = NULL;
+		for (int i = count - 1; i >= 0; i--) {
+			SlabPage* page = sorted[i];
+			if (page->isEvacuating) continue;
+
+			size_t slotSize = SLOT_SIZE(sizeClass);
+			for (int slot = page->slotCount - 1; slot >= 0; slot--) {
+				char* address = (char*)page + FIRST_SLOT + slot * slotSize;
+				size_t bit = SLAB_BIT(address);
+				if ((page->oldBits[bit / 64] >> (bit % 64)) & 1) continue;
+
+				SlabSlot* free = (SlabSlot*)address;
+				free->next = slabClass->freeSlots;
+				slabClass->freeSlots = free;
+			}
+		}
+	}
+
+	free(sorted);
+	return picked;
+}
+
+//Takes the pages emptied by a compaction out of their size classes and
+//gives their memory back.
+void slabReleaseEvacuated()
+{
+	for (int sizeClass = 0; sizeClass < SLAB_CLASS_COUNT; sizeClass++) {
+		SlabPage** link = &classes[sizeClass].pages;
+		while (*link != NULL) {
+			if ((*link)->isEvacuating) *link = (*link)->next;
+			else link = &(*link)->next;
+		}
+	}
+
+	int kept = 0;
+	for (int i = 0; i < pageCount; i++) {
+		SlabPage* page = pages[i];
+		if (!page->isEvacuating) {
+			pages[kept++] = page;
+			continue;
+		}
+
+#ifdef __unix__
+		if (releasedCapacity < releasedCount + 1) {
+			releasedCapacity = releasedCapacity < 8 ? 8 : releasedCapacity * 2;
+			released = realloc(released, sizeof(SlabPage*) * releasedCapacity);
+
+			if (released == NULL) exit(1);
+		}
+		madvise(page, SLAB_PAGE_SIZE, MADV_DONTNEED);
+		released[releasedCount++] = page;
+#elif defined(_WIN32)
+		_aligned_free(page);
+#else
+		free(page);
+#endif
+	}
+	pageCount = kept;
+}
+
+void freeSlabs()
+{
+	for (int i = 0; i < pageCount; i++) {
+#ifdef _WIN32
+		_aligned_free(pages[i]);
+#else
+		free(pages[i]);
+#endif
+	}
+	free(pages);
+	pages = NULL;
+	pageCount = 0;
+	pageCapacity = 0;
+
+	for (int i = 0; i < releasedCount; i++) {
+		free(released[i]);
+	}
+	free(released);
+	released = NULL;
+	releasedCount = 0;
+	releasedCapacity = 0;
+
+	free(youngPages);
+	youngPages = NULL;
+	youngPageCount = 0;
+	youngPageCapacity = 0;
+
+	unsweptPages = 0;
+
+	for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+		classes[i].pages = NULL;
+		classes[i].sweepCursor = NULL;
+		classes[i].freeSlots = NULL;
+		classes[i].bump = NULL;
+		classes[i].bumpEnd = NULL;
+	}
+}
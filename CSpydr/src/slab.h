@@ -0,0 +1,144 @@
+#ifndef cspydr_slab_h
+#define cspydr_slab_h
+
+#include "common.h"
+
+//Objects are carved out of pages of equally sized slots, one set of pages
+//per size class.
+#define SLAB_PAGE_SIZE (64 * 1024)
+#define SLAB_GRANULE 8
+//Anything bigger goes to malloc.
+#define SLAB_MAX_SIZE 256
+#define SLAB_CLASS_COUNT (SLAB_MAX_SIZE / SLAB_GRANULE)
+
+#define SLAB_CLASS(size) (((size) + SLAB_GRANULE - 1) / SLAB_GRANULE - 1)
+
+//One bit per granule of the page, set for the granule a slot starts at.
+#define SLAB_BITMAP_WORDS (SLAB_PAGE_SIZE / SLAB_GRANULE / 64)
+
+#define SLAB_PAGE(pointer) ((SlabPage*)((uintptr_t)(pointer) & ~(uintptr_t)(SLAB_PAGE_SIZE - 1)))
+#define SLAB_BIT(pointer) (((uintptr_t)(pointer) & (SLAB_PAGE_SIZE - 1)) / SLAB_GRANULE)
+#define SLAB_BIT_ADDRESS(page, bit) ((void*)((char*)(page) + (size_t)(bit) * SLAB_GRANULE))
+
+typedef struct sSlabSlot
+{
+	struct sSlabSlot* next;
+} SlabSlot;
+
+//Sits at the start of every page, so the page of a slot is its address
+//rounded down to SLAB_PAGE_SIZE. Keeping the mark bits here rather than in
+//the objects means marking leaves the objects' own memory untouched, and
+//the old and young bits are what the heap is walked by, so objects need no
+//list pointer of their own.
+typedef struct sSlabPage
+{
+	struct sSlabPage* next;		//Next page of the same size class.
+	int sizeClass;
+	int slotCount;
+	int liveCount;
+	bool isEvacuating;	//Its objects are being moved out by a compaction.
+	bool hasYoung;		//Listed for the next minor collection.
+	uint64_t markBits[SLAB_BITMAP_WORDS];
+	uint64_t oldBits[SLAB_BITMAP_WORDS];	//Slots holding an object that survived a collection.
+	uint64_t youngBits[SLAB_BITMAP_WORDS];	//Slots holding an object allocated since.
+} SlabPage;
+
+//Slots freed by a parallel sweeper, which has whole pages to itself, handed
+//back in one piece with slabMergeFreeList().
+typedef struct
+{
+	SlabSlot* heads[SLAB_CLASS_COUNT];
+	SlabSlot* tails[SLAB_CLASS_COUNT];
+} SlabFreeList;
+
+typedef struct
+{
+	size_t slotSize;
+	int pageCount;
+	int emptyPages;		//Pages with no live slot, kept for reuse.
+	size_t slotCount;
+	size_t liveCount;
+} SlabClassStats;
+
+//A dead slot's mark bit is already clear when it is freed, so allocating
+//never writes to the bitmaps.
+static inline bool slabIsMarked(void* pointer)
+{
+	size_t bit = SLAB_BIT(pointer);
+	return (SLAB_PAGE(pointer)->markBits[bit / 64] >> (bit % 64)) & 1;
+}
+
+static inline void slabMark(void* pointer)
+{
+	size_t bit = SLAB_BIT(pointer);
+	SLAB_PAGE(pointer)->markBits[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+#ifdef __GNUC__
+//Neighbouring slots share a bitmap word, so parallel markers set bits
+//atomically. Tells whether this call was the one that set it.
+static inline bool slabClaimMark(void* pointer)
+{
+	size_t bit = SLAB_BIT(pointer);
+	uint64_t mask = (uint64_t)1 << (bit % 64);
+	uint64_t* word = &SLAB_PAGE(pointer)->markBits[bit / 64];
+	if (__atomic_load_n(word, __ATOMIC_RELAXED) & mask) return false;
+	return (__atomic_fetch_or(word, mask, __ATOMIC_RELAXED) & mask) == 0;
+}
+#endif
+
+static inline void slabSetOld(void* pointer)
+{
+	size_t bit = SLAB_BIT(pointer);
+	SLAB_PAGE(pointer)->oldBits[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+void slabAddYoungPage(SlabPage* page);
+
+//Objects allocated in a row mostly share a page, which is only listed for
+//the nursery with the first of them.
+static inline void slabSetYoung(void* pointer)
+{
+	size_t bit = SLAB_BIT(pointer);
+	SlabPage* page = SLAB_PAGE(pointer);
+	page->youngBits[bit / 64] |= (uint64_t)1 << (bit % 64);
+	if (!page->hasYoung) slabAddYoungPage(page);
+}
+
+static inline int slabLowestBit(uint64_t word)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(word);
+#else
+	int bit = 0;
+	while ((word & 1) == 0) {
+		word >>= 1;
+		bit++;
+	}
+	return bit;
+#endif
+}
+
+void* slabAllocate(size_t size);
+void slabFree(void* pointer, size_t size);
+void slabFreeTo(SlabFreeList* list, void* pointer, size_t size);
+void slabMergeFreeList(SlabFreeList* list);
+bool slabHasFreeSlot(int sizeClass);
+void slabClearMarks();
+void slabBeginSweep();
+SlabPage* slabNextUnswept(int sizeClass);
+void slabEndSweep();
+bool slabIsSwept();
+int slabPageCount();
+SlabPage* slabPageAt(int index);
+void slabStats(int sizeClass, SlabClassStats* stats);
+int slabReleasedPages();
+int slabYoungPageCount();
+SlabPage* slabYoungPageAt(int index);
+void slabClearYoung();
+void slabPromoteYoung();
+int slabPlanEvacuation();
+void slabReleaseEvacuated();
+void freeSlabs();
+
+#endif
@@ -0,0 +1,37 @@
+//Generated by --gen-superinstructions from a profile of 140500211 instructions,
+//see opprofile.h. Regenerate this file rather than editing it.
+//
+//SUPERINSTRUCTION(name, first, next) runs 'first' and goes straight on to
+//'next', which may be a superinstruction itself.
+SUPERINSTRUCTION(OP_GET_LOCAL__CONSTANT, OP_GET_LOCAL, OP_CONSTANT)	//6.81%
+SUPERINSTRUCTION(OP_CONSTANT__JUMP_IF_NOT_LESS, OP_CONSTANT, OP_JUMP_IF_NOT_LESS)	//4.48%
+SUPERINSTRUCTION(OP_GET_LOCAL__CONSTANT__JUMP_IF_NOT_LESS, OP_GET_LOCAL, OP_CONSTANT__JUMP_IF_NOT_LESS)	//4.41%
+SUPERINSTRUCTION(OP_GET_LOCAL__GET_LOCAL, OP_GET_LOCAL, OP_GET_LOCAL)	//3.79%
+SUPERINSTRUCTION(OP_INC_LOCAL__LOOP, OP_INC_LOCAL, OP_LOOP)	//3.58%
+SUPERINSTRUCTION(OP_GET_LOCAL__GET_PROPERTY, OP_GET_LOCAL, OP_GET_PROPERTY)	//2.68%
+SUPERINSTRUCTION(OP_GET_GLOBAL__GET_LOCAL, OP_GET_GLOBAL, OP_GET_LOCAL)	//2.66%
+SUPERINSTRUCTION(OP_GET_GLOBAL__CONSTANT, OP_GET_GLOBAL, OP_CONSTANT)	//2.57%
+SUPERINSTRUCTION(OP_GET_GLOBAL__GET_GLOBAL, OP_GET_GLOBAL, OP_GET_GLOBAL)	//2.28%
+SUPERINSTRUCTION(OP_GET_LOCAL__ADD_NUM, OP_GET_LOCAL, OP_ADD_NUM)	//2.14%
+SUPERINSTRUCTION(OP_CONSTANT__CALL, OP_CONSTANT, OP_CALL)	//2.14%
+SUPERINSTRUCTION(OP_GET_UPVALUE__GET_LOCAL, OP_GET_UPVALUE, OP_GET_LOCAL)	//2.14%
+SUPERINSTRUCTION(OP_GET_UPVALUE__GET_LOCAL__ADD_NUM, OP_GET_UPVALUE, OP_GET_LOCAL__ADD_NUM)	//2.14%
+SUPERINSTRUCTION(OP_SET_GLOBAL__CONSTANT, OP_SET_GLOBAL, OP_CONSTANT)	//2.14%
+SUPERINSTRUCTION(OP_GET_GLOBAL__CONSTANT__CALL, OP_GET_GLOBAL, OP_CONSTANT__CALL)	//2.14%
+SUPERINSTRUCTION(OP_CONSTANT__JUMP_IF_NOT_GREATER, OP_CONSTANT, OP_JUMP_IF_NOT_GREATER)	//2.14%
+SUPERINSTRUCTION(OP_SET_GLOBAL__CONSTANT__JUMP_IF_NOT_GREATER, OP_SET_GLOBAL, OP_CONSTANT__JUMP_IF_NOT_GREATER)	//2.14%
+SUPERINSTRUCTION(OP_GET_GLOBAL__GET_GLOBAL__CONSTANT, OP_GET_GLOBAL, OP_GET_GLOBAL__CONSTANT)	//2.14%
+SUPERINSTRUCTION(OP_GET_GLOBAL__GET_LOCAL__CONSTANT, OP_GET_GLOBAL, OP_GET_LOCAL__CONSTANT)	//1.93%
+SUPERINSTRUCTION(OP_CONSTANT__SUBTRACT_NUM, OP_CONSTANT, OP_SUBTRACT_NUM)	//1.93%
+SUPERINSTRUCTION(OP_GET_LOCAL__CONSTANT__SUBTRACT_NUM, OP_GET_LOCAL, OP_CONSTANT__SUBTRACT_NUM)	//1.93%
+SUPERINSTRUCTION(OP_POP__GET_LOCAL, OP_POP, OP_GET_LOCAL)	//1.66%
+SUPERINSTRUCTION(OP_GET_LOCAL__RETURN, OP_GET_LOCAL, OP_RETURN)	//1.64%
+SUPERINSTRUCTION(OP_GET_LOCAL__MULTIPLY_NUM, OP_GET_LOCAL, OP_MULTIPLY_NUM)	//1.54%
+SUPERINSTRUCTION(OP_POP__INC_LOCAL, OP_POP, OP_INC_LOCAL)	//1.37%
+SUPERINSTRUCTION(OP_POP__INC_LOCAL__LOOP, OP_POP, OP_INC_LOCAL__LOOP)	//1.37%
+SUPERINSTRUCTION(OP_GET_LOCAL__SET_PROPERTY, OP_GET_LOCAL, OP_SET_PROPERTY)	//1.33%
+SUPERINSTRUCTION(OP_GET_LOCAL__GET_LOCAL__SET_PROPERTY, OP_GET_LOCAL, OP_GET_LOCAL__SET_PROPERTY)	//1.33%
+SUPERINSTRUCTION(OP_CONSTANT__EQUAL, OP_CONSTANT, OP_EQUAL)	//1.24%
+SUPERINSTRUCTION(OP_GET_LOCAL__JUMP_IF_NOT_LESS_EQUAL, OP_GET_LOCAL, OP_JUMP_IF_NOT_LESS_EQUAL)	//0.97%
+SUPERINSTRUCTION(OP_GET_LOCAL__GET_LOCAL__MULTIPLY_NUM, OP_GET_LOCAL, OP_GET_LOCAL__MULTIPLY_NUM)	//0.97%
+SUPERINSTRUCTION(OP_GET_LOCAL__MODULO, OP_GET_LOCAL, OP_MODULO)	//0.97%
@@ -1,28 +1,29 @@
-#ifndef cspydr_table_h
-#define cspydr_table_h
-
-#include "common.h"
-#include "value.h"
-
-typedef struct {
-	ObjString* key;
-	Value value;
-} Entry;
-
-typedef struct {
-	int count;
-	int capacity;
-	Entry* entries;
-} Table;
-
-void initTable(Table* table);
-void freeTable(Table* table);
-bool tableGet(Table* table, ObjString* key, Value* value);
-bool tableSet(Table* table, ObjString* key, Value value);
-bool tableDelete(Table* table, ObjString* key);
-void tableAddAll(Table* from, Table* to);
-void markTable(Table* table);
-void tableRemoveWhite(Table* table);
-ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash);
-
+#ifndef cspydr_table_h
+#define cspydr_table_h
+
+#include "common.h"
+#include "value.h"
+
+typedef struct {
+	ObjString* key;
+	Value value;
+} Entry;
+
+typedef struct {
+	int count;
+	int capacity;
+	Entry* entries;
+} Table;
+
+void initTable(Table* table);
+void freeTable(Table* table);
+bool tableGet(Table* table, ObjString* key, Value* value);
+bool tableSet(Table* table, ObjString* key, Value value);
+bool tableDelete(Table* table, ObjString* key);
+void tableAddAll(Table* from, Table* to);
+void markTable(Table* table);
+void forwardTable(Table* table);
+void tableRemoveWhite(Table* table);
+ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash);
+
 #endif
\ No newline at end of file
@@ -1,836 +1,2036 @@
-#include <stdio.h>
-#include <stdarg.h>
-#include <string.h>
-#include <math.h>
-#include <time.h>
-
-#include "common.h"
-#include "debug.h"
-#include "compiler.h"
-#include "vm.h"
-#include "value.h"
-#include "object.h"
-#include "memory.h"
-#include "natives.h"
-
-VM vm;
-
-static InterpretResult run();
-static void resetStack();
-static bool callValue(Value callee, int argCount);
-static void defineNative(const char* name, NativeFn function);
-void push(Value value);
-Value pop();
-
-void initVM()
-{
-	resetStack();
-	vm.objects = NULL;
-
-	vm.grayCount = 0;
-	vm.grayCapacity = 0;
-	vm.grayStack = NULL;
-	vm.bytesAllocated = 0;
-	vm.nextGC = 1024 * 1024;
-
-	initTable(&vm.strings);
-	initTable(&vm.globals);
-
-	vm.initString = NULL;
-	vm.initString = copyString("init", 4);
-
-	defineNative("clock", clockNative);
-	defineNative("to_int", toIntNative);
-	defineNative("sin", sinNative);
-	defineNative("cos", cosNative);
-	defineNative("c_in", consoleInputNative);
-	defineNative("clear", clearNative);
-	defineNative("err", errorNative);
-	defineNative("pi", piNative);
-	defineNative("endl", endLineNative);
-}
-
-void freeVM()
-{
-	freeTable(&vm.strings);
-	freeTable(&vm.globals);
-	vm.initString = NULL;
-	freeObjects();
-}
-
-InterpretResult interpret(const char *source)
-{
-	ObjFunction* function = compile(source);
-	if (function == NULL) return INTERPRET_COMPILE_ERROR;
-
-	push(OBJ_VAL(function));
-	ObjClosure* closure = newClosure(function);
-	pop();
-	push(OBJ_VAL(closure));
-	callValue(OBJ_VAL(closure), 0);
-
-	return run();
-}
-
-static void resetStack()
-{
-	vm.stackTop = vm.stack;
-	vm.frameCount = 0;
-	vm.openUpvalues = NULL;
-}
-
-void runtimeError(const char *format, ...)
-{
-	PRINT_ERROR(stderr);
-	va_list args;
-	va_start(args, format);
-	vfprintf(stderr, format, args);
-	va_end(args);
-	fputs("\n", stderr);
-
-	for (int i = vm.frameCount - 1; i >= 0; i--) {
-		CallFrame* frame = &vm.frames[i];
-		ObjFunction* function = frame->closure->function;
-		// -1 because the IP is sitting on the next instruction to be
-		// executed.
-		size_t instruction = frame->ip - function->chunk.code - 1;
-		fprintf(stderr, "[line %d] in ",
-			function->chunk.lines[instruction]);
-		if (function->name == NULL) {
-			fprintf(stderr, "script\n");
-		}
-		else {
-			fprintf(stderr, "%s()\n", function->name->chars);
-		}
-	}
-
-
-	resetStack();
-	PRINT_RESET(stderr);
-}
-
-static void defineNative(const char* name, NativeFn function)
-{
-	push(OBJ_VAL(copyString(name, (int)strlen(name))));
-	push(OBJ_VAL(newNative(function)));
-	tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
-	pop();
-	pop();
-}
-
-void push(Value value)
-{
-	*vm.stackTop = value;
-	vm.stackTop++;
-}
-
-Value pop()
-{
-	vm.stackTop--;
-	return *vm.stackTop;
-}
-
-static Value peek(int distance)
-{
-	return vm.stackTop[-1 - distance];
-}
-
-static bool call(ObjClosure* closure, int argCount)
-{
-	if (argCount != closure->function->arity) {
-		runtimeError("Expected %d arguments but got %d.",
-			closure->function->arity, argCount);
-	}
-
-	if (vm.frameCount == FRAMES_MAX) {
-		runtimeError("Stack overflow.");
-		return false;
-	}
-
-	CallFrame* frame = &vm.frames[vm.frameCount++];
-	frame->closure = closure;
-	frame->ip = closure->function->chunk.code;
-
-	frame->slots = vm.stackTop - argCount - 1;
-	return true;
-}
-
-static bool callValue(Value callee, int argCount)
-{
-	if (IS_OBJ(callee)) {
-		switch (OBJ_TYPE(callee)) {
-		case OBJ_BOUND_METHOD:
-		{
-			ObjBoundMethod* bound = AS_BOUND_METHOD(callee);
-			vm.stackTop[-argCount - 1] = bound->reciever;
-			return call(bound->method, argCount);
-		}
-
-		case OBJ_CLASS:
-		{
-			ObjClass* _class = AS_CLASS(callee);
-			vm.stackTop[-argCount - 1] = OBJ_VAL(newInstance(_class));
-			Value initializer;
-			if (tableGet(&_class->methods, vm.initString, &initializer)) {
-				return call(AS_CLOSURE(initializer), argCount);
-			}
-			else if (argCount != 0) {
-				runtimeError("Expected 0 arguments but got %d", argCount);
-				return false;
-			}
-			return true;
-		}
-
-		case OBJ_CLOSURE:
-			return call(AS_CLOSURE(callee), argCount);
-
-		case OBJ_NATIVE:
-		{
-			NativeFn native = AS_NATIVE(callee);
-			Value result = native(argCount, vm.stackTop - argCount);
-			if (IS_NIL(result)) {
-				return false;
-			}
-
-			vm.stackTop -= argCount + 1;
-			push(result);
-			return true;
-		}
-
-		case OBJ_FUNCTION:
-			return call(AS_FUNCTION(callee), argCount);
-
-		default:
-			//Non-callable object type.
-			break;
-		}
-	}
-
-	runtimeError("Can only call functions and classes.");
-	return false;
-}
-
-static bool invokeFromClass(ObjClass* _class, ObjString* name, int argCount)
-{
-	Value method;
-	if (!tableGet(&_class->methods, name, &method)) {
-		runtimeError("Undefined property '%s'", name->chars);
-		return false;
-	}
-
-	return call(AS_CLOSURE(method), argCount);
-}
-
-static bool invoke(ObjString* name, int argCount)
-{
-	Value reciever = peek(argCount);
-
-	if (!IS_INSTANCE(reciever)) {
-		runtimeError("Only instances have methods.");
-		return false;
-	}
-
-	ObjInstance* instance = AS_INSTANCE(reciever);
-
-	Value value;
-	if (tableGet(&instance->fields, name, &value)) {
-		vm.stackTop[-argCount - 1] = value;
-		return callValue(value, argCount);
-	}
-
-	return invokeFromClass(instance->_class, name, argCount);
-}
-
-static bool bindMethod(ObjClass* _class, ObjString* name)
-{
-	Value method;
-	if (!tableGet(&_class->methods, name, &method)) {
-		runtimeError("Undefined property '%s'.", name->chars);
-		return false;
-	}
-
-	ObjBoundMethod* bound = newBoundMethod(peek(0), AS_CLOSURE(method));
-	pop();
-	push(OBJ_VAL(bound));
-	return true;
-}
-
-static ObjUpvalue* captureUpvalue(Value* local)
-{
-	ObjUpvalue* prevUpvalue = NULL;
-	ObjUpvalue* upvalue = vm.openUpvalues;
-
-	while (upvalue != NULL && upvalue->location > local) {
-		prevUpvalue = upvalue;
-		upvalue = upvalue->next;
-	}
-
-	if (upvalue != NULL && upvalue->location == local) {
-		return upvalue;
-	}
-
-	ObjUpvalue* createdUpvalue = newUpvalue(local);
-	createdUpvalue->next = upvalue;
-
-	if (prevUpvalue == NULL) {
-		vm.openUpvalues = createdUpvalue;
-	}
-	else {
-		prevUpvalue->next = createdUpvalue;
-	}
-
-	return createdUpvalue;
-}
-
-static void closeUpvalues(Value* last)
-{
-	while (vm.openUpvalues != NULL &&
-		vm.openUpvalues->location >= last) {
-		ObjUpvalue* upvalue = vm.openUpvalues;
-		upvalue->closed = *upvalue->location;
-		upvalue->location = &upvalue->closed;
-		vm.openUpvalues = upvalue->next;
-	}
-}
-
-static void defineMethod(ObjString* name)
-{
-	Value method = peek(0);
-	ObjClass* _class = AS_CLASS(peek(1));
-	tableSet(&_class->methods, name, method);
-	pop();
-}
-
-static bool isFalsey(Value value)
-{
-	return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
-}
-
-static void concatenate()
-{
-	ObjString* b = AS_STRING(peek(0));
-	ObjString* a = AS_STRING(peek(1));
-
-	int length = a->length + b->length;
-	char *chars = ALLOCATE(char, length + 1);
-	memcpy(chars, a->chars, a->length);
-	memcpy(chars + a->length, b->chars, b->length);
-	chars[length] = '\0';
-
-	ObjString *result = takeString(chars, length);
-	pop();
-	pop();
-	push(OBJ_VAL(result));
-}
-
-static ObjString* doubleToObjString(double in)
-{
-	int length = sizeof(double) * 24;
-	char* charArray = ALLOCATE(char, length);
-	sprintf(charArray, "%g", in);
-
-	return takeString(charArray, length);
-}
-
-static ObjString* boolToObjString(bool in)
-{
-	int length = sizeof(char) * (in ? 4 : 5);
-	char* charArray = (in ? "true" : "false");
-
-	return takeString(charArray, length);
-}
-
-static InterpretResult run()
-{
-	CallFrame* frame = &vm.frames[vm.frameCount - 1];
-
-#define READ_BYTE() (*frame->ip++)
-#define READ_SHORT() (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
-#define READ_CONSTANT() (frame->closure->function->chunk.constants.values[READ_BYTE()])
-#define READ_STRING() AS_STRING(READ_CONSTANT())
-
-#define BINARY_OP(valueType, op)                        \
-	do                                                  \
-	{													\
-		if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) \
-		{                                               \
-			runtimeError("Operands must be numbers.");  \
-			return INTERPRET_RUNTIME_ERROR;             \
-		}                                               \
-		double b = AS_NUMBER(pop());                    \
-		double a = AS_NUMBER(pop());                    \
-		push(valueType(a op b));                        \
-	} while (false)
-
-#define BINARY_SHIFT_OP(op)								\
-	do                                                  \
-	{                                                   \
-		if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) \
-		{                                               \
-			runtimeError("Operands must be numbers.");  \
-			return INTERPRET_RUNTIME_ERROR;             \
-		}                                               \
-		long b = (long) AS_NUMBER(pop());               \
-		long a = (long) AS_NUMBER(pop());               \
-		push(NUMBER_VAL(a op b));                       \
-	} while (false)
-
-#define MOD_OP()										\
-	do{													\
-		if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1)))	\
-		{												\
-														\
-			runtimeError("Operands must be numbers.");  \
-			return INTERPRET_RUNTIME_ERROR;				\
-		}												\
-		double b = AS_NUMBER(pop());                    \
-		double a = AS_NUMBER(pop());					\
-		push(NUMBER_VAL(fmod(a, b)));					\
-	} while (false);
-
-#define POWER_OP()										\
-	do{													\
-		if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1)))	\
-		{												\
-														\
-			runtimeError("Operands must be numbers.");  \
-			return INTERPRET_RUNTIME_ERROR;				\
-		}												\
-		double b = AS_NUMBER(pop());                    \
-		double a = AS_NUMBER(pop());					\
-		push(NUMBER_VAL(pow(a, b)));					\
-	} while (false);
-
-	for (;;)
-	{
-
-#ifdef DEBUG_TRACE_EXECUTION
-		printf("        ");
-		for (Value *slot = vm.stack; slot < vm.stackTop; slot++)
-		{
-			printf("  [");
-			printValue(*slot);
-			printf("] ");
-		}
-		printf("\n");
-
-		disassembleInstruction(&frame->closure->function->chunk,(int)(frame->ip - frame->closure->function->chunk.code));
-#endif
-
-		uint8_t instruction;
-		switch (instruction = READ_BYTE())
-		{
-		case OP_CONSTANT:
-		{
-			Value constant = READ_CONSTANT();
-			push(constant);
-			break;
-		}
-		case OP_NIL:
-			push(NIL_VAL);
-			break;
-		case OP_TRUE:
-			push(BOOL_VAL(true));
-			break;
-		case OP_FALSE:
-			push(BOOL_VAL(false));
-			break;
-		case OP_POP:
-			pop();
-			break;
-
-		case OP_GET_LOCAL:
-		{
-			uint8_t slot = READ_BYTE();
-			push(frame->slots[slot]);
-			break;
-		}
-
-		case OP_SET_LOCAL:
-		{
-			uint8_t slot = READ_BYTE();
-
-			Value value = vm.stack[slot];
-			if (value.isConstant || peek(0).isConstant) {
-				runtimeError("Can't change the value of constant.");
-				return INTERPRET_RUNTIME_ERROR;
-			}
-
-			frame->slots[slot] = peek(0);
-			break;
-		}
-
-		case OP_DEFINE_GLOBAL:
-		{
-			ObjString* name = READ_STRING();
-			Value value = peek(0);
-			value.isConstant = false;
-			tableSet(&vm.globals, name, value);
-			pop();
-			break;
-		}
-		
-		case OP_GET_GLOBAL:
-		{
-			ObjString* name = READ_STRING();
-			Value value;
-			if (!tableGet(&vm.globals, name, &value)) {
-				runtimeError("Undefined variable '%s'.", name->chars);
-				return INTERPRET_RUNTIME_ERROR;
-			}
-			push(value);
-			break;
-		}
-
-		case OP_SET_GLOBAL:
-		{
-			ObjString* name = READ_STRING();
-			Value global;
-			if (tableGet(&vm.globals, name, &global)) {
-				if (global.isConstant) {
-					runtimeError("Can't change the value of a constant.");
-					return INTERPRET_RUNTIME_ERROR;
-				}
-			}
-
-			if (tableSet(&vm.globals, name, peek(0))) {
-				tableDelete(&vm.globals, name);
-				runtimeError("Undefined variable '%s'.", name->chars);
-				return INTERPRET_RUNTIME_ERROR;
-			}
-			break;
-		}
-
-		case OP_GET_UPVALUE:
-		{
-			uint8_t slot = READ_BYTE();
-			push(*frame->closure->upvalues[slot]->location);
-			break;
-		}
-
-		case OP_SET_UPVALUE:
-		{
-			uint8_t slot = READ_BYTE();
-			*frame->closure->upvalues[slot]->location = peek(0);
-			break;
-		}
-
-		case OP_GET_PROPERTY:
-		{
-			Value value = peek(0);
-			ObjString* name = READ_STRING();
-
-			switch (value.type) {
-			case VAL_NUMBER:
-			{
-				if (strcmp(name->chars, "to_str") == 0) {
-					pop();
-					push(OBJ_VAL(doubleToObjString(AS_NUMBER(value))));
-				}
-				else {
-					runtimeError("Unknown number property %s.", name->chars);
-					return INTERPRET_RUNTIME_ERROR;
-				}
-				break;
-			}
-			case VAL_BOOL:
-			{
-				if (strcmp(name->chars, "to_str") == 0) {
-					pop();
-					push(OBJ_VAL(boolToObjString(AS_BOOL(value))));
-				}
-				else {
-					runtimeError("Unknown bool property %s.", name->chars);
-					return INTERPRET_RUNTIME_ERROR;
-				}
-				break;
-			}
-			case VAL_NIL:
-			{
-				if (strcmp(name->chars, "to_str") == 0) {
-					pop();
-					push(OBJ_VAL(takeString("nil", 3)));
-				}
-				else {
-					runtimeError("Unknown nil property %s.", name->chars);
-					return INTERPRET_RUNTIME_ERROR;
-				}
-				break;
-			}
-			case VAL_OBJ:
-			{
-				if (IS_INSTANCE(value)) {
-					ObjInstance* instance = AS_INSTANCE(value);
-
-					Value value;
-					if (tableGet(&instance->fields, name, &value)) {
-						pop(); //Instance.
-						push(value);
-						break;
-					}
-
-					if (!bindMethod(instance->_class, name)) {
-						return INTERPRET_RUNTIME_ERROR;
-					}
-				}
-				break;
-			}
-
-			default:
-				runtimeError("Unknown property %s.", name->chars);
-				return INTERPRET_RUNTIME_ERROR;
-			}
-			break;
-		}
-
-		case OP_SET_PROPERTY:
-		{
-			if (!IS_INSTANCE(peek(1))) {
-				runtimeError("Only instances have fields.");
-				return INTERPRET_RUNTIME_ERROR;
-			}
-
-			ObjInstance* instance = AS_INSTANCE(peek(1));
-			tableSet(&instance->fields, READ_STRING(), peek(0));
-
-			Value value = pop(0);
-			pop();
-			push(value);
-			break;
-		}
-
-		case OP_CLOSE_UPVALUE:
-			closeUpvalues(vm.stackTop - 1);
-			pop();
-			break;
-
-		case OP_GET_SUPER:
-		{
-			ObjString* name = READ_STRING();
-			ObjClass* superclass = AS_CLASS(pop());
-			if (!bindMethod(superclass, name)) {
-				return INTERPRET_RUNTIME_ERROR;
-			}
-			break;
-		}
-
-		case OP_SUPER_INVOKE:
-		{
-			ObjString* method = READ_STRING();
-			int argCount = READ_BYTE();
-			ObjClass* superclass = AS_CLASS(pop());
-			if (!invokeFromClass(superclass, method, argCount)) {
-				return INTERPRET_RUNTIME_ERROR;
-			}
-			frame = &vm.frames[vm.frameCount - 1];
-			break;
-		}
-
-		case OP_DEFINE_CONSTANT:
-		{
-			ObjString* name = READ_STRING();
-			Value existent;
-			if (tableGet(&vm.globals, name, &existent)) {
-				runtimeError("%s '%s' is already defined.", ((existent.isConstant) ? "Constant" : "Variable"), name->chars);
-				return INTERPRET_RUNTIME_ERROR;
-			}
-
-			Value value = peek(0);
-			value.isConstant = true;
-			tableSet(&vm.globals, name, value);
-			pop();
-			break;
-		}
-
-		case OP_EQUAL:
-		{
-			Value a = pop();
-			Value b = pop();
-			push(BOOL_VAL(valuesEqual(a, b)));
-			break;
-		}
-
-		case OP_GREATER:
-			BINARY_OP(BOOL_VAL, >);
-			break;
-		case OP_LESS:
-			BINARY_OP(BOOL_VAL, <);
-			break;
-		case OP_ADD:
-		{
-			if (IS_STRING(peek(0)) && IS_STRING(peek(1)))
-			{
-				concatenate();
-			}
-			else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1)))
-			{
-				double b = AS_NUMBER(pop());
-				double a = AS_NUMBER(pop());
-				push(NUMBER_VAL(a + b));
-			}
-			else
-			{
-				runtimeError("Operands must be two numbers or two strings.");
-				return INTERPRET_RUNTIME_ERROR;
-			}
-			break;
-		}
-		case OP_SUBTRACT:
-			BINARY_OP(NUMBER_VAL, -);
-			break;
-		case OP_MULTIPLY:
-			BINARY_OP(NUMBER_VAL, *);
-			break;
-		case OP_DIVIDE:
-			BINARY_OP(NUMBER_VAL, /);
-			break;
-		case OP_MODULO:
-			MOD_OP();
-			break;
-		case OP_POWER:
-			POWER_OP();
-			break;
-		case OP_NOT:
-			push(BOOL_VAL(isFalsey(pop())));
-			break;
-		case OP_SHIFT_LEFT:
-			BINARY_SHIFT_OP(<<);
-			break;
-		case OP_SHIFT_RIGHT:
-			BINARY_SHIFT_OP(>>);
-			break;
-
-		case OP_NEGATE:
-			if (!IS_NUMBER(peek(0)))
-			{
-				runtimeError("Operand must be a number.");
-				return INTERPRET_RUNTIME_ERROR;
-			}
-
-			push(NUMBER_VAL(-AS_NUMBER(pop())));
-			break;
-
-		case OP_PRINT:
-		{
-			printValue(pop());
-			printf("\n");
-			break;
-		}
-
-		case OP_EXIT:
-			return INTERPRET_OK;
-
-		case OP_JUMP:
-		{
-			uint16_t offset = READ_SHORT();
-			frame->ip += offset;
-			break;
-		}
-
-		case OP_JUMP_IF_FALSE:
-		{
-			uint16_t offset = READ_SHORT();
-			if (isFalsey(peek(0))) frame->ip += offset;
-			break;
-		}
-
-		case OP_LOOP:
-		{
-			uint16_t offset = READ_SHORT();
-			frame->ip -= offset;
-			break;
-		}
-
-		case OP_CALL:
-		{
-			int argCount = READ_BYTE();
-			if (!callValue(peek(argCount), argCount)) {
-				return INTERPRET_RUNTIME_ERROR;
-			}
-			frame = &vm.frames[vm.frameCount - 1];
-			break;
-		}
-
-		case OP_INVOKE:
-		{
-			ObjString* method = READ_STRING();
-			int argCount = READ_BYTE();
-			if (!invoke(method, argCount)) {
-				return INTERPRET_RUNTIME_ERROR;
-			}
-			frame = &vm.frames[vm.frameCount - 1];
-			break;
-		}
-
-		case OP_INHERIT:
-		{
-			Value superclass = peek(1);
-
-			if (!IS_CLASS(superclass)) {
-				runtimeError("Superclass must be a class.");
-				return INTERPRET_RUNTIME_ERROR;
-			}
-
-			ObjClass* subclass = AS_CLASS(peek(0));
-			tableAddAll(&AS_CLASS(superclass)->methods, &subclass->methods);
-			pop(); //Subclass.
-			break;
-		}
-
-		case OP_METHOD:
-			defineMethod(READ_STRING());
-			break;
-
-		case OP_CLOSURE:
-		{
-			ObjFunction* function = AS_FUNCTION(READ_CONSTANT());
-			ObjClosure* closure = newClosure(function);
-			push(OBJ_VAL(closure));
-			for (int i = 0; i < closure->upvalueCount; i++) {
-				uint8_t isLocal = READ_BYTE();
-				uint8_t index = READ_BYTE();
-				if (isLocal) {
-					closure->upvalues[i] = captureUpvalue(frame->slots + index);
-				}
-				else {
-					closure->upvalues[i] = frame->closure->upvalues[index];
-				}
-			}
-			break;
-		}
-
-		case OP_CLASS:
-		{
-			push(OBJ_VAL(newClass(READ_STRING())));
-			break;
-		}
-
-		case OP_RETURN:
-		{
-			Value result = pop();
-
-			closeUpvalues(frame->slots);
-
-			vm.frameCount--;
-			if (vm.frameCount == 0) {
-				pop();
-				return INTERPRET_OK;
-			}
-
-			vm.stackTop = frame->slots;
-			push(result);
-
-			frame = &vm.frames[vm.frameCount - 1];
-			break;
-		}
-		}
-	}
-#undef READ_BYTE
-#undef READ_CONSTANT
-#undef READ_SHORT
-#undef BINARY_OP
-#undef READ_STRING
-#undef MOD_OP
-#undef BINARY_SHIFT_OP
-#undef POWER_OP
-}
\ No newline at end of file
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "common.h"
+#include "debug.h"
+#include "compiler.h"
+#include "vm.h"
+#include "value.h"
+#include "object.h"
+#include "memory.h"
+#include "natives.h"
+#include "jit.h"
+#include "opprofile.h"
+
+VM vm;
+
+static InterpretResult run();
+static void resetStack();
+static bool callValue(Value callee, int argCount);
+static void closeUpvalues(Value* last);
+static void defineNative(const char* name, NativeFn function);
+void push(Value value);
+Value pop();
+
+void initVM()
+{
+	resetStack();
+#ifndef SLAB_ENABLED
+	for (int i = 0; i < GC_REGION_COUNT; i++) {
+		vm.objects[i] = NULL;
+	}
+	vm.promoteRegion = 0;
+	vm.youngObjects = NULL;
+#endif
+	vm.rememberedCount = 0;
+	vm.rememberedCapacity = 0;
+	vm.rememberedSet = NULL;
+
+	vm.grayCount = 0;
+	vm.grayCapacity = 0;
+	vm.grayStack = NULL;
+	vm.bytesAllocated = 0;
+	vm.nextGC = GC_DEFAULT_TARGET_HEAP;
+	vm.nextMinorGC = GC_NURSERY_SIZE;
+	vm.nextGCStep = 0;
+
+	vm.gcPacing.targetHeap = GC_DEFAULT_TARGET_HEAP;
+	vm.gcPacing.maxHeap = 0;
+	vm.gcPacing.growFactor = GC_HEAP_GROW_FACTOR;
+	vm.gcPacing.gcTimeRatio = 0;
+	vm.gcPacing.pauseTarget = 0;
+	vm.heapGrowth = GC_HEAP_GROW_FACTOR;
+	vm.nurserySize = GC_NURSERY_SIZE;
+	vm.cycleStartAllocated = 0;
+	vm.cycleAllocated = 0;
+
+	vm.gcIncremental = false;
+	vm.gcConcurrent = false;
+	vm.gcThreads = 1;
+	vm.gcCompact = false;
+	vm.compactPending = false;
+	vm.isMarkerRunning = false;
+	vm.isMarkerDone = false;
+	vm.gcStepWork = GC_DEFAULT_STEP_WORK;
+	vm.gcPhase = GC_IDLE;
+	initGcStats(&vm.gcStats);
+#ifndef SLAB_ENABLED
+	vm.sweepYoung = NULL;
+	vm.markValue = true;
+	vm.sweepRegion = GC_REGION_COUNT;
+	vm.sweepPrevious = NULL;
+	vm.sweepCursor = NULL;
+#endif
+
+	initTable(&vm.strings);
+	initTable(&vm.globalNames);
+	vm.globalValues = NULL;
+	vm.globalSlots = NULL;
+	vm.globalCount = 0;
+	vm.globalCapacity = 0;
+
+	vm.initString = NULL;
+	vm.initString = copyString("init", 4);
+
+	vm.optimizeBytecode = true;
+	vm.registerCode = REGISTER_CODE_DEFAULT;
+#ifdef JIT_ENABLED
+	vm.jitEnabled = true;
+#else
+	vm.jitEnabled = false;
+#endif
+	vm.jitThreshold = JIT_DEFAULT_THRESHOLD;
+	vm.traceThreshold = TRACE_DEFAULT_THRESHOLD;
+
+	defineNative("clock", clockNative);
+	defineNative("to_int", toIntNative);
+	defineNative("sin", sinNative);
+	defineNative("cos", cosNative);
+	defineNative("c_in", consoleInputNative);
+	defineNative("clear", clearNative);
+	defineNative("err", errorNative);
+	defineNative("pi", piNative);
+	defineNative("endl", endLineNative);
+	defineNative("gc_stat", gcStatNative);
+}
+
+void freeVM()
+{
+	freeTable(&vm.strings);
+	freeTable(&vm.globalNames);
+	FREE_ARRAY(Value, vm.globalValues, vm.globalCapacity);
+	FREE_ARRAY(GlobalSlot, vm.globalSlots, vm.globalCapacity);
+	vm.globalCount = 0;
+	vm.globalCapacity = 0;
+	vm.initString = NULL;
+	freeObjects();
+}
+
+InterpretResult interpret(const char *source)
+{
+	ObjFunction* function = compile(source);
+	if (function == NULL) return INTERPRET_COMPILE_ERROR;
+
+	push(OBJ_VAL(function));
+	ObjClosure* closure = newClosure(function);
+	pop();
+	push(OBJ_VAL(closure));
+	callValue(OBJ_VAL(closure), 0);
+
+	return run();
+}
+
+static void resetStack()
+{
+	vm.stackTop = vm.stack;
+	vm.frameCount = 0;
+	vm.openUpvalues = NULL;
+}
+
+void runtimeError(const char *format, ...)
+{
+	PRINT_ERROR(stderr);
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputs("\n", stderr);
+
+	for (int i = vm.frameCount - 1; i >= 0; i--) {
+		CallFrame* frame = &vm.frames[i];
+		ObjFunction* function = frame->closure->function;
+		// -1 because the IP is sitting on the next instruction to be
+		// executed.
+		size_t instruction = frame->ip - function->chunk.code - 1;
+		fprintf(stderr, "[line %d] in ",
+			function->chunk.lines[instruction]);
+		if (function->name == NULL) {
+			fprintf(stderr, "script\n");
+		}
+		else {
+			fprintf(stderr, "%s()\n", function->name->chars);
+		}
+	}
+
+
+	resetStack();
+	PRINT_RESET(stderr);
+}
+
+int globalSlot(ObjString* name)
+{
+	Value index;
+	if (tableGet(&vm.globalNames, name, &index)) {
+		return (int)AS_NUMBER(index);
+	}
+
+	push(OBJ_VAL(name));
+	if (vm.globalCapacity < vm.globalCount + 1) {
+		int oldCapacity = vm.globalCapacity;
+		vm.globalCapacity = GROW_CAPACITY(oldCapacity);
+		vm.globalValues = GROW_ARRAY(Value, vm.globalValues, oldCapacity, vm.globalCapacity);
+		vm.globalSlots = GROW_ARRAY(GlobalSlot, vm.globalSlots, oldCapacity, vm.globalCapacity);
+	}
+
+	int slot = vm.globalCount;
+	vm.globalValues[slot] = NIL_VAL;
+	vm.globalSlots[slot].name = name;
+	vm.globalSlots[slot].isDefined = false;
+	vm.globalSlots[slot].isConstant = false;
+	vm.globalCount++;
+
+	tableSet(&vm.globalNames, name, NUMBER_VAL(slot));
+	pop();
+	return slot;
+}
+
+static void defineNative(const char* name, NativeFn function)
+{
+	int slot = globalSlot(copyString(name, (int)strlen(name)));
+	vm.globalValues[slot] = OBJ_VAL(newNative(function));
+	vm.globalSlots[slot].isDefined = true;
+}
+
+void push(Value value)
+{
+	*vm.stackTop = value;
+	vm.stackTop++;
+}
+
+Value pop()
+{
+	vm.stackTop--;
+	return *vm.stackTop;
+}
+
+static Value peek(int distance)
+{
+	return vm.stackTop[-1 - distance];
+}
+
+#ifdef JIT_ENABLED
+//Counts calls and loop back edges and hands the function to the JIT once it
+//gets hot. A function the JIT can't handle is never tried again.
+static void warmUp(ObjFunction* function)
+{
+	if (function->jit != NULL || function->hotness < 0 || !vm.jitEnabled) return;
+
+	if (++function->hotness > vm.jitThreshold && !jitCompile(function)) {
+		function->hotness = -1;
+	}
+}
+#endif
+
+static bool call(ObjClosure* closure, int argCount)
+{
+	if (argCount != closure->function->arity) {
+		runtimeError("Expected %d arguments but got %d.",
+			closure->function->arity, argCount);
+		return false;
+	}
+
+	if (vm.frameCount == FRAMES_MAX) {
+		runtimeError("Stack overflow.");
+		return false;
+	}
+
+#ifdef JIT_ENABLED
+	warmUp(closure->function);
+#endif
+
+	CallFrame* frame = &vm.frames[vm.frameCount++];
+	frame->closure = closure;
+	frame->ip = closure->function->chunk.code;
+
+	frame->slots = vm.stackTop - argCount - 1;
+	return true;
+}
+
+//For a call whose result is returned straight away. A closure runs in the
+//caller's frame instead of a new one, so recursion in tail position needs
+//no more frames. Everything else is called like OP_CALL does.
+static bool tailCall(Value callee, int argCount)
+{
+	ObjClosure* closure;
+	if (IS_CLOSURE(callee)) {
+		closure = AS_CLOSURE(callee);
+	}
+	else if (IS_BOUND_METHOD(callee)) {
+		ObjBoundMethod* bound = AS_BOUND_METHOD(callee);
+		vm.stackTop[-argCount - 1] = bound->reciever;
+		closure = bound->method;
+	}
+	else {
+		return callValue(callee, argCount);
+	}
+
+	if (argCount != closure->function->arity) {
+		runtimeError("Expected %d arguments but got %d.",
+			closure->function->arity, argCount);
+		return false;
+	}
+
+#ifdef JIT_ENABLED
+	warmUp(closure->function);
+#endif
+
+	//The caller's slots are about to be overwritten, anything that captured
+	//them gets its own copy first.
+	CallFrame* frame = &vm.frames[vm.frameCount - 1];
+	closeUpvalues(frame->slots);
+	memmove(frame->slots, vm.stackTop - argCount - 1, (argCount + 1) * sizeof(Value));
+	vm.stackTop = frame->slots + argCount + 1;
+	frame->closure = closure;
+	frame->ip = closure->function->chunk.code;
+	return true;
+}
+
+static bool callValue(Value callee, int argCount)
+{
+	if (IS_OBJ(callee)) {
+		switch (OBJ_TYPE(callee)) {
+		case OBJ_BOUND_METHOD:
+		{
+			ObjBoundMethod* bound = AS_BOUND_METHOD(callee);
+			vm.stackTop[-argCount - 1] = bound->reciever;
+			return call(bound->method, argCount);
+		}
+
+		case OBJ_CLASS:
+		{
+			ObjClass* _class = AS_CLASS(callee);
+			vm.stackTop[-argCount - 1] = OBJ_VAL(newInstance(_class));
+			Value initializer;
+			if (tableGet(&_class->methods, vm.initString, &initializer)) {
+				return call(AS_CLOSURE(initializer), argCount);
+			}
+			else if (argCount != 0) {
+				runtimeError("Expected 0 arguments but got %d", argCount);
+				return false;
+			}
+			return true;
+		}
+
+		case OBJ_CLOSURE:
+			return call(AS_CLOSURE(callee), argCount);
+
+		case OBJ_NATIVE:
+		{
+			NativeFn native = AS_NATIVE(callee);
+			Value result = native(argCount, vm.stackTop - argCount);
+			if (IS_NIL(result)) {
+				return false;
+			}
+
+			vm.stackTop -= argCount + 1;
+			push(result);
+			return true;
+		}
+
+		case OBJ_FUNCTION:
+			return call(AS_FUNCTION(callee), argCount);
+
+		default:
+			//Non-callable object type.
+			break;
+		}
+	}
+
+	runtimeError("Can only call functions and classes.");
+	return false;
+}
+
+//Methods invoked in tail position reuse the caller's frame like OP_TAIL_CALL.
+static bool callMethod(ObjClosure* method, int argCount, bool isTail)
+{
+	return isTail ? tailCall(OBJ_VAL(method), argCount) : call(method, argCount);
+}
+
+static bool invokeFromClass(ObjClass* _class, ObjString* name, int argCount, bool isTail)
+{
+	Value method;
+	if (!tableGet(&_class->methods, name, &method)) {
+		runtimeError("Undefined property '%s'", name->chars);
+		return false;
+	}
+
+	return callMethod(AS_CLOSURE(method), argCount, isTail);
+}
+
+static CacheEntry* findCacheEntry(InlineCache* cache, ObjShape* shape)
+{
+	for (int i = 0; i < cache->count; i++) {
+		if (cache->entries[i].receiver == (Obj*)shape) {
+			return &cache->entries[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void updateCache(InlineCache* cache, ObjShape* shape, int slot, Obj* target)
+{
+	//Dictionary shapes change in place, so nothing about them can be cached.
+	if (cache->isMegamorphic || shape->isDictionary) return;
+
+	if (cache->count == INLINE_CACHE_ENTRIES) {
+		//Too many receivers at this site, stop caching for good.
+		cache->isMegamorphic = true;
+		STORE_RELEASE(cache->count, 0);
+		return;
+	}
+
+	CacheEntry* entry = &cache->entries[cache->count];
+	entry->receiver = (Obj*)shape;
+	entry->slot = slot;
+	entry->target = target;
+	STORE_RELEASE(cache->count, cache->count + 1);
+
+	//The cache belongs to the function that is running.
+	WRITE_BARRIER(vm.frames[vm.frameCount - 1].closure->function);
+}
+
+static ObjClosure* findMethod(ObjInstance* instance, ObjString* name, InlineCache* cache)
+{
+	Value method;
+	if (!tableGet(&instance->_class->methods, name, &method)) {
+		runtimeError("Undefined property '%s'.", name->chars);
+		return NULL;
+	}
+
+	updateCache(cache, instance->shape, -1, AS_OBJ(method));
+	return AS_CLOSURE(method);
+}
+
+static bool invoke(ObjString* name, int argCount, InlineCache* cache, bool isTail)
+{
+	Value reciever = peek(argCount);
+
+	if (!IS_INSTANCE(reciever)) {
+		runtimeError("Only instances have methods.");
+		return false;
+	}
+
+	ObjInstance* instance = AS_INSTANCE(reciever);
+	int slot;
+
+	CacheEntry* entry = findCacheEntry(cache, instance->shape);
+	if (entry != NULL) {
+		if (entry->slot < 0) {
+			return callMethod((ObjClosure*)entry->target, argCount, isTail);
+		}
+		slot = entry->slot;
+	}
+	else {
+		slot = shapeFindSlot(instance->shape, name);
+		if (slot >= 0) updateCache(cache, instance->shape, slot, NULL);
+	}
+
+	if (slot >= 0) {
+		Value value = instance->fields[slot];
+		vm.stackTop[-argCount - 1] = value;
+		return isTail ? tailCall(value, argCount) : callValue(value, argCount);
+	}
+
+	ObjClosure* method = findMethod(instance, name, cache);
+	if (method == NULL) return false;
+
+	return callMethod(method, argCount, isTail);
+}
+
+static bool bindMethod(ObjClass* _class, ObjString* name)
+{
+	Value method;
+	if (!tableGet(&_class->methods, name, &method)) {
+		runtimeError("Undefined property '%s'.", name->chars);
+		return false;
+	}
+
+	ObjBoundMethod* bound = newBoundMethod(peek(0), AS_CLOSURE(method));
+	pop();
+	push(OBJ_VAL(bound));
+	return true;
+}
+
+static ObjUpvalue* captureUpvalue(Value* local)
+{
+	ObjUpvalue* prevUpvalue = NULL;
+	ObjUpvalue* upvalue = vm.openUpvalues;
+
+	while (upvalue != NULL && upvalue->location > local) {
+		prevUpvalue = upvalue;
+		upvalue = upvalue->next;
+	}
+
+	if (upvalue != NULL && upvalue->location == local) {
+		return upvalue;
+	}
+
+	ObjUpvalue* createdUpvalue = newUpvalue(local);
+	createdUpvalue->next = upvalue;
+
+	if (prevUpvalue == NULL) {
+		vm.openUpvalues = createdUpvalue;
+	}
+	else {
+		prevUpvalue->next = createdUpvalue;
+	}
+
+	return createdUpvalue;
+}
+
+static void closeUpvalues(Value* last)
+{
+	while (vm.openUpvalues != NULL &&
+		vm.openUpvalues->location >= last) {
+		ObjUpvalue* upvalue = vm.openUpvalues;
+		STORE_SHARED(upvalue->closed, *upvalue->location);
+		upvalue->location = &upvalue->closed;
+		WRITE_BARRIER(upvalue);
+		vm.openUpvalues = upvalue->next;
+	}
+}
+
+static void defineMethod(ObjString* name)
+{
+	Value method = peek(0);
+	ObjClass* _class = AS_CLASS(peek(1));
+	tableSet(&_class->methods, name, method);
+	WRITE_BARRIER(_class);
+	pop();
+}
+
+static bool isFalsey(Value value)
+{
+	return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+static void concatenate()
+{
+	ObjString* b = AS_STRING(peek(0));
+	ObjString* a = AS_STRING(peek(1));
+
+	int length = a->length + b->length;
+	char *chars = ALLOCATE(char, length + 1);
+	memcpy(chars, a->chars, a->length);
+	memcpy(chars + a->length, b->chars, b->length);
+	chars[length] = '\0';
+
+	ObjString *result = takeString(chars, length);
+	pop();
+	pop();
+	push(OBJ_VAL(result));
+}
+
+//Everything but two numbers for the three-address arithmetic, which is only
+//ever written for OP_ADD, OP_SUBTRACT, OP_MULTIPLY and OP_DIVIDE and so fails
+//the same way they do.
+static bool registerArithmetic(uint8_t instruction, Value a, Value b, Value* result)
+{
+	bool isAdd = instruction == OP_ADD_RR || instruction == OP_ADD_RK;
+	if (isAdd && IS_STRING(a) && IS_STRING(b)) {
+		push(a);
+		push(b);
+		concatenate();
+		*result = pop();
+		return true;
+	}
+	if (!IS_NUMBER(a) || !IS_NUMBER(b)) {
+		runtimeError(isAdd ? "Operands must be two numbers or two strings." : "Operands must be numbers.");
+		return false;
+	}
+
+	switch (instruction) {
+	case OP_ADD_RR:
+	case OP_ADD_RK:
+		*result = NUMBER_VAL(AS_NUMBER(a) + AS_NUMBER(b));
+		break;
+	case OP_SUBTRACT_RR:
+	case OP_SUBTRACT_RK:
+		*result = NUMBER_VAL(AS_NUMBER(a) - AS_NUMBER(b));
+		break;
+	case OP_MULTIPLY_RR:
+	case OP_MULTIPLY_RK:
+		*result = NUMBER_VAL(AS_NUMBER(a) * AS_NUMBER(b));
+		break;
+	default:
+		*result = NUMBER_VAL(AS_NUMBER(a) / AS_NUMBER(b));
+		break;
+	}
+	return true;
+}
+
+static ObjString* doubleToObjString(double in)
+{
+	int length = sizeof(double) * 24;
+	char* charArray = ALLOCATE(char, length);
+	sprintf(charArray, "%g", in);
+
+	return takeString(charArray, length);
+}
+
+static ObjString* boolToObjString(bool in)
+{
+	int length = sizeof(char) * (in ? 4 : 5);
+	char* charArray = (in ? "true" : "false");
+
+	return takeString(charArray, length);
+}
+
+static bool getProperty(ObjString* name, InlineCache* cache)
+{
+	Value value = peek(0);
+
+	if (IS_INSTANCE(value)) {
+		ObjInstance* instance = AS_INSTANCE(value);
+		ObjClosure* method;
+
+		CacheEntry* entry = findCacheEntry(cache, instance->shape);
+		if (entry != NULL) {
+			if (entry->slot >= 0) {
+				pop(); //Instance.
+				push(instance->fields[entry->slot]);
+				return true;
+			}
+			method = (ObjClosure*)entry->target;
+		}
+		else {
+			int slot = shapeFindSlot(instance->shape, name);
+			if (slot >= 0) {
+				updateCache(cache, instance->shape, slot, NULL);
+				pop(); //Instance.
+				push(instance->fields[slot]);
+				return true;
+			}
+
+			method = findMethod(instance, name, cache);
+			if (method == NULL) return false;
+		}
+
+		ObjBoundMethod* bound = newBoundMethod(peek(0), method);
+		pop();
+		push(OBJ_VAL(bound));
+		return true;
+	}
+
+	if (IS_OBJ(value)) return true;
+
+	bool isToString = strcmp(name->chars, "to_str") == 0;
+	if (IS_NUMBER(value)) {
+		if (isToString) {
+			pop();
+			push(OBJ_VAL(doubleToObjString(AS_NUMBER(value))));
+			return true;
+		}
+		runtimeError("Unknown number property %s.", name->chars);
+		return false;
+	}
+	if (IS_BOOL(value)) {
+		if (isToString) {
+			pop();
+			push(OBJ_VAL(boolToObjString(AS_BOOL(value))));
+			return true;
+		}
+		runtimeError("Unknown bool property %s.", name->chars);
+		return false;
+	}
+	if (IS_NIL(value)) {
+		if (isToString) {
+			pop();
+			push(OBJ_VAL(takeString("nil", 3)));
+			return true;
+		}
+		runtimeError("Unknown nil property %s.", name->chars);
+		return false;
+	}
+
+	runtimeError("Unknown property %s.", name->chars);
+	return false;
+}
+
+static bool setProperty(ObjString* name, InlineCache* cache)
+{
+	if (!IS_INSTANCE(peek(1))) {
+		runtimeError("Only instances have fields.");
+		return false;
+	}
+
+	ObjInstance* instance = AS_INSTANCE(peek(1));
+	ObjShape* shape = instance->shape;
+
+	CacheEntry* entry = findCacheEntry(cache, shape);
+	if (entry != NULL && entry->target == NULL) {
+		STORE_SHARED(instance->fields[entry->slot], peek(0));
+		WRITE_BARRIER(instance);
+	}
+	else if (entry != NULL && entry->slot < instance->fieldCapacity) {
+		//Cached transition to the shape that has this field.
+		STORE_SHARED(instance->shape, (ObjShape*)entry->target);
+		STORE_SHARED(instance->fields[entry->slot], peek(0));
+		WRITE_BARRIER(instance);
+	}
+	else {
+		instanceSetField(instance, name, peek(0));
+		if (entry == NULL && !instance->shape->isDictionary) {
+			int slot = shapeFindSlot(instance->shape, name);
+			updateCache(cache, shape, slot, instance->shape == shape ? NULL : (Obj*)instance->shape);
+		}
+	}
+
+	Value value = pop();
+	pop();
+	push(value);
+	return true;
+}
+
+//Builds the closure for an OP_CLOSURE whose operands start at 'ip' and
+//returns the address just past them.
+static uint8_t* makeClosure(CallFrame* frame, uint8_t* ip)
+{
+	ObjFunction* function = AS_FUNCTION(frame->closure->function->chunk.constants.values[*ip++]);
+	ObjClosure* closure = newClosure(function);
+	push(OBJ_VAL(closure));
+	for (int i = 0; i < closure->upvalueCount; i++) {
+		uint8_t isLocal = *ip++;
+		uint8_t index = *ip++;
+		if (isLocal) {
+			STORE_SHARED(closure->upvalues[i], captureUpvalue(frame->slots + index));
+		}
+		else {
+			STORE_SHARED(closure->upvalues[i], frame->closure->upvalues[index]);
+		}
+	}
+	//Capturing can collect, which may already have promoted the closure.
+	WRITE_BARRIER(closure);
+	return ip;
+}
+
+#ifdef DEBUG_TRACE_EXECUTION
+static void traceExecution(CallFrame* frame)
+{
+	printf("        ");
+	for (Value *slot = vm.stack; slot < vm.stackTop; slot++)
+	{
+		printf("  [");
+		printValue(*slot);
+		printf("] ");
+	}
+	printf("\n");
+
+	disassembleInstruction(&frame->closure->function->chunk,(int)(frame->ip - frame->closure->function->chunk.code));
+}
+#endif
+
+//Instructions the interpreter rewrites between a generic and a quickened
+//form, so only the byte in the chunk tells which of them to run.
+static inline bool isQuickenable(uint8_t instruction)
+{
+	switch (instruction)
+	{
+	case OP_ADD: case OP_ADD_NUM: case OP_ADD_STR:
+	case OP_SUBTRACT: case OP_SUBTRACT_NUM:
+	case OP_MULTIPLY: case OP_MULTIPLY_NUM:
+	case OP_DIVIDE: case OP_DIVIDE_NUM:
+	case OP_GREATER: case OP_GREATER_NUM:
+	case OP_LESS: case OP_LESS_NUM:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static InterpretResult run()
+{
+	CallFrame* frame;
+	register uint8_t* ip;
+	register Value* slots;
+	register Value* constants;
+
+#define LOAD_FRAME()                                                     \
+	do                                                                   \
+	{                                                                    \
+		frame = &vm.frames[vm.frameCount - 1];                           \
+		ip = frame->ip;                                                  \
+		slots = frame->slots;                                            \
+		constants = frame->closure->function->chunk.constants.values;    \
+	} while (false)
+
+#define STORE_FRAME() (frame->ip = ip)
+
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+#define READ_CONSTANT() (constants[READ_BYTE()])
+#define READ_STRING() AS_STRING(READ_CONSTANT())
+#define READ_CACHE() (&frame->closure->function->chunk.caches[READ_SHORT()])
+
+#define RUNTIME_ERROR(...)                              \
+	do                                                  \
+	{                                                   \
+		STORE_FRAME();                                  \
+		runtimeError(__VA_ARGS__);                      \
+		return INTERPRET_RUNTIME_ERROR;                 \
+	} while (false)
+
+#define BINARY_OP(valueType, op, quickOp)               \
+	do                                                  \
+	{													\
+		if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) \
+		{                                               \
+			RUNTIME_ERROR("Operands must be numbers."); \
+		}                                               \
+		ip[-1] = quickOp;                               \
+		double b = AS_NUMBER(pop());                    \
+		double a = AS_NUMBER(pop());                    \
+		push(valueType(a op b));                        \
+	} while (false)
+
+//Rewrites the current instruction back to its generic form and runs that
+//instead.
+#define DEQUICKEN(genericOp)                            \
+	do                                                  \
+	{                                                   \
+		ip[-1] = genericOp;                             \
+		ip--;                                           \
+		DISPATCH();                                     \
+	} while (false)
+
+#define QUICK_BINARY_OP(valueType, op, genericOp)       \
+	do                                                  \
+	{                                                   \
+		Value* top = vm.stackTop;                       \
+		if (!IS_NUMBER(top[-1]) || !IS_NUMBER(top[-2])) \
+		{                                               \
+			DEQUICKEN(genericOp);                       \
+		}                                               \
+		top[-2] = valueType(AS_NUMBER(top[-2]) op AS_NUMBER(top[-1])); \
+		vm.stackTop--;                                  \
+	} while (false)
+
+#define COMPARE_OP(op)                                  \
+	do                                                  \
+	{                                                   \
+		if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) \
+		{                                               \
+			RUNTIME_ERROR("Operands must be numbers."); \
+		}                                               \
+		double b = AS_NUMBER(pop());                    \
+		double a = AS_NUMBER(pop());                    \
+		push(BOOL_VAL(a op b));                         \
+	} while (false)
+
+//Pops both operands and jumps unless 'a op b' holds, which NaNs never do.
+#define COMPARE_JUMP(op)                                \
+	do                                                  \
+	{                                                   \
+		uint16_t offset = READ_SHORT();                 \
+		Value* top = vm.stackTop;                       \
+		if (!IS_NUMBER(top[-1]) || !IS_NUMBER(top[-2])) \
+		{                                               \
+			RUNTIME_ERROR("Operands must be numbers."); \
+		}                                               \
+		vm.stackTop -= 2;                               \
+		if (!(AS_NUMBER(top[-2]) op AS_NUMBER(top[-1]))) ip += offset; \
+	} while (false)
+
+//The register forms read their operands from the frame's slots, or the
+//second one from the constants for the _RK ones.
+#define REGISTER_BINARY_OP(op, readB)                   \
+	do                                                  \
+	{                                                   \
+		uint8_t instruction = ip[-1];                   \
+		Value* result = &slots[READ_BYTE()];            \
+		Value a = slots[READ_BYTE()];                   \
+		Value b = readB;                                \
+		if (IS_NUMBER(a) && IS_NUMBER(b))               \
+		{                                               \
+			*result = NUMBER_VAL(AS_NUMBER(a) op AS_NUMBER(b)); \
+		}                                               \
+		else                                            \
+		{                                               \
+			STORE_FRAME();                              \
+			if (!registerArithmetic(instruction, a, b, result)) return INTERPRET_RUNTIME_ERROR; \
+		}                                               \
+	} while (false)
+
+#define REGISTER_COMPARE_JUMP(op, readB)                \
+	do                                                  \
+	{                                                   \
+		Value a = slots[READ_BYTE()];                   \
+		Value b = readB;                                \
+		uint16_t offset = READ_SHORT();                 \
+		if (!IS_NUMBER(a) || !IS_NUMBER(b))             \
+		{                                               \
+			RUNTIME_ERROR("Operands must be numbers."); \
+		}                                               \
+		if (!(AS_NUMBER(a) op AS_NUMBER(b))) ip += offset; \
+	} while (false)
+
+#define BINARY_SHIFT_OP(op)								\
+	do                                                  \
+	{                                                   \
+		if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) \
+		{                                               \
+			RUNTIME_ERROR("Operands must be numbers."); \
+		}                                               \
+		long b = (long) AS_NUMBER(pop());               \
+		long a = (long) AS_NUMBER(pop());               \
+		push(NUMBER_VAL(a op b));                       \
+	} while (false)
+
+#define MOD_OP()										\
+	do{													\
+		if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1)))	\
+		{												\
+			RUNTIME_ERROR("Operands must be numbers."); \
+		}												\
+		double b = AS_NUMBER(pop());                    \
+		double a = AS_NUMBER(pop());					\
+		push(NUMBER_VAL(fmod(a, b)));					\
+	} while (false);
+
+#define POWER_OP()										\
+	do{													\
+		if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1)))	\
+		{												\
+			RUNTIME_ERROR("Operands must be numbers."); \
+		}												\
+		double b = AS_NUMBER(pop());                    \
+		double a = AS_NUMBER(pop());					\
+		push(NUMBER_VAL(pow(a, b)));					\
+	} while (false);
+
+	//Whenever a frame is (re)entered we switch over to its native code if
+	//the JIT has compiled it.
+#ifdef JIT_ENABLED
+#define TRY_JIT()                                                        \
+	do                                                                   \
+	{                                                                    \
+		if (frame->closure->function->jit != NULL) goto enterJit;        \
+	} while (false)
+#else
+#define TRY_JIT() do { } while (false)
+#endif
+
+//Between instructions every object is reached through the VM, so a
+//compaction asked for by the last collection can move them here.
+#ifdef SLAB_ENABLED
+#define SAFE_POINT()                                                     \
+	do                                                                   \
+	{                                                                    \
+		if (vm.compactPending) {                                         \
+			STORE_FRAME();                                               \
+			compactHeap();                                               \
+			LOAD_FRAME();                                                \
+		}                                                                \
+	} while (false)
+#else
+#define SAFE_POINT() do { } while (false)
+#endif
+
+#ifdef DEBUG_TRACE_EXECUTION
+#define TRACE_INSTRUCTION() do { STORE_FRAME(); traceExecution(frame); } while (false)
+#else
+#define TRACE_INSTRUCTION() do { } while (false)
+#endif
+
+#ifdef PROFILE_OPCODES
+#define PROFILE_INSTRUCTION() profileInstruction(*ip)
+#else
+#define PROFILE_INSTRUCTION() do { } while (false)
+#endif
+
+	//Bodies of the instructions a superinstruction can start with, shared
+	//by their own handlers and those of the superinstructions.
+#define BODY_OP_CONSTANT() push(READ_CONSTANT())
+#define BODY_OP_NIL() push(NIL_VAL)
+#define BODY_OP_TRUE() push(BOOL_VAL(true))
+#define BODY_OP_FALSE() push(BOOL_VAL(false))
+#define BODY_OP_POP() pop()
+
+#define BODY_OP_GET_LOCAL()                             \
+	do                                                  \
+	{                                                   \
+		uint8_t slot = READ_BYTE();                     \
+		push(slots[slot]);                              \
+	} while (false)
+
+#define BODY_OP_SET_LOCAL()                             \
+	do                                                  \
+	{                                                   \
+		uint8_t slot = READ_BYTE();                     \
+		slots[slot] = peek(0);                          \
+	} while (false)
+
+	//Fused from an OP_ADD, so it fails the same way.
+#define BODY_OP_INC_LOCAL()                             \
+	do                                                  \
+	{                                                   \
+		uint8_t slot = READ_BYTE();                     \
+		Value constant = READ_CONSTANT();               \
+		if (!IS_NUMBER(slots[slot])) {                  \
+			RUNTIME_ERROR("Operands must be two numbers or two strings."); \
+		}                                               \
+		slots[slot] = NUMBER_VAL(AS_NUMBER(slots[slot]) + AS_NUMBER(constant)); \
+	} while (false)
+
+#define BODY_OP_GET_UPVALUE()                           \
+	do                                                  \
+	{                                                   \
+		uint8_t slot = READ_BYTE();                     \
+		push(*frame->closure->upvalues[slot]->location); \
+	} while (false)
+
+#define BODY_OP_GET_GLOBAL()                            \
+	do                                                  \
+	{                                                   \
+		uint16_t slot = READ_SHORT();                   \
+		if (!vm.globalSlots[slot].isDefined) {          \
+			RUNTIME_ERROR("Undefined variable '%s'.", vm.globalSlots[slot].name->chars); \
+		}                                               \
+		push(vm.globalValues[slot]);                    \
+	} while (false)
+
+#define BODY_OP_SET_GLOBAL()                            \
+	do                                                  \
+	{                                                   \
+		uint16_t slot = READ_SHORT();                   \
+		GlobalSlot* global = &vm.globalSlots[slot];     \
+		if (!global->isDefined) {                       \
+			RUNTIME_ERROR("Undefined variable '%s'.", global->name->chars); \
+		}                                               \
+		if (global->isConstant) {                       \
+			RUNTIME_ERROR("Can't change the value of a constant."); \
+		}                                               \
+		vm.globalValues[slot] = peek(0);                \
+	} while (false)
+
+	//With labels-as-values every opcode handler jumps straight to the next
+	//handler through its own indirect branch; otherwise we fall back to a
+	//plain switch inside the loop.
+#ifdef COMPUTED_GOTO
+	//Every opcode is first pointed at op_UNKNOWN and then at its handler.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+	static void* dispatchTable[UINT8_COUNT] = {
+		[0 ... UINT8_MAX] = &&op_UNKNOWN,
+		[OP_NEGATE] = &&op_OP_NEGATE,
+		[OP_PRINT] = &&op_OP_PRINT,
+		[OP_JUMP_IF_FALSE] = &&op_OP_JUMP_IF_FALSE,
+		[OP_JUMP] = &&op_OP_JUMP,
+		[OP_LOOP] = &&op_OP_LOOP,
+		[OP_CALL] = &&op_OP_CALL,
+		[OP_TAIL_CALL] = &&op_OP_TAIL_CALL,
+		[OP_CLASS] = &&op_OP_CLASS,
+		[OP_METHOD] = &&op_OP_METHOD,
+		[OP_INVOKE] = &&op_OP_INVOKE,
+		[OP_TAIL_INVOKE] = &&op_OP_TAIL_INVOKE,
+		[OP_INHERIT] = &&op_OP_INHERIT,
+		[OP_CLOSURE] = &&op_OP_CLOSURE,
+		[OP_ADD] = &&op_OP_ADD,
+		[OP_SUBTRACT] = &&op_OP_SUBTRACT,
+		[OP_MULTIPLY] = &&op_OP_MULTIPLY,
+		[OP_DIVIDE] = &&op_OP_DIVIDE,
+		[OP_POWER] = &&op_OP_POWER,
+		[OP_MODULO] = &&op_OP_MODULO,
+		[OP_SHIFT_LEFT] = &&op_OP_SHIFT_LEFT,
+		[OP_SHIFT_RIGHT] = &&op_OP_SHIFT_RIGHT,
+		[OP_RETURN] = &&op_OP_RETURN,
+		[OP_NIL] = &&op_OP_NIL,
+		[OP_TRUE] = &&op_OP_TRUE,
+		[OP_FALSE] = &&op_OP_FALSE,
+		[OP_POP] = &&op_OP_POP,
+		[OP_DEFINE_GLOBAL] = &&op_OP_DEFINE_GLOBAL,
+		[OP_DEFINE_CONSTANT] = &&op_OP_DEFINE_CONSTANT,
+		[OP_GET_GLOBAL] = &&op_OP_GET_GLOBAL,
+		[OP_SET_GLOBAL] = &&op_OP_SET_GLOBAL,
+		[OP_GET_UPVALUE] = &&op_OP_GET_UPVALUE,
+		[OP_SET_UPVALUE] = &&op_OP_SET_UPVALUE,
+		[OP_GET_PROPERTY] = &&op_OP_GET_PROPERTY,
+		[OP_SET_PROPERTY] = &&op_OP_SET_PROPERTY,
+		[OP_CLOSE_UPVALUE] = &&op_OP_CLOSE_UPVALUE,
+		[OP_GET_LOCAL] = &&op_OP_GET_LOCAL,
+		[OP_SET_LOCAL] = &&op_OP_SET_LOCAL,
+		[OP_GET_SUPER] = &&op_OP_GET_SUPER,
+		[OP_SUPER_INVOKE] = &&op_OP_SUPER_INVOKE,
+		[OP_TAIL_SUPER_INVOKE] = &&op_OP_TAIL_SUPER_INVOKE,
+		[OP_EQUAL] = &&op_OP_EQUAL,
+		[OP_GREATER] = &&op_OP_GREATER,
+		[OP_LESS] = &&op_OP_LESS,
+		[OP_GREATER_EQUAL] = &&op_OP_GREATER_EQUAL,
+		[OP_LESS_EQUAL] = &&op_OP_LESS_EQUAL,
+		[OP_NOT] = &&op_OP_NOT,
+		[OP_CONSTANT] = &&op_OP_CONSTANT,
+		[OP_EXIT] = &&op_OP_EXIT,
+		[OP_JUMP_IF_NOT_LESS] = &&op_OP_JUMP_IF_NOT_LESS,
+		[OP_JUMP_IF_NOT_LESS_EQUAL] = &&op_OP_JUMP_IF_NOT_LESS_EQUAL,
+		[OP_JUMP_IF_NOT_GREATER] = &&op_OP_JUMP_IF_NOT_GREATER,
+		[OP_JUMP_IF_NOT_GREATER_EQUAL] = &&op_OP_JUMP_IF_NOT_GREATER_EQUAL,
+		[OP_INC_LOCAL] = &&op_OP_INC_LOCAL,
+		[OP_MOVE] = &&op_OP_MOVE,
+		[OP_ADD_RR] = &&op_OP_ADD_RR,
+		[OP_SUBTRACT_RR] = &&op_OP_SUBTRACT_RR,
+		[OP_MULTIPLY_RR] = &&op_OP_MULTIPLY_RR,
+		[OP_DIVIDE_RR] = &&op_OP_DIVIDE_RR,
+		[OP_ADD_RK] = &&op_OP_ADD_RK,
+		[OP_SUBTRACT_RK] = &&op_OP_SUBTRACT_RK,
+		[OP_MULTIPLY_RK] = &&op_OP_MULTIPLY_RK,
+		[OP_DIVIDE_RK] = &&op_OP_DIVIDE_RK,
+		[OP_JUMP_IF_NOT_LESS_RR] = &&op_OP_JUMP_IF_NOT_LESS_RR,
+		[OP_JUMP_IF_NOT_LESS_EQUAL_RR] = &&op_OP_JUMP_IF_NOT_LESS_EQUAL_RR,
+		[OP_JUMP_IF_NOT_GREATER_RR] = &&op_OP_JUMP_IF_NOT_GREATER_RR,
+		[OP_JUMP_IF_NOT_GREATER_EQUAL_RR] = &&op_OP_JUMP_IF_NOT_GREATER_EQUAL_RR,
+		[OP_JUMP_IF_NOT_LESS_RK] = &&op_OP_JUMP_IF_NOT_LESS_RK,
+		[OP_JUMP_IF_NOT_LESS_EQUAL_RK] = &&op_OP_JUMP_IF_NOT_LESS_EQUAL_RK,
+		[OP_JUMP_IF_NOT_GREATER_RK] = &&op_OP_JUMP_IF_NOT_GREATER_RK,
+		[OP_JUMP_IF_NOT_GREATER_EQUAL_RK] = &&op_OP_JUMP_IF_NOT_GREATER_EQUAL_RK,
+		[OP_ADD_NUM] = &&op_OP_ADD_NUM,
+		[OP_ADD_STR] = &&op_OP_ADD_STR,
+		[OP_SUBTRACT_NUM] = &&op_OP_SUBTRACT_NUM,
+		[OP_MULTIPLY_NUM] = &&op_OP_MULTIPLY_NUM,
+		[OP_DIVIDE_NUM] = &&op_OP_DIVIDE_NUM,
+		[OP_GREATER_NUM] = &&op_OP_GREATER_NUM,
+		[OP_LESS_NUM] = &&op_OP_LESS_NUM,
+#define SUPERINSTRUCTION(name, first, next) [name] = &&op_##name,
+#include "superinstructions.h"
+#undef SUPERINSTRUCTION
+	};
+#pragma GCC diagnostic pop
+
+#define INTERPRET_LOOP DISPATCH();
+#define CASE_OP(name) op_##name
+#define CASE_UNKNOWN op_UNKNOWN
+#define DISPATCH()                                      \
+	do                                                  \
+	{                                                   \
+		TRACE_INSTRUCTION();                            \
+		PROFILE_INSTRUCTION();                          \
+		goto *dispatchTable[READ_BYTE()];               \
+	} while (false)
+//A superinstruction knows what comes after it and goes there directly,
+//unless that is quickened or dequickened as it runs. The check is on a
+//constant and folds away.
+#define DISPATCH_TO(next)                               \
+	do                                                  \
+	{                                                   \
+		if (isQuickenable(next)) DISPATCH();            \
+		TRACE_INSTRUCTION();                            \
+		ip++;                                           \
+		goto op_##next;                                 \
+	} while (false)
+#else
+#define INTERPRET_LOOP                                  \
+	loop:                                               \
+		TRACE_INSTRUCTION();                            \
+		PROFILE_INSTRUCTION();                          \
+		switch (READ_BYTE())
+#define CASE_OP(name) case name
+#define CASE_UNKNOWN default
+#define DISPATCH() goto loop
+#define DISPATCH_TO(next) goto loop
+#endif
+
+	LOAD_FRAME();
+#ifdef PROFILE_OPCODES
+	profileBreak();
+#endif
+	TRY_JIT();
+
+	INTERPRET_LOOP
+	{
+		CASE_OP(OP_CONSTANT):
+			BODY_OP_CONSTANT();
+			DISPATCH();
+		CASE_OP(OP_NIL):
+			BODY_OP_NIL();
+			DISPATCH();
+		CASE_OP(OP_TRUE):
+			BODY_OP_TRUE();
+			DISPATCH();
+		CASE_OP(OP_FALSE):
+			BODY_OP_FALSE();
+			DISPATCH();
+		CASE_OP(OP_POP):
+			BODY_OP_POP();
+			DISPATCH();
+
+		CASE_OP(OP_GET_LOCAL):
+			BODY_OP_GET_LOCAL();
+			DISPATCH();
+
+		CASE_OP(OP_SET_LOCAL):
+			BODY_OP_SET_LOCAL();
+			DISPATCH();
+
+		CASE_OP(OP_INC_LOCAL):
+			BODY_OP_INC_LOCAL();
+			DISPATCH();
+
+		CASE_OP(OP_MOVE):
+		{
+			uint8_t slot = READ_BYTE();
+			slots[slot] = slots[READ_BYTE()];
+			DISPATCH();
+		}
+		CASE_OP(OP_ADD_RR):
+			REGISTER_BINARY_OP(+, slots[READ_BYTE()]);
+			DISPATCH();
+		CASE_OP(OP_SUBTRACT_RR):
+			REGISTER_BINARY_OP(-, slots[READ_BYTE()]);
+			DISPATCH();
+		CASE_OP(OP_MULTIPLY_RR):
+			REGISTER_BINARY_OP(*, slots[READ_BYTE()]);
+			DISPATCH();
+		CASE_OP(OP_DIVIDE_RR):
+			REGISTER_BINARY_OP(/, slots[READ_BYTE()]);
+			DISPATCH();
+		CASE_OP(OP_ADD_RK):
+			REGISTER_BINARY_OP(+, READ_CONSTANT());
+			DISPATCH();
+		CASE_OP(OP_SUBTRACT_RK):
+			REGISTER_BINARY_OP(-, READ_CONSTANT());
+			DISPATCH();
+		CASE_OP(OP_MULTIPLY_RK):
+			REGISTER_BINARY_OP(*, READ_CONSTANT());
+			DISPATCH();
+		CASE_OP(OP_DIVIDE_RK):
+			REGISTER_BINARY_OP(/, READ_CONSTANT());
+			DISPATCH();
+
+		CASE_OP(OP_DEFINE_GLOBAL):
+		{
+			uint16_t slot = READ_SHORT();
+			vm.globalValues[slot] = peek(0);
+			vm.globalSlots[slot].isDefined = true;
+			vm.globalSlots[slot].isConstant = false;
+			pop();
+			DISPATCH();
+		}
+		
+		CASE_OP(OP_GET_GLOBAL):
+			BODY_OP_GET_GLOBAL();
+			DISPATCH();
+
+		CASE_OP(OP_SET_GLOBAL):
+			BODY_OP_SET_GLOBAL();
+			DISPATCH();
+
+		CASE_OP(OP_GET_UPVALUE):
+			BODY_OP_GET_UPVALUE();
+			DISPATCH();
+
+		CASE_OP(OP_SET_UPVALUE):
+		{
+			uint8_t slot = READ_BYTE();
+			ObjUpvalue* upvalue = frame->closure->upvalues[slot];
+			STORE_SHARED(*upvalue->location, peek(0));
+			WRITE_BARRIER(upvalue);
+			DISPATCH();
+		}
+
+		CASE_OP(OP_GET_PROPERTY):
+		{
+			ObjString* name = READ_STRING();
+			InlineCache* cache = READ_CACHE();
+			STORE_FRAME();
+			if (!getProperty(name, cache)) {
+				return INTERPRET_RUNTIME_ERROR;
+			}
+			DISPATCH();
+		}
+
+		CASE_OP(OP_SET_PROPERTY):
+		{
+			ObjString* name = READ_STRING();
+			InlineCache* cache = READ_CACHE();
+			STORE_FRAME();
+			if (!setProperty(name, cache)) {
+				return INTERPRET_RUNTIME_ERROR;
+			}
+			DISPATCH();
+		}
+
+		CASE_OP(OP_CLOSE_UPVALUE):
+			closeUpvalues(vm.stackTop - 1);
+			pop();
+			DISPATCH();
+
+		CASE_OP(OP_GET_SUPER):
+		{
+			ObjString* name = READ_STRING();
+			ObjClass* superclass = AS_CLASS(pop());
+			STORE_FRAME();
+			if (!bindMethod(superclass, name)) {
+				return INTERPRET_RUNTIME_ERROR;
+			}
+			DISPATCH();
+		}
+
+		CASE_OP(OP_SUPER_INVOKE):
+		{
+			ObjString* method = READ_STRING();
+			int argCount = READ_BYTE();
+			ObjClass* superclass = AS_CLASS(pop());
+			STORE_FRAME();
+			if (!invokeFromClass(superclass, method, argCount, false)) {
+				return INTERPRET_RUNTIME_ERROR;
+			}
+			LOAD_FRAME();
+			TRY_JIT();
+			DISPATCH();
+		}
+
+		CASE_OP(OP_TAIL_SUPER_INVOKE):
+		{
+			ObjString* method = READ_STRING();
+			int argCount = READ_BYTE();
+			ObjClass* superclass = AS_CLASS(pop());
+			STORE_FRAME();
+			if (!invokeFromClass(superclass, method, argCount, true)) {
+				return INTERPRET_RUNTIME_ERROR;
+			}
+			LOAD_FRAME();
+			TRY_JIT();
+			DISPATCH();
+		}
+
+		CASE_OP(OP_DEFINE_CONSTANT):
+		{
+			uint16_t slot = READ_SHORT();
+			GlobalSlot* global = &vm.globalSlots[slot];
+			if (global->isDefined) {
+				RUNTIME_ERROR("%s '%s' is already defined.", ((global->isConstant) ? "Constant" : "Variable"), global->name->chars);
+			}
+
+			vm.globalValues[slot] = peek(0);
+			global->isDefined = true;
+			global->isConstant = true;
+			pop();
+			DISPATCH();
+		}
+
+		CASE_OP(OP_EQUAL):
+		{
+			Value a = pop();
+			Value b = pop();
+			push(BOOL_VAL(valuesEqual(a, b)));
+			DISPATCH();
+		}
+
+		CASE_OP(OP_GREATER):
+			BINARY_OP(BOOL_VAL, >, OP_GREATER_NUM);
+			DISPATCH();
+		CASE_OP(OP_LESS):
+			BINARY_OP(BOOL_VAL, <, OP_LESS_NUM);
+			DISPATCH();
+		CASE_OP(OP_GREATER_EQUAL):
+			COMPARE_OP(>=);
+			DISPATCH();
+		CASE_OP(OP_LESS_EQUAL):
+			COMPARE_OP(<=);
+			DISPATCH();
+		CASE_OP(OP_ADD):
+		{
+			if (IS_STRING(peek(0)) && IS_STRING(peek(1)))
+			{
+				ip[-1] = OP_ADD_STR;
+				concatenate();
+			}
+			else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1)))
+			{
+				ip[-1] = OP_ADD_NUM;
+				double b = AS_NUMBER(pop());
+				double a = AS_NUMBER(pop());
+				push(NUMBER_VAL(a + b));
+			}
+			else
+			{
+				RUNTIME_ERROR("Operands must be two numbers or two strings.");
+			}
+			DISPATCH();
+		}
+		CASE_OP(OP_SUBTRACT):
+			BINARY_OP(NUMBER_VAL, -, OP_SUBTRACT_NUM);
+			DISPATCH();
+		CASE_OP(OP_MULTIPLY):
+			BINARY_OP(NUMBER_VAL, *, OP_MULTIPLY_NUM);
+			DISPATCH();
+		CASE_OP(OP_DIVIDE):
+			BINARY_OP(NUMBER_VAL, /, OP_DIVIDE_NUM);
+			DISPATCH();
+
+		CASE_OP(OP_ADD_NUM):
+			QUICK_BINARY_OP(NUMBER_VAL, +, OP_ADD);
+			DISPATCH();
+		CASE_OP(OP_ADD_STR):
+			if (!IS_STRING(peek(0)) || !IS_STRING(peek(1))) {
+				DEQUICKEN(OP_ADD);
+			}
+			concatenate();
+			DISPATCH();
+		CASE_OP(OP_SUBTRACT_NUM):
+			QUICK_BINARY_OP(NUMBER_VAL, -, OP_SUBTRACT);
+			DISPATCH();
+		CASE_OP(OP_MULTIPLY_NUM):
+			QUICK_BINARY_OP(NUMBER_VAL, *, OP_MULTIPLY);
+			DISPATCH();
+		CASE_OP(OP_DIVIDE_NUM):
+			QUICK_BINARY_OP(NUMBER_VAL, /, OP_DIVIDE);
+			DISPATCH();
+		CASE_OP(OP_GREATER_NUM):
+			QUICK_BINARY_OP(BOOL_VAL, >, OP_GREATER);
+			DISPATCH();
+		CASE_OP(OP_LESS_NUM):
+			QUICK_BINARY_OP(BOOL_VAL, <, OP_LESS);
+			DISPATCH();
+		CASE_OP(OP_MODULO):
+			MOD_OP();
+			DISPATCH();
+		CASE_OP(OP_POWER):
+			POWER_OP();
+			DISPATCH();
+		CASE_OP(OP_NOT):
+			push(BOOL_VAL(isFalsey(pop())));
+			DISPATCH();
+		CASE_OP(OP_SHIFT_LEFT):
+			BINARY_SHIFT_OP(<<);
+			DISPATCH();
+		CASE_OP(OP_SHIFT_RIGHT):
+			BINARY_SHIFT_OP(>>);
+			DISPATCH();
+
+		CASE_OP(OP_NEGATE):
+			if (!IS_NUMBER(peek(0)))
+			{
+				RUNTIME_ERROR("Operand must be a number.");
+			}
+
+			push(NUMBER_VAL(-AS_NUMBER(pop())));
+			DISPATCH();
+
+		CASE_OP(OP_PRINT):
+		{
+			printValue(pop());
+			printf("\n");
+			DISPATCH();
+		}
+
+		CASE_OP(OP_EXIT):
+			return INTERPRET_OK;
+
+		CASE_OP(OP_JUMP):
+		{
+			uint16_t offset = READ_SHORT();
+			ip += offset;
+			DISPATCH();
+		}
+
+		CASE_OP(OP_JUMP_IF_FALSE):
+		{
+			uint16_t offset = READ_SHORT();
+			if (isFalsey(peek(0))) ip += offset;
+			DISPATCH();
+		}
+
+		CASE_OP(OP_JUMP_IF_NOT_LESS):
+			COMPARE_JUMP(<);
+			DISPATCH();
+		CASE_OP(OP_JUMP_IF_NOT_LESS_EQUAL):
+			COMPARE_JUMP(<=);
+			DISPATCH();
+		CASE_OP(OP_JUMP_IF_NOT_GREATER):
+			COMPARE_JUMP(>);
+			DISPATCH();
+		CASE_OP(OP_JUMP_IF_NOT_GREATER_EQUAL):
+			COMPARE_JUMP(>=);
+			DISPATCH();
+		CASE_OP(OP_JUMP_IF_NOT_LESS_RR):
+			REGISTER_COMPARE_JUMP(<, slots[READ_BYTE()]);
+			DISPATCH();
+		CASE_OP(OP_JUMP_IF_NOT_LESS_EQUAL_RR):
+			REGISTER_COMPARE_JUMP(<=, slots[READ_BYTE()]);
+			DISPATCH();
+		CASE_OP(OP_JUMP_IF_NOT_GREATER_RR):
+			REGISTER_COMPARE_JUMP(>, slots[READ_BYTE()]);
+			DISPATCH();
+		CASE_OP(OP_JUMP_IF_NOT_GREATER_EQUAL_RR):
+			REGISTER_COMPARE_JUMP(>=, slots[READ_BYTE()]);
+			DISPATCH();
+		CASE_OP(OP_JUMP_IF_NOT_LESS_RK):
+			REGISTER_COMPARE_JUMP(<, READ_CONSTANT());
+			DISPATCH();
+		CASE_OP(OP_JUMP_IF_NOT_LESS_EQUAL_RK):
+			REGISTER_COMPARE_JUMP(<=, READ_CONSTANT());
+			DISPATCH();
+		CASE_OP(OP_JUMP_IF_NOT_GREATER_RK):
+			REGISTER_COMPARE_JUMP(>, READ_CONSTANT());
+			DISPATCH();
+		CASE_OP(OP_JUMP_IF_NOT_GREATER_EQUAL_RK):
+			REGISTER_COMPARE_JUMP(>=, READ_CONSTANT());
+			DISPATCH();
+
+		CASE_OP(OP_LOOP):
+		{
+			uint16_t offset = READ_SHORT();
+			ip -= offset;
+#ifdef JIT_ENABLED
+			if (vm.jitEnabled) {
+				STORE_FRAME();
+				if (traceLoop(frame)) LOAD_FRAME();
+			}
+			warmUp(frame->closure->function);
+#endif
+			SAFE_POINT();
+			TRY_JIT();
+			DISPATCH();
+		}
+
+		CASE_OP(OP_CALL):
+		{
+			int argCount = READ_BYTE();
+			STORE_FRAME();
+			if (!callValue(peek(argCount), argCount)) {
+				return INTERPRET_RUNTIME_ERROR;
+			}
+			LOAD_FRAME();
+			TRY_JIT();
+			DISPATCH();
+		}
+
+		CASE_OP(OP_TAIL_CALL):
+		{
+			int argCount = READ_BYTE();
+			STORE_FRAME();
+			if (!tailCall(peek(argCount), argCount)) {
+				return INTERPRET_RUNTIME_ERROR;
+			}
+			LOAD_FRAME();
+			TRY_JIT();
+			DISPATCH();
+		}
+
+		CASE_OP(OP_INVOKE):
+		{
+			ObjString* method = READ_STRING();
+			int argCount = READ_BYTE();
+			InlineCache* cache = READ_CACHE();
+			STORE_FRAME();
+			if (!invoke(method, argCount, cache, false)) {
+				return INTERPRET_RUNTIME_ERROR;
+			}
+			LOAD_FRAME();
+			TRY_JIT();
+			DISPATCH();
+		}
+
+		CASE_OP(OP_TAIL_INVOKE):
+		{
+			ObjString* method = READ_STRING();
+			int argCount = READ_BYTE();
+			InlineCache* cache = READ_CACHE();
+			STORE_FRAME();
+			if (!invoke(method, argCount, cache, true)) {
+				return INTERPRET_RUNTIME_ERROR;
+			}
+			LOAD_FRAME();
+			TRY_JIT();
+			DISPATCH();
+		}
+
+		CASE_OP(OP_INHERIT):
+		{
+			Value superclass = peek(1);
+
+			if (!IS_CLASS(superclass)) {
+				RUNTIME_ERROR("Superclass must be a class.");
+			}
+
+			ObjClass* subclass = AS_CLASS(peek(0));
+			tableAddAll(&AS_CLASS(superclass)->methods, &subclass->methods);
+			WRITE_BARRIER(subclass);
+			pop(); //Subclass.
+			DISPATCH();
+		}
+
+		CASE_OP(OP_METHOD):
+			defineMethod(READ_STRING());
+			DISPATCH();
+
+		CASE_OP(OP_CLOSURE):
+			ip = makeClosure(frame, ip);
+			DISPATCH();
+
+		CASE_OP(OP_CLASS):
+		{
+			push(OBJ_VAL(newClass(READ_STRING())));
+			DISPATCH();
+		}
+
+		CASE_OP(OP_RETURN):
+		{
+			Value result = pop();
+
+			closeUpvalues(slots);
+
+			vm.frameCount--;
+			if (vm.frameCount == 0) {
+				pop();
+				return INTERPRET_OK;
+			}
+
+			vm.stackTop = slots;
+			push(result);
+
+			LOAD_FRAME();
+			SAFE_POINT();
+			TRY_JIT();
+			DISPATCH();
+		}
+
+#define SUPERINSTRUCTION(name, first, next)             \
+		CASE_OP(name):                                  \
+			BODY_##first();                             \
+			DISPATCH_TO(next);
+#include "superinstructions.h"
+#undef SUPERINSTRUCTION
+
+		CASE_UNKNOWN:
+			//Opcodes without a handler are skipped.
+			DISPATCH();
+		}
+
+#ifdef JIT_ENABLED
+enterJit:
+	STORE_FRAME();
+	switch (jitRun(frame)) {
+	case JIT_EXIT_ERROR:
+		return INTERPRET_RUNTIME_ERROR;
+	case JIT_EXIT_DONE:
+		return INTERPRET_OK;
+	default:
+		break;
+	}
+
+	//Native code only leaves a frame through a call or a return.
+	LOAD_FRAME();
+	SAFE_POINT();
+	TRY_JIT();
+	DISPATCH();
+#endif
+
+	return INTERPRET_RUNTIME_ERROR; //Unreachable.
+#undef LOAD_FRAME
+#undef STORE_FRAME
+#undef READ_BYTE
+#undef READ_CONSTANT
+#undef READ_SHORT
+#undef BINARY_OP
+#undef DEQUICKEN
+#undef QUICK_BINARY_OP
+#undef READ_STRING
+#undef READ_CACHE
+#undef RUNTIME_ERROR
+#undef MOD_OP
+#undef BINARY_SHIFT_OP
+#undef COMPARE_OP
+#undef COMPARE_JUMP
+#undef REGISTER_BINARY_OP
+#undef REGISTER_COMPARE_JUMP
+#undef POWER_OP
+#undef TRY_JIT
+#undef SAFE_POINT
+#undef TRACE_INSTRUCTION
+#undef PROFILE_INSTRUCTION
+#undef BODY_OP_CONSTANT
+#undef BODY_OP_NIL
+#undef BODY_OP_TRUE
+#undef BODY_OP_FALSE
+#undef BODY_OP_POP
+#undef BODY_OP_GET_LOCAL
+#undef BODY_OP_SET_LOCAL
+#undef BODY_OP_INC_LOCAL
+#undef BODY_OP_GET_UPVALUE
+#undef BODY_OP_GET_GLOBAL
+#undef BODY_OP_SET_GLOBAL
+#undef INTERPRET_LOOP
+#undef CASE_OP
+#undef CASE_UNKNOWN
+#undef DISPATCH
+#undef DISPATCH_TO
+}
+
+
+#ifdef JIT_ENABLED
+//Slow paths for code compiled by jit.c. Each one gets the address of the
+//instruction it implements, leaves the frame's ip on the next instruction so
+//errors report the right line, and returns a JitStatus.
+
+static CallFrame* jitFrame(uint8_t* next)
+{
+	CallFrame* frame = &vm.frames[vm.frameCount - 1];
+	frame->ip = next;
+	return frame;
+}
+
+static Value jitConstant(CallFrame* frame, uint8_t index)
+{
+	return frame->closure->function->chunk.constants.values[index];
+}
+
+static InlineCache* jitCache(CallFrame* frame, uint8_t* operand)
+{
+	return &frame->closure->function->chunk.caches[(operand[0] << 8) | operand[1]];
+}
+
+//Calls that push a frame hand control back to the interpreter.
+static int jitCallStatus(bool success, int frameCount)
+{
+	if (!success) return JIT_EXIT_ERROR;
+	return vm.frameCount == frameCount ? JIT_CONTINUE : JIT_EXIT_FRAME;
+}
+
+int jitNegate(uint8_t* ip)
+{
+	jitFrame(ip + 1);
+	if (!IS_NUMBER(peek(0))) {
+		runtimeError("Operand must be a number.");
+		return JIT_EXIT_ERROR;
+	}
+
+	vm.stackTop[-1] = NUMBER_VAL(-AS_NUMBER(peek(0)));
+	return JIT_CONTINUE;
+}
+
+int jitNot(uint8_t* ip)
+{
+	jitFrame(ip + 1);
+	vm.stackTop[-1] = BOOL_VAL(isFalsey(peek(0)));
+	return JIT_CONTINUE;
+}
+
+int jitEqual(uint8_t* ip)
+{
+	jitFrame(ip + 1);
+	Value a = pop();
+	Value b = pop();
+	push(BOOL_VAL(valuesEqual(a, b)));
+	return JIT_CONTINUE;
+}
+
+//Also the slow path of the compare and branches, which only take it when an
+//operand isn't a number.
+int jitBinary(uint8_t* ip)
+{
+	jitFrame(ip + 1);
+	OpCode op = (OpCode)*ip;
+	bool isAdd = op == OP_ADD || op == OP_ADD_NUM || op == OP_ADD_STR;
+
+	if (isAdd && IS_STRING(peek(0)) && IS_STRING(peek(1))) {
+		concatenate();
+		return JIT_CONTINUE;
+	}
+
+	if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {
+		runtimeError(isAdd ? "Operands must be two numbers or two strings." : "Operands must be numbers.");
+		return JIT_EXIT_ERROR;
+	}
+
+	double b = AS_NUMBER(peek(0));
+	double a = AS_NUMBER(peek(1));
+	Value result;
+	switch (op) {
+	case OP_ADD:
+	case OP_ADD_NUM:
+	case OP_ADD_STR:		result = NUMBER_VAL(a + b); break;
+	case OP_SUBTRACT:
+	case OP_SUBTRACT_NUM:	result = NUMBER_VAL(a - b); break;
+	case OP_MULTIPLY:
+	case OP_MULTIPLY_NUM:	result = NUMBER_VAL(a * b); break;
+	case OP_DIVIDE:
+	case OP_DIVIDE_NUM:		result = NUMBER_VAL(a / b); break;
+	case OP_GREATER:
+	case OP_GREATER_NUM:	result = BOOL_VAL(a > b); break;
+	case OP_LESS:
+	case OP_LESS_NUM:		result = BOOL_VAL(a < b); break;
+	case OP_GREATER_EQUAL:	result = BOOL_VAL(a >= b); break;
+	case OP_LESS_EQUAL:		result = BOOL_VAL(a <= b); break;
+	case OP_MODULO:			result = NUMBER_VAL(fmod(a, b)); break;
+	case OP_POWER:			result = NUMBER_VAL(pow(a, b)); break;
+	case OP_SHIFT_LEFT:		result = NUMBER_VAL((long)a << (long)b); break;
+	case OP_SHIFT_RIGHT:	result = NUMBER_VAL((long)a >> (long)b); break;
+	default:				return JIT_EXIT_ERROR; //Unreachable.
+	}
+
+	vm.stackTop--;
+	vm.stackTop[-1] = result;
+	return JIT_CONTINUE;
+}
+
+int jitIncLocal(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 3);
+	Value* slot = &frame->slots[ip[1]];
+	if (!IS_NUMBER(*slot)) {
+		runtimeError("Operands must be two numbers or two strings.");
+		return JIT_EXIT_ERROR;
+	}
+
+	*slot = NUMBER_VAL(AS_NUMBER(*slot) + AS_NUMBER(jitConstant(frame, ip[2])));
+	return JIT_CONTINUE;
+}
+
+//Operands that aren't both numbers, the compare and branches only come
+//here to fail.
+int jitRegisterBinary(uint8_t* ip)
+{
+	bool isCompare = *ip >= OP_JUMP_IF_NOT_LESS_RR;
+	CallFrame* frame = jitFrame(ip + (isCompare ? 5 : 4));
+	if (isCompare) {
+		runtimeError("Operands must be numbers.");
+		return JIT_EXIT_ERROR;
+	}
+
+	Value b = *ip >= OP_ADD_RK ? jitConstant(frame, ip[3]) : frame->slots[ip[3]];
+	if (!registerArithmetic(*ip, frame->slots[ip[2]], b, &frame->slots[ip[1]])) return JIT_EXIT_ERROR;
+	return JIT_CONTINUE;
+}
+
+int jitPrint(uint8_t* ip)
+{
+	jitFrame(ip + 1);
+	printValue(pop());
+	printf("\n");
+	return JIT_CONTINUE;
+}
+
+int jitDefineGlobal(uint8_t* ip)
+{
+	jitFrame(ip + 3);
+	uint16_t slot = (uint16_t)((ip[1] << 8) | ip[2]);
+	vm.globalValues[slot] = peek(0);
+	vm.globalSlots[slot].isDefined = true;
+	vm.globalSlots[slot].isConstant = false;
+	pop();
+	return JIT_CONTINUE;
+}
+
+int jitDefineConstant(uint8_t* ip)
+{
+	jitFrame(ip + 3);
+	uint16_t slot = (uint16_t)((ip[1] << 8) | ip[2]);
+	GlobalSlot* global = &vm.globalSlots[slot];
+	if (global->isDefined) {
+		runtimeError("%s '%s' is already defined.", ((global->isConstant) ? "Constant" : "Variable"), global->name->chars);
+		return JIT_EXIT_ERROR;
+	}
+
+	vm.globalValues[slot] = peek(0);
+	global->isDefined = true;
+	global->isConstant = true;
+	pop();
+	return JIT_CONTINUE;
+}
+
+int jitGetGlobal(uint8_t* ip)
+{
+	jitFrame(ip + 3);
+	uint16_t slot = (uint16_t)((ip[1] << 8) | ip[2]);
+	if (!vm.globalSlots[slot].isDefined) {
+		runtimeError("Undefined variable '%s'.", vm.globalSlots[slot].name->chars);
+		return JIT_EXIT_ERROR;
+	}
+
+	push(vm.globalValues[slot]);
+	return JIT_CONTINUE;
+}
+
+int jitSetGlobal(uint8_t* ip)
+{
+	jitFrame(ip + 3);
+	uint16_t slot = (uint16_t)((ip[1] << 8) | ip[2]);
+	GlobalSlot* global = &vm.globalSlots[slot];
+	if (!global->isDefined) {
+		runtimeError("Undefined variable '%s'.", global->name->chars);
+		return JIT_EXIT_ERROR;
+	}
+	if (global->isConstant) {
+		runtimeError("Can't change the value of a constant.");
+		return JIT_EXIT_ERROR;
+	}
+
+	vm.globalValues[slot] = peek(0);
+	return JIT_CONTINUE;
+}
+
+int jitGetUpvalue(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 2);
+	push(*frame->closure->upvalues[ip[1]]->location);
+	return JIT_CONTINUE;
+}
+
+int jitSetUpvalue(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 2);
+	ObjUpvalue* upvalue = frame->closure->upvalues[ip[1]];
+	STORE_SHARED(*upvalue->location, peek(0));
+	WRITE_BARRIER(upvalue);
+	return JIT_CONTINUE;
+}
+
+int jitCloseUpvalue(uint8_t* ip)
+{
+	jitFrame(ip + 1);
+	closeUpvalues(vm.stackTop - 1);
+	pop();
+	return JIT_CONTINUE;
+}
+
+int jitGetProperty(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 4);
+	ObjString* name = AS_STRING(jitConstant(frame, ip[1]));
+	return getProperty(name, jitCache(frame, ip + 2)) ? JIT_CONTINUE : JIT_EXIT_ERROR;
+}
+
+int jitSetProperty(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 4);
+	ObjString* name = AS_STRING(jitConstant(frame, ip[1]));
+	return setProperty(name, jitCache(frame, ip + 2)) ? JIT_CONTINUE : JIT_EXIT_ERROR;
+}
+
+int jitGetSuper(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 2);
+	ObjString* name = AS_STRING(jitConstant(frame, ip[1]));
+	ObjClass* superclass = AS_CLASS(pop());
+	return bindMethod(superclass, name) ? JIT_CONTINUE : JIT_EXIT_ERROR;
+}
+
+int jitCall(uint8_t* ip)
+{
+	jitFrame(ip + 2);
+	int frameCount = vm.frameCount;
+	int argCount = ip[1];
+	return jitCallStatus(callValue(peek(argCount), argCount), frameCount);
+}
+
+//Leaves native code when the frame was reused for the callee.
+static int jitTailCallStatus(bool success, CallFrame* frame, uint8_t* next, int frameCount)
+{
+	if (!success) return JIT_EXIT_ERROR;
+	return vm.frameCount == frameCount && frame->ip == next ? JIT_CONTINUE : JIT_EXIT_FRAME;
+}
+
+int jitTailCall(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 2);
+	int frameCount = vm.frameCount;
+	int argCount = ip[1];
+	return jitTailCallStatus(tailCall(peek(argCount), argCount), frame, ip + 2, frameCount);
+}
+
+int jitInvoke(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 5);
+	int frameCount = vm.frameCount;
+	ObjString* method = AS_STRING(jitConstant(frame, ip[1]));
+	return jitCallStatus(invoke(method, ip[2], jitCache(frame, ip + 3), false), frameCount);
+}
+
+int jitTailInvoke(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 5);
+	int frameCount = vm.frameCount;
+	ObjString* method = AS_STRING(jitConstant(frame, ip[1]));
+	bool success = invoke(method, ip[2], jitCache(frame, ip + 3), true);
+	return jitTailCallStatus(success, frame, ip + 5, frameCount);
+}
+
+int jitSuperInvoke(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 3);
+	int frameCount = vm.frameCount;
+	ObjString* method = AS_STRING(jitConstant(frame, ip[1]));
+	ObjClass* superclass = AS_CLASS(pop());
+	return jitCallStatus(invokeFromClass(superclass, method, ip[2], false), frameCount);
+}
+
+int jitTailSuperInvoke(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 3);
+	int frameCount = vm.frameCount;
+	ObjString* method = AS_STRING(jitConstant(frame, ip[1]));
+	ObjClass* superclass = AS_CLASS(pop());
+	bool success = invokeFromClass(superclass, method, ip[2], true);
+	return jitTailCallStatus(success, frame, ip + 3, frameCount);
+}
+
+int jitClosure(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 1);
+	frame->ip = makeClosure(frame, ip + 1);
+	return JIT_CONTINUE;
+}
+
+int jitClass(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 2);
+	push(OBJ_VAL(newClass(AS_STRING(jitConstant(frame, ip[1])))));
+	return JIT_CONTINUE;
+}
+
+int jitMethod(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 2);
+	defineMethod(AS_STRING(jitConstant(frame, ip[1])));
+	return JIT_CONTINUE;
+}
+
+int jitInherit(uint8_t* ip)
+{
+	jitFrame(ip + 1);
+	Value superclass = peek(1);
+	if (!IS_CLASS(superclass)) {
+		runtimeError("Superclass must be a class.");
+		return JIT_EXIT_ERROR;
+	}
+
+	ObjClass* subclass = AS_CLASS(peek(0));
+	tableAddAll(&AS_CLASS(superclass)->methods, &subclass->methods);
+	WRITE_BARRIER(subclass);
+	pop(); //Subclass.
+	return JIT_CONTINUE;
+}
+
+int jitReturn(uint8_t* ip)
+{
+	CallFrame* frame = jitFrame(ip + 1);
+	Value result = pop();
+
+	closeUpvalues(frame->slots);
+
+	vm.frameCount--;
+	if (vm.frameCount == 0) {
+		pop();
+		return JIT_EXIT_DONE;
+	}
+
+	vm.stackTop = frame->slots;
+	push(result);
+	return JIT_EXIT_FRAME;
+}
+#endif
@@ -1,56 +1,136 @@
-#ifndef cspydr_vm_h
-#define cspydr_vm_h
-
-#include "chunk.h"
-#include "value.h"
-#include "table.h"
-#include "object.h"
-
-#define FRAMES_MAX 64
-#define STACK_MAX (FRAMES_MAX * UINT8_COUNT)
-
-typedef struct
-{
-    ObjClosure* closure;
-    uint8_t* ip;
-    Value* slots;
-} CallFrame;
-
-typedef struct
-{
-    CallFrame frames[FRAMES_MAX];
-    int frameCount;
-
-    Value stack[STACK_MAX];
-    Value *stackTop;
-    Table strings;
-    Table globals;
-    ObjString* initString;
-    ObjUpvalue* openUpvalues;
-
-    size_t bytesAllocated;
-    size_t nextGC;
-
-    Obj *objects;
-    int grayCount;
-    int grayCapacity;
-    Obj** grayStack;
-} VM;
-
-typedef enum
-{
-    INTERPRET_OK,
-    INTERPRET_COMPILE_ERROR,
-    INTERPRET_RUNTIME_ERROR
-} InterpretResult;
-
-extern VM vm;
-
-void initVM();
-void freeVM();
-InterpretResult interpret(const char *source);
-void runtimeError(const char* format, ...);
-void push(Value value);
-Value pop();
-
+#ifndef cspydr_vm_h
+#define cspydr_vm_h
+
+#include "chunk.h"
+#include "value.h"
+#include "table.h"
+#include "object.h"
+#include "gcstats.h"
+
+#define FRAMES_MAX 64
+#define STACK_MAX (FRAMES_MAX * UINT8_COUNT)
+//Without slab pages to scan, the old generation is split into this many
+//lists, which can be swept independently of each other.
+#define GC_REGION_COUNT 64
+
+typedef struct
+{
+    ObjClosure* closure;
+    uint8_t* ip;
+    Value* slots;
+} CallFrame;
+
+typedef enum
+{
+    GC_IDLE,
+    GC_MARK,
+    GC_SWEEP
+} GcPhase;
+
+//How big the heap may get before a full collection, set with setGcPacing().
+//Sizes are in bytes and times in seconds, a 0 leaves a setting out.
+typedef struct
+{
+    size_t targetHeap;      //No full collection starts below this.
+    size_t maxHeap;         //One always starts by this, however little it frees.
+    double growFactor;      //The heap may grow to this times what survived.
+    //Largest share of the run time the collector should take. Adapts the
+    //growth to the allocation rate instead of keeping it at growFactor.
+    double gcTimeRatio;
+    //How long a slice of an incremental collection should take. Adapts the
+    //objects done per slice, and turns incremental collections on.
+    double pauseTarget;
+} GcPacing;
+
+//Compile-time metadata for an indexed global. The value itself lives in
+//vm.globalValues at the same index.
+typedef struct
+{
+    ObjString* name;
+    bool isDefined;
+    bool isConstant;
+} GlobalSlot;
+
+typedef struct
+{
+    CallFrame frames[FRAMES_MAX];
+    int frameCount;
+
+    Value stack[STACK_MAX];
+    Value *stackTop;
+    Table strings;
+    Table globalNames;
+    Value* globalValues;
+    GlobalSlot* globalSlots;
+    int globalCount;
+    int globalCapacity;
+    ObjString* initString;
+    ObjUpvalue* openUpvalues;
+
+    bool optimizeBytecode;
+    bool registerCode;
+    bool jitEnabled;
+    int jitThreshold;
+    int traceThreshold;
+
+    size_t bytesAllocated;
+    size_t nextGC;
+    size_t nextMinorGC;
+    size_t nextGCStep;
+
+    GcPacing gcPacing;
+    double heapGrowth;
+    size_t nurserySize;
+    //All bytes ever allocated when the running full cycle started, and how
+    //many were allocated while the last one ran.
+    size_t cycleStartAllocated;
+    size_t cycleAllocated;
+
+    bool gcIncremental;
+    bool gcConcurrent;
+    int gcThreads;
+    bool gcCompact;
+    bool compactPending;
+    bool isMarkerRunning;
+    bool isMarkerDone;
+    int gcStepWork;
+    GcPhase gcPhase;
+#ifndef SLAB_ENABLED
+    Obj* sweepYoung;
+    bool markValue;
+    int sweepRegion;
+    Obj* sweepPrevious;
+    Obj* sweepCursor;
+
+    Obj* objects[GC_REGION_COUNT];
+    int promoteRegion;
+    Obj* youngObjects;
+#endif
+    int rememberedCount;
+    int rememberedCapacity;
+    Obj** rememberedSet;
+    int grayCount;
+    int grayCapacity;
+    Obj** grayStack;
+
+    GcStats gcStats;
+} VM;
+
+typedef enum
+{
+    INTERPRET_OK,
+    INTERPRET_COMPILE_ERROR,
+    INTERPRET_RUNTIME_ERROR
+} InterpretResult;
+
+extern VM vm;
+
+void initVM();
+void freeVM();
+InterpretResult interpret(const char *source);
+void runtimeError(const char* format, ...);
+int globalSlot(ObjString* name);
+void push(Value value);
+Value pop();
+
 #endif
\ No newline at end of file
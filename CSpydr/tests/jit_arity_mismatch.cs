@@ -0,0 +1,7 @@
+// A call with the wrong number of arguments to a function the JIT has
+// already compiled has to stop with an error instead of running on without
+// a frame. Run with and without --jit-all, it exits with 70 either way.
+fn f(a, b) { ret a; }
+
+for (let i = 0; i < 2000; i++) { f(1, 2); }
+print f(1); // expect runtime error: Expected 2 arguments but got 1.
@@ -0,0 +1,19 @@
+// Closures capturing the locals and arguments of a frame that a tail call
+// reuses keep their own values.
+fn zero() { ret 0; }
+fn chain(n, previous) {
+	if (n == 0) ret previous;
+	let value = n;
+	fn next() { ret value + previous(); }
+	ret chain(n - 1, next);
+}
+print chain(50, zero)(); // expect: 1275
+
+class Box {
+	wrap(n, getters) {
+		if (n == 0) ret getters;
+		fn get() { ret n; }
+		ret this.wrap(n - 1, get);
+	}
+}
+print Box().wrap(3, zero)(); // expect: 1
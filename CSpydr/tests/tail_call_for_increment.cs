@@ -0,0 +1,9 @@
+// A call in a for loop's increment is moved after the body, so a return in
+// the body must not take it for a call in tail position.
+fn f() { ret 0; }
+fn t(a, b, c, d) {
+	let e = 10;
+	for (let i = 0; i < 3; f()) { ret 1 + e; }
+	ret -1;
+}
+print t(1, 2, 3, 4); // expect: 11
@@ -0,0 +1,25 @@
+// Calls in tail position reuse the caller's frame, so recursion this deep
+// runs without overflowing the stack.
+fn count(n, total) {
+	if (n == 0) ret total;
+	ret count(n - 1, total + 1);
+}
+print count(100000, 0); // expect: 100000
+
+fn isEven(n) {
+	if (n == 0) ret true;
+	ret isOdd(n - 1);
+}
+fn isOdd(n) {
+	if (n == 0) ret false;
+	ret isEven(n - 1);
+}
+print isEven(100001); // expect: false
+print isOdd(100001); // expect: true
+
+// Not in tail position, the result is still needed.
+fn sum(n) {
+	if (n == 0) ret 0;
+	ret n + sum(n - 1);
+}
+print sum(50); // expect: 1275
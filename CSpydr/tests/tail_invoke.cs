@@ -0,0 +1,30 @@
+// Method calls in tail position reuse the caller's frame too.
+class Counter {
+	init() { this.calls = 0; }
+	loop(n) {
+		if (n == 0) ret this.calls;
+		this.calls = this.calls + 1;
+		ret this.loop(n - 1);
+	}
+}
+print Counter().loop(100000); // expect: 100000
+
+class Player {
+	ping(other, n) {
+		if (n == 0) ret "ping";
+		ret other.pong(this, n - 1);
+	}
+	pong(other, n) {
+		if (n == 0) ret "pong";
+		ret other.ping(this, n - 1);
+	}
+}
+print Player().ping(Player(), 100001); // expect: pong
+
+// A function stored in a field is called through the invoke as well.
+fn double(x) { ret x * 2; }
+class Holder {
+	init() { this.f = double; }
+	run(x) { ret this.f(x); }
+}
+print Holder().run(21); // expect: 42
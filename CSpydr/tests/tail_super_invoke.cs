@@ -0,0 +1,15 @@
+// Superclass methods called in tail position reuse the caller's frame.
+class Base {
+	down(n) {
+		if (n == 0) ret "base";
+		ret this.down(n - 1);
+	}
+}
+class Derived < Base {
+	down(n) {
+		if (n == 0) ret "derived";
+		ret super.down(n - 1);
+	}
+}
+print Derived().down(100001); // expect: base
+print Derived().down(100000); // expect: derived
@@ -1,5 +1,5 @@
 pushd CSpydr/src
-g++ -m64 common.h main.c chunk.h chunk.c compiler.h compiler.c debug.c debug.h memory.c memory.h natives.h object.c object.h scanner.c scanner.h table.c table.h value.c value.h vm.c vm.h -o ../../bin/CSpydr
+g++ -m64 common.h main.c chunk.h chunk.c compiler.h compiler.c debug.c debug.h gcstats.c gcstats.h jit.c jit.h memory.c memory.h natives.h object.c object.h opprofile.c opprofile.h scanner.c scanner.h slab.c slab.h superinstructions.h table.c table.h value.c value.h vm.c vm.h -o ../../bin/CSpydr -lm -lpthread
 popd
 
 #chmod +x bin/CSpydr.o
\ No newline at end of file